@@ -113,6 +113,7 @@ typedef enum {
     LORA_STATE_IDLE,        /**< アイドル状態 */
     LORA_STATE_WAITING_TX,  /**< 送信完了(AUX High)を待っている状態 */
     LORA_STATE_WAITING_RX,  /**< 受信開始(AUX Low)を待っている状態 */
+    LORA_STATE_RECEIVING,   /**< 受信したフレームのUARTへの出力の終了(AUX High)を待っている状態 */
 } LoraState_t;
 
 struct s_LoraHandle; // LoraHandle_t の前方宣言
@@ -156,10 +157,271 @@ typedef struct {
  */
 typedef struct {
     bool     is_active;            /**< 現在、大容量送受信中か */
-    uint8_t  total_packets;        /**< 今回の転送における全パケット数 */
-    uint8_t  current_packet_index; /**< 現在処理中のパケット番号 (0から) */
+    uint16_t total_packets;        /**< 今回の転送における全パケット数 */
+    uint16_t current_packet_index; /**< 現在処理中のパケット番号 (0から) */
 } LoRabbit_TransferStatus_t;
 
+/**
+ * @brief 大容量データ送信時の再送制御方式
+ */
+typedef enum {
+    LORABBIT_TP_MODE_NO_ACK = 0,     /**< ACKなし (高速だが欠損を回復できない) */
+    LORABBIT_TP_MODE_STOP_AND_WAIT,  /**< 1パケットごとにACKを待つ (従来の信頼性通信) */
+    LORABBIT_TP_MODE_WINDOW,         /**< スライディングウィンドウによる選択的再送 */
+    LORABBIT_TP_MODE_BURST,          /**< 全パケットを連続送信し、末尾の欠損ビットマップ(NACK)で欠損分のみ再送 */
+    LORABBIT_TP_MODE_MULTICAST,      /**< 複数の受信側に全パケットを1回ずつ同報送信し、受信側のNACKの和集合で欠損分のみ再送 */
+} LoRabbit_TpMode_t;
+
+/**
+ * @brief 大容量データ送信のトラフィッククラス
+ * @details LORABBIT_USE_TRAFFIC_CLASS が有効な場合、上位のクラスの転送は、送信中の下位のクラスの転送のパケットの合間に
+ * 割り込んで先に送信されます。同じクラスの転送は、送信を始めた順に1つずつ送信されます。
+ * 無効な場合も、エアタイム予算の予約分を使えるかどうか (LORABBIT_TRAFFIC_CLASS_CONTROL のみ) はクラスで決まります。
+ */
+typedef enum {
+    LORABBIT_TRAFFIC_CLASS_BULK = 0,    /**< 画像やファイルなどの大きな転送 (デフォルト) */
+    LORABBIT_TRAFFIC_CLASS_INTERACTIVE, /**< 要求への応答など、相手が待っている転送 */
+    LORABBIT_TRAFFIC_CLASS_CONTROL,     /**< 警報や制御コマンドなど、最も急ぐ短い転送 */
+    LORABBIT_TRAFFIC_CLASS_COUNT,
+} LoRabbit_TrafficClass_t;
+
+#ifdef LORABBIT_USE_TRAFFIC_CLASS
+/**
+ * @brief トラフィッククラスごとの送信待ち時間の統計
+ * @details 待ち時間は、送信を要求してから他の転送が送信権を譲るまでの時間です。
+ */
+typedef struct {
+    uint32_t transfer_count;       /**< 送信を始めた転送の数 */
+    uint32_t last_queue_delay_ms;  /**< 最後の転送の待ち時間 (ms) */
+    uint32_t max_queue_delay_ms;   /**< 待ち時間の最大値 (ms) */
+    uint32_t total_queue_delay_ms; /**< 待ち時間の合計 (ms)。transfer_count で割ると平均 */
+    uint32_t preempted_count;      /**< 上位のクラスの転送に割り込まれた回数 */
+    uint32_t total_preempted_ms;   /**< 割り込まれて中断していた時間の合計 (ms) */
+} LoRabbit_TrafficClassStats_t;
+#endif
+
+/**
+ * @brief 大容量データ送信時のオプション
+ */
+typedef struct {
+    LoRabbit_TpMode_t mode;  /**< 再送制御方式 */
+    uint8_t window_size;     /**< [WINDOWモードのみ] ACKを待たずに送信できるパケット数 (0でデフォルト値) */
+    uint8_t fec_redundancy_percent; /**< [BURST/MULTICASTモードで、データパケットが255個未満の転送のみ] データパケット数に対する冗長パケット数の割合 (%)。0でFECなし (LORABBIT_USE_FEC が必要) */
+    bool use_compact_header; /**< 受信側が転送を認識した後のパケットとACKのヘッダを省略する (MULTICASTモードでは使えない。docs/compact_header.md を参照) */
+    LoRabbit_TrafficClass_t traffic_class; /**< トラフィッククラス (0で LORABBIT_TRAFFIC_CLASS_BULK) */
+} LoRabbit_SendOptions_t;
+
+#ifdef LORABBIT_USE_TX_SERVICE
+struct s_LoRabbit_TxRequest;
+
+/**
+ * @brief 送信サービスの送信完了時に呼ばれるコールバック関数の型
+ * @details 送信サービスのタスクから呼ばれます。長い処理やブロックする処理は避けて下さい。
+ */
+typedef void (*LoRabbit_TxDoneCallback_t)(struct s_LoRabbit_TxRequest *p_request);
+
+/**
+ * @brief 送信サービスに投入する送信要求
+ * @details 送信が完了する (is_done が true になる) まで、要求本体と p_data の内容を保持して下さい。
+ */
+typedef struct s_LoRabbit_TxRequest {
+    uint16_t target_address;        /**< 送信先アドレス */
+    uint8_t  target_channel;        /**< 送信先チャンネル */
+    uint8_t *p_data;                /**< 送信するデータ */
+    uint32_t size;                  /**< 送信するデータのサイズ */
+    LoRabbit_SendOptions_t options; /**< 送信オプション */
+    LoRabbit_TxDoneCallback_t pf_done_callback; /**< 送信完了時に呼ぶ関数 (NULLで呼ばない) */
+    void    *p_context;             /**< コールバック関数に渡す任意のポインタ */
+    ID       done_flag_id;          /**< 送信完了時にセットするイベントフラグのID (0でセットしない) */
+    UINT     done_flag_pattern;     /**< 送信完了時にセットするビットパターン */
+    volatile bool is_done;          /**< 送信が完了したか */
+    volatile int  result;           /**< 送信結果 (LoRabbit_SendDataWithOptions() の戻り値) */
+} LoRabbit_TxRequest_t;
+#endif
+
+/**
+ * @brief 受信したLoRaフレームの情報を格納する構造体
+ */
+typedef struct {
+  uint8_t recv_data[201]; /**< 受信データ本体 (最大200バイト + RSSI 1バイト) */
+  uint8_t recv_data_len;  /**< 受信したペイロードの長さ */
+  int rssi;               /**< 受信時のRSSI値 */
+} RecvFrameE220900T22SJP_t;
+
+/**
+ * @brief 受信中のフレームの長さを、先頭から届いたデータで判定する関数の型
+ * @details LoRabbit_ReceiveFrameWithLength() に渡します。受信したタスクから、長さを判定できるまで
+ * データが届くたびに呼ばれます。
+ * @param[in] p_data フレームの先頭から届いたデータ
+ * @param[in] len 届いたデータの長さ
+ * @param[in] p_context LoRabbit_ReceiveFrameWithLength() に渡した任意のポインタ
+ * @return 正の値: フレームの長さ (RSSIバイトを含まない), 0: まだ判定できない, 負値: 長さを判定できないフレーム
+ */
+typedef int (*LoRabbit_FrameLengthFunc_t)(const uint8_t *p_data, int len, void *p_context);
+
+#ifdef LORABBIT_USE_RX_DISPATCHER
+/**
+ * @brief 受信ディスパッチャが受信したフレームを振り分ける先
+ */
+typedef enum {
+    LORABBIT_RX_CLASS_ACK = 0, /**< 送信中の大容量データ転送へのACK/NACK */
+    LORABBIT_RX_CLASS_DATA,    /**< 大容量データ転送のデータパケット */
+    LORABBIT_RX_CLASS_RAW,     /**< それ以外のフレーム (LoRabbit_ReceiveFrame() で受け取る) */
+    LORABBIT_RX_CLASS_COUNT,
+    LORABBIT_RX_CLASS_NONE = LORABBIT_RX_CLASS_COUNT, /**< どこにも振り分けずに読み捨てるフレーム (キューを持たない) */
+} LoRabbit_RxClass_t;
+
+/**
+ * @brief 受信ディスパッチャが振り分けたフレームのキュー
+ * @details 満杯のときは最も古いフレームを捨てて新しいフレームを格納します。
+ */
+typedef struct {
+    RecvFrameE220900T22SJP_t frames[LORABBIT_RX_DISPATCH_QUEUE_DEPTH]; /**< 格納したフレーム */
+    uint8_t  head;          /**< 最も古いフレームの位置 */
+    uint8_t  count;         /**< 格納しているフレームの数 */
+    ID       sem_id;        /**< 格納しているフレームの数を表すセマフォID */
+    uint32_t dropped_count; /**< キューが満杯で捨てたフレームの数 */
+} LoRabbit_RxQueue_t;
+
+/**
+ * @brief 送信中の大容量データ転送の情報 (受信ディスパッチャがACKを見分けるために使う)
+ */
+typedef struct {
+    volatile bool is_active; /**< 送信中か */
+    uint16_t target_address; /**< 送信先アドレス */
+    uint8_t  transaction_id; /**< トランザクションID */
+    uint16_t total_packets;  /**< 総パケット数 */
+    uint8_t  session_flags;  /**< 転送全体に付けるコントロールバイトのフラグ */
+} LoRabbitTP_TxSession_t;
+#endif
+
+/**
+ * @brief 往復時間の推定値 (Jacobson/Karels方式)
+ * @details 精度を保つため、平滑化した往復時間は8倍、ばらつきは4倍した値で保持します。
+ */
+typedef struct {
+    bool     is_measured; /**< 実測値を1回以上反映したか (falseの間はエアタイムからの推定値) */
+    uint32_t srtt_x8;     /**< 平滑化した往復時間 (ミリ秒の8倍) */
+    uint32_t rttvar_x4;   /**< 往復時間のばらつき (ミリ秒の4倍) */
+    uint32_t rto_ms;      /**< 現在のタイムアウト時間 (ミリ秒、タイムアウト時のバックオフを含む) */
+} LoRabbit_RttEstimator_t;
+
+/**
+ * @brief 通信相手ごとのリンク状態 (往復時間と損失率の推定値)
+ */
+typedef struct {
+    bool     is_valid;                /**< このエントリが使用中か */
+    uint16_t address;                 /**< 通信相手のアドレス */
+    LoraAirDateRate_t air_data_rate;  /**< 推定に使った空中データレート (変わったら推定し直す) */
+    LoRabbit_RttEstimator_t ack_rtt;  /**< 送信側: ACKを要求したパケットの送信完了からACK受信までの時間 */
+    LoRabbit_RttEstimator_t rx_gap;   /**< 受信側: パケット受信(またはACK返信)から次のパケット受信までの時間 */
+    uint16_t loss_permille;           /**< 平滑化した損失率 (‰)。再送回数の決定に使う */
+    uint16_t data_loss_permille;      /**< 送信側: 平滑化したデータパケットの損失率 (‰)。パケット長の決定に使う */
+    uint8_t  data_frame_size;         /**< data_loss_permille を観測したデータフレームの長さ (送信先指定を含むバイト数) */
+    uint32_t last_used_ms;            /**< 最後に使用した時刻 (テーブルが満杯の時の入れ替え用) */
+} LoRabbit_PeerLink_t;
+
+/**
+ * @brief 受信側が最後に返したACK (送信側の再送に返し直すために記録する)
+ */
+#define LORABBIT_TP_ACK_FRAME_SIZE_MAX 42 /**< ACKフレームの最大長 (拡張ヘッダ10バイト + NACKビットマップ32バイト) */
+typedef struct {
+    bool     is_valid;         /**< frame に返信済みのACKがあるか */
+    uint16_t address;          /**< 転送の送信元アドレス */
+    uint8_t  channel;          /**< 転送の送信元チャンネル */
+    uint8_t  transaction_id;   /**< 転送のトランザクションID */
+    uint8_t  session_flags;    /**< 転送全体で共通のコントロールバイトのフラグ (ヘッダの種類とFEC) */
+    uint16_t total_packets;    /**< 転送の総パケット数 */
+    uint8_t  fragment_length;  /**< 転送のパケットの間隔 */
+    uint8_t  length;           /**< frame の長さ */
+    uint8_t  frame[LORABBIT_TP_ACK_FRAME_SIZE_MAX]; /**< 最後に返信したACKフレーム */
+} LoRabbitTP_AckCache_t;
+
+#ifdef LORABBIT_USE_RX_DISPATCHER
+/**
+ * @brief 送信を保留しているACK (同じ相手へ送るデータパケットに載せるか、期限が来たら単独で送る)
+ */
+typedef struct {
+    volatile bool is_pending; /**< 保留しているACKがあるか */
+    uint16_t address;         /**< ACKの送信先アドレス */
+    uint8_t  channel;         /**< ACKの送信先チャンネル */
+    uint8_t  transaction_id;  /**< ACKを返す転送のトランザクションID */
+    uint32_t deadline_ms;     /**< 単独で送る期限 (tk_get_tim() の下位32ビット) */
+    uint8_t  length;          /**< frame の長さ */
+    uint8_t  frame[LORABBIT_TP_ACK_FRAME_SIZE_MAX]; /**< 保留しているACKフレーム */
+} LoRabbitTP_DelayedAck_t;
+#endif
+
+#ifdef LORABBIT_USE_FEC
+/**
+ * @brief FEC付き転送の受信時に、欠損位置へ一時保管している冗長パケットの管理情報
+ * @details 冗長断片は未受信のデータパケットの位置に1つずつ保管するため、受信バッファを
+ * 余分に必要としない。保管した冗長断片の数と受信済みデータパケットの数の合計が
+ * データパケット数に達したら、その場で復号して欠損位置を元のデータで置き換える。
+ */
+typedef struct {
+    uint8_t slot[LORABBIT_FEC_MAX_REPAIR_PACKETS];   /**< 冗長断片を保管している欠損データパケットの位置 */
+    uint8_t repair[LORABBIT_FEC_MAX_REPAIR_PACKETS]; /**< 保管している冗長パケットの番号 */
+    uint8_t count;                                   /**< 保管している冗長パケットの数 */
+    uint8_t last_payload_length;                     /**< 末尾のデータパケットの長さ (0: 未判明) */
+} LoRabbitTP_FecRxState_t;
+#endif
+
+/**
+ * @brief 大容量データ受信中の1つの転送の状態
+ */
+#define LORABBIT_TP_BITMAP_SIZE ((LORABBIT_TP_MAX_PACKETS + 7) / 8) /**< 大容量データ転送のパケットごとの状態を表すビットマップのサイズ */
+#if LORABBIT_TP_MAX_PACKETS < 255 || LORABBIT_TP_MAX_PACKETS > 65535
+#error "LORABBIT_TP_MAX_PACKETS must be between 255 and 65535"
+#endif
+typedef struct {
+    bool     is_active;        /**< 受信中か (完了後も ack は再送への返信に使う) */
+    bool     is_multicast;     /**< 同報送信の転送か (送信側が全ての返信スロットを待ってから再送する) */
+    LoRabbitTP_AckCache_t ack; /**< 転送の情報と、最後に返信したACK */
+    uint8_t *p_buffer;         /**< 復元先のバッファ */
+    uint16_t received_count;   /**< 受信済み (FECで復元したものを含む) のパケット数 */
+    uint16_t next_new_index;   /**< 初回送信で次に届くはずのパケット番号 (損失率の推定に使う) */
+    uint32_t written_size;     /**< 復元したデータのサイズ */
+    uint64_t last_event_ms;    /**< 最後にパケットを受信、またはACKを返信した時刻 */
+    uint64_t completed_ms;     /**< 受信完了した時刻 (0なら未完了)。ack を再送への返信に使える期間の起点 */
+    uint64_t nack_due_ms;      /**< [同報送信] 選んだ返信スロットでNACKを返す時刻 (0なら予定なし) */
+    uint8_t  bitmap[LORABBIT_TP_BITMAP_SIZE]; /**< 受信済みパケットのビットマップ */
+#ifdef LORABBIT_USE_FEC
+    LoRabbitTP_FecRxState_t fec; /**< 保管している冗長パケット */
+#endif
+} LoRabbitTP_RxSession_t;
+
+#ifdef LORABBIT_USE_TRAFFIC_CLASS
+/**
+ * @brief 上位のクラスの転送に割り込まれ、送信権が戻るのを待っている転送の状態
+ * @details 割り込んだ転送が上書きするハンドル内の状態を退避しておきます。
+ * 割り込まれた転送は同じクラスの他の転送より先に再開するため、1つのクラスで同時に割り込まれている転送は1つだけです。
+ */
+typedef struct {
+    volatile bool is_active; /**< 割り込まれて再開を待っているか */
+    ID       resume_sem_id;  /**< 送信権が戻ったことを知らせるセマフォID */
+    uint16_t total_packets;  /**< 転送の総パケット数 */
+    uint16_t current_index;  /**< 割り込まれた時点の進捗 */
+    uint8_t  acked_bitmap[LORABBIT_TP_BITMAP_SIZE];   /**< 退避した受信確認済みパケットのビットマップ */
+    uint8_t  pending_bitmap[LORABBIT_TP_BITMAP_SIZE]; /**< 退避した次のラウンドで送信するパケットのビットマップ */
+#ifdef LORABBIT_USE_RX_DISPATCHER
+    LoRabbitTP_TxSession_t tp_tx; /**< 退避した送信中の転送の情報 */
+#endif
+} LoRabbitTP_TxPreempted_t;
+#endif
+
+#ifdef LORABBIT_USE_MULTI_SESSION
+/**
+ * @brief 複数の送信元から同時に受信したときの、完了した転送の情報
+ */
+typedef struct {
+    uint8_t  buffer_index;   /**< データを書き出したバッファの番号 (LoRabbit_ReceiveDataMulti() の p_buffers の添字) */
+    uint16_t source_address; /**< 送信元のアドレス */
+    uint8_t  source_channel; /**< 送信元のチャンネル */
+    uint32_t received_size;  /**< 受信したデータのサイズ */
+} LoRabbit_ReceiveResult_t;
+#endif
+
 /**
  * @brief 1回の通信結果を記録するログ構造体
  */
@@ -171,49 +433,206 @@ typedef struct {
     bool     ack_requested;        /**< ACKを要求したか */
     bool     ack_success;          /**< 最終的な成功/失敗 */
     int8_t   last_ack_rssi;        /**< 最後に成功したACKのRSSI値 */
-    uint8_t  total_retries;        /**< 全パケットの合計リトライ回数 */
+    uint16_t total_retries;        /**< 全パケットの合計リトライ回数 */
 } LoraCommLog_t;
 
+#ifdef LORABBIT_USE_AGGREGATION
+#define LORABBIT_AGG_FRAME_SIZE_MAX 197 /**< 集約フレームの最大長 (LoRabbit_SendFrame() で送れる最大長) */
+
+/**
+ * @brief 集約フレームから取り出したメッセージ
+ */
+typedef struct {
+    const uint8_t *p_data; /**< メッセージ本体 (集約フレームの受信バッファ内を指す) */
+    uint8_t length;        /**< メッセージの長さ */
+} LoRabbit_Message_t;
+
+/**
+ * @brief 短いメッセージの集約送信の統計
+ */
+typedef struct {
+    uint32_t message_count;          /**< 送信したメッセージの数 */
+    uint32_t frame_count;            /**< 送信した集約フレームの数 */
+    uint32_t flushed_by_size;        /**< フレームが満杯になって送信した回数 */
+    uint32_t flushed_by_deadline;    /**< メッセージの送信期限が来て送信した回数 */
+    uint32_t flushed_by_request;     /**< LoRabbit_FlushMessages() で送信した回数 */
+    uint64_t airtime_us;             /**< 集約フレームのエアタイムの合計 (マイクロ秒) */
+    uint64_t unaggregated_airtime_us; /**< メッセージを1つずつ LoRabbit_SendFrame() で送った場合のエアタイムの合計 (マイクロ秒) */
+} LoRabbit_AggStats_t;
+
+/**
+ * @brief 送信先ごとに溜めているメッセージ
+ */
+typedef struct {
+    uint16_t address;        /**< 送信先アドレス */
+    uint8_t  channel;        /**< 送信先チャンネル */
+    uint8_t  count;          /**< 溜めているメッセージの数 (0なら未使用) */
+    uint8_t  length;         /**< frame の長さ */
+    uint32_t deadline_ms;    /**< 最も早いメッセージの送信期限 (tk_get_tim() の下位32ビット) */
+    uint32_t unaggregated_airtime_us; /**< 溜めているメッセージを1つずつ送った場合のエアタイム (マイクロ秒) */
+    uint8_t  frame[LORABBIT_AGG_FRAME_SIZE_MAX]; /**< 組み立て中の集約フレーム */
+} LoRabbitAgg_Buffer_t;
+#endif
+
+#ifdef LORABBIT_USE_AIRTIME_BUDGET
+/**
+ * @brief 送信時間の制限 (エアタイム予算) の状態
+ */
+typedef struct {
+    uint32_t window_ms;        /**< 送信時間の総和を数える期間 (ms) */
+    uint32_t budget_ms;        /**< 期間内に送信できる時間の総和 (ms) */
+    uint32_t used_ms;          /**< 期間内に送信した時間の総和 (ms) */
+    uint32_t remaining_ms;     /**< 残りの予算 (ms)。ACKと制御クラスの転送のために残しておく分を含む */
+    uint32_t next_release_ms;  /**< 次に送信時間が期間を過ぎて予算に戻るまでの時間 (ms)。送信していなければ0 */
+    uint32_t frame_count;      /**< 送信したフレームの数 */
+    uint64_t total_airtime_us; /**< 送信したフレームのエアタイムの合計 (マイクロ秒) */
+    uint32_t delayed_count;    /**< 予算が空くのを待ってから送信した回数 */
+    uint32_t total_delay_ms;   /**< 予算が空くのを待った時間の合計 (ms) */
+    uint32_t rejected_count;   /**< 予算が空かずに送信しなかった回数 */
+} LoRabbit_AirtimeBudget_t;
+
+/**
+ * @brief 期間内の送信時間の記録 (期間を LORABBIT_AIRTIME_BUCKET_COUNT 個に分けて数える)
+ */
+typedef struct {
+    uint32_t bucket_start_ms;  /**< 現在の区間の開始時刻 (tk_get_tim() の下位32ビット) */
+    uint8_t  current_bucket;   /**< 現在の区間 */
+    uint32_t used_us[LORABBIT_AIRTIME_BUCKET_COUNT]; /**< 区間ごとの送信時間 (マイクロ秒) */
+    uint64_t window_used_us;   /**< 期間内の送信時間の総和 (マイクロ秒) */
+    uint32_t last_tx_end_ms;   /**< 最後の送信が終わった (終わる見込みの) 時刻 */
+    bool     has_sent;         /**< 送信したことがあるか */
+    LoRabbit_AirtimeBudget_t stats; /**< 統計 (LoRabbit_GetAirtimeBudget() で返す) */
+} LoRabbitAirtime_Account_t;
+#endif
+
+#ifdef LORABBIT_USE_LBT
+/**
+ * @brief 送信前のキャリアセンス (Listen Before Talk) の統計
+ */
+typedef struct {
+    uint32_t sense_count;        /**< 周囲のRSSIノイズを確かめた回数 */
+    uint32_t busy_count;         /**< チャンネルを使用中と判定した回数 */
+    uint32_t deferred_count;     /**< 使用中のため送信を遅らせ、空いてから送信したフレームの数 (避けられた衝突の見込み) */
+    uint32_t total_backoff_ms;   /**< バックオフで待った時間の合計 (ms) */
+    uint32_t gave_up_count;      /**< 確認を LORABBIT_LBT_MAX_ATTEMPTS 回繰り返しても空かず、送信しなかったフレームの数 */
+    uint32_t sense_failed_count; /**< RSSIの読み出しに応答がなく、確かめずに送信した回数 */
+    int16_t  last_noise_dbm;     /**< 最後に読み出した周囲のRSSIノイズ (dBm) */
+} LoRabbit_LbtStats_t;
+#endif
+
+#ifdef LORABBIT_USE_CHANNEL_SURVEY
+/**
+ * @brief チャンネルの調査結果 (1チャンネル分)
+ */
+typedef struct {
+    uint8_t channel;        /**< チャンネル */
+    uint8_t busy_percent;   /**< 周囲のRSSIノイズが LORABBIT_SURVEY_BUSY_THRESHOLD_DBM 以上だった割合 (%) */
+    int16_t noise_avg_dbm;  /**< 周囲のRSSIノイズの平均 (dBm) */
+    int16_t noise_max_dbm;  /**< 周囲のRSSIノイズの最大 (dBm) */
+    uint8_t sample_count;   /**< 読み出せた回数 (0なら調査できなかった) */
+} LoRabbit_ChannelSurvey_t;
+#endif
+
 /**
  * @brief LoRaモジュールの全状態を保持するメインハンドル構造体
  */
-#define LORA_RX_BUFFER_SIZE 256
+#define LORA_RX_BUFFER_SIZE LORABBIT_RX_BUFFER_SIZE
+#define LORA_RX_BUFFER_MASK (LORA_RX_BUFFER_SIZE - 1) /**< リングバッファ内の位置を求めるマスク */
+#if LORA_RX_BUFFER_SIZE < 2 || LORA_RX_BUFFER_SIZE > 32768 || (LORA_RX_BUFFER_SIZE & LORA_RX_BUFFER_MASK) != 0
+#error "LORABBIT_RX_BUFFER_SIZE must be a power of two between 2 and 32768"
+#endif
 typedef struct s_LoraHandle {
     LoraHwConfig_t hw_config; /**< ハードウェア構成 */
     LoraConfigItem_t current_config; /**< 現在のLoRaモジュール設定 */
 
     volatile uint8_t rx_buffer[LORA_RX_BUFFER_SIZE]; /**< UART受信用リングバッファ */
-    volatile uint16_t rx_head; /**< リングバッファの書き込み位置 */
-    volatile uint16_t rx_tail; /**< リングバッファの読み出し位置 */
+    volatile uint16_t rx_head; /**< リングバッファに書き込んだバイト数 (65536で一周。位置は LORA_RX_BUFFER_MASK との論理積) */
+    volatile uint16_t rx_tail; /**< リングバッファから読み出したバイト数 (65536で一周。位置は LORA_RX_BUFFER_MASK との論理積) */
+    volatile uint32_t rx_overflow_count; /**< リングバッファが満杯、またはUARTのオーバーランで失われた受信バイト数 */
+    ID rx_data_sem_id;                /**< AUXピンを使わない受信で、最初のバイトが届いたことを知らせるセマフォID */
+    volatile bool is_waiting_rx_data; /**< 受信データが届くのを待っているタスクがあるか */
+#ifdef LORABBIT_USE_UART_DTC
+    volatile uint16_t rx_dtc_length; /**< DTC転送で受信中のバイト数 (0なら転送していない) */
+    volatile uint16_t rx_dtc_seq;    /**< DTC転送を開始・完了するたびに増える番号 (書き込み位置の整合確認用) */
+#endif
 
 #ifdef LORABBIT_USE_AUX_IRQ
     ID tx_done_sem_id;  /**< 送信完了同期用セマフォID */
     ID rx_start_sem_id; /**< 受信開始同期用セマフォID */
+    ID rx_end_sem_id;   /**< 受信終了同期用セマフォID */
     volatile LoraState_t state; /**< AUX割り込み利用時の内部状態 */
 #endif
 
     volatile LoRabbit_TransferStatus_t transfer_status; /**< 大容量データ転送の進捗状況 */
+    LoRabbitTP_RxSession_t tp_rx; /**< LoRabbit_ReceiveData() で受信中の転送 */
+#ifdef LORABBIT_USE_MULTI_SESSION
+    LoRabbitTP_RxSession_t tp_rx_sessions[LORABBIT_TP_RX_SESSION_COUNT]; /**< LoRabbit_ReceiveDataMulti() で受信中の転送 */
+#endif
+    uint8_t tp_tx_acked_bitmap[LORABBIT_TP_BITMAP_SIZE];   /**< 大容量データ送信時の、受信確認済みパケットのビットマップ */
+    uint8_t tp_tx_pending_bitmap[LORABBIT_TP_BITMAP_SIZE]; /**< バースト送信時の、次のラウンドで送信するパケットのビットマップ */
+#if LORABBIT_TP_RX_LINGER_ROUNDS > 0
+    RecvFrameE220900T22SJP_t held_frame; /**< 受信完了後に再送を待つ間に受信した、再送以外のフレーム (次の受信で返す) */
+    volatile bool has_held_frame;        /**< held_frame にフレームがあるか */
+#endif
     ID status_mutex_id; /**< 転送状態を保護するミューテックスID */
 
     ID encoder_mutex_id; /**< 圧縮処理(エンコーダ)を保護するミューテックスID */
     ID decoder_mutex_id; /**< 伸長処理(デコーダ)を保護するミューテックスID */
 
-    ID api_mutex_id; /**< ライブラリ全体を保護するミューテックスID (現在は未使用) */
+#ifdef LORABBIT_USE_TRAFFIC_CLASS
+    volatile bool is_tx_busy; /**< 大容量データ送信 (モジュールへの送信とACK待ち) の送信権をいずれかの転送が持っているか */
+    volatile uint8_t tx_waiting_count[LORABBIT_TRAFFIC_CLASS_COUNT]; /**< トラフィッククラスごとの、送信権を待っている転送の数 */
+    ID tx_wait_sem_id[LORABBIT_TRAFFIC_CLASS_COUNT]; /**< トラフィッククラスごとの、送信権を渡された待ち転送を起こすセマフォID */
+    LoRabbitTP_TxPreempted_t tx_preempted[LORABBIT_TRAFFIC_CLASS_COUNT - 1]; /**< 割り込まれた転送の状態 (割り込まれない最上位のクラスを除くクラスごと) */
+    LoRabbit_TrafficClassStats_t tx_class_stats[LORABBIT_TRAFFIC_CLASS_COUNT]; /**< トラフィッククラスごとの送信待ち時間の統計 */
+    LoRabbit_TrafficClass_t tx_class; /**< 送信権を持っている転送のトラフィッククラス */
+#else
+    ID api_mutex_id; /**< 大容量データ送信 (モジュールへの送信とACK待ち) を直列化するミューテックスID */
+#endif
+
+#ifdef LORABBIT_USE_TX_SERVICE
+    ID tx_service_task_id; /**< 送信サービスのタスクID (0なら未起動) */
+    ID tx_service_mbf_id;  /**< 送信サービスへの送信要求を受け渡すメッセージバッファID */
+#endif
+
+#ifdef LORABBIT_USE_RX_DISPATCHER
+    ID rx_dispatcher_task_id; /**< 受信ディスパッチャのタスクID (0なら未起動) */
+    ID rx_queue_mutex_id;     /**< 振り分けたフレームのキューを保護するミューテックスID */
+    LoRabbit_RxQueue_t rx_queues[LORABBIT_RX_CLASS_COUNT]; /**< 振り分け先ごとのフレームのキュー */
+    LoRabbitTP_TxSession_t tp_tx; /**< 送信中の大容量データ転送 */
+    LoRabbitTP_DelayedAck_t tp_delayed_ack; /**< 送信を保留しているACK */
+#endif
+
+#ifdef LORABBIT_USE_AGGREGATION
+    ID agg_task_id;         /**< 溜めたメッセージを期限に送信するタスクのID (0なら未起動) */
+    ID agg_mutex_id;        /**< 溜めているメッセージを保護するミューテックスID */
+    ID agg_wakeup_sem_id;   /**< 送信期限が早まったことをタスクに知らせるセマフォID */
+    LoRabbitAgg_Buffer_t agg_buffers[LORABBIT_AGG_DESTINATION_COUNT]; /**< 送信先ごとに溜めているメッセージ */
+    LoRabbit_AggStats_t agg_stats; /**< 集約送信の統計 */
+#endif
+
+#ifdef LORABBIT_USE_AIRTIME_BUDGET
+    ID airtime_mutex_id; /**< 送信時間の記録を保護するミューテックスID */
+    LoRabbitAirtime_Account_t airtime; /**< 送信時間の記録 */
+#endif
+
+#if defined(LORABBIT_USE_LBT) || defined(LORABBIT_USE_CHANNEL_SURVEY)
+    ID noise_mutex_id;               /**< RSSIの読み出しを1つずつ行うためのミューテックスID */
+    ID noise_sem_id;                 /**< 受信ディスパッチャがRSSIの応答を渡したことを通知するセマフォID */
+    volatile bool is_reading_noise;  /**< RSSIの応答を待っているか (受信ディスパッチャが応答を見分けるのに使う) */
+    volatile int16_t noise_dbm;      /**< 受信ディスパッチャが受け取ったRSSIノイズ (dBm) */
+#endif
+#ifdef LORABBIT_USE_LBT
+    LoRabbit_LbtStats_t lbt_stats;   /**< キャリアセンスの統計 */
+#endif
+
+    LoRabbit_PeerLink_t peer_links[LORABBIT_TP_PEER_TABLE_SIZE]; /**< 通信相手ごとの往復時間と損失率の推定値 */
 
     LoraCommLog_t history[LORABBIT_HISTORY_SIZE]; /**< 通信履歴を保存するリングバッファ */
     uint8_t       history_index;   /**< 履歴バッファの現在の書き込み位置 */
     bool          history_wrapped; /**< 履歴バッファが一周したかを示すフラグ */
 } LoraHandle_t;
 
-/**
- * @brief 受信したLoRaフレームの情報を格納する構造体
- */
-typedef struct {
-  uint8_t recv_data[201]; /**< 受信データ本体 (最大200バイト + RSSI 1バイト) */
-  uint8_t recv_data_len;  /**< 受信したペイロードの長さ */
-  int rssi;               /**< 受信時のRSSI値 */
-} RecvFrameE220900T22SJP_t;
-
 /**
  * @brief LoRabbitライブラリが返すステータスコード
  */
@@ -231,6 +650,8 @@ typedef enum {
     LORABBIT_ERROR_COMPRESS_FAILED       = E_LR_BASE -   7, /**< (-107) データ圧縮失敗 */
     LORABBIT_ERROR_DECOMPRESS_FAILED     = E_LR_BASE -   8, /**< (-108) データ伸長失敗 */
     LORABBIT_ERROR_RETRY                 = E_LR_BASE -   9, /**< (-109) 内部リトライ要求 */
+    LORABBIT_ERROR_AIRTIME_EXHAUSTED     = E_LR_BASE -  10, /**< (-110) 送信時間の制限 (エアタイム予算) に収まらない */
+    LORABBIT_ERROR_CHANNEL_BUSY          = E_LR_BASE -  11, /**< (-111) キャリアセンスでチャンネルが空かない */
     LORABBIT_ERROR_AI_INFERENCE_FAILED   = E_LR_BASE - 100, /**< (-200) AIモデルの推論失敗 */
     LORABBIT_ERROR_NOT_READY_DATA_FOR_AI = E_LR_BASE - 101, /**< (-201) AI推論に必要なデータがない */
 } LoRabbit_Status_t;
@@ -249,5 +670,8 @@ typedef struct {
 #ifdef LORABBIT_USE_AI_ADR
 #include "LoRabbit_ai_adr.h"
 #endif
+#if defined(LORABBIT_USE_TX_SERVICE) || defined(LORABBIT_USE_RX_DISPATCHER)
+#include "LoRabbit_service.h"
+#endif
 
 /** @} */ // end of LoRabbitCore group
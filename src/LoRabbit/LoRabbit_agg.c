@@ -0,0 +1,306 @@
+/**
+ * @file LoRabbit_agg.c
+ * @brief LoRabbit 短いメッセージの集約送信の実装
+ * @details 集約フレームの形式は以下の通りです。
+ * | 識別子 (1) | 送信元アドレス (2) | 長さ (1) | メッセージ | 長さ (1) | メッセージ | ... |
+ * メッセージごとのプリアンブルとモジュールのヘッダを1フレーム分にまとめることで、
+ * 短いメッセージを頻繁に送る場合のエアタイムを削減します。
+ */
+#include "LoRabbit_agg.h"
+
+#ifdef LORABBIT_USE_AGGREGATION
+
+#include "LoRabbit_internal.h"
+#include "LoRabbit_hal.h"
+
+#include <string.h>
+
+#define LORA_AGG_FRAME_MARKER   0xA7 // 集約フレームの識別子
+#define LORA_AGG_HEADER_SIZE    3    // 識別子 + 送信元アドレス
+#define LORA_AGG_RECORD_HEADER  1    // メッセージごとの長さ
+#define LORA_AGG_ADDRESS_SIZE   3    // LoRabbit_SendFrame が先頭に付ける送信先アドレスとチャンネル (エアタイムの計算に含める)
+
+// 集約フレームを送信した理由
+typedef enum {
+    LORA_AGG_FLUSH_BY_SIZE,
+    LORA_AGG_FLUSH_BY_DEADLINE,
+    LORA_AGG_FLUSH_BY_REQUEST,
+} LoraAggFlushReason_t;
+
+// 現在時刻をミリ秒で取得するヘルパー関数（内部利用）
+static uint32_t lora_agg_now_ms(void) {
+    SYSTIM now;
+    tk_get_tim(&now);
+    return now.lo;
+}
+
+// 送信先のフレームを送信して空にし、統計に反映するヘルパー関数（内部利用）
+// ミューテックスを取得した状態で呼ぶ (送信中に他のタスクがメッセージを追加・送信しないようにする)
+static int lora_agg_send(LoraHandle_t *p_handle, LoRabbitAgg_Buffer_t *p_buffer, LoraAggFlushReason_t reason) {
+    if (0 == p_buffer->count) {
+        return LORABBIT_OK;
+    }
+
+    int ret = LoRabbit_SendFrame(p_handle, p_buffer->address, p_buffer->channel, p_buffer->frame, p_buffer->length);
+    LORA_PRINTF("aggregator: sent %u messages (%u bytes) to 0x%04X (reason=%d, ret=%d)\n",
+                p_buffer->count, p_buffer->length, p_buffer->address, reason, ret);
+
+    if (ret == LORABBIT_OK) {
+        LoRabbit_AggStats_t *p_stats = &p_handle->agg_stats;
+        p_stats->message_count += p_buffer->count;
+        p_stats->frame_count++;
+        p_stats->airtime_us += LoRabbit_GetTimeOnAirUsec(p_handle->current_config.air_data_rate,
+                                                         LORA_AGG_ADDRESS_SIZE + p_buffer->length);
+        p_stats->unaggregated_airtime_us += p_buffer->unaggregated_airtime_us;
+        switch (reason) {
+            case LORA_AGG_FLUSH_BY_SIZE:     p_stats->flushed_by_size++;     break;
+            case LORA_AGG_FLUSH_BY_DEADLINE: p_stats->flushed_by_deadline++; break;
+            default:                         p_stats->flushed_by_request++;  break;
+        }
+    }
+
+    // 送信に失敗したメッセージも捨てる (ACKによる再送はしない)
+    p_buffer->count = 0;
+    p_buffer->length = 0;
+    p_buffer->unaggregated_airtime_us = 0;
+    return ret;
+}
+
+// 送信期限の最も早い送信先を探すヘルパー関数（内部利用）
+// 戻り値: 送信先のフレーム。溜めているメッセージがなければ NULL
+static LoRabbitAgg_Buffer_t *lora_agg_earliest(LoraHandle_t *p_handle) {
+    LoRabbitAgg_Buffer_t *p_earliest = NULL;
+    for (int i = 0; i < LORABBIT_AGG_DESTINATION_COUNT; i++) {
+        LoRabbitAgg_Buffer_t *p_buffer = &p_handle->agg_buffers[i];
+        if (p_buffer->count > 0 &&
+            (NULL == p_earliest || (int32_t)(p_buffer->deadline_ms - p_earliest->deadline_ms) < 0)) {
+            p_earliest = p_buffer;
+        }
+    }
+    return p_earliest;
+}
+
+// 溜めたメッセージを送信期限に送信するタスク（内部利用）
+static void lora_agg_task(INT stacd, void *exinf) {
+    LoraHandle_t *p_handle = (LoraHandle_t *)exinf;
+    (void)stacd;
+
+    while (1) {
+        TMO timeout = TMO_FEVR;
+
+        tk_wai_sem(p_handle->agg_mutex_id, 1, TMO_FEVR);
+        LoRabbitAgg_Buffer_t *p_earliest = lora_agg_earliest(p_handle);
+        while (NULL != p_earliest) {
+            int32_t remaining_ms = (int32_t)(p_earliest->deadline_ms - lora_agg_now_ms());
+            if (remaining_ms > 0) {
+                timeout = (TMO)remaining_ms;
+                break;
+            }
+            lora_agg_send(p_handle, p_earliest, LORA_AGG_FLUSH_BY_DEADLINE);
+            p_earliest = lora_agg_earliest(p_handle);
+        }
+        tk_sig_sem(p_handle->agg_mutex_id, 1);
+
+        // 次の送信期限まで待つ (メッセージの追加で期限が早まれば起こされる)
+        tk_wai_sem(p_handle->agg_wakeup_sem_id, 1, timeout);
+    }
+}
+
+int LoRabbit_StartAggregator(LoraHandle_t *p_handle, PRI task_priority) {
+    if (NULL == p_handle || p_handle->agg_task_id > 0) {
+        return LORABBIT_ERROR_INVALID_ARGUMENT;
+    }
+
+    // 溜めているメッセージを保護するミューテックスと、タスクを起こすセマフォを生成
+    T_CSEM csem;
+    memset(&csem, 0, sizeof(csem));
+    csem.sematr  = TA_TFIFO | TA_FIRST;
+    csem.isemcnt = 1;
+    csem.maxsem  = 1;
+    ID mutex_id = tk_cre_sem(&csem);
+    if (mutex_id < LORABBIT_OK) {
+        LORA_PRINTF("LoRabbit_StartAggregator: tk_cre_sem failed(%d)\n", mutex_id);
+        return mutex_id;
+    }
+    p_handle->agg_mutex_id = mutex_id;
+
+    csem.isemcnt = 0;
+    ID sem_id = tk_cre_sem(&csem);
+    if (sem_id < LORABBIT_OK) {
+        LORA_PRINTF("LoRabbit_StartAggregator: tk_cre_sem failed(%d)\n", sem_id);
+        return sem_id;
+    }
+    p_handle->agg_wakeup_sem_id = sem_id;
+
+    // 送信期限を待つタスクを生成して起動
+    T_CTSK ctsk;
+    memset(&ctsk, 0, sizeof(ctsk));
+    ctsk.exinf   = p_handle;
+    ctsk.tskatr  = TA_HLNG | TA_RNG3;
+    ctsk.task    = lora_agg_task;
+    ctsk.itskpri = task_priority;
+    ctsk.stksz   = LORABBIT_AGG_STACK_SIZE;
+    ID task_id = tk_cre_tsk(&ctsk);
+    if (task_id < LORABBIT_OK) {
+        LORA_PRINTF("LoRabbit_StartAggregator: tk_cre_tsk failed(%d)\n", task_id);
+        return task_id;
+    }
+    ER err = tk_sta_tsk(task_id, 0);
+    if (err < LORABBIT_OK) {
+        LORA_PRINTF("LoRabbit_StartAggregator: tk_sta_tsk failed(%d)\n", err);
+        return err;
+    }
+    p_handle->agg_task_id = task_id;
+
+    return LORABBIT_OK;
+}
+
+int LoRabbit_SendMessage(LoraHandle_t *p_handle, uint16_t target_address, uint8_t target_channel,
+                         const uint8_t *p_message, uint8_t length, uint32_t max_delay_ms)
+{
+    if (NULL == p_handle || NULL == p_message || 0 == length || p_handle->agg_task_id <= 0) {
+        return LORABBIT_ERROR_INVALID_ARGUMENT;
+    }
+    const uint8_t frame_limit = lora_frame_size_limit(p_handle);
+    if (LORA_AGG_HEADER_SIZE + LORA_AGG_RECORD_HEADER + length > frame_limit) {
+        return LORABBIT_ERROR_INVALID_ARGUMENT;
+    }
+
+    const uint32_t deadline_ms = lora_agg_now_ms() + max_delay_ms;
+    bool is_deadline_earlier = false;
+    int ret = LORABBIT_OK;
+
+    tk_wai_sem(p_handle->agg_mutex_id, 1, TMO_FEVR);
+
+    // 送信先のフレームを探す。なければ空きを使い、空きもなければ送信期限の最も早いフレームを先に送る
+    LoRabbitAgg_Buffer_t *p_buffer = NULL;
+    LoRabbitAgg_Buffer_t *p_free = NULL;
+    for (int i = 0; i < LORABBIT_AGG_DESTINATION_COUNT; i++) {
+        LoRabbitAgg_Buffer_t *p_candidate = &p_handle->agg_buffers[i];
+        if (p_candidate->count > 0 && p_candidate->address == target_address &&
+            p_candidate->channel == target_channel) {
+            p_buffer = p_candidate;
+            break;
+        }
+        if (0 == p_candidate->count && NULL == p_free) {
+            p_free = p_candidate;
+        }
+    }
+    if (NULL == p_buffer) {
+        if (NULL == p_free) {
+            p_free = lora_agg_earliest(p_handle);
+            ret = lora_agg_send(p_handle, p_free, LORA_AGG_FLUSH_BY_SIZE);
+        }
+        p_buffer = p_free;
+    } else if (p_buffer->length + LORA_AGG_RECORD_HEADER + length > frame_limit) {
+        // 入りきらなければ、溜めているメッセージを先に送る
+        ret = lora_agg_send(p_handle, p_buffer, LORA_AGG_FLUSH_BY_SIZE);
+    }
+
+    // メッセージを追加する
+    if (0 == p_buffer->count) {
+        p_buffer->address = target_address;
+        p_buffer->channel = target_channel;
+        p_buffer->frame[0] = LORA_AGG_FRAME_MARKER;
+        p_buffer->frame[1] = (uint8_t)(p_handle->current_config.own_address >> 8);
+        p_buffer->frame[2] = (uint8_t)(p_handle->current_config.own_address & 0xFF);
+        p_buffer->length = LORA_AGG_HEADER_SIZE;
+        p_buffer->deadline_ms = deadline_ms;
+        is_deadline_earlier = true;
+    } else if ((int32_t)(deadline_ms - p_buffer->deadline_ms) < 0) {
+        p_buffer->deadline_ms = deadline_ms;
+        is_deadline_earlier = true;
+    }
+    p_buffer->frame[p_buffer->length] = length;
+    memcpy(&p_buffer->frame[p_buffer->length + LORA_AGG_RECORD_HEADER], p_message, length);
+    p_buffer->length += LORA_AGG_RECORD_HEADER + length;
+    p_buffer->count++;
+    p_buffer->unaggregated_airtime_us += LoRabbit_GetTimeOnAirUsec(p_handle->current_config.air_data_rate,
+                                                                   LORA_AGG_ADDRESS_SIZE + length);
+
+    // 1バイトのメッセージも入らなくなったフレームと、溜めておけないメッセージは、すぐに送る
+    int sent_ret = LORABBIT_OK;
+    if (p_buffer->length + LORA_AGG_RECORD_HEADER + 1 > frame_limit) {
+        sent_ret = lora_agg_send(p_handle, p_buffer, LORA_AGG_FLUSH_BY_SIZE);
+        is_deadline_earlier = false;
+    } else if (0 == max_delay_ms) {
+        sent_ret = lora_agg_send(p_handle, p_buffer, LORA_AGG_FLUSH_BY_DEADLINE);
+        is_deadline_earlier = false;
+    }
+
+    tk_sig_sem(p_handle->agg_mutex_id, 1);
+
+    // 送信期限が早まったら、タスクに待ち時間を計算し直させる
+    if (is_deadline_earlier) {
+        tk_sig_sem(p_handle->agg_wakeup_sem_id, 1);
+    }
+    return (ret == LORABBIT_OK) ? sent_ret : ret;
+}
+
+int LoRabbit_FlushMessages(LoraHandle_t *p_handle) {
+    if (NULL == p_handle || p_handle->agg_task_id <= 0) {
+        return LORABBIT_ERROR_INVALID_ARGUMENT;
+    }
+
+    int ret = LORABBIT_OK;
+    tk_wai_sem(p_handle->agg_mutex_id, 1, TMO_FEVR);
+    for (int i = 0; i < LORABBIT_AGG_DESTINATION_COUNT; i++) {
+        int err = lora_agg_send(p_handle, &p_handle->agg_buffers[i], LORA_AGG_FLUSH_BY_REQUEST);
+        if (err != LORABBIT_OK) {
+            ret = err;
+        }
+    }
+    tk_sig_sem(p_handle->agg_mutex_id, 1);
+    return ret;
+}
+
+bool lora_agg_is_frame(const uint8_t *raw_packet, int len) {
+    if (len < LORA_AGG_HEADER_SIZE + LORA_AGG_RECORD_HEADER + 1 || raw_packet[0] != LORA_AGG_FRAME_MARKER) {
+        return false;
+    }
+    int offset = LORA_AGG_HEADER_SIZE;
+    while (offset < len) {
+        if (0 == raw_packet[offset]) {
+            return false;
+        }
+        offset += LORA_AGG_RECORD_HEADER + raw_packet[offset];
+    }
+    return offset == len;
+}
+
+int LoRabbit_UnpackMessages(const RecvFrameE220900T22SJP_t *p_frame, uint16_t *p_source_address,
+                            LoRabbit_Message_t *p_messages, int max_messages)
+{
+    if (NULL == p_frame || NULL == p_source_address || NULL == p_messages) {
+        return LORABBIT_ERROR_INVALID_ARGUMENT;
+    }
+    const uint8_t *raw_packet = p_frame->recv_data;
+    const int len = p_frame->recv_data_len;
+    if (!lora_agg_is_frame(raw_packet, len)) {
+        return LORABBIT_ERROR_INVALID_PACKET;
+    }
+
+    *p_source_address = (raw_packet[1] << 8) | raw_packet[2];
+    int count = 0;
+    for (int offset = LORA_AGG_HEADER_SIZE; offset < len; offset += LORA_AGG_RECORD_HEADER + raw_packet[offset]) {
+        if (count >= max_messages) {
+            return LORABBIT_ERROR_BUFFER_OVERFLOW;
+        }
+        p_messages[count].length = raw_packet[offset];
+        p_messages[count].p_data = &raw_packet[offset + LORA_AGG_RECORD_HEADER];
+        count++;
+    }
+    return count;
+}
+
+int LoRabbit_GetAggregationStats(LoraHandle_t *p_handle, LoRabbit_AggStats_t *p_stats) {
+    if (NULL == p_handle || NULL == p_stats || p_handle->agg_task_id <= 0) {
+        return LORABBIT_ERROR_INVALID_ARGUMENT;
+    }
+    tk_wai_sem(p_handle->agg_mutex_id, 1, TMO_FEVR);
+    memcpy(p_stats, &p_handle->agg_stats, sizeof(LoRabbit_AggStats_t));
+    tk_sig_sem(p_handle->agg_mutex_id, 1);
+    return LORABBIT_OK;
+}
+
+#endif // LORABBIT_USE_AGGREGATION
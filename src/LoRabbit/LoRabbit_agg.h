@@ -0,0 +1,91 @@
+/**
+ * @file LoRabbit_agg.h
+ * @brief LoRabbit 短いメッセージの集約送信
+ * @details センサー値などの短いメッセージを送信先ごとに溜め、長さ付きのレコードとして
+ * 1つのフレームにまとめて送るためのAPIを定義します。フレームが満杯になった時、
+ * メッセージの送信期限が来た時、LoRabbit_FlushMessages() を呼んだ時に送信します。
+ * @author men100
+ * @date 2025/09/30
+ */
+#pragma once
+#include "LoRabbit.h"
+
+#ifdef LORABBIT_USE_AGGREGATION
+
+/**
+ * @defgroup LoRabbitAggregation Message Aggregation
+ * @brief 短いメッセージを1つのフレームにまとめて送受信するAPI
+ * @{
+ */
+
+/**
+ * @brief 集約送信のタスクを起動する
+ * @details 溜めたメッセージを送信期限に送信するタスク (スタック LORABBIT_AGG_STACK_SIZE バイト) を
+ * 生成して起動します。LoRabbit_Init() と LoRabbit_InitModule() の後に、1度だけ呼んで下さい。
+ * @param[in,out] p_handle 操作対象のハンドル
+ * @param[in] task_priority タスクの優先度
+ * @retval LORABBIT_OK 成功
+ * @retval LORABBIT_ERROR_INVALID_ARGUMENT 引数がNULL、または起動済み
+ * @retval その他 負値のエラーコード (μT-Kernelのエラー)
+ */
+int LoRabbit_StartAggregator(LoraHandle_t *p_handle, PRI task_priority);
+
+/**
+ * @brief 短いメッセージを送信先ごとに溜め、まとめて送信する
+ * @details メッセージは送信先ごとの集約フレームに追加し、通常はすぐに戻ります。集約フレームは次の時に送信します。
+ * - メッセージを追加するとフレームが満杯になる時 (追加する前に送信し、新しいフレームに追加する)
+ * - 溜めているメッセージのうち最も早い送信期限 (追加してから max_delay_ms 後) が来た時
+ * - LoRabbit_FlushMessages() を呼んだ時
+ *
+ * 溜められる送信先は LORABBIT_AGG_DESTINATION_COUNT 個までで、それを超えると送信期限の最も早い送信先の
+ * フレームを先に送信します。フレームの送信は LoRabbit_SendFrame() で行い、ACKによる再送はしません。
+ * この呼び出しでフレームを送信する場合と、タスクが送信中の場合は、送信が完了するまで戻りません。
+ * @param[in,out] p_handle 操作対象のハンドル (LoRabbit_StartAggregator() で起動済みのもの)
+ * @param[in] target_address 送信先アドレス
+ * @param[in] target_channel 送信先チャンネル
+ * @param[in] p_message メッセージ
+ * @param[in] length メッセージの長さ (1バイト以上、最大フレーム長 - 4 バイト以下)
+ * @param[in] max_delay_ms メッセージを溜めておける最大時間 (ms)。0ですぐに送信する
+ * @retval LORABBIT_OK 成功 (溜めた、または送信した)
+ * @retval LORABBIT_ERROR_INVALID_ARGUMENT 引数が不正、またはタスクが未起動
+ * @retval その他 負値のエラーコード (フレームの送信に失敗)
+ */
+int LoRabbit_SendMessage(LoraHandle_t *p_handle, uint16_t target_address, uint8_t target_channel,
+                         const uint8_t *p_message, uint8_t length, uint32_t max_delay_ms);
+
+/**
+ * @brief 溜めている全ての送信先のメッセージを、送信期限を待たずに送信する
+ * @param[in,out] p_handle 操作対象のハンドル
+ * @retval LORABBIT_OK 成功 (溜めているメッセージがない場合を含む)
+ * @retval LORABBIT_ERROR_INVALID_ARGUMENT 引数がNULL、またはタスクが未起動
+ * @retval その他 負値のエラーコード (フレームの送信に失敗)
+ */
+int LoRabbit_FlushMessages(LoraHandle_t *p_handle);
+
+/**
+ * @brief 受信したフレームから、集約されたメッセージを取り出す
+ * @details LoRabbit_ReceiveFrame() で受信したフレームを渡します。メッセージはコピーせず、
+ * p_frame の受信バッファ内を指すので、p_frame を保持している間だけ使えます。
+ * @param[in] p_frame 受信したフレーム
+ * @param[out] p_source_address 送信元アドレスの格納先
+ * @param[out] p_messages 取り出したメッセージの格納先
+ * @param[in] max_messages p_messages の要素数
+ * @return 取り出したメッセージの数
+ * @retval LORABBIT_ERROR_INVALID_ARGUMENT 引数がNULL
+ * @retval LORABBIT_ERROR_INVALID_PACKET 集約フレームではない
+ * @retval LORABBIT_ERROR_BUFFER_OVERFLOW メッセージの数が max_messages を超えている
+ */
+int LoRabbit_UnpackMessages(const RecvFrameE220900T22SJP_t *p_frame, uint16_t *p_source_address,
+                            LoRabbit_Message_t *p_messages, int max_messages);
+
+/**
+ * @brief 集約送信の統計を取得する
+ * @param[in] p_handle 操作対象のハンドル
+ * @param[out] p_stats 統計の格納先
+ * @retval LORABBIT_OK 成功
+ * @retval LORABBIT_ERROR_INVALID_ARGUMENT 引数がNULL、またはタスクが未起動
+ */
+int LoRabbit_GetAggregationStats(LoraHandle_t *p_handle, LoRabbit_AggStats_t *p_stats);
+
+/** @} */ // end of LoRabbitAggregation group
+#endif // LORABBIT_USE_AGGREGATION
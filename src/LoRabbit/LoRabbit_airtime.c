@@ -0,0 +1,202 @@
+/**
+ * @file LoRabbit_airtime.c
+ * @brief LoRabbit 送信時間の制限 (エアタイム予算) の実装
+ * @details 送信するフレームごとに LoRabbit_GetTimeOnAirUsec() でエアタイムを求め、予算から差し引きます。
+ * 予算が足りない時や、前の送信から休止時間が経っていない時は、送信できるようになるまで待ちます。
+ * 待つ時間が LORABBIT_AIRTIME_MAX_WAIT_MS を超える場合は、送信せずにエラーを返します。
+ */
+#include "LoRabbit_airtime.h"
+
+#ifdef LORABBIT_USE_AIRTIME_BUDGET
+
+#include "LoRabbit_internal.h"
+#include "LoRabbit_hal.h"
+
+#include <string.h>
+
+#define LORA_AIRTIME_ADDRESS_SIZE 3 // LoRabbit_SendFrame が先頭に付ける送信先アドレスとチャンネル (エアタイムの計算に含める)
+#define LORA_AIRTIME_BUCKET_MS    (LORABBIT_AIRTIME_WINDOW_MS / LORABBIT_AIRTIME_BUCKET_COUNT)
+
+#if LORABBIT_AIRTIME_BUCKET_COUNT < 1 || LORABBIT_AIRTIME_BUCKET_COUNT > 255
+#error "LORABBIT_AIRTIME_BUCKET_COUNT must be between 1 and 255"
+#endif
+#if LORABBIT_AIRTIME_RESERVE_PERCENT >= 100
+#error "LORABBIT_AIRTIME_RESERVE_PERCENT must be less than 100"
+#endif
+
+// 現在時刻をミリ秒で取得するヘルパー関数（内部利用）
+static uint32_t lora_airtime_now_ms(void) {
+    SYSTIM now;
+    tk_get_tim(&now);
+    return now.lo;
+}
+
+// 使える予算 (マイクロ秒) を返すヘルパー関数（内部利用）
+// 予約分を使えない送信には、LORABBIT_AIRTIME_RESERVE_PERCENT の分を除いた予算を返す
+static uint64_t lora_airtime_limit_us(bool may_use_reserve) {
+    uint64_t limit_us = (uint64_t)LORABBIT_AIRTIME_BUDGET_MS * 1000;
+    if (!may_use_reserve) {
+        limit_us -= limit_us * LORABBIT_AIRTIME_RESERVE_PERCENT / 100;
+    }
+    return limit_us;
+}
+
+// 期間を過ぎた区間の送信時間を予算に戻すヘルパー関数（内部利用）
+// ミューテックスを取得した状態で呼ぶ
+static void lora_airtime_advance(LoRabbitAirtime_Account_t *p_account, uint32_t now_ms) {
+    uint32_t elapsed_ms = now_ms - p_account->bucket_start_ms;
+    if (elapsed_ms < LORA_AIRTIME_BUCKET_MS) {
+        return;
+    }
+    if (elapsed_ms >= LORABBIT_AIRTIME_WINDOW_MS) {
+        // 期間全体が過ぎていれば、全ての区間を空にする
+        memset(p_account->used_us, 0, sizeof(p_account->used_us));
+        p_account->window_used_us = 0;
+        p_account->bucket_start_ms = now_ms - elapsed_ms % LORA_AIRTIME_BUCKET_MS;
+        return;
+    }
+    while (elapsed_ms >= LORA_AIRTIME_BUCKET_MS) {
+        // 次の区間は、期間の最初 (最も古い) 区間でもあるので、その送信時間を予算に戻してから使う
+        p_account->current_bucket = (uint8_t)((p_account->current_bucket + 1) % LORABBIT_AIRTIME_BUCKET_COUNT);
+        p_account->window_used_us -= p_account->used_us[p_account->current_bucket];
+        p_account->used_us[p_account->current_bucket] = 0;
+        p_account->bucket_start_ms += LORA_AIRTIME_BUCKET_MS;
+        elapsed_ms -= LORA_AIRTIME_BUCKET_MS;
+    }
+}
+
+// airtime_us の送信が予算に収まるまでの時間 (ms) を返すヘルパー関数（内部利用）
+// 古い区間から順に予算に戻る時刻を調べる。予算より長い送信で、待っても収まらなければ UINT32_MAX を返す
+// ミューテックスを取得した状態で呼ぶ
+static uint32_t lora_airtime_budget_wait_ms(const LoRabbitAirtime_Account_t *p_account, uint32_t now_ms,
+                                            uint64_t airtime_us, bool may_use_reserve) {
+    const uint64_t limit_us = lora_airtime_limit_us(may_use_reserve);
+    if (airtime_us > limit_us) {
+        return UINT32_MAX;
+    }
+    uint64_t used_us = p_account->window_used_us;
+    for (uint32_t i = 1; used_us + airtime_us > limit_us; i++) {
+        if (i > LORABBIT_AIRTIME_BUCKET_COUNT) {
+            return UINT32_MAX; // 到達しない (全ての区間が戻れば used_us は0になる)
+        }
+        used_us -= p_account->used_us[(p_account->current_bucket + i) % LORABBIT_AIRTIME_BUCKET_COUNT];
+        if (used_us + airtime_us <= limit_us) {
+            uint32_t release_ms = p_account->bucket_start_ms + i * LORA_AIRTIME_BUCKET_MS;
+            return release_ms - now_ms;
+        }
+    }
+    return 0;
+}
+
+// 前の送信からの休止時間が経つまでの時間 (ms) を返すヘルパー関数（内部利用）
+// ミューテックスを取得した状態で呼ぶ
+static uint32_t lora_airtime_pause_wait_ms(const LoRabbitAirtime_Account_t *p_account, uint32_t now_ms) {
+    if (!p_account->has_sent) {
+        return 0;
+    }
+    int32_t remaining_ms = (int32_t)(p_account->last_tx_end_ms + LORABBIT_AIRTIME_MIN_PAUSE_MS - now_ms);
+    return (remaining_ms > 0) ? (uint32_t)remaining_ms : 0;
+}
+
+// 予算が空くまで待つヘルパー関数（内部利用）
+// is_frame が true なら、休止時間も待ってから airtime_us を予算から差し引く
+static int lora_airtime_wait(LoraHandle_t *p_handle, uint64_t airtime_us, bool may_use_reserve, bool is_frame) {
+    LoRabbitAirtime_Account_t *p_account = &p_handle->airtime;
+    const uint32_t start_ms = lora_airtime_now_ms();
+    bool is_budget_delayed = false;
+
+    for (;;) {
+        tk_wai_sem(p_handle->airtime_mutex_id, 1, TMO_FEVR);
+        const uint32_t now_ms = lora_airtime_now_ms();
+        const uint32_t waited_ms = now_ms - start_ms;
+        lora_airtime_advance(p_account, now_ms);
+
+        uint32_t budget_wait_ms = lora_airtime_budget_wait_ms(p_account, now_ms, airtime_us, may_use_reserve);
+        if (budget_wait_ms == UINT32_MAX || waited_ms + budget_wait_ms > LORABBIT_AIRTIME_MAX_WAIT_MS) {
+            p_account->stats.rejected_count++;
+            tk_sig_sem(p_handle->airtime_mutex_id, 1);
+            LORA_PRINTF("airtime: budget exhausted (need %lu us, wait %lu ms)\n",
+                        (unsigned long)airtime_us, (unsigned long)budget_wait_ms);
+            return LORABBIT_ERROR_AIRTIME_EXHAUSTED;
+        }
+        uint32_t wait_ms = budget_wait_ms;
+        if (is_frame) {
+            uint32_t pause_wait_ms = lora_airtime_pause_wait_ms(p_account, now_ms);
+            if (pause_wait_ms > wait_ms) {
+                wait_ms = pause_wait_ms;
+            }
+        }
+        if (budget_wait_ms > 0) {
+            is_budget_delayed = true;
+        }
+
+        if (wait_ms == 0) {
+            if (is_frame) {
+                p_account->used_us[p_account->current_bucket] += (uint32_t)airtime_us;
+                p_account->window_used_us += airtime_us;
+                // 送信完了 (lora_airtime_on_tx_done) まではエアタイム後に終わる見込みとする
+                p_account->last_tx_end_ms = now_ms + (uint32_t)((airtime_us + 999) / 1000);
+                p_account->has_sent = true;
+                p_account->stats.frame_count++;
+                p_account->stats.total_airtime_us += airtime_us;
+            }
+            if (is_budget_delayed) {
+                p_account->stats.delayed_count++;
+                p_account->stats.total_delay_ms += waited_ms;
+            }
+            tk_sig_sem(p_handle->airtime_mutex_id, 1);
+            return LORABBIT_OK;
+        }
+        tk_sig_sem(p_handle->airtime_mutex_id, 1);
+        tk_dly_tsk(wait_ms);
+    }
+}
+
+int lora_airtime_acquire(LoraHandle_t *p_handle, int frame_size, bool may_use_reserve) {
+    uint32_t airtime_us = LoRabbit_GetTimeOnAirUsec(p_handle->current_config.air_data_rate,
+                                                    (uint8_t)(LORA_AIRTIME_ADDRESS_SIZE + frame_size));
+    return lora_airtime_wait(p_handle, airtime_us, may_use_reserve, true);
+}
+
+void lora_airtime_on_tx_done(LoraHandle_t *p_handle) {
+    tk_wai_sem(p_handle->airtime_mutex_id, 1, TMO_FEVR);
+    p_handle->airtime.last_tx_end_ms = lora_airtime_now_ms();
+    tk_sig_sem(p_handle->airtime_mutex_id, 1);
+}
+
+int lora_airtime_wait_for(LoraHandle_t *p_handle, uint64_t airtime_us, bool may_use_reserve) {
+    if (airtime_us > lora_airtime_limit_us(may_use_reserve)) {
+        return LORABBIT_OK; // 予算全体より長い転送は、フレームごとの制限だけで送る
+    }
+    return lora_airtime_wait(p_handle, airtime_us, may_use_reserve, false);
+}
+
+int LoRabbit_GetAirtimeBudget(LoraHandle_t *p_handle, LoRabbit_AirtimeBudget_t *p_budget) {
+    if (NULL == p_handle || NULL == p_budget) {
+        return LORABBIT_ERROR_INVALID_ARGUMENT;
+    }
+    LoRabbitAirtime_Account_t *p_account = &p_handle->airtime;
+
+    tk_wai_sem(p_handle->airtime_mutex_id, 1, TMO_FEVR);
+    const uint32_t now_ms = lora_airtime_now_ms();
+    lora_airtime_advance(p_account, now_ms);
+
+    memcpy(p_budget, &p_account->stats, sizeof(LoRabbit_AirtimeBudget_t));
+    p_budget->window_ms = LORABBIT_AIRTIME_WINDOW_MS;
+    p_budget->budget_ms = LORABBIT_AIRTIME_BUDGET_MS;
+    p_budget->used_ms = (uint32_t)((p_account->window_used_us + 999) / 1000);
+    p_budget->remaining_ms = (p_budget->used_ms < p_budget->budget_ms) ? p_budget->budget_ms - p_budget->used_ms : 0;
+
+    // 送信時間が残っている最も古い区間が、期間を過ぎて予算に戻るまでの時間
+    p_budget->next_release_ms = 0;
+    for (uint32_t i = 1; i <= LORABBIT_AIRTIME_BUCKET_COUNT; i++) {
+        if (p_account->used_us[(p_account->current_bucket + i) % LORABBIT_AIRTIME_BUCKET_COUNT] > 0) {
+            p_budget->next_release_ms = p_account->bucket_start_ms + i * LORA_AIRTIME_BUCKET_MS - now_ms;
+            break;
+        }
+    }
+    tk_sig_sem(p_handle->airtime_mutex_id, 1);
+    return LORABBIT_OK;
+}
+
+#endif // LORABBIT_USE_AIRTIME_BUDGET
@@ -0,0 +1,34 @@
+/**
+ * @file LoRabbit_airtime.h
+ * @brief LoRabbit 送信時間の制限 (エアタイム予算)
+ * @details ACKを含む全ての送信フレームのエアタイムを数え、一定期間内の送信時間の総和と
+ * 送信後の休止時間が制限 (初期値は ARIB STD-T108) に収まるよう送信を遅らせます。
+ * このヘッダでは、残りの予算を取得するAPIを定義します。
+ * @author men100
+ * @date 2025/09/30
+ */
+#pragma once
+#include "LoRabbit.h"
+
+#ifdef LORABBIT_USE_AIRTIME_BUDGET
+
+/**
+ * @defgroup LoRabbitAirtime Airtime Budget
+ * @brief 送信時間の制限 (エアタイム予算) の状態を取得するAPI
+ * @{
+ */
+
+/**
+ * @brief 送信時間の制限 (エアタイム予算) の状態を取得する
+ * @details 送信時間は LORABBIT_AIRTIME_WINDOW_MS を LORABBIT_AIRTIME_BUCKET_COUNT 個に分けた区間ごとに数え、
+ * 期間を過ぎた区間の送信時間を予算に戻します。残りの予算 (remaining_ms) のうち
+ * LORABBIT_AIRTIME_RESERVE_PERCENT の分は、ACKと制御クラス (LORABBIT_TRAFFIC_CLASS_CONTROL) の転送だけが使えます。
+ * @param[in,out] p_handle 操作対象のハンドル
+ * @param[out] p_budget 状態の格納先
+ * @retval LORABBIT_OK 成功
+ * @retval LORABBIT_ERROR_INVALID_ARGUMENT 引数がNULL
+ */
+int LoRabbit_GetAirtimeBudget(LoraHandle_t *p_handle, LoRabbit_AirtimeBudget_t *p_budget);
+
+/** @} */ // end of LoRabbitAirtime group
+#endif // LORABBIT_USE_AIRTIME_BUDGET
@@ -25,8 +25,88 @@
  * @name Transport Protocol Settings
  * @{
  */
-#define LORABBIT_TP_RETRY_COUNT      3    /**< 大容量データ送信時の、各パケットの最大リトライ回数 */
-#define LORABBIT_TP_ACK_TIMEOUT_MS   2000 /**< ACK応答を待つタイムアウト時間 (ミリ秒) */
+#define LORABBIT_TP_RETRY_COUNT      3    /**< 大容量データ送信時の、各パケットの最大リトライ回数 (損失率から決める回数の下限) */
+#define LORABBIT_TP_RETRY_COUNT_MAX  8    /**< 観測した損失率に応じて増やす、各パケットの最大リトライ回数の上限 */
+#define LORABBIT_TP_RTO_MIN_MS       50    /**< 往復時間から求めるACK待ち時間 (再送タイムアウト) の下限 (ミリ秒) */
+#define LORABBIT_TP_RTO_MAX_MS       30000 /**< 往復時間から求めるACK待ち時間 (再送タイムアウト) の上限 (ミリ秒) */
+#define LORABBIT_TP_RX_LINGER_ROUNDS 2    /**< 受信完了後、最後のACKが欠損した送信側の再送を待つ回数 (0で待たずに戻る) */
+#define LORABBIT_TP_RX_SESSION_COUNT 4    /**< [LORABBIT_USE_MULTI_SESSION 有効時のみ] LoRabbit_ReceiveDataMulti() で同時に受信できる転送の数 (1転送あたり約 LORABBIT_TP_MAX_PACKETS / 8 + 100 バイトのRAMを使う) */
+#define LORABBIT_TP_MULTICAST_NACK_SLOTS   8 /**< 同報送信で、受信側がNACKを返すタイミングを散らす返信スロットの数 (受信側が多いほど増やすとNACKが衝突しにくい) */
+#define LORABBIT_TP_MULTICAST_SILENT_POLLS 2 /**< 同報送信で、NACKが1つも返らない問い合わせがこの回数 (損失率に応じて増やす回数の下限) 続いたら全受信側の受信完了とみなす */
+#define LORABBIT_TP_PEER_TABLE_SIZE  4    /**< 往復時間と損失率を記録しておく通信相手の数 */
+#define LORABBIT_TP_MAX_PACKETS      255  /**< 1回の大容量データ転送の最大パケット数 (255以上65535以下)。255を超える値で、拡張ヘッダ (約187バイト/パケット) の転送が有効になるが、ハンドルが1パケットあたり3ビット大きくなる (初期値でsizeof(LoraHandle_t)は約1.9KB、2048で約2.5KB。docs/setup.md 参照) */
+#define LORABBIT_TP_WINDOW_SIZE_DEFAULT 4  /**< ウィンドウ送信モードでウィンドウサイズ未指定時に使うサイズ */
+#define LORABBIT_TP_WINDOW_SIZE_MAX     16 /**< ウィンドウ送信モードで指定できる最大ウィンドウサイズ (送信タイマの数) */
+#define LORABBIT_FEC_MAX_REPAIR_PACKETS 16 /**< FEC有効時の1転送あたりの最大冗長パケット数 (復号時にこの2乗のバイト数をスタックに使用) */
+/** @} */
+
+/**
+ * @name TX Service Settings
+ * @{
+ */
+#define LORABBIT_TX_SERVICE_QUEUE_DEPTH 8    /**< 送信サービスに投入しておける送信要求の数 */
+#define LORABBIT_TX_SERVICE_STACK_SIZE  4096 /**< 送信サービスのタスクのスタックサイズ (バイト) */
+/** @} */
+
+/**
+ * @name RX Dispatcher Settings
+ * @{
+ */
+#define LORABBIT_RX_DISPATCH_QUEUE_DEPTH   4    /**< 振り分け先 (ACK/データ/その他) ごとに保持しておける受信フレームの数 */
+#define LORABBIT_RX_DISPATCHER_STACK_SIZE  2048 /**< 受信ディスパッチャのタスクのスタックサイズ (バイト) */
+#define LORABBIT_RX_DISPATCHER_POLL_MS     20   /**< 受信ディスパッチャが受信待ちをやり直す間隔 (ms)。他のタスクの送信完了後に受信待ちに戻るまでの最大時間 */
+#define LORABBIT_TP_DELAYED_ACK_MS         0    /**< [LORABBIT_USE_RX_DISPATCHER 有効時のみ] ACKを保留し、同じ相手へ送るデータパケットに載せる (ピギーバック) までの最大待ち時間 (ms)。0で保留しない。受信ディスパッチャを起動していない間も保留しない */
+/** @} */
+
+/**
+ * @name Message Aggregation Settings
+ * @{
+ */
+#define LORABBIT_AGG_DESTINATION_COUNT     2    /**< 短いメッセージを溜めておける送信先の数 (1送信先あたり約200バイトのRAMを使う) */
+#define LORABBIT_AGG_STACK_SIZE            1024 /**< 溜めたメッセージを期限に送信するタスクのスタックサイズ (バイト) */
+/** @} */
+
+/**
+ * @name Airtime Budget Settings
+ * @brief 初期値は ARIB STD-T108 (920MHz帯、キャリアセンスあり) の送信時間の制限
+ * @{
+ */
+#define LORABBIT_AIRTIME_WINDOW_MS         3600000 /**< 送信時間の総和を数える期間 (ms) */
+#define LORABBIT_AIRTIME_BUDGET_MS         360000  /**< LORABBIT_AIRTIME_WINDOW_MS の間に送信できる時間の総和 (ms) */
+#define LORABBIT_AIRTIME_BUCKET_COUNT      60      /**< 送信時間を数える期間の分割数 (期間を過ぎた送信時間は、分割した単位で予算に戻る) */
+#define LORABBIT_AIRTIME_MIN_PAUSE_MS      50      /**< 送信を終えてから次の送信を始めるまでの休止時間 (ms) */
+#define LORABBIT_AIRTIME_RESERVE_PERCENT   10      /**< ACKと制御クラスの転送のために残しておく予算の割合 (%) */
+#define LORABBIT_AIRTIME_MAX_WAIT_MS       10000   /**< 予算が空くのを待つ最大時間 (ms)。これより長く待つ必要があれば送信せずにエラーを返す */
+/** @} */
+
+/**
+ * @name Listen Before Talk Settings
+ * @{
+ */
+#define LORABBIT_LBT_BUSY_THRESHOLD_DBM    (-80) /**< 周囲のRSSIノイズがこの値以上なら、チャンネルを使用中とみなす (dBm) */
+#define LORABBIT_LBT_BACKOFF_MIN_MS        10    /**< 最初のバックオフの最大時間 (ms)。使用中と判定するたびに倍にする */
+#define LORABBIT_LBT_BACKOFF_MAX_MS        640   /**< バックオフの最大時間の上限 (ms) */
+#define LORABBIT_LBT_MAX_ATTEMPTS          8     /**< 1フレームあたりのチャンネルの確認回数。全て使用中なら送信せずにエラーを返す */
+#define LORABBIT_LBT_SENSE_TIMEOUT_MS      50    /**< RSSIの読み出しコマンドの応答を待つ最大時間 (ms) */
+/** @} */
+
+/**
+ * @name Channel Survey Settings
+ * @{
+ */
+#define LORABBIT_SURVEY_SAMPLE_COUNT        10    /**< 1チャンネルあたりの周囲のRSSIノイズの読み出し回数 */
+#define LORABBIT_SURVEY_SAMPLE_INTERVAL_MS  50    /**< 周囲のRSSIノイズを読み出す間隔 (ms) */
+#define LORABBIT_SURVEY_BUSY_THRESHOLD_DBM  (-80) /**< 周囲のRSSIノイズがこの値以上なら、そのチャンネルを使用中と数える (dBm) */
+#define LORABBIT_CHANNEL_MOVE_RETRY_COUNT   3     /**< チャンネル移動の要求を送り直す回数 */
+#define LORABBIT_CHANNEL_MOVE_ACK_TIMEOUT_MS 1000 /**< チャンネル移動の要求に対する応答を待つ時間 (ms) */
+/** @} */
+
+/**
+ * @name UART Reception Settings
+ * @{
+ */
+#define LORABBIT_RX_BUFFER_SIZE            256 /**< UART受信用リングバッファのサイズ (2のべき乗、2以上32768以下。1フレーム (最大201バイト) を溜められる256以上を推奨) */
+#define LORABBIT_UART_DTC_BLOCK_SIZE       64 /**< 1回のDTC転送で受信するバイト数の上限 (受信の割り込みはこのバイト数ごとに1回になる) */
 /** @} */
 
 /**
@@ -55,5 +135,85 @@
  */
 // #define LORABBIT_USE_AI_ADR
 
+/**
+ * @brief 前方誤り訂正 (FEC) 機能の有効/無効
+ * @details このマクロを有効にすると、バースト送信モードで冗長パケットを事前に送信し、
+ * 欠損したパケットを再送なしで復元できるようになります (LoRabbit_SendOptions_t::fec_redundancy_percent)。
+ */
+// #define LORABBIT_USE_FEC
+
+/**
+ * @brief 複数の送信元からの同時受信機能の有効/無効
+ * @details このマクロを有効にすると、複数の送信元からの大容量データ転送を並行して受信する
+ * LoRabbit_ReceiveDataMulti() APIが利用可能になります。
+ * 受信状態をハンドル内に LORABBIT_TP_RX_SESSION_COUNT 個持つため、その分ハンドルが大きくなります。
+ */
+// #define LORABBIT_USE_MULTI_SESSION
+
+/**
+ * @brief 送信サービス機能の有効/無効
+ * @details このマクロを有効にすると、無線モジュールへの送信を専用のタスクに任せる
+ * LoRabbit_StartTxService() / LoRabbit_SubmitSend() APIが利用可能になります。
+ * 複数のタスクが、互いの転送の完了を待たずに送信要求を投入できます。
+ */
+// #define LORABBIT_USE_TX_SERVICE
+
+/**
+ * @brief 受信ディスパッチャ機能の有効/無効
+ * @details このマクロを有効にすると、UARTで受信したフレームを専用のタスクで読み出し、
+ * ACK/データパケット/その他のフレームに振り分ける LoRabbit_StartRxDispatcher() APIが利用可能になります。
+ * 送信中や、別の種類のフレームを待っている間に届いたフレームも捨てずに保持します。
+ */
+// #define LORABBIT_USE_RX_DISPATCHER
+
+/**
+ * @brief トラフィッククラスによる割り込み機能の有効/無効
+ * @details このマクロを有効にすると、LoRabbit_SendOptions_t::traffic_class で上位のクラスを指定した転送が、
+ * 送信中の下位のクラスの転送のパケットの合間に割り込んで先に送信されるようになります。
+ * クラスごとの送信待ち時間の統計を取得する LoRabbit_GetTrafficClassStats() APIも利用可能になります。
+ * 割り込まれた転送の状態の退避領域とクラスごとのセマフォを持つため、その分ハンドルが大きくなります。
+ * 無効の場合、転送は送信を始めた順に1つずつ送信されます。
+ */
+// #define LORABBIT_USE_TRAFFIC_CLASS
+
+/**
+ * @brief 短いメッセージの集約送信機能の有効/無効
+ * @details このマクロを有効にすると、短いメッセージを送信先ごとに溜めて1つのフレームにまとめて送る
+ * LoRabbit_StartAggregator() / LoRabbit_SendMessage() / LoRabbit_UnpackMessages() APIが利用可能になります。
+ * メッセージごとのプリアンブルとヘッダのエアタイムを削減できます。
+ */
+// #define LORABBIT_USE_AGGREGATION
+
+/**
+ * @brief 送信時間の制限 (エアタイム予算) 機能の有効/無効
+ * @details このマクロを有効にすると、ACKを含む全てのフレームのエアタイムを数え、
+ * LORABBIT_AIRTIME_BUDGET_MS と LORABBIT_AIRTIME_MIN_PAUSE_MS の制限に収まるよう送信を遅らせます。
+ * 残りの予算は LoRabbit_GetAirtimeBudget() で取得できます。
+ */
+// #define LORABBIT_USE_AIRTIME_BUDGET
+
+/**
+ * @brief 送信前のキャリアセンス (Listen Before Talk) 機能の有効/無効
+ * @details このマクロを有効にすると、フレームを送信する前にモジュールのRSSI読み出しコマンドで
+ * 周囲のRSSIノイズを確かめ、チャンネルが使用中ならランダムな時間 (確認のたびに倍になる範囲) 待ってから
+ * 確かめ直します。モジュールの設定で rssi_ambient_noise_flag を有効にして下さい。
+ */
+// #define LORABBIT_USE_LBT
+
+/**
+ * @brief チャンネルの調査とチャンネル移動機能の有効/無効
+ * @details このマクロを有効にすると、各チャンネルの周囲のRSSIノイズを調べて空いている順に並べる
+ * LoRabbit_SurveyChannels() と、通信相手と示し合わせてチャンネルを移る LoRabbit_MoveChannel() が使えます。
+ */
+// #define LORABBIT_USE_CHANNEL_SURVEY
+
+/**
+ * @brief DTCによるUART受信機能の有効/無効
+ * @details このマクロを有効にすると、FSPのUARTの受信DTC転送で、受信データを
+ * LORABBIT_UART_DTC_BLOCK_SIZE バイト単位でリングバッファに直接書き込みます (1バイトごとの割り込みがなくなります)。
+ * UARTのFSP設定で受信用のDTC (Receive) を指定して下さい。指定していない場合は1バイトごとの受信になります。
+ */
+// #define LORABBIT_USE_UART_DTC
+
 /** @} */
 /** @} */ // end of LoRabbitConfig group
@@ -0,0 +1,219 @@
+/**
+ * @file LoRabbit_fec.c
+ * @brief 前方誤り訂正 (FEC) の実装
+ * @details LoRabbit_fec.hで宣言された、GF(256)上のCauchy行列による
+ * Reed-Solomon消失訂正符号の符号化・復号を実装します。
+ */
+#include "LoRabbit_fec.h"
+
+#ifdef LORABBIT_USE_FEC
+
+#include "LoRabbit_internal.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+// GF(256)の既約多項式 x^8 + x^4 + x^3 + x^2 + 1
+#define LORA_FEC_GF_POLY 0x11D
+
+// GF(256)の指数表と対数表 (指数表は剰余計算を省くため2周分持つ)
+static uint8_t s_gf_exp[512];
+static uint8_t s_gf_log[256];
+static bool s_gf_initialized = false;
+
+/**
+ * @brief GF(256)の指数表と対数表を作成する（内部関数）
+ * @details 何度呼ばれても同じ表が作られるだけなので、排他制御は不要。
+ */
+static void lora_fec_gf_init(void) {
+    if (s_gf_initialized) {
+        return;
+    }
+
+    uint16_t x = 1;
+    for (uint16_t i = 0; i < 255; i++) {
+        s_gf_exp[i] = (uint8_t)x;
+        s_gf_exp[i + 255] = (uint8_t)x;
+        s_gf_log[x] = (uint8_t)i;
+        x <<= 1;
+        if (x & 0x100) {
+            x ^= LORA_FEC_GF_POLY;
+        }
+    }
+    s_gf_exp[510] = s_gf_exp[0];
+    s_gf_exp[511] = s_gf_exp[1];
+    s_gf_log[0] = 0; // 0の対数は未定義 (使用しない)
+
+    s_gf_initialized = true;
+}
+
+static inline uint8_t lora_fec_gf_mul(uint8_t a, uint8_t b) {
+    if (a == 0 || b == 0) {
+        return 0;
+    }
+    return s_gf_exp[s_gf_log[a] + s_gf_log[b]];
+}
+
+static inline uint8_t lora_fec_gf_inv(uint8_t a) {
+    return s_gf_exp[255 - s_gf_log[a]]; // a != 0 であること
+}
+
+/**
+ * @brief Cauchy行列の係数を求める（内部関数）
+ * @details 冗長断片 repair_index とデータ断片 data_index の係数は 1 / (repair_index + data_index)。
+ * 冗長断片の番号は常にデータ断片の番号より大きいので、分母が0になることはない。
+ */
+static inline uint8_t lora_fec_coefficient(uint8_t repair_index, uint8_t data_index) {
+    return lora_fec_gf_inv(repair_index ^ data_index);
+}
+
+/**
+ * @brief dst += coef * src を計算する（内部関数）
+ */
+static void lora_fec_mul_add(uint8_t *p_dst, const uint8_t *p_src, uint8_t coef, uint16_t len) {
+    if (coef == 0) {
+        return;
+    }
+    const uint16_t log_coef = s_gf_log[coef];
+    for (uint16_t i = 0; i < len; i++) {
+        if (p_src[i] != 0) {
+            p_dst[i] ^= s_gf_exp[s_gf_log[p_src[i]] + log_coef];
+        }
+    }
+}
+
+/**
+ * @brief buf *= coef を計算する（内部関数）
+ */
+static void lora_fec_scale(uint8_t *p_buf, uint8_t coef, uint16_t len) {
+    const uint16_t log_coef = s_gf_log[coef];
+    for (uint16_t i = 0; i < len; i++) {
+        if (p_buf[i] != 0) {
+            p_buf[i] = s_gf_exp[s_gf_log[p_buf[i]] + log_coef];
+        }
+    }
+}
+
+void lora_fec_encode(const uint8_t *p_data,
+                     uint32_t size,
+                     uint8_t data_count,
+                     uint16_t symbol_len,
+                     uint8_t repair_index,
+                     uint8_t *p_out)
+{
+    lora_fec_gf_init();
+
+    memset(p_out, 0, symbol_len);
+    for (uint8_t j = 0; j < data_count; j++) {
+        uint32_t offset = (uint32_t)j * symbol_len;
+        if (offset >= size) {
+            break; // 以降の断片はすべて0
+        }
+        uint32_t len = size - offset;
+        if (len > symbol_len) {
+            len = symbol_len;
+        }
+        // 末尾の断片の不足分は0なので、足し合わせる必要はない
+        lora_fec_mul_add(p_out, &p_data[offset], lora_fec_coefficient(repair_index, j), (uint16_t)len);
+    }
+}
+
+int lora_fec_decode(uint8_t *p_buffer,
+                    uint8_t data_count,
+                    uint16_t symbol_len,
+                    const uint8_t *p_erased,
+                    const uint8_t *p_repair,
+                    uint8_t erased_count)
+{
+    uint8_t matrix[LORABBIT_FEC_MAX_REPAIR_PACKETS][LORABBIT_FEC_MAX_REPAIR_PACKETS];
+
+    if (erased_count > LORABBIT_FEC_MAX_REPAIR_PACKETS) {
+        return LORABBIT_ERROR_INVALID_ARGUMENT;
+    }
+    for (uint8_t k = 0; k < erased_count; k++) {
+        if (p_erased[k] >= data_count || p_repair[k] < data_count) {
+            return LORABBIT_ERROR_INVALID_ARGUMENT;
+        }
+    }
+
+    lora_fec_gf_init();
+
+    // 1. 受信済みデータ断片の寄与を冗長断片から取り除く
+    //    (欠損位置 p_erased[k] には冗長断片 p_repair[k] が格納されている)
+    for (uint8_t j = 0; j < data_count; j++) {
+        bool is_erased = false;
+        for (uint8_t k = 0; k < erased_count; k++) {
+            if (p_erased[k] == j) {
+                is_erased = true;
+                break;
+            }
+        }
+        if (is_erased) {
+            continue;
+        }
+        const uint8_t *p_src = &p_buffer[(uint32_t)j * symbol_len];
+        for (uint8_t k = 0; k < erased_count; k++) {
+            lora_fec_mul_add(&p_buffer[(uint32_t)p_erased[k] * symbol_len], p_src,
+                             lora_fec_coefficient(p_repair[k], j), symbol_len);
+        }
+    }
+
+    // 2. 残った連立方程式 (係数行列は正則なCauchy行列) をガウス・ジョルダン法で解く
+    //    行の操作は、対応する位置の断片にも同じように適用する
+    for (uint8_t row = 0; row < erased_count; row++) {
+        for (uint8_t col = 0; col < erased_count; col++) {
+            matrix[row][col] = lora_fec_coefficient(p_repair[row], p_erased[col]);
+        }
+    }
+
+    for (uint8_t col = 0; col < erased_count; col++) {
+        // ピボットを探して、必要なら行を入れ替える
+        uint8_t pivot = col;
+        while (pivot < erased_count && matrix[pivot][col] == 0) {
+            pivot++;
+        }
+        if (pivot == erased_count) {
+            return LORABBIT_ERROR_INVALID_ARGUMENT; // 正則でない (番号の重複など)
+        }
+        if (pivot != col) {
+            uint8_t *p_a = &p_buffer[(uint32_t)p_erased[col] * symbol_len];
+            uint8_t *p_b = &p_buffer[(uint32_t)p_erased[pivot] * symbol_len];
+            for (uint8_t i = 0; i < erased_count; i++) {
+                uint8_t tmp = matrix[col][i];
+                matrix[col][i] = matrix[pivot][i];
+                matrix[pivot][i] = tmp;
+            }
+            for (uint16_t i = 0; i < symbol_len; i++) {
+                uint8_t tmp = p_a[i];
+                p_a[i] = p_b[i];
+                p_b[i] = tmp;
+            }
+        }
+
+        // ピボット行を正規化する
+        uint8_t *p_pivot_row = &p_buffer[(uint32_t)p_erased[col] * symbol_len];
+        uint8_t inv = lora_fec_gf_inv(matrix[col][col]);
+        for (uint8_t i = 0; i < erased_count; i++) {
+            matrix[col][i] = lora_fec_gf_mul(matrix[col][i], inv);
+        }
+        lora_fec_scale(p_pivot_row, inv, symbol_len);
+
+        // 他の行からピボット列を消去する
+        for (uint8_t row = 0; row < erased_count; row++) {
+            uint8_t factor = matrix[row][col];
+            if (row == col || factor == 0) {
+                continue;
+            }
+            for (uint8_t i = 0; i < erased_count; i++) {
+                matrix[row][i] ^= lora_fec_gf_mul(matrix[col][i], factor);
+            }
+            lora_fec_mul_add(&p_buffer[(uint32_t)p_erased[row] * symbol_len], p_pivot_row, factor, symbol_len);
+        }
+    }
+
+    LORA_PRINTF("FEC: recovered %d of %d fragments\n", erased_count, data_count);
+
+    return LORABBIT_OK;
+}
+
+#endif
@@ -0,0 +1,64 @@
+/**
+ * @file LoRabbit_fec.h
+ * @brief 前方誤り訂正 (FEC) による消失訂正符号
+ * @details GF(256)上のCauchy行列を用いたReed-Solomon消失訂正符号を定義します。
+ * N個のデータ断片からK個の冗長断片を生成し、N+K個のうち任意のN個が揃えば
+ * 元のデータ断片を復元できます。トランスポート層 (LoRabbit_tp.c) から利用されます。
+ * @author men100
+ * @date 2025/09/30
+ */
+#pragma once
+#include "LoRabbit.h"
+
+#ifdef LORABBIT_USE_FEC
+
+/**
+ * @defgroup LoRabbitFEC Forward Error Correction
+ * @brief 消失訂正符号による冗長断片の生成と欠損断片の復元
+ * @internal
+ * @{
+ */
+
+/**
+ * @brief 冗長断片を1つ生成する
+ * @details データを symbol_len バイトごとの断片に分割し (末尾の断片は0で埋める)、
+ * 各断片にCauchy行列の係数を掛けて足し合わせた冗長断片を p_out に書き込みます。
+ * 冗長断片の番号はデータ断片の番号に続く通し番号 (data_count 以上) で指定します。
+ * @param[in] p_data 元データ
+ * @param[in] size 元データのサイズ
+ * @param[in] data_count データ断片の数
+ * @param[in] symbol_len 断片1つのバイト数
+ * @param[in] repair_index 冗長断片の通し番号 (data_count から 254 まで)
+ * @param[out] p_out 冗長断片の書き込み先 (symbol_len バイト)
+ */
+void lora_fec_encode(const uint8_t *p_data,
+                     uint32_t size,
+                     uint8_t data_count,
+                     uint16_t symbol_len,
+                     uint8_t repair_index,
+                     uint8_t *p_out);
+
+/**
+ * @brief 欠損したデータ断片を冗長断片から復元する
+ * @details バッファは symbol_len バイトごとの断片の並びとして扱います。
+ * 受信済みのデータ断片は自分の位置に (末尾の断片は0で埋めて) 格納し、
+ * 欠損した位置には代わりに受信した冗長断片を1つずつ格納しておきます。
+ * 復元はバッファ上でその場で行われ、欠損位置が元のデータ断片で置き換わります。
+ * @param[in,out] p_buffer 断片を並べたバッファ
+ * @param[in] data_count データ断片の数
+ * @param[in] symbol_len 断片1つのバイト数
+ * @param[in] p_erased 欠損したデータ断片の番号の配列 (冗長断片の格納位置)
+ * @param[in] p_repair 各欠損位置に格納した冗長断片の通し番号の配列
+ * @param[in] erased_count 欠損したデータ断片の数 (LORABBIT_FEC_MAX_REPAIR_PACKETS 以下)
+ * @retval LORABBIT_OK 復元に成功
+ * @retval LORABBIT_ERROR_INVALID_ARGUMENT 欠損数が上限を超えている、または番号が不正
+ */
+int lora_fec_decode(uint8_t *p_buffer,
+                    uint8_t data_count,
+                    uint16_t symbol_len,
+                    const uint8_t *p_erased,
+                    const uint8_t *p_repair,
+                    uint8_t erased_count);
+
+/** @} */ // end of LoRabbitFEC group
+#endif
@@ -9,6 +9,7 @@
 #include "LoRabbit_config.h"
 #include "LoRabbit_internal.h"
 #include "LoRabbit_util.h"
+#include <math.h>
 #include <stdio.h>
 #include <string.h>
 #include <tm/tmonitor.h>
@@ -16,15 +17,134 @@
 // Configuration Mode 時の Baudrate
 #define LORA_CONFIGURATION_MODE_UART_BPS 9600
 
+// UART受信用リングバッファは、割り込みハンドラが書き込み、受信処理のタスクが読み出す (書き込み側と読み出し側が1つずつ)。
+// rx_head / rx_tail はそれぞれ書き込んだ・読み出したバイト数 (65536で一周) で、
+// バッファ内の位置は LORA_RX_BUFFER_MASK との論理積で求める。溜まっているバイト数は rx_head - rx_tail
+
+#ifdef LORABBIT_USE_UART_DTC
+// リングバッファの書き込み位置から、DTC転送による受信を開始する（内部利用）
+// 割り込みハンドラ、または割り込み禁止中に呼ぶこと。読み出していないデータを上書きしないよう、
+// 転送するバイト数は max_length 以下で、リングバッファの空きと、バッファの終端までの連続した領域に収める
+static void lora_uart_dtc_start(LoraHandle_t *p_handle, uint16_t max_length) {
+    const uart_instance_t *p_uart = p_handle->hw_config.p_uart;
+    if (0 != p_handle->rx_dtc_length || NULL == p_uart || NULL == p_uart->p_cfg->p_transfer_rx) {
+        return;
+    }
+
+    uint16_t head = p_handle->rx_head;
+    uint16_t free_bytes = LORA_RX_BUFFER_SIZE - (uint16_t)(head - p_handle->rx_tail);
+    uint16_t length = LORA_RX_BUFFER_SIZE - (head & LORA_RX_BUFFER_MASK);
+    if (length > free_bytes) {
+        length = free_bytes;
+    }
+    if (length > max_length) {
+        length = max_length;
+    }
+    if (0 == length) {
+        return; // リングバッファが満杯。次のバイトは1バイトごとの受信で捨てる
+    }
+
+    uint8_t *p_dest = (uint8_t *)&p_handle->rx_buffer[head & LORA_RX_BUFFER_MASK];
+    if (FSP_SUCCESS == p_uart->p_api->read(p_uart->p_ctrl, p_dest, length)) {
+        p_handle->rx_dtc_length = length;
+    }
+}
+
+// DTC転送中のデータも含めた、リングバッファの書き込み位置を返す（内部利用）
+// 読み出している間に割り込みハンドラが書き込み位置を更新した場合 (番号が奇数か、変わった場合) は、読み直す
+static uint16_t lora_rx_head(LoraHandle_t *p_handle) {
+    const transfer_instance_t *p_transfer = p_handle->hw_config.p_uart->p_cfg->p_transfer_rx;
+    if (NULL == p_transfer) {
+        return p_handle->rx_head;
+    }
+
+    while (1) {
+        uint16_t seq = p_handle->rx_dtc_seq;
+        if (seq & 1) {
+            continue;
+        }
+        uint16_t head = p_handle->rx_head;
+        uint16_t length = p_handle->rx_dtc_length;
+        uint16_t received = 0;
+        if (length > 0) {
+            transfer_properties_t info;
+            if (FSP_SUCCESS == p_transfer->p_api->infoGet(p_transfer->p_ctrl, &info) &&
+                info.transfer_length_remaining <= length) {
+                received = (uint16_t)(length - info.transfer_length_remaining);
+            }
+        }
+        if (seq == p_handle->rx_dtc_seq) {
+            return (uint16_t)(head + received);
+        }
+    }
+}
+
+// 受信データを待つ前に、次に届いたバイトで割り込みが起きるよう、DTC転送を1バイトでやり直す（内部利用）
+// ブロックの途中までのDTC転送は、転送を止めた時点で受信済みのバイトを確定する
+static void lora_uart_dtc_wake_on_next_byte(LoraHandle_t *p_handle) {
+    const uart_instance_t *p_uart = p_handle->hw_config.p_uart;
+    if (NULL == p_uart->p_cfg->p_transfer_rx) {
+        return;
+    }
+
+    FSP_CRITICAL_SECTION_DEFINE;
+    FSP_CRITICAL_SECTION_ENTER;
+    p_handle->rx_dtc_seq++;
+    uint16_t length = p_handle->rx_dtc_length;
+    uint32_t remaining = 0;
+    if (length > 1 && FSP_SUCCESS == p_uart->p_api->readStop(p_uart->p_ctrl, &remaining)) {
+        if (remaining <= length) {
+            p_handle->rx_head = p_handle->rx_head + (uint16_t)(length - remaining);
+        }
+        p_handle->rx_dtc_length = 0;
+    }
+    lora_uart_dtc_start(p_handle, 1);
+    p_handle->rx_dtc_seq++;
+    FSP_CRITICAL_SECTION_EXIT;
+}
+#else
+#define lora_rx_head(p_handle) ((p_handle)->rx_head)
+#endif
+
+// 受信データが届くのを待っているタスクがあれば起こす（内部利用、割り込みハンドラから呼ぶ）
+static void lora_notify_rx_data(LoraHandle_t *p_handle) {
+    if (p_handle->is_waiting_rx_data) {
+        p_handle->is_waiting_rx_data = false;
+        tk_sig_sem(p_handle->rx_data_sem_id, 1);
+    }
+}
+
 void LoRabbit_UartCallbackHandler(LoraHandle_t * p_handle, uart_callback_args_t * p_args) {
+#ifdef LORABBIT_USE_UART_DTC
+    p_handle->rx_dtc_seq++; // 奇数の間は、書き込み位置とDTC転送のバイト数を更新中
+#endif
     if (UART_EVENT_RX_CHAR == p_args->event) {
-        // リングバッファをハンドルから取得する
-        uint16_t next_head = (p_handle->rx_head + 1) % LORA_RX_BUFFER_SIZE;
-        if (next_head != p_handle->rx_tail) {
-            p_handle->rx_buffer[p_handle->rx_head] = (uint8_t)p_args->data;
-            p_handle->rx_head = next_head;
+        uint16_t head = p_handle->rx_head;
+        if ((uint16_t)(head - p_handle->rx_tail) < LORA_RX_BUFFER_SIZE) {
+            p_handle->rx_buffer[head & LORA_RX_BUFFER_MASK] = (uint8_t)p_args->data;
+            __DMB(); // データを書き込んでから、書き込み位置を進める
+            p_handle->rx_head = head + 1;
+            lora_notify_rx_data(p_handle);
+        } else {
+            p_handle->rx_overflow_count++; // リングバッファが満杯
         }
+#ifdef LORABBIT_USE_UART_DTC
+        // DTC転送をしていない間に届いたバイト。次のバイトからはDTC転送で受信する
+        lora_uart_dtc_start(p_handle, LORABBIT_UART_DTC_BLOCK_SIZE);
+#endif
+    } else if (UART_EVENT_ERR_OVERFLOW == p_args->event) {
+        p_handle->rx_overflow_count++; // UARTのオーバーランで失われたバイト
     }
+#ifdef LORABBIT_USE_UART_DTC
+    else if (UART_EVENT_RX_COMPLETE == p_args->event) {
+        // DTC転送を終えたブロックを確定し、続きの転送を開始する
+        p_handle->rx_head = p_handle->rx_head + p_handle->rx_dtc_length;
+        p_handle->rx_dtc_length = 0;
+        lora_uart_dtc_start(p_handle, LORABBIT_UART_DTC_BLOCK_SIZE);
+        lora_notify_rx_data(p_handle);
+    }
+    p_handle->rx_dtc_seq++;
+#endif
 }
 
 #ifdef LORABBIT_USE_AUX_IRQ
@@ -45,11 +165,19 @@ void LoRabbit_AuxCallbackHandler(LoraHandle_t *p_handle, external_irq_callback_a
         case LORA_STATE_WAITING_RX:
             // 受信開始待ちの状態で、ピンがLowになった (立ち下がり)
             if (BSP_IO_LEVEL_LOW == pin_level) {
-                p_handle->state = LORA_STATE_IDLE;
+                p_handle->state = LORA_STATE_RECEIVING;
                 tk_sig_sem(p_handle->rx_start_sem_id, 1);
             }
             break;
 
+        case LORA_STATE_RECEIVING:
+            // 受信中の状態で、ピンがHighになった (立ち上がり)。モジュールがフレームのUARTへの出力を終えた
+            if (BSP_IO_LEVEL_HIGH == pin_level) {
+                p_handle->state = LORA_STATE_IDLE;
+                tk_sig_sem(p_handle->rx_end_sem_id, 1);
+            }
+            break;
+
         default:
             // アイドル時など、予期しない割り込みは無視
             break;
@@ -57,25 +185,75 @@ void LoRabbit_AuxCallbackHandler(LoraHandle_t *p_handle, external_irq_callback_a
 }
 #endif
 
+/**
+ * @brief リングバッファに溜まっているデータの、連続した領域
+ * @details 書き込み位置がバッファの終端で折り返していれば、2つの領域に分かれる (折り返していなければ2つ目の長さは0)
+ */
+typedef struct {
+    const uint8_t *p_data[2]; /**< 各領域の先頭 */
+    uint16_t length[2];       /**< 各領域のバイト数 */
+} LoraRxSpans_t;
+
+// 溜まっているデータを、コピーせずに連続した領域として取得する（内部利用）
+// 取得した領域は lora_rx_commit() で読み出し済みにするまで上書きされない。溜まっているバイト数を返す
+static uint16_t lora_rx_peek(LoraHandle_t *p_handle, LoraRxSpans_t *p_spans) {
+    uint16_t tail = p_handle->rx_tail;
+    uint16_t count = (uint16_t)(lora_rx_head(p_handle) - tail);
+    __DMB(); // 書き込み位置を読んでから、データを読む
+
+    uint16_t offset = tail & LORA_RX_BUFFER_MASK;
+    uint16_t first = LORA_RX_BUFFER_SIZE - offset;
+    if (first > count) {
+        first = count;
+    }
+    p_spans->p_data[0] = (const uint8_t *)&p_handle->rx_buffer[offset];
+    p_spans->length[0] = first;
+    p_spans->p_data[1] = (const uint8_t *)&p_handle->rx_buffer[0];
+    p_spans->length[1] = count - first;
+    return count;
+}
+
+// lora_rx_peek() で取得したデータのうち、先頭から length バイトを読み出し済みにする（内部利用）
+static void lora_rx_commit(LoraHandle_t *p_handle, uint16_t length) {
+    __DMB(); // データを読み終えてから、読み出し位置を進める
+    p_handle->rx_tail = p_handle->rx_tail + length;
+}
+
 static int lora_available(LoraHandle_t *p_handle) {
-    return (p_handle->rx_head - p_handle->rx_tail + LORA_RX_BUFFER_SIZE) % LORA_RX_BUFFER_SIZE;
+    return (uint16_t)(lora_rx_head(p_handle) - p_handle->rx_tail);
 }
 
-static int lora_read(LoraHandle_t *p_handle) {
-    if (p_handle->rx_head == p_handle->rx_tail) {
-        return LORABBIT_ERROR_UART_READ_FAILED;
+// リングバッファに溜まっているデータを、最大 max_len バイトまとめて読み出す（内部利用）
+// 連続した領域ごと (折り返しがあれば2回) にコピーし、読み出したバイト数を返す
+static int lora_read_bytes(LoraHandle_t *p_handle, uint8_t *p_dest, int max_len) {
+    LoraRxSpans_t spans;
+    lora_rx_peek(p_handle, &spans);
+
+    int len = 0;
+    for (int i = 0; i < 2 && len < max_len; i++) {
+        int span = spans.length[i];
+        if (span > max_len - len) {
+            span = max_len - len;
+        }
+        memcpy(&p_dest[len], spans.p_data[i], span);
+        len += span;
     }
+    lora_rx_commit(p_handle, (uint16_t)len);
+    return len;
+}
 
-    uint8_t data = p_handle->rx_buffer[p_handle->rx_tail];
-    p_handle->rx_tail = (p_handle->rx_tail + 1) % LORA_RX_BUFFER_SIZE;
-    return data;
+// リングバッファに溜まっているデータを捨てる（内部利用）
+static void lora_rx_discard(LoraHandle_t *p_handle) {
+    LoraRxSpans_t spans;
+    lora_rx_commit(p_handle, lora_rx_peek(p_handle, &spans));
 }
 
 static int lora_wait_for_tx_done(const LoraHandle_t *p_handle, int payload_size) {
 #ifdef LORABBIT_USE_AUX_IRQ
     if (LORA_PIN_UNDEFINED == p_handle->hw_config.aux) {
+        // マージンは、受信バッファをクリアした後で lora_send_frame_internal() が待つ
         int time = LoRabbit_GetTimeOnAirMsec(p_handle->current_config.air_data_rate, payload_size);
-        tk_dly_tsk(time + 10); // 計算結果に少しマージンを追加して待機
+        tk_dly_tsk(time);
         return LORABBIT_OK;
     }
 
@@ -91,9 +269,13 @@ static int lora_wait_for_tx_done(const LoraHandle_t *p_handle, int payload_size)
 }
 
 // 新しい設定を書き込む
-static ER lora_write_config(LoraHandle_t *p_handle, LoraConfigItem_t *p_config) {
+// is_temporary が true なら一時的な書き込み (0xC2) で、電源を切ると元に戻るが不揮発メモリを消耗しない
+static ER lora_write_config(LoraHandle_t *p_handle, LoraConfigItem_t *p_config, bool is_temporary) {
     const uart_instance_t *p_uart = p_handle->hw_config.p_uart;
     uint8_t command[11] = {0xC0, 0x00, 0x08}; // ヘッダ(3) + パラメータ(8)
+    if (is_temporary) {
+        command[0] = 0xC2;
+    }
     uint8_t response[11] = {0};
     uint8_t response_len = 0;
 
@@ -118,9 +300,7 @@ static ER lora_write_config(LoraHandle_t *p_handle, LoraConfigItem_t *p_config)
     p_uart->p_api->write(p_uart->p_ctrl, command, sizeof(command));
     tk_dly_tsk(100);
 
-    while (lora_available(p_handle) && response_len < sizeof(response)) {
-        response[response_len++] = lora_read(p_handle);
-    }
+    response_len = (uint8_t)lora_read_bytes(p_handle, response, sizeof(response));
 
     LORA_PRINTF("# Command Response\n");
     for (size_t i = 0; i < response_len; i++) {
@@ -157,12 +337,36 @@ int LoRabbit_Init(LoraHandle_t *p_handle, LoraHwConfig_t const *p_hw_config) {
     // リングバッファを初期化
     p_handle->rx_head = 0;
     p_handle->rx_tail = 0;
+    p_handle->rx_overflow_count = 0;
+#ifdef LORABBIT_USE_UART_DTC
+    // 受信のDTC転送を開始する (UARTはオープン済みであること)
+    p_handle->rx_dtc_length = 0;
+    p_handle->rx_dtc_seq = 0;
+    {
+        FSP_CRITICAL_SECTION_DEFINE;
+        FSP_CRITICAL_SECTION_ENTER;
+        lora_uart_dtc_start(p_handle, LORABBIT_UART_DTC_BLOCK_SIZE);
+        FSP_CRITICAL_SECTION_EXIT;
+    }
+#endif
 
     // 履歴バッファの初期化
     memset(p_handle->history, 0, sizeof(p_handle->history));
     p_handle->history_index = 0;
     p_handle->history_wrapped = false;
 
+    // 通信相手ごとのリンク状態の初期化
+    memset(p_handle->peer_links, 0, sizeof(p_handle->peer_links));
+#if LORABBIT_TP_RX_LINGER_ROUNDS > 0
+    p_handle->has_held_frame = false;
+#endif
+
+    // 大容量データ受信の状態の初期化
+    memset(&p_handle->tp_rx, 0, sizeof(p_handle->tp_rx));
+#ifdef LORABBIT_USE_MULTI_SESSION
+    memset(p_handle->tp_rx_sessions, 0, sizeof(p_handle->tp_rx_sessions));
+#endif
+
 #ifdef LORABBIT_USE_AUX_IRQ
     // AUXピンが設定されている場合のみセマフォを生成
     if (LORA_PIN_UNDEFINED != p_handle->hw_config.aux) {
@@ -189,6 +393,14 @@ int LoRabbit_Init(LoraHandle_t *p_handle, LoraHwConfig_t const *p_hw_config) {
             return p_handle->rx_start_sem_id;
         }
 
+        // 受信終了用セマフォを生成
+        p_handle->rx_end_sem_id = tk_cre_sem(&csem);
+        if (p_handle->rx_end_sem_id < LORABBIT_OK) {
+            // エラー処理 (IDが負の値で返る)
+            LORA_PRINTF("LoRa_Init: tk_cre_sem failed(%d)\n", p_handle->rx_end_sem_id);
+            return p_handle->rx_end_sem_id;
+        }
+
         // ステートを初期化
         p_handle->state = LORA_STATE_IDLE;
     }
@@ -221,17 +433,112 @@ int LoRabbit_Init(LoraHandle_t *p_handle, LoraHwConfig_t const *p_hw_config) {
         return p_handle->decoder_mutex_id;
     }
 
-    // ライブラリ保護ミューテックス
+    // AUXピンを使わない受信で、最初のバイトが届いたことをUARTの受信割り込みから知らせるセマフォ
+    p_handle->is_waiting_rx_data = false;
+    T_CSEM csem_rx_data = csem_mutex;
+    csem_rx_data.isemcnt = 0;
+    p_handle->rx_data_sem_id = tk_cre_sem(&csem_rx_data);
+    if (p_handle->rx_data_sem_id < LORABBIT_OK) {
+        LORA_PRINTF("LoRa_Init: tk_cre_sem for rx_data_sem_id failed(%d)\n", p_handle->rx_data_sem_id);
+        return p_handle->rx_data_sem_id;
+    }
+
+#ifdef LORABBIT_USE_TX_SERVICE
+    // 送信サービスは LoRabbit_StartTxService() で起動する
+    p_handle->tx_service_task_id = 0;
+    p_handle->tx_service_mbf_id = 0;
+#endif
+
+#ifdef LORABBIT_USE_RX_DISPATCHER
+    // 受信ディスパッチャは LoRabbit_StartRxDispatcher() で起動する
+    p_handle->rx_dispatcher_task_id = 0;
+    p_handle->rx_queue_mutex_id = 0;
+    memset(p_handle->rx_queues, 0, sizeof(p_handle->rx_queues));
+    memset(&p_handle->tp_tx, 0, sizeof(p_handle->tp_tx));
+    memset(&p_handle->tp_delayed_ack, 0, sizeof(p_handle->tp_delayed_ack));
+#endif
+
+#ifdef LORABBIT_USE_AGGREGATION
+    // 溜めたメッセージを期限に送信するタスクは LoRabbit_StartAggregator() で起動する
+    p_handle->agg_task_id = 0;
+    p_handle->agg_mutex_id = 0;
+    p_handle->agg_wakeup_sem_id = 0;
+    memset(p_handle->agg_buffers, 0, sizeof(p_handle->agg_buffers));
+    memset(&p_handle->agg_stats, 0, sizeof(p_handle->agg_stats));
+#endif
+
+#ifdef LORABBIT_USE_LBT
+    memset(&p_handle->lbt_stats, 0, sizeof(p_handle->lbt_stats));
+#endif
+#if defined(LORABBIT_USE_LBT) || defined(LORABBIT_USE_CHANNEL_SURVEY)
+    // RSSIの読み出しを1つずつ行うミューテックスと、RSSIの応答を受信ディスパッチャから受け取るセマフォ
+    p_handle->is_reading_noise = false;
+    p_handle->noise_dbm = 0;
+    p_handle->noise_mutex_id = tk_cre_sem(&csem_mutex);
+    if (p_handle->noise_mutex_id < LORABBIT_OK) {
+        LORA_PRINTF("LoRa_Init: tk_cre_sem for noise_mutex_id failed(%d)\n", p_handle->noise_mutex_id);
+        return p_handle->noise_mutex_id;
+    }
+    T_CSEM csem_noise = csem_mutex;
+    csem_noise.isemcnt = 0;
+    p_handle->noise_sem_id = tk_cre_sem(&csem_noise);
+    if (p_handle->noise_sem_id < LORABBIT_OK) {
+        LORA_PRINTF("LoRa_Init: tk_cre_sem for noise_sem_id failed(%d)\n", p_handle->noise_sem_id);
+        return p_handle->noise_sem_id;
+    }
+#endif
+
+#ifdef LORABBIT_USE_AIRTIME_BUDGET
+    // 送信時間の記録は、初期化した時刻から数え始める
+    SYSTIM airtime_start;
+    tk_get_tim(&airtime_start);
+    memset(&p_handle->airtime, 0, sizeof(p_handle->airtime));
+    p_handle->airtime.bucket_start_ms = airtime_start.lo;
+    p_handle->airtime_mutex_id = tk_cre_sem(&csem_mutex);
+    if (p_handle->airtime_mutex_id < LORABBIT_OK) {
+        LORA_PRINTF("LoRa_Init: tk_cre_sem for airtime_mutex_id failed(%d)\n", p_handle->airtime_mutex_id);
+        return p_handle->airtime_mutex_id;
+    }
+#endif
+
+#ifdef LORABBIT_USE_TRAFFIC_CLASS
+    p_handle->tx_class = LORABBIT_TRAFFIC_CLASS_BULK;
+    // 大容量データ送信の送信権と、トラフィッククラスごとの状態
+    // 送信権は解放する転送が待っている転送に直接渡し、渡した転送のクラスのセマフォで起こす
+    p_handle->is_tx_busy = false;
+    memset((void*)p_handle->tx_waiting_count, 0, sizeof(p_handle->tx_waiting_count));
+    memset(p_handle->tx_preempted, 0, sizeof(p_handle->tx_preempted));
+    memset(p_handle->tx_class_stats, 0, sizeof(p_handle->tx_class_stats));
+    T_CSEM csem_tx_wait = csem_mutex;
+    csem_tx_wait.isemcnt = 0;
+    for (int c = 0; c < LORABBIT_TRAFFIC_CLASS_COUNT; c++) {
+        p_handle->tx_wait_sem_id[c] = tk_cre_sem(&csem_tx_wait);
+        if (p_handle->tx_wait_sem_id[c] < LORABBIT_OK) {
+            LORA_PRINTF("LoRa_Init: tk_cre_sem for tx_wait_sem_id failed(%d)\n", p_handle->tx_wait_sem_id[c]);
+            return p_handle->tx_wait_sem_id[c];
+        }
+    }
+    for (int c = 0; c < LORABBIT_TRAFFIC_CLASS_COUNT - 1; c++) {
+        p_handle->tx_preempted[c].resume_sem_id = tk_cre_sem(&csem_tx_wait);
+        if (p_handle->tx_preempted[c].resume_sem_id < LORABBIT_OK) {
+            LORA_PRINTF("LoRa_Init: tk_cre_sem for resume_sem_id failed(%d)\n", p_handle->tx_preempted[c].resume_sem_id);
+            return p_handle->tx_preempted[c].resume_sem_id;
+        }
+    }
+#else
+    // 大容量データ送信の直列化用ミューテックス
     p_handle->api_mutex_id = tk_cre_sem(&csem_mutex);
     if (p_handle->api_mutex_id < LORABBIT_OK) {
         LORA_PRINTF("LoRa_Init: tk_cre_sem for api_mutex_id failed(%d)\n", p_handle->api_mutex_id);
         return p_handle->api_mutex_id;
     }
+#endif
 
     return LORABBIT_OK;
 }
 
-int LoRabbit_InitModule(LoraHandle_t *p_handle, LoraConfigItem_t *p_config) {
+// コンフィグモードに切り替えて設定を書き込み、ハンドルに保存するヘルパー関数（内部利用）
+static int lora_apply_config(LoraHandle_t *p_handle, LoraConfigItem_t *p_config, bool is_temporary) {
     const uart_instance_t *p_uart = p_handle->hw_config.p_uart;
     if (NULL == p_uart) {
         return LORABBIT_ERROR_INVALID_ARGUMENT;
@@ -242,7 +549,7 @@ int LoRabbit_InitModule(LoraHandle_t *p_handle, LoraConfigItem_t *p_config) {
     tk_dly_tsk(100);
 
     // 設定を書き込む
-    ER err = lora_write_config(p_handle, p_config); // (0xC0コマンドを送信する内部関数)
+    ER err = lora_write_config(p_handle, p_config, is_temporary);
     if (err != LORABBIT_OK) {
         LORA_PRINTF("LoRa_InitModule: Failed to write config.\n");
         return err;
@@ -255,40 +562,199 @@ int LoRabbit_InitModule(LoraHandle_t *p_handle, LoraConfigItem_t *p_config) {
     return LORABBIT_OK;
 }
 
-#define POST_RECEIVE_TIMEOUT_MS_DEFAULT 5
-int LoRabbit_ReceiveFrame(LoraHandle_t *p_handle, RecvFrameE220900T22SJP_t *recv_frame, TMO timeout) {
-    int len = 0;
-    memset(recv_frame->recv_data, 0x00, sizeof(recv_frame->recv_data));
+int LoRabbit_InitModule(LoraHandle_t *p_handle, LoraConfigItem_t *p_config) {
+    return lora_apply_config(p_handle, p_config, false); // (0xC0コマンドで不揮発メモリに書き込む)
+}
+
+#ifdef LORABBIT_USE_CHANNEL_SURVEY
+int lora_apply_config_temporary(LoraHandle_t *p_handle, LoraConfigItem_t *p_config) {
+    return lora_apply_config(p_handle, p_config, true); // (0xC2コマンドでレジスタだけに書き込む)
+}
+#endif
 
 #ifdef LORABBIT_USE_AUX_IRQ
-    // AUXピンが未接続の場合は、このイベント駆動の受信はできない
-    if (LORA_PIN_UNDEFINED == p_handle->hw_config.aux) {
-        LORA_PRINTF((UB*)"# ERROR: LoRa_ReceiveFrame in IRQ mode requires AUX pin.\n");
-        return LORABBIT_ERROR_UNSUPPORTED; // 未サポートエラー
+// 受信開始 (AUX Low) を待つ状態にする（内部利用）
+// 他のタスクが送信完了を待っている間は、その通知を奪わないよう false を返す
+static bool lora_arm_rx(LoraHandle_t *p_handle) {
+    bool is_armed = false;
+    tk_dis_dsp();
+    if (LORA_STATE_WAITING_TX != p_handle->state) {
+        p_handle->state = LORA_STATE_WAITING_RX;
+        is_armed = true;
     }
+    tk_ena_dsp();
+    return is_armed;
+}
 
-    // 受信開始前にステートを設定
-    p_handle->state = LORA_STATE_WAITING_RX;
-
-    // 受信開始(AUX Low)をセマフォで待つ
-    ER err = tk_wai_sem(p_handle->rx_start_sem_id, 1, timeout);
-    if (err != LORABBIT_OK) {
+// 受信開始待ちと受信終了待ちをやめる（内部利用）
+// 待っている間に他のタスクが送信を始めていれば、その送信完了待ちのステートは残す
+static void lora_disarm_rx(LoraHandle_t *p_handle) {
+    tk_dis_dsp();
+    if (LORA_STATE_WAITING_RX == p_handle->state || LORA_STATE_RECEIVING == p_handle->state) {
         p_handle->state = LORA_STATE_IDLE;
+    }
+    tk_ena_dsp();
+}
+
+// 受信したフレームのUARTへの出力の終了 (AUX High) を待つ（内部利用）
+// 受信開始の立ち下がりを検知していなくても (待つ前にデータが届いていた場合)、AUXがLowなら立ち上がりを待つ。
+// 他のタスクの送信中や、最大長のフレームを出力できる時間を過ぎても立ち上がらなければ false を返す
+static bool lora_wait_for_rx_end(LoraHandle_t *p_handle) {
+    tk_dis_dsp();
+    if (LORA_STATE_WAITING_TX == p_handle->state) {
+        tk_ena_dsp();
+        return false; // AUXは送信の完了を示している
+    }
+    p_handle->state = LORA_STATE_RECEIVING;
+    tk_ena_dsp();
+
+    bsp_io_level_t pin_level;
+    R_IOPORT_PinRead(&g_ioport_ctrl, p_handle->hw_config.aux, &pin_level);
+    if (BSP_IO_LEVEL_HIGH == pin_level) {
+        // 出力を終えている。割り込みハンドラが立ち上がりを通知していれば、その通知を捨てる
+        lora_disarm_rx(p_handle);
+        tk_wai_sem(p_handle->rx_end_sem_id, 1, TMO_POL);
+        return true;
+    }
+
+    // 最大長のフレームとRSSIバイトをUARTで出力する時間に、マージンを加えて待つ
+    uint32_t baud = lora_enum_to_fsp_baud(p_handle->current_config.baud_rate);
+    TMO timeout = (TMO)(sizeof(((RecvFrameE220900T22SJP_t *)0)->recv_data) * 10 * 1000 / baud) + 10;
+    ER err = tk_wai_sem(p_handle->rx_end_sem_id, 1, timeout);
+    if (err != E_OK) {
+        lora_disarm_rx(p_handle);
+        return false;
+    }
+    return true;
+}
+#endif
+
+// AUXピンを使わずに、受信データが届くのを待つ（内部利用）
+// UARTの受信割り込みで最初のバイトが届いたことを知らされるまで、最大 timeout ミリ秒ブロックする
+static ER lora_wait_for_rx_data(LoraHandle_t *p_handle, TMO timeout) {
+    if (lora_available(p_handle)) {
+        return E_OK;
+    }
+
+    tk_wai_sem(p_handle->rx_data_sem_id, 1, TMO_POL); // 前回の待ちの後に届いた通知を捨てる
+    p_handle->is_waiting_rx_data = true;
+#ifdef LORABBIT_USE_UART_DTC
+    lora_uart_dtc_wake_on_next_byte(p_handle);
+#endif
+    if (lora_available(p_handle)) {
+        // 待つ状態にする直前に届いていた
+        p_handle->is_waiting_rx_data = false;
+        return E_OK;
+    }
+
+    ER err = tk_wai_sem(p_handle->rx_data_sem_id, 1, timeout);
+    p_handle->is_waiting_rx_data = false;
+    return err;
+}
+
+// 受信の開始を待つ（内部利用）
+// AUXピンがあれば立ち下がりを、なければ最初のバイトが届くのを待つ。受信が始まっていれば E_OK を返す
+static ER lora_wait_for_rx_start(LoraHandle_t *p_handle, TMO timeout) {
+#ifdef LORABBIT_USE_AUX_IRQ
+    if (LORA_PIN_UNDEFINED != p_handle->hw_config.aux) {
+        // 受信待ちに入る前に届いたデータが残っていれば、AUXの立ち下がりを待たずに読み出す
+        while (0 == lora_available(p_handle)) {
+            // 受信開始前にステートを設定
+            if (lora_arm_rx(p_handle)) {
+                if (lora_available(p_handle)) {
+                    // ステートを設定する直前に受信が始まっていた
+                    lora_disarm_rx(p_handle);
+                    break;
+                }
+
+                // 受信開始(AUX Low)をセマフォで待つ
+                ER err = tk_wai_sem(p_handle->rx_start_sem_id, 1, timeout);
+                if (err != E_OK) {
+                    lora_disarm_rx(p_handle);
+                    return err;
+                }
+                break;
+            }
+
+            // 他のタスクの送信中は、送信完了まで待つ
+            if (TMO_POL == timeout) {
+                return E_TMOUT;
+            }
+            tk_dly_tsk(1);
+            if (timeout > 0) {
+                timeout--;
+            }
+        }
+        return E_OK;
+    }
+#endif
+    return lora_wait_for_rx_data(p_handle, timeout);
+}
+
+#define POST_RECEIVE_TIMEOUT_MS_DEFAULT 5
+#define POST_RECEIVE_TIMEOUT_MS_NO_AUX 10
+// 1フレームを受信する（内部利用）
+// pf_frame_length があれば、データ間の空き時間を待たずに、判定したフレームの長さ分が届いた時点で完了する
+static int lora_receive_frame(LoraHandle_t *p_handle, RecvFrameE220900T22SJP_t *recv_frame, TMO timeout,
+                              LoRabbit_FrameLengthFunc_t pf_frame_length, void *p_context) {
+    int len = 0;
+#if LORABBIT_TP_RX_LINGER_ROUNDS > 0
+    // 大容量データの受信完了後、再送を待つ間に受信したフレームがあれば先に返す
+    if (p_handle->has_held_frame) {
+        memcpy(recv_frame, &p_handle->held_frame, sizeof(RecvFrameE220900T22SJP_t));
+        p_handle->has_held_frame = false;
+        return (int)recv_frame->recv_data_len;
+    }
+#endif
+    memset(recv_frame->recv_data, 0x00, sizeof(recv_frame->recv_data));
+
+    ER err = lora_wait_for_rx_start(p_handle, timeout);
+    if (err != E_OK) {
         return (err == E_TMOUT) ? 0 : err; // タイムアウトなら受信データなし(0)、それ以外はエラーを返す
     }
 
-    // 受信が開始されたので、UARTバッファからデータを最後まで読み出す
-    // (データ受信完了の明確な通知はないため、データ間が一定時間空いたら完了とみなす)
-    int post_receive_timeout_ms = POST_RECEIVE_TIMEOUT_MS_DEFAULT; // データ間のタイムアウト
+    int post_receive_gap_ms = POST_RECEIVE_TIMEOUT_MS_NO_AUX;
+#ifdef LORABBIT_USE_AUX_IRQ
+    if (LORA_PIN_UNDEFINED != p_handle->hw_config.aux) {
+        // モジュールはフレームをUARTへ出力し終えるとAUXをHighに戻すので、その時点で届いているデータが1フレーム
+        if (lora_wait_for_rx_end(p_handle)) {
+            len = lora_read_bytes(p_handle, recv_frame->recv_data, (int)sizeof(recv_frame->recv_data) - 1);
+        }
+        post_receive_gap_ms = POST_RECEIVE_TIMEOUT_MS_DEFAULT;
+    }
+#endif
+
+    // 受信終了を検知できない場合は、UARTバッファからデータを最後まで読み出す
+    // (データ間が一定時間空いたら完了とみなす。フレームの長さを判定できれば、その長さ分が届いた時点で完了)
+    int frame_len = (NULL != pf_frame_length) ? 0 : -1; // RSSIバイトを含むフレームの長さ。0:未判定, 負値:判定しない
+    int post_receive_timeout_ms = (len > 0) ? 0 : post_receive_gap_ms; // データ間のタイムアウト
     while (post_receive_timeout_ms > 0) {
-        if (lora_available(p_handle)) {
-            recv_frame->recv_data[len] = lora_read(p_handle);
-            len++;
+        // フレームの長さを判定する場合は、次のフレームのデータまで読み出さないよう、
+        // 長さが分かるまでは1バイトずつ、分かった後はその長さまでを読み出す
+        int max_len = (int)sizeof(recv_frame->recv_data) - 1 - len;
+        if (0 == frame_len) {
+            max_len = 1;
+        } else if (frame_len > 0 && frame_len - len < max_len) {
+            max_len = frame_len - len;
+        }
+        int read_len = lora_read_bytes(p_handle, &recv_frame->recv_data[len], max_len);
+        if (read_len > 0) {
+            len += read_len;
             if (len >= (int)sizeof(recv_frame->recv_data) - 1) {
                 break; // バッファ満杯
             }
+            if (0 == frame_len) {
+                int length = pf_frame_length(recv_frame->recv_data, len, p_context);
+                frame_len = (length > 0) ? length + 1 : length;
+            }
+            if (len == frame_len) {
+                break; // フレームの長さ分が届いた
+            }
+            if (frame_len > 0 && len > frame_len) {
+                frame_len = -1; // 判定した長さを超えて届いた。データ間の空き時間で判定する
+            }
             // タイムアウトをリセット
-            post_receive_timeout_ms = POST_RECEIVE_TIMEOUT_MS_DEFAULT;
+            post_receive_timeout_ms = post_receive_gap_ms;
         } else {
             tk_dly_tsk(1); // 1ms待機
             post_receive_timeout_ms--;
@@ -300,39 +766,162 @@ int LoRabbit_ReceiveFrame(LoraHandle_t *p_handle, RecvFrameE220900T22SJP_t *recv
         recv_frame->rssi = recv_frame->recv_data[len - 1] - 256;
     }
     return len > 0 ? (int)recv_frame->recv_data_len : 0;
-#else
-    // 従来のポーリング方式で受信を待つ
-    while (1) {
-        while (lora_available(p_handle)) {
-            recv_frame->recv_data[len] = lora_read(p_handle);
-            len++;
-            if (len >= (int)sizeof(recv_frame->recv_data) -1) {
-                // バッファが満杯になったら強制的に終了
-                goto receive_complete;
-            }
+}
+
+int LoRabbit_ReceiveFrame(LoraHandle_t *p_handle, RecvFrameE220900T22SJP_t *recv_frame, TMO timeout) {
+#ifdef LORABBIT_USE_RX_DISPATCHER
+    // 受信ディスパッチャの起動中は、振り分け済みのフレームから受け取る
+    if (p_handle->rx_dispatcher_task_id > 0) {
+        return lora_rx_queue_pop(p_handle, LORABBIT_RX_CLASS_RAW, recv_frame, timeout);
+    }
+#endif
+    return lora_receive_frame_raw(p_handle, recv_frame, timeout);
+}
+
+int LoRabbit_ReceiveFrameWithLength(LoraHandle_t *p_handle, RecvFrameE220900T22SJP_t *recv_frame, TMO timeout,
+                                    LoRabbit_FrameLengthFunc_t pf_frame_length, void *p_context) {
+#ifdef LORABBIT_USE_RX_DISPATCHER
+    // 受信ディスパッチャの起動中は、フレームの終わりをディスパッチャが判定している
+    if (p_handle->rx_dispatcher_task_id > 0) {
+        return lora_rx_queue_pop(p_handle, LORABBIT_RX_CLASS_RAW, recv_frame, timeout);
+    }
+#endif
+    return lora_receive_frame(p_handle, recv_frame, timeout, pf_frame_length, p_context);
+}
+
+int lora_receive_frame_raw(LoraHandle_t *p_handle, RecvFrameE220900T22SJP_t *recv_frame, TMO timeout) {
+    return lora_receive_frame(p_handle, recv_frame, timeout, NULL, NULL);
+}
+
+#if defined(LORABBIT_USE_LBT) || defined(LORABBIT_USE_CHANNEL_SURVEY)
+// RSSI読み出しコマンド (周囲のRSSIノイズのレジスタ 0x00 から1バイト) と、その応答の先頭
+static const uint8_t s_noise_command[] = {0xC0, 0xC1, 0xC2, 0xC3, 0x00, 0x01};
+static const uint8_t s_noise_reply[]   = {0xC1, 0x00, 0x01};
+
+#ifdef LORABBIT_USE_RX_DISPATCHER
+bool lora_take_noise_reply(LoraHandle_t *p_handle, const RecvFrameE220900T22SJP_t *p_frame, int len) {
+    // 応答には受信フレームのRSSIバイトが付かないため、最後の1バイト (RSSIノイズ) は rssi に入る
+    if (!p_handle->is_reading_noise || len != (int)sizeof(s_noise_reply) ||
+        memcmp(p_frame->recv_data, s_noise_reply, sizeof(s_noise_reply)) != 0) {
+        return false;
+    }
+    p_handle->noise_dbm = p_frame->rssi;
+    p_handle->is_reading_noise = false;
+    tk_sig_sem(p_handle->noise_sem_id, 1);
+    return true;
+}
+#endif
+
+// 受信ディスパッチャの起動中は、ディスパッチャが応答を受け取って渡す (ディスパッチャ自身が読み出す場合を除く)
+int lora_read_ambient_noise(LoraHandle_t *p_handle, int16_t *p_noise_dbm) {
+    const uart_instance_t *p_uart = p_handle->hw_config.p_uart;
+
+#ifdef LORABBIT_USE_RX_DISPATCHER
+    if (p_handle->rx_dispatcher_task_id > 0 && tk_get_tid() != p_handle->rx_dispatcher_task_id) {
+        tk_wai_sem(p_handle->noise_sem_id, 1, TMO_POL); // 前回タイムアウトした後に届いた通知を捨てる
+        p_handle->is_reading_noise = true;
+        p_uart->p_api->write(p_uart->p_ctrl, s_noise_command, sizeof(s_noise_command));
+        ER err = tk_wai_sem(p_handle->noise_sem_id, 1, LORABBIT_LBT_SENSE_TIMEOUT_MS);
+        p_handle->is_reading_noise = false;
+        if (err != E_OK) {
+            return LORABBIT_ERROR_TIMEOUT;
         }
+        *p_noise_dbm = p_handle->noise_dbm;
+        return LORABBIT_OK;
+    }
+#endif
 
-        if ((lora_available(p_handle) == 0) && (len > 0)) {
-            // データが来ていて、かつバッファが空になったら、少し待ってから再度確認
-            // それでもデータがなければ受信完了とみなす
-            tk_dly_tsk(10);
-            if (lora_available(p_handle) == 0) {
-                goto receive_complete;
-            }
+    // 読み出していない受信データが残っていると、応答と区別できないため確かめない
+    // (受信側のタスクが読み出すデータなので、ここでは捨てない)
+    if (lora_available(p_handle)) {
+        return LORABBIT_ERROR_RETRY;
+    }
+    p_uart->p_api->write(p_uart->p_ctrl, s_noise_command, sizeof(s_noise_command));
+
+    uint8_t reply[sizeof(s_noise_reply) + 1];
+    size_t reply_len = 0;
+    for (int waited_ms = 0; reply_len < sizeof(reply); ) {
+        size_t read_len = (size_t)lora_read_bytes(p_handle, &reply[reply_len], (int)(sizeof(reply) - reply_len));
+        if (read_len > 0) {
+            reply_len += read_len;
+        } else if (waited_ms++ < LORABBIT_LBT_SENSE_TIMEOUT_MS) {
+            tk_dly_tsk(1);
+        } else {
+            return LORABBIT_ERROR_TIMEOUT;
         }
+    }
+    if (memcmp(reply, s_noise_reply, sizeof(s_noise_reply)) != 0) {
+        return LORABBIT_ERROR_INVALID_PACKET;
+    }
+    *p_noise_dbm = (int16_t)reply[sizeof(s_noise_reply)] - 256;
+    return LORABBIT_OK;
+}
+#endif
 
-        // 受信データがまだない場合、待つ
-        tk_dly_tsk(100);
+#ifdef LORABBIT_USE_LBT
+// チャンネルが空くまで待つヘルパー関数（内部利用）
+// 使用中なら、確認のたびに倍になる範囲からランダムに選んだ時間だけ待ってから確かめ直す
+static int lora_lbt_wait_for_clear_channel(LoraHandle_t *p_handle) {
+    // RSSIノイズの出力が無効な設定では、モジュールがコマンドに応答しない
+    if (LORA_FLAG_ENABLED != p_handle->current_config.rssi_ambient_noise_flag) {
+        return LORABBIT_OK;
     }
 
-receive_complete:
-    if (len > 0) {
-        recv_frame->recv_data_len = len - 1;
-        recv_frame->rssi = recv_frame->recv_data[len - 1] - 256;
+    LoRabbit_LbtStats_t *p_stats = &p_handle->lbt_stats;
+    uint32_t backoff_window_ms = LORABBIT_LBT_BACKOFF_MIN_MS;
+    bool is_deferred = false;
+    for (int attempt = 0; attempt < LORABBIT_LBT_MAX_ATTEMPTS; attempt++) {
+        tk_wai_sem(p_handle->noise_mutex_id, 1, TMO_FEVR);
+        int16_t noise_dbm = 0;
+        int err = lora_read_ambient_noise(p_handle, &noise_dbm);
+        p_stats->sense_count++;
+        if (err < 0) {
+            // 確かめられなければ、送信を止めずにそのまま送る
+            // (受信データが残っている場合は、相手の送信が終わった直後なのでチャンネルは空いている見込み)
+            p_stats->sense_failed_count++;
+            tk_sig_sem(p_handle->noise_mutex_id, 1);
+            LORA_PRINTF("LoRa_LBT: failed to read ambient noise(%d)\n", err);
+            return LORABBIT_OK;
+        }
+        p_stats->last_noise_dbm = noise_dbm;
+        if (noise_dbm < LORABBIT_LBT_BUSY_THRESHOLD_DBM) {
+            if (is_deferred) {
+                p_stats->deferred_count++;
+            }
+            tk_sig_sem(p_handle->noise_mutex_id, 1);
+            return LORABBIT_OK;
+        }
+        p_stats->busy_count++;
+        is_deferred = true;
+
+        uint32_t backoff_ms = 1 + lora_random(p_handle) % backoff_window_ms;
+        p_stats->total_backoff_ms += backoff_ms;
+        tk_sig_sem(p_handle->noise_mutex_id, 1);
+        LORA_PRINTF("LoRa_LBT: channel busy (%d dBm), backoff %lu ms\n", noise_dbm, (unsigned long)backoff_ms);
+        tk_dly_tsk(backoff_ms);
+
+        backoff_window_ms *= 2;
+        if (backoff_window_ms > LORABBIT_LBT_BACKOFF_MAX_MS) {
+            backoff_window_ms = LORABBIT_LBT_BACKOFF_MAX_MS;
+        }
     }
-    return (int)recv_frame->recv_data_len;
-#endif
+
+    tk_wai_sem(p_handle->noise_mutex_id, 1, TMO_FEVR);
+    p_stats->gave_up_count++;
+    tk_sig_sem(p_handle->noise_mutex_id, 1);
+    return LORABBIT_ERROR_CHANNEL_BUSY;
+}
+
+int LoRabbit_GetLbtStats(LoraHandle_t *p_handle, LoRabbit_LbtStats_t *p_stats) {
+    if (NULL == p_handle || NULL == p_stats) {
+        return LORABBIT_ERROR_INVALID_ARGUMENT;
+    }
+    tk_wai_sem(p_handle->noise_mutex_id, 1, TMO_FEVR);
+    memcpy(p_stats, &p_handle->lbt_stats, sizeof(LoRabbit_LbtStats_t));
+    tk_sig_sem(p_handle->noise_mutex_id, 1);
+    return LORABBIT_OK;
 }
+#endif
 
 ER lora_send_frame_fire_and_forget_internal(LoraHandle_t *p_handle,
                                             uint16_t target_address,
@@ -358,6 +947,20 @@ ER lora_send_frame_fire_and_forget_internal(LoraHandle_t *p_handle,
         return LORABBIT_ERROR_INVALID_ARGUMENT;
     }
 
+#ifdef LORABBIT_USE_AIRTIME_BUDGET
+    // ACKなどの短い応答は、予算の予約分も使う
+    int err = lora_airtime_acquire(p_handle, size, true);
+    if (err < 0) {
+        return err;
+    }
+#endif
+#ifdef LORABBIT_USE_LBT
+    int lbt_err = lora_lbt_wait_for_clear_channel(p_handle);
+    if (lbt_err < 0) {
+        return lbt_err;
+    }
+#endif
+
     uint8_t frame[3 + 197]; // 最大サイズでバッファ確保
     frame[0] = target_address >> 8;
     frame[1] = target_address & 0xff;
@@ -366,7 +969,7 @@ ER lora_send_frame_fire_and_forget_internal(LoraHandle_t *p_handle,
     int frame_size = 3 + size;
 
     p_uart->p_api->write(p_uart->p_ctrl, frame, frame_size);
-    // 書き込み後、待たない
+    // 書き込み後、待たない (送信完了の時刻はエアタイムからの見込みのまま)
     
     // 短いdelayで送信処理の開始を待つ
     tk_dly_tsk(10);
@@ -375,6 +978,11 @@ ER lora_send_frame_fire_and_forget_internal(LoraHandle_t *p_handle,
 }
 
 int LoRabbit_SendFrame(LoraHandle_t *p_handle, uint16_t target_address, uint8_t target_channel, uint8_t *p_send_data, int size) {
+    return lora_send_frame_internal(p_handle, target_address, target_channel, p_send_data, size, false);
+}
+
+int lora_send_frame_internal(LoraHandle_t *p_handle, uint16_t target_address, uint8_t target_channel,
+                             uint8_t *p_send_data, int size, bool may_use_reserve) {
     int err = 0;
     const uart_instance_t *p_uart = p_handle->hw_config.p_uart;
     const LoraConfigItem_t *p_config = &p_handle->current_config;
@@ -394,6 +1002,23 @@ int LoRabbit_SendFrame(LoraHandle_t *p_handle, uint16_t target_address, uint8_t
         return LORABBIT_ERROR_INVALID_ARGUMENT;
     }
 
+#ifdef LORABBIT_USE_AIRTIME_BUDGET
+    err = lora_airtime_acquire(p_handle, size, may_use_reserve);
+    if (err < 0) {
+        return err;
+    }
+#else
+    (void)may_use_reserve;
+#endif
+#ifdef LORABBIT_USE_LBT
+    // 予算を確保してから (休止時間を待ってから) チャンネルを確かめる。
+    // 空かずに送信しなかった場合も差し引いた予算は戻さない (送信時間を多めに数える側に倒す)
+    err = lora_lbt_wait_for_clear_channel(p_handle);
+    if (err < 0) {
+        return err;
+    }
+#endif
+
     uint8_t frame[3 + 197]; // 最大サイズでバッファ確保
     frame[0] = target_address >> 8;
     frame[1] = target_address & 0xff;
@@ -419,17 +1044,38 @@ int LoRabbit_SendFrame(LoraHandle_t *p_handle, uint16_t target_address, uint8_t
     err = lora_wait_for_tx_done(p_handle, frame_size);
     if (err < 0) {
         LORA_PRINTF("LoRa_SendFrame: lora_wait_for_tx_done timeout\n");
+#ifdef LORABBIT_USE_AUX_IRQ
+        // 送信完了待ちのままだと受信待ちに入れないため、ステートを戻す
+        p_handle->state = LORA_STATE_IDLE;
+#endif
     }
+#ifdef LORABBIT_USE_AIRTIME_BUDGET
+    lora_airtime_on_tx_done(p_handle);
+#endif
 
-    // 送信後にモジュールから応答データが返る場合があるため、バッファをクリア
-    while (lora_available(p_handle)) {
-        lora_read(p_handle);
+#ifdef LORABBIT_USE_RX_DISPATCHER
+    // 受信ディスパッチャの起動中は、送信中に届いたフレームをディスパッチャが読み出すので残しておく
+    bool is_dispatched = (p_handle->rx_dispatcher_task_id > 0);
+#else
+    bool is_dispatched = false;
+#endif
+    if (!is_dispatched) {
+        // 送信後にモジュールから応答データが返る場合があるため、バッファをクリア
+        lora_rx_discard(p_handle);
     }
 
+#ifdef LORABBIT_USE_AUX_IRQ
+    if (LORA_PIN_UNDEFINED == p_handle->hw_config.aux) {
+        // 空中占有時間から推定した送信完了に、少しマージンを追加して待機。
+        // 相手がすぐに応答すると、マージンの間に応答が届くことがあるので、バッファをクリアした後で待つ
+        tk_dly_tsk(10);
+    }
+#endif
     return LORABBIT_OK;
 }
 
-int LoRabbit_GetTimeOnAirMsec(LoraAirDateRate_t air_data_rate, uint8_t payload_size_bytes)
+// LoRaパケットの空中占有時間を秒単位で計算する
+static double lora_time_on_air_sec(LoraAirDateRate_t air_data_rate, uint8_t payload_size_bytes)
 {
     // air_data_rate から SF と BW を抽出
     int spreading_factor = get_spreading_factor_from_air_data_rate(air_data_rate);
@@ -463,9 +1109,26 @@ int LoRabbit_GetTimeOnAirMsec(LoraAirDateRate_t air_data_rate, uint8_t payload_s
     // ペイロードの時間を計算
     double t_payload = payload_symbol_count_part1 * t_sym;
 
-    // 合計時間を計算し、ミリ秒に変換して返す
-    double total_time_sec = t_preamble + t_payload;
-    return (int)ceil(total_time_sec * 1000.0);
+    // 合計時間を計算して返す
+    return t_preamble + t_payload;
+}
+
+int LoRabbit_GetTimeOnAirMsec(LoraAirDateRate_t air_data_rate, uint8_t payload_size_bytes)
+{
+    return (int)ceil(lora_time_on_air_sec(air_data_rate, payload_size_bytes) * 1000.0);
+}
+
+uint32_t LoRabbit_GetTimeOnAirUsec(LoraAirDateRate_t air_data_rate, uint8_t payload_size_bytes)
+{
+    return (uint32_t)ceil(lora_time_on_air_sec(air_data_rate, payload_size_bytes) * 1000000.0);
+}
+
+int LoRabbit_GetRxOverflowCount(LoraHandle_t *p_handle, uint32_t *p_count) {
+    if (NULL == p_handle || NULL == p_count) {
+        return LORABBIT_ERROR_INVALID_ARGUMENT;
+    }
+    *p_count = p_handle->rx_overflow_count;
+    return LORABBIT_OK;
 }
 
 void LoRabbit_SwitchToNormalMode(LoraHandle_t *p_handle) {
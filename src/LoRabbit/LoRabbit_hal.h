@@ -43,13 +43,32 @@ int LoRabbit_InitModule(LoraHandle_t *p_handle, LoraConfigItem_t *p_config);
  * @brief LoRaフレームを1つ受信する
  * @details UARTからデータを受信し、1つのLoRaフレームとして返します。
  * この関数はデータを受信するまで、あるいはタイムアウトするまでブロックします。
+ * 受信ディスパッチャ (LoRabbit_StartRxDispatcher()) の起動中は、大容量データ転送のACKとパケット以外の
+ * フレームだけを、ディスパッチャが振り分けたキューから受け取ります。
  * @param[in,out] p_handle 操作対象のハンドル
  * @param[out] recv_frame LoRa受信データの格納先
- * @param[in] timeout [割り込み利用時のみ] 受信開始を待つタイムアウト値(ms)。ポーリング時は無視されます。
+ * @param[in] timeout 受信開始を待つタイムアウト値(ms)。AUXピンを使わない場合は、最初のバイトが届くのを待つ時間です。
  * @return 0より大きい値: 受信したペイロード長, 0:タイムアウト(受信なし), 負値:エラー
  */
 int LoRabbit_ReceiveFrame(LoraHandle_t *p_handle, RecvFrameE220900T22SJP_t *recv_frame, TMO timeout);
 
+/**
+ * @brief フレームの長さを判定しながら、LoRaフレームを1つ受信する
+ * @details LoRabbit_ReceiveFrame() と同じですが、フレームの終わりをデータ間の空き時間で判定する場合
+ * (AUXピンを使わない場合や、他のタスクの送信中でAUXの立ち上がりを使えない場合) に、届いたデータから
+ * pf_frame_length でフレームの長さを求め、その長さ分 (とRSSIバイト) が届いた時点で受信を完了します。
+ * 判定した長さを超えてデータが届いた場合や、長さを判定できないフレームは、データ間の空き時間で判定します。
+ * 受信ディスパッチャの起動中は LoRabbit_ReceiveFrame() と同じで、pf_frame_length は呼ばれません。
+ * @param[in,out] p_handle 操作対象のハンドル
+ * @param[out] recv_frame LoRa受信データの格納先
+ * @param[in] timeout 受信開始を待つタイムアウト値(ms)
+ * @param[in] pf_frame_length フレームの長さを判定する関数 (NULLで LoRabbit_ReceiveFrame() と同じ)
+ * @param[in] p_context pf_frame_length に渡す任意のポインタ
+ * @return 0より大きい値: 受信したペイロード長, 0:タイムアウト(受信なし), 負値:エラー
+ */
+int LoRabbit_ReceiveFrameWithLength(LoraHandle_t *p_handle, RecvFrameE220900T22SJP_t *recv_frame, TMO timeout,
+                                    LoRabbit_FrameLengthFunc_t pf_frame_length, void *p_context);
+
 /**
  * @brief LoRaフレームを1つ送信する
  * @details 指定されたデータからLoRaフレームを組み立てて送信します。
@@ -62,6 +81,8 @@ int LoRabbit_ReceiveFrame(LoraHandle_t *p_handle, RecvFrameE220900T22SJP_t *recv
  * @retval LORABBIT_OK 成功
  * @retval LORABBIT_ERROR_INVALID_ARGUMENT 引数が不正（サイズ超過など）
  * @retval LORABBIT_ERROR_TIMEOUT タイムアウト（割り込み利用時）
+ * @retval LORABBIT_ERROR_AIRTIME_EXHAUSTED 送信時間の制限 (LORABBIT_USE_AIRTIME_BUDGET) に収まらず、送信しなかった
+ * @retval LORABBIT_ERROR_CHANNEL_BUSY キャリアセンス (LORABBIT_USE_LBT) でチャンネルが空かず、送信しなかった
  */
 int LoRabbit_SendFrame(LoraHandle_t *p_handle, uint16_t target_address, uint8_t target_channel, uint8_t *p_send_data, int size);
 
@@ -73,6 +94,39 @@ int LoRabbit_SendFrame(LoraHandle_t *p_handle, uint16_t target_address, uint8_t
  */
 int LoRabbit_GetTimeOnAirMsec(LoraAirDateRate_t air_data_rate, uint8_t payload_size_bytes);
 
+/**
+ * @brief LoRaパケットの空中占有時間(Time on Air)をマイクロ秒単位で計算する
+ * @details シンボル単位の違いを比較できるよう、LoRabbit_GetTimeOnAirMsec() より細かい単位で返します。
+ * @param[in] air_data_rate 使用する空中データレート
+ * @param[in] payload_size_bytes ペイロードのバイト数
+ * @return 計算された時間 (マイクロ秒)
+ */
+uint32_t LoRabbit_GetTimeOnAirUsec(LoraAirDateRate_t air_data_rate, uint8_t payload_size_bytes);
+
+/**
+ * @brief UART受信で失われたバイト数を取得する
+ * @details リングバッファ (LORABBIT_RX_BUFFER_SIZE バイト) が満杯で捨てたバイトと、UARTのオーバーランで
+ * 失われたバイトの数です。増えている場合は、受信したフレームの読み出しが間に合っていません。
+ * @param[in] p_handle 操作対象のハンドル
+ * @param[out] p_count バイト数の格納先 (LoRabbit_Init() からの累計)
+ * @retval LORABBIT_OK 成功
+ * @retval LORABBIT_ERROR_INVALID_ARGUMENT 引数がNULL
+ */
+int LoRabbit_GetRxOverflowCount(LoraHandle_t *p_handle, uint32_t *p_count);
+
+#ifdef LORABBIT_USE_LBT
+/**
+ * @brief 送信前のキャリアセンス (Listen Before Talk) の統計を取得する
+ * @details LORABBIT_USE_LBT 有効時は、LoRabbit_SendFrame() とACKの送信の前に周囲のRSSIノイズを確かめ、
+ * LORABBIT_LBT_BUSY_THRESHOLD_DBM 以上ならランダムな時間待ってから確かめ直します。
+ * @param[in] p_handle 操作対象のハンドル
+ * @param[out] p_stats 統計の格納先
+ * @retval LORABBIT_OK 成功
+ * @retval LORABBIT_ERROR_INVALID_ARGUMENT 引数がNULL
+ */
+int LoRabbit_GetLbtStats(LoraHandle_t *p_handle, LoRabbit_LbtStats_t *p_stats);
+#endif
+
 /**
  * @name LoRa Module Operation Modes
  * @brief LoRaモジュールの動作モードを切り替える関数群
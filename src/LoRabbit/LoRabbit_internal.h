@@ -44,4 +44,258 @@ ER lora_send_frame_fire_and_forget_internal(LoraHandle_t *p_handle,
                                             uint8_t target_channel,
                                             uint8_t *p_send_data,
                                             int size);
+
+/**
+ * @brief LoRaフレームを送信し、完了を待つ
+ * @details LoRabbit_SendFrame() の本体です。エアタイム予算の機能が有効な場合、
+ * may_use_reserve でACKと制御クラスのための予約分を使えるかを指定します。
+ * @param[in] may_use_reserve 予算の予約分 (LORABBIT_AIRTIME_RESERVE_PERCENT) を使えるか
+ * @retval LORABBIT_OK 成功
+ * @retval LORABBIT_ERROR_AIRTIME_EXHAUSTED 予算が空かず送信しなかった
+ * @retval LORABBIT_ERROR_CHANNEL_BUSY キャリアセンスでチャンネルが空かず送信しなかった
+ */
+int lora_send_frame_internal(LoraHandle_t *p_handle, uint16_t target_address, uint8_t target_channel,
+                             uint8_t *p_send_data, int size, bool may_use_reserve);
+
+/**
+ * @brief 通信相手のリンク状態を取得する。未登録なら登録する
+ * @details テーブルが満杯の場合は、最も長く使われていないエントリを入れ替えます。
+ * 新規登録時や空中データレートが変わった時は、エアタイムの計算値から推定値を初期化します。
+ * @param[in,out] p_handle 操作対象のハンドル
+ * @param[in] address 通信相手のアドレス
+ * @return リンク状態へのポインタ
+ */
+LoRabbit_PeerLink_t *lora_link_get(LoraHandle_t *p_handle, uint16_t address);
+
+/**
+ * @brief 登録済みの通信相手のリンク状態を探す (登録はしない)
+ * @return リンク状態へのポインタ。未登録ならNULL
+ */
+LoRabbit_PeerLink_t *lora_link_find(LoraHandle_t *p_handle, uint16_t address);
+
+/**
+ * @brief ACKを待つ時間 (再送タイムアウト) を返す
+ */
+TMO lora_link_ack_timeout(const LoRabbit_PeerLink_t *p_link);
+
+/**
+ * @brief 今回のACK待ちで待つ時間 (再送タイムアウトに乱数で揺らぎを加えたもの) を返す
+ */
+TMO lora_link_ack_wait(const LoraHandle_t *p_handle, const LoRabbit_PeerLink_t *p_link);
+
+/**
+ * @brief ACKを受信したことを反映する
+ * @param[in,out] p_link リンク状態
+ * @param[in] rtt_ms ACKを要求したパケットの送信完了からACK受信までの時間
+ * @param[in] is_valid_sample 往復時間として使えるか。直前のACK待ちがタイムアウトしていた場合は、
+ * 遅れて届いた古いACKの可能性があるため false を指定する (Karnのアルゴリズム)。
+ * false でも、倍にした待ち時間は推定値に戻す
+ */
+void lora_link_on_ack(LoRabbit_PeerLink_t *p_link, uint32_t rtt_ms, bool is_valid_sample);
+
+/**
+ * @brief ACK待ちがタイムアウトしたことを反映する (損失として数え、待ち時間を倍にする)
+ */
+void lora_link_on_ack_timeout(LoRabbit_PeerLink_t *p_link);
+
+/**
+ * @brief 受信側で観測したパケット間隔を反映する
+ */
+void lora_link_on_rx_gap(LoRabbit_PeerLink_t *p_link, uint32_t gap_ms);
+
+/**
+ * @brief 受信側で観測したパケットの到着/欠損を損失率に反映する
+ * @param[in,out] p_link リンク状態
+ * @param[in] is_lost 欠損 (欠番や再送による重複) を観測したか
+ */
+void lora_link_on_rx_packet(LoRabbit_PeerLink_t *p_link, bool is_lost);
+
+/**
+ * @brief 送信側でACKから判明したデータパケットの到着/欠損を、データパケットの損失率に反映する
+ * @details 長さの違うフレームの結果を合わせられるよう、1バイトあたりの誤り率が一定とみなして
+ * 以前の推定値を今回のフレーム長に換算してから反映します。
+ * @param[in,out] p_link リンク状態
+ * @param[in] frame_size データフレームの長さ (送信先指定を含むバイト数)
+ * @param[in] sent_count 到着/欠損が判明したパケット数
+ * @param[in] lost_count そのうち欠損していたパケット数
+ */
+void lora_link_on_data_result(LoRabbit_PeerLink_t *p_link, uint8_t frame_size, uint16_t sent_count, uint16_t lost_count);
+
+/**
+ * @brief 指定した長さのデータフレームが届く確率を、観測したデータパケットの損失率から見積もる
+ * @param[in] p_link リンク状態
+ * @param[in] frame_size データフレームの長さ (送信先指定を含むバイト数)
+ * @return 届く確率 (0より大きく1以下)
+ */
+double lora_link_frame_delivery_rate(const LoRabbit_PeerLink_t *p_link, uint8_t frame_size);
+
+/**
+ * @brief 観測した損失率から、1パケットあたりの最大送信回数を求める
+ * @return LORABBIT_TP_RETRY_COUNT 以上 LORABBIT_TP_RETRY_COUNT_MAX 以下の回数
+ */
+uint8_t lora_link_retry_budget(const LoRabbit_PeerLink_t *p_link);
+
+/**
+ * @brief 同報送信で、NACKの返らない問い合わせを何回続けたら完了とみなすかを求める
+ * @details 欠損のある受信側の問い合わせかNACKが、その回数続けて全て失われる確率が
+ * 目標値を下回る回数です。損失率には、いずれかの受信側がパケットを取りこぼす率を使います。
+ * 損失率をまだ観測していなければ LORABBIT_TP_RETRY_COUNT_MAX を返します。
+ * @param[in] p_link 同報送信の送信先のリンク状態
+ * @param[in] frame_size 問い合わせに使うデータフレームの長さ (送信先指定を含むバイト数)
+ * @return LORABBIT_TP_MULTICAST_SILENT_POLLS 以上 LORABBIT_TP_RETRY_COUNT_MAX 以下の回数
+ */
+uint8_t lora_link_silent_poll_count(const LoRabbit_PeerLink_t *p_link, uint8_t frame_size);
+
+/**
+ * @brief 受信側で次のパケットを待つ時間を返す
+ * @details 送信側がACKタイムアウトと再送 (待ち時間の倍増を含む) を繰り返しても
+ * 間に合うだけの時間を返します。
+ */
+TMO lora_link_rx_timeout(const LoRabbit_PeerLink_t *p_link);
+
+/**
+ * @brief 送信側で、相手 (受信側) が次のパケットを待つ最短の時間を見積もる
+ * @details 相手の再送回数を下限の LORABBIT_TP_RETRY_COUNT とみなした lora_link_rx_timeout() です。
+ * ACKのないままこの時間が過ぎると、相手は転送を破棄したかもしれません。
+ */
+TMO lora_link_peer_rx_timeout(const LoRabbit_PeerLink_t *p_link);
+
+/**
+ * @brief 受信完了後、送信側の再送を待つ時間を返す
+ * @details 最後のACKが欠損すると、送信側はACK待ちのタイムアウト後に同じパケットを再送してきます。
+ * その再送を LORABBIT_TP_RX_LINGER_ROUNDS 回分待てるだけの時間を、パケット間隔1回分の待ち時間で打ち切って返します
+ * (それより後の再送には、次の LoRabbit_ReceiveData() が記録したACKを返し直します)。
+ */
+TMO lora_link_rx_linger_timeout(const LoRabbit_PeerLink_t *p_link);
+
+/**
+ * @brief 乱数 (xorshift32) を返す
+ * @details 初回に自分のアドレスと時刻で初期化するため、同じタイミングで動く端末どうしでも値が揃いません。
+ */
+uint32_t lora_random(const LoraHandle_t *p_handle);
+
+/**
+ * @brief 同報送信で、受信側がNACKを返す返信スロット1つ分の長さ (ミリ秒) を返す
+ * @details 最大長のNACKのUART入力・エアタイム・UART出力に、処理時間の見込みを加えた時間です。
+ * スロットをずらして返したNACKが、送信側で重ならない長さになります。
+ */
+uint32_t lora_link_reply_slot_ms(LoraHandle_t *p_handle);
+
+/**
+ * @brief モジュールの設定 (payload_size) で LoRabbit_SendFrame() に渡せる最大フレーム長を返す
+ */
+uint8_t lora_frame_size_limit(const LoraHandle_t *p_handle);
+
+/**
+ * @brief UARTのリングバッファから1フレームを読み出す
+ * @details LoRabbit_ReceiveFrame() の本体です。受信ディスパッチャの起動中は、
+ * ディスパッチャのタスクだけがこの関数でリングバッファを読み出します。
+ * @return 受信したペイロードの長さ。タイムアウト時は0。エラー時は負値
+ */
+int lora_receive_frame_raw(LoraHandle_t *p_handle, RecvFrameE220900T22SJP_t *recv_frame, TMO timeout);
+
+#ifdef LORABBIT_USE_RX_DISPATCHER
+/**
+ * @brief 受信したフレームの振り分け先を判定する
+ * @details 送信中の転送へのACK/NACKなら LORABBIT_RX_CLASS_ACK、受信中 (または受信完了した) 転送のパケットや
+ * 新しい転送の最初のパケットなら LORABBIT_RX_CLASS_DATA を返します。送信中のどの転送にも当てはまらない
+ * ACK/NACK (通常のヘッダのもの) は読み捨てるよう LORABBIT_RX_CLASS_NONE を、それ以外は LORABBIT_RX_CLASS_RAW を返します。
+ */
+LoRabbit_RxClass_t lora_tp_classify_frame(LoraHandle_t *p_handle, const uint8_t *raw_packet, int len);
+
+/**
+ * @brief 受信ディスパッチャが振り分けたフレームを取り出す
+ * @param[in] timeout フレームが届くまで待つ最大時間(ms)
+ * @return 受信したペイロードの長さ。タイムアウト時は0。エラー時は負値
+ */
+int lora_rx_queue_pop(LoraHandle_t *p_handle, LoRabbit_RxClass_t rx_class,
+                      RecvFrameE220900T22SJP_t *recv_frame, TMO timeout);
+
+/**
+ * @brief 受信完了した転送の再送パケットであれば、最後のACKを返し直す
+ * @return 受信完了した転送のパケットであれば true (フレームは読み捨ててよい)
+ */
+bool lora_tp_answer_retransmission(LoraHandle_t *p_handle, const uint8_t *raw_packet, int len);
+
+/**
+ * @brief ACKを先頭に載せたデータパケットのフレームか判定する
+ * @return 先頭のACKの長さ。ACKを載せたフレームでなければ0
+ */
+int lora_tp_piggyback_ack_length(const uint8_t *raw_packet, int len);
+
+/**
+ * @brief 保留しているACKの期限が来ていれば、単独で送信する
+ * @return 次の期限までの時間(ms)。保留しているACKがなければ TMO_FEVR
+ */
+TMO lora_tp_flush_delayed_ack(LoraHandle_t *p_handle);
+#endif
+
+#if defined(LORABBIT_USE_LBT) || defined(LORABBIT_USE_CHANNEL_SURVEY)
+/**
+ * @brief モジュールのRSSI読み出しコマンドで、周囲のRSSIノイズを読み出す
+ * @details モジュールの設定で rssi_ambient_noise_flag が有効な必要があります。
+ * noise_mutex_id を取得した状態で呼んで下さい。
+ * @param[out] p_noise_dbm 周囲のRSSIノイズ (dBm) の格納先
+ * @retval LORABBIT_OK 成功
+ * @retval LORABBIT_ERROR_TIMEOUT LORABBIT_LBT_SENSE_TIMEOUT_MS 以内に応答がない
+ * @retval LORABBIT_ERROR_RETRY 読み出していない受信データが残っていて、応答と区別できない
+ * @retval LORABBIT_ERROR_INVALID_PACKET 応答が不正
+ */
+int lora_read_ambient_noise(LoraHandle_t *p_handle, int16_t *p_noise_dbm);
+
+#ifdef LORABBIT_USE_RX_DISPATCHER
+/**
+ * @brief 受信ディスパッチャが読み出したフレームが、RSSI読み出しコマンドの応答か判定する
+ * @details 他のタスクが応答を待っていれば、RSSIノイズを渡して通知します。
+ * @return 応答であれば true (フレームは振り分けない)
+ */
+bool lora_take_noise_reply(LoraHandle_t *p_handle, const RecvFrameE220900T22SJP_t *p_frame, int len);
+#endif
+#endif
+
+#ifdef LORABBIT_USE_CHANNEL_SURVEY
+/**
+ * @brief モジュールの設定を一時的に書き込む (コンフィグモードのまま戻る)
+ * @details LoRabbit_InitModule() と同じですが、不揮発メモリではなくレジスタだけに書き込む
+ * コマンド (0xC2) を使います。不揮発メモリの書き換え回数を消耗しない代わりに、電源を切ると
+ * LoRabbit_InitModule() で最後に書き込んだ設定に戻ります。
+ * @return LORABBIT_OK 成功、負値 エラーコード
+ */
+int lora_apply_config_temporary(LoraHandle_t *p_handle, LoraConfigItem_t *p_config);
+#endif
+
+#ifdef LORABBIT_USE_AGGREGATION
+/**
+ * @brief 集約フレームか判定する
+ * @details 先頭の識別子と、メッセージの長さの合計がフレーム長と一致することを確かめます。
+ */
+bool lora_agg_is_frame(const uint8_t *raw_packet, int len);
+#endif
+
+#ifdef LORABBIT_USE_AIRTIME_BUDGET
+/**
+ * @brief フレームを送信できるまで待ち、エアタイムを予算から差し引く
+ * @details 予算が足りない間と、前の送信から LORABBIT_AIRTIME_MIN_PAUSE_MS が経つまで待ちます。
+ * @param[in] frame_size フレームの長さ (送信先指定を除くバイト数)
+ * @param[in] may_use_reserve 予算の予約分を使えるか (ACKと制御クラスの転送)
+ * @retval LORABBIT_OK 送信してよい
+ * @retval LORABBIT_ERROR_AIRTIME_EXHAUSTED LORABBIT_AIRTIME_MAX_WAIT_MS 待っても予算が空かない
+ */
+int lora_airtime_acquire(LoraHandle_t *p_handle, int frame_size, bool may_use_reserve);
+
+/**
+ * @brief フレームの送信が完了した時刻を記録する (休止時間はここから数える)
+ */
+void lora_airtime_on_tx_done(LoraHandle_t *p_handle);
+
+/**
+ * @brief 転送全体のエアタイムが予算に収まるまで待つ (予算からは差し引かない)
+ * @details 予算全体より長い転送は待たずに戻り、フレームごとの制限だけで送ります。
+ * @param[in] airtime_us 転送全体のエアタイムの見積もり (マイクロ秒)
+ * @retval LORABBIT_OK 転送を始めてよい
+ * @retval LORABBIT_ERROR_AIRTIME_EXHAUSTED LORABBIT_AIRTIME_MAX_WAIT_MS 待っても予算が空かない
+ */
+int lora_airtime_wait_for(LoraHandle_t *p_handle, uint64_t airtime_us, bool may_use_reserve);
+#endif
+
 /** @} */ // end of LoRabbitInternal group
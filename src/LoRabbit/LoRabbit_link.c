@@ -0,0 +1,307 @@
+/**
+ * @file LoRabbit_link.c
+ * @brief 通信相手ごとのリンク状態 (往復時間と損失率) の推定
+ * @details トランスポート層のACK待ち時間、受信待ち時間、再送回数、パケット長を決めるために、
+ * 通信相手ごとの往復時間をJacobson/Karels方式で、損失率を指数移動平均で推定します。
+ * 推定値の初期値は、エアタイムとUART転送時間の計算値から求めます。
+ */
+#include "LoRabbit.h"
+#include "LoRabbit_internal.h"
+#include "LoRabbit_util.h"
+
+#include <math.h>
+#include <string.h>
+
+// 推定値の初期化に使う、フレームの最大サイズ
+#define LORA_LINK_MAX_FRAME_SIZE     200 // 送信先指定(3) + データ(197)
+#define LORA_LINK_MAX_ACK_SIZE       40  // TPヘッダ(8) + 欠損ビットマップ(32)
+
+// 受信側のフレーム終端検出や、タスク切り替えなどにかかる時間の見込み (ミリ秒)
+#define LORA_LINK_PROCESSING_MARGIN_MS 20
+
+// タイムアウト計算時の、往復時間のばらつきの最小値 (ミリ秒)
+#define LORA_LINK_MIN_VARIANCE_MS    10
+
+// 再送回数を決める際に許容する、1パケットの送信がすべて失敗する確率 (ppm)
+// 数百パケットの転送でも、途中で失敗する確率が数%に収まるよう小さくしておく
+#define LORA_LINK_TARGET_FAILURE_PPM 100
+
+// データパケットの損失率を平滑化する重み (1パケットあたり 1/N)
+// 損失率が数%でも推定値が安定するよう、ACKの損失率 (1/8) より長い期間で平均する
+#define LORA_LINK_DATA_LOSS_WEIGHT   64
+
+// パケット長を決める際に見込む、データフレームの損失率の上限
+// (これ以上失われる状況でも、届く見込みのあるパケット長を選べるようにする)
+#define LORA_LINK_MAX_DATA_LOSS      0.95
+
+// 現在時刻をミリ秒で取得するヘルパー関数（内部利用）
+static uint32_t lora_link_now_ms(void) {
+    SYSTIM now;
+    tk_get_tim(&now);
+    return now.lo;
+}
+
+// 指定バイト数のUART転送にかかる時間 (ミリ秒、スタート/ストップビット込み)（内部利用）
+static uint32_t lora_link_uart_ms(LoraHandle_t *p_handle, uint32_t bytes) {
+    uint32_t baud = lora_enum_to_fsp_baud(p_handle->current_config.baud_rate);
+    return (bytes * 10 * 1000 + baud - 1) / baud;
+}
+
+// 推定値からタイムアウト時間を計算する（内部利用）
+static void lora_link_update_rto(LoRabbit_RttEstimator_t *p_est) {
+    uint32_t variance_x4 = p_est->rttvar_x4;
+    if (variance_x4 < LORA_LINK_MIN_VARIANCE_MS) {
+        variance_x4 = LORA_LINK_MIN_VARIANCE_MS;
+    }
+
+    // RTO = SRTT + 4 * RTTVAR
+    uint32_t rto = (p_est->srtt_x8 >> 3) + variance_x4;
+    if (rto < LORABBIT_TP_RTO_MIN_MS) {
+        rto = LORABBIT_TP_RTO_MIN_MS;
+    }
+    if (rto > LORABBIT_TP_RTO_MAX_MS) {
+        rto = LORABBIT_TP_RTO_MAX_MS;
+    }
+    p_est->rto_ms = rto;
+}
+
+// 往復時間の測定値を1つ反映する（内部利用）
+static void lora_link_add_sample(LoRabbit_RttEstimator_t *p_est, uint32_t sample_ms) {
+    if (!p_est->is_measured) {
+        // 最初の測定値: SRTT = R, RTTVAR = R / 2
+        p_est->srtt_x8 = sample_ms << 3;
+        p_est->rttvar_x4 = sample_ms << 1;
+        p_est->is_measured = true;
+    } else {
+        // SRTT += (R - SRTT) / 8, RTTVAR += (|R - SRTT| - RTTVAR) / 4
+        int32_t delta = (int32_t)sample_ms - (int32_t)(p_est->srtt_x8 >> 3);
+        p_est->srtt_x8 = (uint32_t)((int32_t)p_est->srtt_x8 + delta);
+        if (delta < 0) {
+            delta = -delta;
+        }
+        p_est->rttvar_x4 = (uint32_t)((int32_t)p_est->rttvar_x4 + delta - (int32_t)(p_est->rttvar_x4 >> 2));
+    }
+    lora_link_update_rto(p_est);
+}
+
+// エアタイムの計算値から推定値を初期化する（内部利用）
+static void lora_link_seed(LoraHandle_t *p_handle, LoRabbit_PeerLink_t *p_link) {
+    const LoraAirDateRate_t rate = p_handle->current_config.air_data_rate;
+
+    // ACKの往復: 受信側モジュールからのデータ出力 + ACKの入力 + ACKのエアタイム + ACKの出力
+    uint32_t ack_path_ms = lora_link_uart_ms(p_handle, LORA_LINK_MAX_FRAME_SIZE)
+                         + lora_link_uart_ms(p_handle, LORA_LINK_MAX_ACK_SIZE + 3)
+                         + LoRabbit_GetTimeOnAirMsec(rate, LORA_LINK_MAX_ACK_SIZE)
+                         + lora_link_uart_ms(p_handle, LORA_LINK_MAX_ACK_SIZE + 1)
+                         + LORA_LINK_PROCESSING_MARGIN_MS;
+#ifdef LORABBIT_USE_RX_DISPATCHER
+    // 受信側はACKを保留して、こちらへ送るデータパケットに載せることがある
+    ack_path_ms += LORABBIT_TP_DELAYED_ACK_MS;
+#endif
+#ifdef LORABBIT_USE_AIRTIME_BUDGET
+    // 受信側は送信後の休止時間が経つまでACKを送れない
+    ack_path_ms += LORABBIT_AIRTIME_MIN_PAUSE_MS;
+#endif
+
+    // 受信側から見た次のパケットまで: ACKの往復 + 次のデータの入力とエアタイム
+    uint32_t rx_gap_ms = ack_path_ms
+                       + lora_link_uart_ms(p_handle, LORA_LINK_MAX_FRAME_SIZE)
+                       + LoRabbit_GetTimeOnAirMsec(rate, LORA_LINK_MAX_FRAME_SIZE - 3);
+
+    memset(&p_link->ack_rtt, 0, sizeof(p_link->ack_rtt));
+    memset(&p_link->rx_gap, 0, sizeof(p_link->rx_gap));
+    lora_link_add_sample(&p_link->ack_rtt, ack_path_ms);
+    lora_link_add_sample(&p_link->rx_gap, rx_gap_ms);
+
+    // 計算値は実測値ではないので、最初の実測値で置き換える
+    p_link->ack_rtt.is_measured = false;
+    p_link->rx_gap.is_measured = false;
+    p_link->air_data_rate = rate;
+
+    // データパケットの損失率は空中データレート (SF) で大きく変わるので、観測し直す
+    p_link->data_loss_permille = 0;
+    p_link->data_frame_size = 0;
+
+    LORA_PRINTF("link 0x%04x: seeded ack_rto=%lu ms, rx_rto=%lu ms\n",
+                p_link->address, p_link->ack_rtt.rto_ms, p_link->rx_gap.rto_ms);
+}
+
+LoRabbit_PeerLink_t *lora_link_find(LoraHandle_t *p_handle, uint16_t address) {
+    for (int i = 0; i < LORABBIT_TP_PEER_TABLE_SIZE; i++) {
+        LoRabbit_PeerLink_t *p_link = &p_handle->peer_links[i];
+        if (p_link->is_valid && p_link->address == address) {
+            return p_link;
+        }
+    }
+    return NULL;
+}
+
+LoRabbit_PeerLink_t *lora_link_get(LoraHandle_t *p_handle, uint16_t address) {
+    LoRabbit_PeerLink_t *p_link = lora_link_find(p_handle, address);
+
+    if (NULL == p_link) {
+        // 空きエントリ、なければ最も長く使われていないエントリを使う
+        p_link = &p_handle->peer_links[0];
+        for (int i = 0; i < LORABBIT_TP_PEER_TABLE_SIZE; i++) {
+            LoRabbit_PeerLink_t *p_candidate = &p_handle->peer_links[i];
+            if (!p_candidate->is_valid) {
+                p_link = p_candidate;
+                break;
+            }
+            if ((int32_t)(p_candidate->last_used_ms - p_link->last_used_ms) < 0) {
+                p_link = p_candidate;
+            }
+        }
+        memset(p_link, 0, sizeof(LoRabbit_PeerLink_t));
+        p_link->is_valid = true;
+        p_link->address = address;
+        lora_link_seed(p_handle, p_link);
+    } else if (p_link->air_data_rate != p_handle->current_config.air_data_rate) {
+        // データレートが変わると往復時間も変わるので、推定し直す
+        lora_link_seed(p_handle, p_link);
+    }
+
+    p_link->last_used_ms = lora_link_now_ms();
+    return p_link;
+}
+
+TMO lora_link_ack_timeout(const LoRabbit_PeerLink_t *p_link) {
+    return (TMO)p_link->ack_rtt.rto_ms;
+}
+
+TMO lora_link_ack_wait(const LoraHandle_t *p_handle, const LoRabbit_PeerLink_t *p_link) {
+    // 同時に衝突した送信側どうしが、同じ間隔で再送して衝突し続けないよう、最大1/4だけ延ばす
+    uint32_t jitter_window_ms = p_link->ack_rtt.rto_ms / 4 + 1;
+    return (TMO)(p_link->ack_rtt.rto_ms + lora_random(p_handle) % jitter_window_ms);
+}
+
+void lora_link_on_ack(LoRabbit_PeerLink_t *p_link, uint32_t rtt_ms, bool is_valid_sample) {
+    p_link->loss_permille = (uint16_t)((p_link->loss_permille * 7) / 8);
+
+    if (is_valid_sample) {
+        lora_link_add_sample(&p_link->ack_rtt, rtt_ms);
+    } else {
+        // 再送したパケットへのACKは往復時間の測定には使えないが、ACKが届いたのでバックオフは解除する
+        lora_link_update_rto(&p_link->ack_rtt);
+    }
+}
+
+void lora_link_on_ack_timeout(LoRabbit_PeerLink_t *p_link) {
+    p_link->loss_permille = (uint16_t)((p_link->loss_permille * 7 + 1000) / 8);
+
+    // 指数バックオフ
+    uint32_t rto = p_link->ack_rtt.rto_ms * 2;
+    p_link->ack_rtt.rto_ms = (rto > LORABBIT_TP_RTO_MAX_MS) ? LORABBIT_TP_RTO_MAX_MS : rto;
+}
+
+void lora_link_on_rx_gap(LoRabbit_PeerLink_t *p_link, uint32_t gap_ms) {
+    lora_link_add_sample(&p_link->rx_gap, gap_ms);
+}
+
+void lora_link_on_rx_packet(LoRabbit_PeerLink_t *p_link, bool is_lost) {
+    p_link->loss_permille = (uint16_t)((p_link->loss_permille * 7 + (is_lost ? 1000 : 0)) / 8);
+}
+
+// 観測したデータパケットの損失率を、別の長さのフレームの損失率に換算する（内部利用）
+// 1バイトあたりの誤り率が一定とみなす: 1 - 損失率 = (1バイトが届く確率)^フレーム長
+static double lora_link_scale_data_loss(const LoRabbit_PeerLink_t *p_link, uint8_t frame_size) {
+    double loss = p_link->data_loss_permille / 1000.0;
+    if (loss <= 0.0 || p_link->data_frame_size == 0) {
+        return 0.0;
+    }
+    if (loss > LORA_LINK_MAX_DATA_LOSS) {
+        loss = LORA_LINK_MAX_DATA_LOSS;
+    }
+    return 1.0 - pow(1.0 - loss, (double)frame_size / p_link->data_frame_size);
+}
+
+void lora_link_on_data_result(LoRabbit_PeerLink_t *p_link, uint8_t frame_size, uint16_t sent_count, uint16_t lost_count) {
+    if (sent_count == 0 || frame_size == 0) {
+        return;
+    }
+
+    // 1パケットごとに 1/LORA_LINK_DATA_LOSS_WEIGHT の重みで平滑化したのと同じになるよう、まとめて反映する
+    double loss = lora_link_scale_data_loss(p_link, frame_size);
+    double sample = (double)lost_count / sent_count;
+    loss = sample + (loss - sample) * pow(1.0 - 1.0 / LORA_LINK_DATA_LOSS_WEIGHT, sent_count);
+
+    p_link->data_loss_permille = (uint16_t)(loss * 1000.0 + 0.5);
+    p_link->data_frame_size = frame_size;
+}
+
+double lora_link_frame_delivery_rate(const LoRabbit_PeerLink_t *p_link, uint8_t frame_size) {
+    double loss = lora_link_scale_data_loss(p_link, frame_size);
+    if (loss > LORA_LINK_MAX_DATA_LOSS) {
+        loss = LORA_LINK_MAX_DATA_LOSS;
+    }
+    return 1.0 - loss;
+}
+
+uint8_t lora_link_retry_budget(const LoRabbit_PeerLink_t *p_link) {
+    // すべての送信が失敗する確率 (損失率^回数) が目標値を下回る回数を求める
+    uint32_t loss = p_link->loss_permille;
+    uint32_t failure_ppm = loss * 1000;
+    uint8_t budget = 1;
+    while (failure_ppm > LORA_LINK_TARGET_FAILURE_PPM && budget < LORABBIT_TP_RETRY_COUNT_MAX) {
+        failure_ppm = failure_ppm * loss / 1000;
+        budget++;
+    }
+    return (budget < LORABBIT_TP_RETRY_COUNT) ? LORABBIT_TP_RETRY_COUNT : budget;
+}
+
+uint8_t lora_link_silent_poll_count(const LoRabbit_PeerLink_t *p_link, uint8_t frame_size) {
+    if (p_link->data_frame_size == 0) {
+        return LORABBIT_TP_RETRY_COUNT_MAX; // 損失率をまだ観測していない
+    }
+    // 欠損のある受信側でも、問い合わせのパケットかNACKのどちらかが失われると返信は届かない
+    double silent = 1.0 - lora_link_frame_delivery_rate(p_link, frame_size) *
+                          lora_link_frame_delivery_rate(p_link, LORA_LINK_MAX_ACK_SIZE);
+    // 返信の届かない問い合わせが続く確率 (silent^回数) が目標値を下回る回数を求める
+    double failure_ppm = silent * 1000000.0;
+    uint8_t count = 1;
+    while (failure_ppm > LORA_LINK_TARGET_FAILURE_PPM && count < LORABBIT_TP_RETRY_COUNT_MAX) {
+        failure_ppm *= silent;
+        count++;
+    }
+    return (count < LORABBIT_TP_MULTICAST_SILENT_POLLS) ? LORABBIT_TP_MULTICAST_SILENT_POLLS : count;
+}
+
+// 指定した再送回数の分だけ、送信側の再送を待つ時間を返す（内部利用）
+static TMO lora_link_rx_timeout_for(const LoRabbit_PeerLink_t *p_link, uint8_t budget) {
+    // ACK (またはACK要求) が欠損すると、送信側はACK待ちのタイムアウト後に再送してくる。
+    // 1回分の待ち時間を「送信側のACK待ち + パケット間隔」とし、送信側は待ち時間を
+    // 倍にしながら再送するので、その合計 (1 + 2 + 4 + ...) だけ待つ
+    uint32_t base = p_link->ack_rtt.rto_ms + p_link->rx_gap.rto_ms;
+    uint32_t timeout = base * ((1UL << budget) - 1);
+    uint32_t limit = (uint32_t)LORABBIT_TP_RTO_MAX_MS * budget;
+    return (TMO)((timeout > limit) ? limit : timeout);
+}
+
+TMO lora_link_rx_timeout(const LoRabbit_PeerLink_t *p_link) {
+    return lora_link_rx_timeout_for(p_link, lora_link_retry_budget(p_link));
+}
+
+TMO lora_link_peer_rx_timeout(const LoRabbit_PeerLink_t *p_link) {
+    // 相手 (受信側) の再送回数は相手が観測した損失率で決まるので、下限の回数で見積もる
+    return lora_link_rx_timeout_for(p_link, LORABBIT_TP_RETRY_COUNT);
+}
+
+TMO lora_link_rx_linger_timeout(const LoRabbit_PeerLink_t *p_link) {
+    // 1回分の待ち時間は lora_link_rx_timeout() と同じく「送信側のACK待ち + パケット間隔」とし、
+    // 送信側の待ち時間の倍増を含めて LORABBIT_TP_RX_LINGER_ROUNDS 回分の合計だけ待つ。
+    // ただし、受信側では送信側のACK待ちの時間を測れない (初期値のまま) ので、パケット間隔1回分で打ち切る
+    uint32_t base = p_link->ack_rtt.rto_ms + p_link->rx_gap.rto_ms;
+    uint32_t timeout = base * ((1UL << LORABBIT_TP_RX_LINGER_ROUNDS) - 1);
+    if (timeout > p_link->rx_gap.rto_ms) {
+        timeout = p_link->rx_gap.rto_ms;
+    }
+    return (TMO)((timeout > LORABBIT_TP_RTO_MAX_MS) ? LORABBIT_TP_RTO_MAX_MS : timeout);
+}
+
+uint32_t lora_link_reply_slot_ms(LoraHandle_t *p_handle) {
+    // 受信側モジュールへのNACKの入力 + エアタイム + 送信側モジュールからの出力
+    return lora_link_uart_ms(p_handle, LORA_LINK_MAX_ACK_SIZE + 3)
+         + LoRabbit_GetTimeOnAirMsec(p_handle->current_config.air_data_rate, LORA_LINK_MAX_ACK_SIZE)
+         + lora_link_uart_ms(p_handle, LORA_LINK_MAX_ACK_SIZE + 1)
+         + LORA_LINK_PROCESSING_MARGIN_MS;
+}
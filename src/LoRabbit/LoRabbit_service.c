@@ -0,0 +1,269 @@
+/**
+ * @file LoRabbit_service.c
+ * @brief LoRabbit TX Service / RX Dispatcher の実装
+ * @details 送信サービスは、送信要求をメッセージバッファで受け取り、専用のタスクで1つずつ送信します。
+ * 無線モジュールを使うのはこのタスクだけになるため、複数のタスクの送信がUART上で混ざりません。
+ * 受信ディスパッチャは、UARTのリングバッファを専用のタスクで読み出し続け、受信したフレームを
+ * 振り分け先ごとのキューに格納します。
+ */
+#include "LoRabbit_service.h"
+
+#if defined(LORABBIT_USE_TX_SERVICE) || defined(LORABBIT_USE_RX_DISPATCHER)
+
+#include "LoRabbit_internal.h"
+#include "LoRabbit_tp.h"
+
+#include <string.h>
+
+#ifdef LORABBIT_USE_TX_SERVICE
+
+// メッセージバッファの1メッセージあたりの管理領域の見込み (バイト)
+#define LORA_SERVICE_MBF_HEADER_SIZE sizeof(INT)
+
+// 送信要求を1つずつ送信するタスク（内部利用）
+static void lora_tx_service_task(INT stacd, void *exinf) {
+    LoraHandle_t *p_handle = (LoraHandle_t *)exinf;
+    (void)stacd;
+
+    while (1) {
+        LoRabbit_TxRequest_t *p_request = NULL;
+        INT size = tk_rcv_mbf(p_handle->tx_service_mbf_id, &p_request, TMO_FEVR);
+        if (size != (INT)sizeof(p_request) || NULL == p_request) {
+            continue;
+        }
+
+        int ret = LoRabbit_SendDataWithOptions(p_handle, p_request->target_address, p_request->target_channel,
+                                               p_request->p_data, p_request->size, &p_request->options);
+        LORA_PRINTF("tx service: sent %lu bytes to 0x%04X (ret=%d)\n",
+                    p_request->size, p_request->target_address, ret);
+
+        // 完了を通知する (コールバック内で要求を再利用できるよう、結果を先に格納する)
+        p_request->result = ret;
+        p_request->is_done = true;
+        if (NULL != p_request->pf_done_callback) {
+            p_request->pf_done_callback(p_request);
+        }
+        if (p_request->done_flag_id > 0) {
+            tk_set_flg(p_request->done_flag_id, p_request->done_flag_pattern);
+        }
+    }
+}
+
+int LoRabbit_StartTxService(LoraHandle_t *p_handle, PRI task_priority) {
+    if (NULL == p_handle || p_handle->tx_service_task_id > 0) {
+        return LORABBIT_ERROR_INVALID_ARGUMENT;
+    }
+
+    // 送信要求 (へのポインタ) を受け渡すメッセージバッファを生成
+    T_CMBF cmbf;
+    memset(&cmbf, 0, sizeof(cmbf));
+    cmbf.mbfatr = TA_TFIFO;
+    cmbf.bufsz  = LORABBIT_TX_SERVICE_QUEUE_DEPTH * (sizeof(LoRabbit_TxRequest_t *) + LORA_SERVICE_MBF_HEADER_SIZE);
+    cmbf.maxmsz = sizeof(LoRabbit_TxRequest_t *);
+    ID mbf_id = tk_cre_mbf(&cmbf);
+    if (mbf_id < LORABBIT_OK) {
+        LORA_PRINTF("LoRabbit_StartTxService: tk_cre_mbf failed(%d)\n", mbf_id);
+        return mbf_id;
+    }
+    p_handle->tx_service_mbf_id = mbf_id;
+
+    // 送信タスクを生成して起動
+    T_CTSK ctsk;
+    memset(&ctsk, 0, sizeof(ctsk));
+    ctsk.exinf   = p_handle;
+    ctsk.tskatr  = TA_HLNG | TA_RNG3;
+    ctsk.task    = lora_tx_service_task;
+    ctsk.itskpri = task_priority;
+    ctsk.stksz   = LORABBIT_TX_SERVICE_STACK_SIZE;
+    ID task_id = tk_cre_tsk(&ctsk);
+    if (task_id < LORABBIT_OK) {
+        LORA_PRINTF("LoRabbit_StartTxService: tk_cre_tsk failed(%d)\n", task_id);
+        return task_id;
+    }
+    ER err = tk_sta_tsk(task_id, 0);
+    if (err < LORABBIT_OK) {
+        LORA_PRINTF("LoRabbit_StartTxService: tk_sta_tsk failed(%d)\n", err);
+        return err;
+    }
+    p_handle->tx_service_task_id = task_id;
+
+    return LORABBIT_OK;
+}
+
+int LoRabbit_SubmitSend(LoraHandle_t *p_handle, LoRabbit_TxRequest_t *p_request, TMO timeout) {
+    if (NULL == p_handle || NULL == p_request || p_handle->tx_service_task_id <= 0) {
+        return LORABBIT_ERROR_INVALID_ARGUMENT;
+    }
+
+    p_request->is_done = false;
+    p_request->result = LORABBIT_OK;
+    return tk_snd_mbf(p_handle->tx_service_mbf_id, &p_request, sizeof(p_request), timeout);
+}
+
+#endif // LORABBIT_USE_TX_SERVICE
+
+#ifdef LORABBIT_USE_RX_DISPATCHER
+// 振り分けたフレームをキューに格納するヘルパー関数（内部利用）
+// キューが満杯の場合は、最も古いフレームを捨てて格納する。LORABBIT_RX_CLASS_NONE のフレームは読み捨てる
+static void lora_rx_queue_push(LoraHandle_t *p_handle, LoRabbit_RxClass_t rx_class,
+                               const RecvFrameE220900T22SJP_t *p_frame)
+{
+    if (rx_class >= LORABBIT_RX_CLASS_COUNT) {
+        return;
+    }
+    LoRabbit_RxQueue_t *p_queue = &p_handle->rx_queues[rx_class];
+    bool is_added = false;
+
+    tk_wai_sem(p_handle->rx_queue_mutex_id, 1, TMO_FEVR);
+    if (p_queue->count >= LORABBIT_RX_DISPATCH_QUEUE_DEPTH) {
+        p_queue->head = (p_queue->head + 1) % LORABBIT_RX_DISPATCH_QUEUE_DEPTH;
+        p_queue->count--;
+        p_queue->dropped_count++;
+    } else {
+        is_added = true;
+    }
+    uint8_t tail = (p_queue->head + p_queue->count) % LORABBIT_RX_DISPATCH_QUEUE_DEPTH;
+    memcpy(&p_queue->frames[tail], p_frame, sizeof(RecvFrameE220900T22SJP_t));
+    p_queue->count++;
+    tk_sig_sem(p_handle->rx_queue_mutex_id, 1);
+
+    // 捨てたフレームの分はセマフォに数えてあるので、増えた場合だけ知らせる
+    if (is_added) {
+        tk_sig_sem(p_queue->sem_id, 1);
+    }
+}
+
+int lora_rx_queue_pop(LoraHandle_t *p_handle, LoRabbit_RxClass_t rx_class,
+                      RecvFrameE220900T22SJP_t *recv_frame, TMO timeout)
+{
+    LoRabbit_RxQueue_t *p_queue = &p_handle->rx_queues[rx_class];
+
+    ER err = tk_wai_sem(p_queue->sem_id, 1, timeout);
+    if (err != LORABBIT_OK) {
+        return (err == E_TMOUT) ? 0 : err; // タイムアウトなら受信データなし(0)、それ以外はエラーを返す
+    }
+
+    tk_wai_sem(p_handle->rx_queue_mutex_id, 1, TMO_FEVR);
+    memcpy(recv_frame, &p_queue->frames[p_queue->head], sizeof(RecvFrameE220900T22SJP_t));
+    p_queue->head = (p_queue->head + 1) % LORABBIT_RX_DISPATCH_QUEUE_DEPTH;
+    p_queue->count--;
+    tk_sig_sem(p_handle->rx_queue_mutex_id, 1);
+
+    return (int)recv_frame->recv_data_len;
+}
+
+// UARTのリングバッファを読み出し続け、受信したフレームを振り分けるタスク（内部利用）
+static void lora_rx_dispatcher_task(INT stacd, void *exinf) {
+    LoraHandle_t *p_handle = (LoraHandle_t *)exinf;
+    RecvFrameE220900T22SJP_t frame;
+    RecvFrameE220900T22SJP_t ack_frame;
+    (void)stacd;
+
+    while (1) {
+        // 保留しているACKの期限が来ていれば単独で送り、次の期限までに受信待ちから戻る
+        TMO timeout = lora_tp_flush_delayed_ack(p_handle);
+        if (timeout < 0 || timeout > LORABBIT_RX_DISPATCHER_POLL_MS) {
+            timeout = LORABBIT_RX_DISPATCHER_POLL_MS;
+        }
+
+        // 他のタスクの送信中は受信待ちに入れないため、一定時間ごとに受信待ちをやり直す
+        int recv_len = lora_receive_frame_raw(p_handle, &frame, timeout);
+        if (recv_len <= 0) {
+            continue;
+        }
+
+#if defined(LORABBIT_USE_LBT) || defined(LORABBIT_USE_CHANNEL_SURVEY)
+        // 送信前のキャリアセンスなどで他のタスクが待っている、RSSI読み出しコマンドの応答
+        if (lora_take_noise_reply(p_handle, &frame, recv_len)) {
+            continue;
+        }
+#endif
+
+        // データパケットの先頭に載ったACKは、分けてから振り分ける
+        int ack_len = lora_tp_piggyback_ack_length(frame.recv_data, recv_len);
+        if (ack_len > 0) {
+            memcpy(ack_frame.recv_data, frame.recv_data, ack_len);
+            ack_frame.recv_data_len = ack_len;
+            ack_frame.rssi = frame.rssi;
+            lora_rx_queue_push(p_handle, lora_tp_classify_frame(p_handle, ack_frame.recv_data, ack_len), &ack_frame);
+
+            recv_len -= ack_len;
+            memmove(frame.recv_data, &frame.recv_data[ack_len], recv_len);
+            frame.recv_data_len = recv_len;
+        }
+
+        // 受信完了した転送への再送は、受信中のタスクがなくてもここで最後のACKを返し直す
+        if (lora_tp_answer_retransmission(p_handle, frame.recv_data, recv_len)) {
+            continue;
+        }
+
+        LoRabbit_RxClass_t rx_class = lora_tp_classify_frame(p_handle, frame.recv_data, recv_len);
+        lora_rx_queue_push(p_handle, rx_class, &frame);
+    }
+}
+
+int LoRabbit_StartRxDispatcher(LoraHandle_t *p_handle, PRI task_priority) {
+    if (NULL == p_handle || p_handle->rx_dispatcher_task_id > 0) {
+        return LORABBIT_ERROR_INVALID_ARGUMENT;
+    }
+
+    // キューを保護するミューテックスを生成
+    T_CSEM csem;
+    memset(&csem, 0, sizeof(csem));
+    csem.sematr  = TA_TFIFO | TA_FIRST;
+    csem.isemcnt = 1;
+    csem.maxsem  = 1;
+    ID mutex_id = tk_cre_sem(&csem);
+    if (mutex_id < LORABBIT_OK) {
+        LORA_PRINTF("LoRabbit_StartRxDispatcher: tk_cre_sem failed(%d)\n", mutex_id);
+        return mutex_id;
+    }
+    p_handle->rx_queue_mutex_id = mutex_id;
+
+    // 振り分け先ごとに、格納しているフレームの数を表すセマフォを生成
+    csem.isemcnt = 0;
+    csem.maxsem  = LORABBIT_RX_DISPATCH_QUEUE_DEPTH;
+    for (int i = 0; i < LORABBIT_RX_CLASS_COUNT; i++) {
+        memset(&p_handle->rx_queues[i], 0, sizeof(LoRabbit_RxQueue_t));
+        ID sem_id = tk_cre_sem(&csem);
+        if (sem_id < LORABBIT_OK) {
+            LORA_PRINTF("LoRabbit_StartRxDispatcher: tk_cre_sem failed(%d)\n", sem_id);
+            return sem_id;
+        }
+        p_handle->rx_queues[i].sem_id = sem_id;
+    }
+
+    // ディスパッチャのタスクを生成して起動
+    T_CTSK ctsk;
+    memset(&ctsk, 0, sizeof(ctsk));
+    ctsk.exinf   = p_handle;
+    ctsk.tskatr  = TA_HLNG | TA_RNG3;
+    ctsk.task    = lora_rx_dispatcher_task;
+    ctsk.itskpri = task_priority;
+    ctsk.stksz   = LORABBIT_RX_DISPATCHER_STACK_SIZE;
+    ID task_id = tk_cre_tsk(&ctsk);
+    if (task_id < LORABBIT_OK) {
+        LORA_PRINTF("LoRabbit_StartRxDispatcher: tk_cre_tsk failed(%d)\n", task_id);
+        return task_id;
+    }
+    // 起動前に設定し、起動直後から LoRabbit_ReceiveFrame() などがキューから受け取るようにする
+    p_handle->rx_dispatcher_task_id = task_id;
+    ER err = tk_sta_tsk(task_id, 0);
+    if (err < LORABBIT_OK) {
+        LORA_PRINTF("LoRabbit_StartRxDispatcher: tk_sta_tsk failed(%d)\n", err);
+        p_handle->rx_dispatcher_task_id = 0;
+        return err;
+    }
+
+    return LORABBIT_OK;
+}
+
+uint32_t LoRabbit_GetRxDroppedCount(const LoraHandle_t *p_handle, LoRabbit_RxClass_t rx_class) {
+    if (NULL == p_handle || rx_class >= LORABBIT_RX_CLASS_COUNT) {
+        return 0;
+    }
+    return p_handle->rx_queues[rx_class].dropped_count;
+}
+#endif // LORABBIT_USE_RX_DISPATCHER
+
+#endif
@@ -0,0 +1,87 @@
+/**
+ * @file LoRabbit_service.h
+ * @brief LoRabbit TX Service / RX Dispatcher
+ * @details 無線モジュールへの送信を専用のタスクに任せ、複数のタスクから送信要求を投入するためのAPIと、
+ * 受信したフレームを専用のタスクで振り分けるためのAPIを定義します。
+ * @author men100
+ * @date 2025/09/30
+ */
+#pragma once
+#include "LoRabbit.h"
+
+#ifdef LORABBIT_USE_TX_SERVICE
+
+/**
+ * @defgroup LoRabbitService TX Service
+ * @brief 送信要求をキューに積み、専用のタスクで順に送信するAPI
+ * @{
+ */
+
+/**
+ * @brief 送信サービスのタスクを起動する
+ * @details 送信要求を受け取るメッセージバッファ (LORABBIT_TX_SERVICE_QUEUE_DEPTH 個分) と、
+ * 要求を1つずつ LoRabbit_SendDataWithOptions() で送信するタスク
+ * (スタック LORABBIT_TX_SERVICE_STACK_SIZE バイト) を生成して起動します。
+ * LoRabbit_Init() と LoRabbit_InitModule() の後に、1度だけ呼んで下さい。
+ * @param[in,out] p_handle 操作対象のハンドル
+ * @param[in] task_priority 送信サービスのタスクの優先度
+ * @retval LORABBIT_OK 成功
+ * @retval LORABBIT_ERROR_INVALID_ARGUMENT 引数がNULL、または起動済み
+ * @retval その他 負値のエラーコード (μT-Kernelのエラー)
+ */
+int LoRabbit_StartTxService(LoraHandle_t *p_handle, PRI task_priority);
+
+/**
+ * @brief 送信要求を送信サービスに投入する。送信の完了は待たない。
+ * @details 要求は投入した順に1つずつ送信されます。送信が完了すると、result に結果を格納して
+ * is_done を true にし、pf_done_callback が指定されていれば呼び出し、done_flag_id が指定されていれば
+ * done_flag_pattern をセットします。完了するまで、p_request と p_data の内容を保持して下さい。
+ * @param[in,out] p_handle 操作対象のハンドル (LoRabbit_StartTxService() で起動済みのもの)
+ * @param[in,out] p_request 送信要求
+ * @param[in] timeout キューが満杯の場合に空きを待つ最大時間(ms)。TMO_POLで待たない。TMO_FEVRで無限待ち。
+ * @retval LORABBIT_OK 投入に成功
+ * @retval LORABBIT_ERROR_INVALID_ARGUMENT 引数がNULL、または送信サービスが未起動
+ * @retval LORABBIT_ERROR_TIMEOUT キューが満杯のままタイムアウト
+ * @retval その他 負値のエラーコード
+ */
+int LoRabbit_SubmitSend(LoraHandle_t *p_handle, LoRabbit_TxRequest_t *p_request, TMO timeout);
+
+/** @} */ // end of LoRabbitService group
+#endif // LORABBIT_USE_TX_SERVICE
+
+#ifdef LORABBIT_USE_RX_DISPATCHER
+
+/**
+ * @defgroup LoRabbitRxDispatcher RX Dispatcher
+ * @brief 受信したフレームを専用のタスクで読み出し、振り分けるAPI
+ * @{
+ */
+
+/**
+ * @brief 受信ディスパッチャのタスクを起動する
+ * @details UARTのリングバッファを読み出し続けるタスク (スタック LORABBIT_RX_DISPATCHER_STACK_SIZE バイト) を
+ * 生成して起動します。受信したフレームは、送信中の転送へのACK/NACK、大容量データ転送のデータパケット、
+ * それ以外のフレームに振り分けて、それぞれ LORABBIT_RX_DISPATCH_QUEUE_DEPTH 個まで保持します。
+ * 起動後は、LoRabbit_SendData() などのACK待ちはACK/NACKだけを、LoRabbit_ReceiveData() などは
+ * データパケットだけを、LoRabbit_ReceiveFrame() はそれ以外のフレームだけを受け取ります。
+ * また、LoRabbit_SendFrame() は送信後にリングバッファを空にしなくなります。
+ * LoRabbit_Init() と LoRabbit_InitModule() の後に、1度だけ呼んで下さい。
+ * @param[in,out] p_handle 操作対象のハンドル
+ * @param[in] task_priority 受信ディスパッチャのタスクの優先度 (フレームを取りこぼさないよう、
+ * ライブラリを使うタスクより高い優先度を推奨)
+ * @retval LORABBIT_OK 成功
+ * @retval LORABBIT_ERROR_INVALID_ARGUMENT 引数がNULL、または起動済み
+ * @retval その他 負値のエラーコード (μT-Kernelのエラー)
+ */
+int LoRabbit_StartRxDispatcher(LoraHandle_t *p_handle, PRI task_priority);
+
+/**
+ * @brief キューが満杯で捨てたフレームの数を取得する
+ * @param[in] p_handle 操作対象のハンドル
+ * @param[in] rx_class 振り分け先
+ * @return 起動してから捨てたフレームの数
+ */
+uint32_t LoRabbit_GetRxDroppedCount(const LoraHandle_t *p_handle, LoRabbit_RxClass_t rx_class);
+
+/** @} */ // end of LoRabbitRxDispatcher group
+#endif // LORABBIT_USE_RX_DISPATCHER
@@ -0,0 +1,265 @@
+/**
+ * @file LoRabbit_survey.c
+ * @brief LoRabbit チャンネルの調査とチャンネル移動の実装
+ * @details チャンネル移動の要求と応答のフレームの形式は以下の通りです。
+ * | 識別子 (1) | 送信元アドレス (2) | 種別 (1) | 移動先チャンネル (1) | 応答先チャンネル (1) | トークン (1) |
+ * 応答は要求と同じ移動先チャンネルとトークンを返し、要求した側はそれで自分の要求への応答か見分けます。
+ */
+#include "LoRabbit_survey.h"
+
+#ifdef LORABBIT_USE_CHANNEL_SURVEY
+
+#include "LoRabbit_internal.h"
+#include "LoRabbit_hal.h"
+
+#include <string.h>
+
+#define LORA_CHMOVE_FRAME_MARKER  0xA8 // チャンネル移動のフレームの識別子
+#define LORA_CHMOVE_FRAME_SIZE    7
+#define LORA_CHMOVE_TYPE_REQUEST  0x01
+#define LORA_CHMOVE_TYPE_ACK      0x02
+
+// 現在時刻をミリ秒で取得するヘルパー関数（内部利用）
+static uint32_t lora_survey_now_ms(void) {
+    SYSTIM now;
+    tk_get_tim(&now);
+    return now.lo;
+}
+
+// モジュールの設定を書き込み、通常モードに戻すヘルパー関数（内部利用）
+// 調査やチャンネル移動のたびに書き換えるため、不揮発メモリを消耗しない一時的な書き込みを使う
+static int lora_survey_apply_config(LoraHandle_t *p_handle, LoraConfigItem_t *p_config) {
+    int err = lora_apply_config_temporary(p_handle, p_config);
+    LoRabbit_SwitchToNormalMode(p_handle);
+    return err;
+}
+
+// 自分のチャンネルを切り替えるヘルパー関数（内部利用）
+static int lora_survey_set_channel(LoraHandle_t *p_handle, uint8_t channel) {
+    if (p_handle->current_config.own_channel == channel) {
+        return LORABBIT_OK;
+    }
+    LoraConfigItem_t config = p_handle->current_config;
+    config.own_channel = channel;
+    return lora_survey_apply_config(p_handle, &config);
+}
+
+// 1チャンネル分の周囲のRSSIノイズを読み出して集計するヘルパー関数（内部利用）
+static void lora_survey_sample(LoraHandle_t *p_handle, LoRabbit_ChannelSurvey_t *p_result) {
+    int32_t noise_sum = 0;
+    uint8_t busy_count = 0;
+    p_result->noise_max_dbm = INT16_MIN;
+    p_result->sample_count = 0;
+
+    for (int i = 0; i < LORABBIT_SURVEY_SAMPLE_COUNT; i++) {
+        if (i > 0) {
+            tk_dly_tsk(LORABBIT_SURVEY_SAMPLE_INTERVAL_MS);
+        }
+        int16_t noise_dbm;
+        tk_wai_sem(p_handle->noise_mutex_id, 1, TMO_FEVR);
+        int err = lora_read_ambient_noise(p_handle, &noise_dbm);
+        tk_sig_sem(p_handle->noise_mutex_id, 1);
+        if (err == LORABBIT_ERROR_RETRY) {
+            // 調査中に受信したフレームは使わないので捨てて、読み出し直す
+            RecvFrameE220900T22SJP_t frame;
+            lora_receive_frame_raw(p_handle, &frame, TMO_POL);
+            continue;
+        }
+        if (err < 0) {
+            continue;
+        }
+        noise_sum += noise_dbm;
+        if (noise_dbm > p_result->noise_max_dbm) {
+            p_result->noise_max_dbm = noise_dbm;
+        }
+        if (noise_dbm >= LORABBIT_SURVEY_BUSY_THRESHOLD_DBM) {
+            busy_count++;
+        }
+        p_result->sample_count++;
+    }
+
+    if (p_result->sample_count > 0) {
+        p_result->noise_avg_dbm = (int16_t)(noise_sum / p_result->sample_count);
+        p_result->busy_percent = (uint8_t)(busy_count * 100 / p_result->sample_count);
+    } else {
+        // 読み出せなかったチャンネルは、最も使用中とみなして最後に並べる
+        p_result->noise_avg_dbm = 0;
+        p_result->noise_max_dbm = 0;
+        p_result->busy_percent = 100;
+    }
+}
+
+// 調査結果が a の方が空いているか判定するヘルパー関数（内部利用）
+static bool lora_survey_is_quieter(const LoRabbit_ChannelSurvey_t *p_a, const LoRabbit_ChannelSurvey_t *p_b) {
+    if (p_a->busy_percent != p_b->busy_percent) {
+        return p_a->busy_percent < p_b->busy_percent;
+    }
+    return p_a->noise_avg_dbm < p_b->noise_avg_dbm;
+}
+
+int LoRabbit_SurveyChannels(LoraHandle_t *p_handle, uint8_t first_channel, uint8_t last_channel,
+                            LoRabbit_ChannelSurvey_t *p_results, int max_results) {
+    if (NULL == p_handle || NULL == p_results || first_channel > last_channel ||
+        max_results < last_channel - first_channel + 1) {
+        return LORABBIT_ERROR_INVALID_ARGUMENT;
+    }
+#ifdef LORABBIT_USE_RX_DISPATCHER
+    // モジュールの設定の応答を受信ディスパッチャが読み出してしまうため
+    if (p_handle->rx_dispatcher_task_id > 0) {
+        return LORABBIT_ERROR_UNSUPPORTED;
+    }
+#endif
+
+    // 周囲のRSSIノイズを読み出せるよう、調査中は出力を有効にする
+    const LoraConfigItem_t original_config = p_handle->current_config;
+    LoraConfigItem_t config = original_config;
+    config.rssi_ambient_noise_flag = LORA_FLAG_ENABLED;
+
+    int count = 0;
+    int err = LORABBIT_OK;
+    for (int channel = first_channel; channel <= last_channel; channel++) {
+        config.own_channel = (uint8_t)channel;
+        err = lora_survey_apply_config(p_handle, &config);
+        if (err < 0) {
+            break;
+        }
+
+        LoRabbit_ChannelSurvey_t result;
+        memset(&result, 0, sizeof(result));
+        result.channel = (uint8_t)channel;
+        lora_survey_sample(p_handle, &result);
+        LORA_PRINTF("survey: ch=%d busy=%d%% avg=%d dBm max=%d dBm\n",
+                    channel, result.busy_percent, result.noise_avg_dbm, result.noise_max_dbm);
+
+        // 空いている順に挿入する
+        int i = count;
+        while (i > 0 && lora_survey_is_quieter(&result, &p_results[i - 1])) {
+            p_results[i] = p_results[i - 1];
+            i--;
+        }
+        p_results[i] = result;
+        count++;
+    }
+
+    LoraConfigItem_t restore_config = original_config;
+    int restore_err = lora_survey_apply_config(p_handle, &restore_config);
+    if (err < 0) {
+        return err;
+    }
+    if (restore_err < 0) {
+        return restore_err;
+    }
+    return count;
+}
+
+// チャンネル移動のフレームを組み立てて送信するヘルパー関数（内部利用）
+static int lora_chmove_send(LoraHandle_t *p_handle, uint16_t target_address, uint8_t target_channel,
+                            uint8_t type, uint8_t new_channel, uint8_t reply_channel, uint8_t token) {
+    const uint16_t own_address = p_handle->current_config.own_address;
+    uint8_t frame[LORA_CHMOVE_FRAME_SIZE] = {
+        LORA_CHMOVE_FRAME_MARKER, (uint8_t)(own_address >> 8), (uint8_t)(own_address & 0xff),
+        type, new_channel, reply_channel, token,
+    };
+    return LoRabbit_SendFrame(p_handle, target_address, target_channel, frame, sizeof(frame));
+}
+
+// 相手に要求を送り、応答を待つヘルパー関数（内部利用）
+// 応答先には自分の現在のチャンネルを指定する
+static int lora_chmove_request(LoraHandle_t *p_handle, uint16_t peer_address, uint8_t peer_channel,
+                               uint8_t new_channel, uint8_t token) {
+    for (int attempt = 0; attempt < LORABBIT_CHANNEL_MOVE_RETRY_COUNT; attempt++) {
+        int err = lora_chmove_send(p_handle, peer_address, peer_channel, LORA_CHMOVE_TYPE_REQUEST,
+                                   new_channel, p_handle->current_config.own_channel, token);
+        if (err < 0) {
+            return err;
+        }
+
+        const uint32_t start_ms = lora_survey_now_ms();
+        uint32_t elapsed_ms = 0;
+        while (elapsed_ms < LORABBIT_CHANNEL_MOVE_ACK_TIMEOUT_MS) {
+            RecvFrameE220900T22SJP_t frame;
+            int len = LoRabbit_ReceiveFrame(p_handle, &frame, LORABBIT_CHANNEL_MOVE_ACK_TIMEOUT_MS - elapsed_ms);
+            const uint8_t *p = frame.recv_data;
+            if (len == LORA_CHMOVE_FRAME_SIZE && p[0] == LORA_CHMOVE_FRAME_MARKER &&
+                ((p[1] << 8) | p[2]) == peer_address && p[3] == LORA_CHMOVE_TYPE_ACK &&
+                p[4] == new_channel && p[6] == token) {
+                return LORABBIT_OK;
+            }
+            elapsed_ms = lora_survey_now_ms() - start_ms;
+        }
+        LORA_PRINTF("channel move: no response from 0x%04X on ch=%d (attempt %d)\n",
+                    peer_address, peer_channel, attempt + 1);
+    }
+    return LORABBIT_ERROR_ACK_FAILED;
+}
+
+int LoRabbit_MoveChannel(LoraHandle_t *p_handle, uint16_t peer_address, uint8_t peer_channel, uint8_t new_channel) {
+    if (NULL == p_handle) {
+        return LORABBIT_ERROR_INVALID_ARGUMENT;
+    }
+#ifdef LORABBIT_USE_RX_DISPATCHER
+    if (p_handle->rx_dispatcher_task_id > 0) {
+        return LORABBIT_ERROR_UNSUPPORTED;
+    }
+#endif
+
+    const uint8_t original_channel = p_handle->current_config.own_channel;
+    const uint8_t token = (uint8_t)lora_random(p_handle);
+
+    int err = lora_chmove_request(p_handle, peer_address, peer_channel, new_channel, token);
+    if (err == LORABBIT_OK) {
+        return lora_survey_set_channel(p_handle, new_channel);
+    }
+    if (err != LORABBIT_ERROR_ACK_FAILED) {
+        return err;
+    }
+
+    // 相手が移った後に応答が失われた場合に備え、移動先のチャンネルで確かめる
+    err = lora_survey_set_channel(p_handle, new_channel);
+    if (err < 0) {
+        return err;
+    }
+    err = lora_chmove_request(p_handle, peer_address, new_channel, new_channel, token);
+    if (err == LORABBIT_OK) {
+        return LORABBIT_OK;
+    }
+    int restore_err = lora_survey_set_channel(p_handle, original_channel);
+    return (restore_err < 0) ? restore_err : err;
+}
+
+int LoRabbit_AcceptChannelMove(LoraHandle_t *p_handle, const RecvFrameE220900T22SJP_t *p_frame,
+                               uint16_t *p_peer_address) {
+    if (NULL == p_handle || NULL == p_frame) {
+        return LORABBIT_ERROR_INVALID_ARGUMENT;
+    }
+    const uint8_t *p = p_frame->recv_data;
+    if (p_frame->recv_data_len != LORA_CHMOVE_FRAME_SIZE || p[0] != LORA_CHMOVE_FRAME_MARKER ||
+        p[3] != LORA_CHMOVE_TYPE_REQUEST) {
+        return LORABBIT_ERROR_INVALID_PACKET;
+    }
+#ifdef LORABBIT_USE_RX_DISPATCHER
+    if (p_handle->rx_dispatcher_task_id > 0) {
+        return LORABBIT_ERROR_UNSUPPORTED;
+    }
+#endif
+
+    const uint16_t peer_address = (p[1] << 8) | p[2];
+    const uint8_t new_channel = p[4];
+    if (NULL != p_peer_address) {
+        *p_peer_address = peer_address;
+    }
+
+    // 応答の送信完了を待ってからチャンネルを移る
+    int err = lora_chmove_send(p_handle, peer_address, p[5], LORA_CHMOVE_TYPE_ACK, new_channel, p[5], p[6]);
+    if (err < 0) {
+        return err;
+    }
+    err = lora_survey_set_channel(p_handle, new_channel);
+    if (err < 0) {
+        return err;
+    }
+    LORA_PRINTF("channel move: moved to ch=%d by 0x%04X\n", new_channel, peer_address);
+    return new_channel;
+}
+
+#endif // LORABBIT_USE_CHANNEL_SURVEY
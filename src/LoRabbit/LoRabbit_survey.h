@@ -0,0 +1,82 @@
+/**
+ * @file LoRabbit_survey.h
+ * @brief LoRabbit チャンネルの調査とチャンネル移動
+ * @details 各チャンネルの周囲のRSSIノイズを調べて空いている順に並べるAPIと、
+ * 通信相手と示し合わせて別のチャンネルへ移るAPIを定義します。
+ * 起動時のチャンネル選択にも、運用中の定期的な見直しにも使えます。
+ * @author men100
+ * @date 2025/09/30
+ */
+#pragma once
+#include "LoRabbit.h"
+
+#ifdef LORABBIT_USE_CHANNEL_SURVEY
+
+/**
+ * @defgroup LoRabbitSurvey Channel Survey
+ * @brief チャンネルを調査し、空いているチャンネルへ移るAPI
+ * @{
+ */
+
+/**
+ * @brief 指定した範囲のチャンネルを調査し、空いている順に並べる
+ * @details チャンネルごとに自分のチャンネルを切り替え、周囲のRSSIノイズを
+ * LORABBIT_SURVEY_SAMPLE_COUNT 回読み出します。結果は使用中の割合 (busy_percent) の小さい順、
+ * 同じなら平均ノイズの小さい順 (それも同じならチャンネルの番号順) に並べます。
+ * 1チャンネルあたり、設定の切り替えに約 0.4 秒と読み出しに約 0.5 秒 (初期値の場合) がかかり、
+ * 最後に元の設定に戻します。その間は送受信できません。
+ * チャンネルの切り替えは不揮発メモリを書き換えない一時的な設定の書き込み (0xC2) で行います。
+ * 受信ディスパッチャの起動中は使えません。
+ * @param[in,out] p_handle 操作対象のハンドル (LoRabbit_InitModule() で設定済みのもの)
+ * @param[in] first_channel 調査する最初のチャンネル
+ * @param[in] last_channel 調査する最後のチャンネル (空中データレートの帯域幅で使えるチャンネルの範囲内)
+ * @param[out] p_results 調査結果の格納先 (先頭が最も空いているチャンネル)
+ * @param[in] max_results p_results の要素数 (last_channel - first_channel + 1 以上)
+ * @return 調査したチャンネルの数
+ * @retval LORABBIT_ERROR_INVALID_ARGUMENT 引数が不正
+ * @retval LORABBIT_ERROR_UNSUPPORTED 受信ディスパッチャの起動中
+ * @retval その他 負値のエラーコード (モジュールの設定に失敗。元の設定に戻せなかった場合を含む)
+ */
+int LoRabbit_SurveyChannels(LoraHandle_t *p_handle, uint8_t first_channel, uint8_t last_channel,
+                            LoRabbit_ChannelSurvey_t *p_results, int max_results);
+
+/**
+ * @brief 通信相手と示し合わせて、自分と相手のチャンネルを移す
+ * @details 相手にチャンネル移動の要求を送り、応答を受け取ったら自分のチャンネルを移します。
+ * 相手は要求を受け取ると応答を返してチャンネルを移るため (LoRabbit_AcceptChannelMove())、
+ * 応答が失われた場合は移動先のチャンネルで要求を送り直し、相手が移っていれば成功とします。
+ * どちらでも応答がなければ元のチャンネルに戻ります。ただし、相手が移った後の応答が全て失われた場合は
+ * 相手だけが移動先にいるため、通信できなければ移動先のチャンネルでも試して下さい。
+ * 応答を待つ間に受信した他のフレームは捨てます。
+ * チャンネルは不揮発メモリを書き換えない一時的な設定の書き込み (0xC2) で移るため、モジュールの電源を
+ * 切ると LoRabbit_InitModule() で最後に書き込んだチャンネルに戻ります。
+ * 受信ディスパッチャの起動中は使えません。
+ * @param[in,out] p_handle 操作対象のハンドル
+ * @param[in] peer_address 相手のアドレス
+ * @param[in] peer_channel 相手の現在のチャンネル
+ * @param[in] new_channel 移動先のチャンネル
+ * @retval LORABBIT_OK 成功 (自分と相手のチャンネルが new_channel になった)
+ * @retval LORABBIT_ERROR_ACK_FAILED 相手から応答がない (自分のチャンネルは元のまま)
+ * @retval LORABBIT_ERROR_UNSUPPORTED 受信ディスパッチャの起動中
+ * @retval その他 負値のエラーコード (モジュールの設定に失敗)
+ */
+int LoRabbit_MoveChannel(LoraHandle_t *p_handle, uint16_t peer_address, uint8_t peer_channel, uint8_t new_channel);
+
+/**
+ * @brief 受信したフレームがチャンネル移動の要求なら、応答を返して自分のチャンネルを移す
+ * @details LoRabbit_ReceiveFrame() で受信したフレームを渡します。移動先が自分の現在のチャンネルと同じ場合は
+ * (自分の応答が失われ、相手が移動先で要求を送り直した場合)、応答だけを返します。
+ * LoRabbit_MoveChannel() と同じく、チャンネルは一時的な設定の書き込みで移ります。
+ * @param[in,out] p_handle 操作対象のハンドル
+ * @param[in] p_frame 受信したフレーム
+ * @param[out] p_peer_address 要求を送った相手のアドレスの格納先 (NULL可)
+ * @return 移動先のチャンネル (0以上)
+ * @retval LORABBIT_ERROR_INVALID_PACKET チャンネル移動の要求ではない
+ * @retval LORABBIT_ERROR_UNSUPPORTED 受信ディスパッチャの起動中
+ * @retval その他 負値のエラーコード (応答の送信、またはモジュールの設定に失敗)
+ */
+int LoRabbit_AcceptChannelMove(LoraHandle_t *p_handle, const RecvFrameE220900T22SJP_t *p_frame,
+                               uint16_t *p_peer_address);
+
+/** @} */ // end of LoRabbitSurvey group
+#endif // LORABBIT_USE_CHANNEL_SURVEY
@@ -9,6 +9,7 @@
 #include "LoRabbit_config.h"
 #include "LoRabbit_internal.h"
 #include "LoRabbit_util.h"
+#include "LoRabbit_fec.h"
 #include <stdio.h>
 #include <string.h>
 #include <tm/tmonitor.h>
@@ -20,14 +21,35 @@ static heatshrink_encoder s_hse;
 static heatshrink_decoder s_hsd;
 
 // 大容量伝送用の定義
+#define LORABBIT_TP_MAX_FRAME_SIZE   197 // LoRabbit_SendFrame で送れる最大フレーム長
+#define LORABBIT_TP_FRAME_ADDRESS_SIZE 3 // LoRabbit_SendFrame が先頭に付ける送信先アドレスとチャンネル (エアタイムの計算に含める)
 #define LORABBIT_TP_HEADER_SIZE      8
-#define LORABBIT_TP_MAX_PAYLOAD      (197 - LORABBIT_TP_HEADER_SIZE) // 189バイト
-#define LORABBIT_TP_MAX_TOTAL_SIZE   (255 * LORABBIT_TP_MAX_PAYLOAD) // 48,195バイト
+#define LORABBIT_TP_MAX_PAYLOAD      (LORABBIT_TP_MAX_FRAME_SIZE - LORABBIT_TP_HEADER_SIZE) // 189バイト
+#define LORABBIT_TP_EXT_HEADER_SIZE  10 // 拡張ヘッダ (パケット数とパケット番号が16ビット)
+#define LORABBIT_TP_EXT_MAX_PAYLOAD  (LORABBIT_TP_MAX_FRAME_SIZE - LORABBIT_TP_EXT_HEADER_SIZE) // 187バイト
+#define LORABBIT_TP_STD_MAX_PACKETS  255 // 通常のヘッダで扱える最大パケット数
+#define LORABBIT_TP_COMPACT_HEADER_SIZE 3 // コンパクトヘッダ (コントロールバイト + トランザクションID + パケット番号)。拡張ヘッダの転送では4バイト
 
 // コントロールバイトのフラグ定義
 #define LORABBIT_TP_FLAG_ACK_REQUEST (1 << 7)
 #define LORABBIT_TP_FLAG_IS_ACK      (1 << 6)
 #define LORABBIT_TP_FLAG_EOT         (1 << 5)
+#define LORABBIT_TP_FLAG_FEC         (1 << 4) // 冗長パケット付きの転送 (total_packets 以上の packet_index は冗長パケット)
+#define LORABBIT_TP_FLAG_COMPACT     (1 << 3) // コンパクトヘッダを使う転送 (ACKもコンパクトヘッダで返す)
+#define LORABBIT_TP_FLAG_EXT_HEADER  (1 << 2) // 拡張ヘッダ (total_packets と packet_index が16ビット)
+#define LORABBIT_TP_FLAG_NACK_PARTIAL LORABBIT_TP_FLAG_EOT // NACK: ビットマップの範囲より後ろの受信状況は未確定
+
+// コントロールバイト下位2ビット: 再送制御方式 (ACKパケットでは応答の形式を示す)
+#define LORABBIT_TP_ARQ_MASK          0x03
+#define LORABBIT_TP_ARQ_STOP_AND_WAIT 0x00 // 1パケットごとのACK (従来方式)
+#define LORABBIT_TP_ARQ_WINDOW        0x01 // スライディングウィンドウ + 選択ACK
+#define LORABBIT_TP_ARQ_BURST         0x02 // 全パケット連続送信 + 末尾での欠損ビットマップ(NACK)
+#define LORABBIT_TP_ARQ_MULTICAST     0x03 // 同報送信 + 欠損のある受信側だけがランダムな返信スロットでNACK
+
+// 受信状況ビットマップの定義 (ビットマップ本体はハンドルが持つ)
+#define LORABBIT_TP_SACK_BITMAP_MAX  24   // 選択ACKに載せる最大ビットマップ長 (32バイトモードでも1フレームに収まるサイズ)
+#define LORABBIT_TP_NACK_BITMAP_MAX  32   // NACKに載せる最大ビットマップ長 (通常のヘッダなら全パケット分)
+#define LORABBIT_TP_COMPACT_BITMAP_MAX LORABBIT_TP_SACK_BITMAP_MAX // コンパクトヘッダのACKに載せる最大ビットマップ長
 
 // パケットヘッダ構造体（内部利用）
 typedef struct {
@@ -35,153 +57,2363 @@ typedef struct {
     uint8_t  source_channel;
     uint8_t  control_byte;
     uint8_t  transaction_id;
-    uint8_t  total_packets;
-    uint8_t  packet_index;
+    uint16_t total_packets;
+    uint16_t packet_index;
     uint8_t  payload_length;
+    uint8_t  fragment_length; // データパケットの間隔 (packet_index x fragment_length がデータ内の位置)。ACKと、間隔の分からない末尾のデータパケットでは0
+    uint8_t  header_size; // ヘッダ長 (ペイロードの開始位置)
 } LoRabbitTP_Header_t;
 
+// 送信ごとに払い出すトランザクションID (初回に乱数で初期化する)
+static uint8_t s_transaction_id_counter = 0;
+static bool s_is_transaction_id_seeded = false;
+
+// 乱数の状態 (xorshift32。0は未初期化)
+static uint32_t s_random_state = 0;
+
+// ビットマップ操作のヘルパー関数（内部利用）
+static inline void lora_bitmap_set(uint8_t *p_bitmap, uint16_t index) {
+    p_bitmap[index / 8] |= (uint8_t)(1 << (index % 8));
+}
+
+static inline void lora_bitmap_clear(uint8_t *p_bitmap, uint16_t index) {
+    p_bitmap[index / 8] &= (uint8_t)~(1 << (index % 8));
+}
+
+static inline bool lora_bitmap_test(const uint8_t *p_bitmap, uint16_t index) {
+    return (p_bitmap[index / 8] & (1 << (index % 8))) != 0;
+}
+
+// 現在時刻をミリ秒で取得するヘルパー関数（内部利用）
+static uint64_t lora_get_time_ms(void) {
+    SYSTIM now;
+    tk_get_tim(&now);
+    return ((uint64_t)now.hi << 32) | now.lo;
+}
+
+// 乱数を返す
+// 同じタイミングで衝突した端末や、同じ同報送信を受信した端末どうしで値が揃わないよう、自分のアドレスと時刻で初期化する
+uint32_t lora_random(const LoraHandle_t *p_handle) {
+    if (s_random_state == 0) {
+        s_random_state = ((uint32_t)p_handle->current_config.own_address << 16) ^ (uint32_t)lora_get_time_ms();
+        if (s_random_state == 0) {
+            s_random_state = 1;
+        }
+    }
+    s_random_state ^= s_random_state << 13;
+    s_random_state ^= s_random_state >> 17;
+    s_random_state ^= s_random_state << 5;
+    return s_random_state;
+}
+
+// 次の送信に使うトランザクションIDを払い出すヘルパー関数（内部利用）
+// 再起動した送信側が、受信側に残る受信完了した転送と同じIDで送り始めないようにする
+static uint8_t lora_next_transaction_id(const LoraHandle_t *p_handle) {
+    if (!s_is_transaction_id_seeded) {
+        s_transaction_id_counter = (uint8_t)lora_random(p_handle);
+        s_is_transaction_id_seeded = true;
+    }
+    return s_transaction_id_counter++;
+}
+
+// 転送のパケット数から、使用するヘッダの種類を決めるヘルパー関数（内部利用）
+// 戻り値: コントロールバイトに加えるフラグ
+static inline uint8_t lora_header_flags(uint16_t total_packets) {
+    return (total_packets > LORABBIT_TP_STD_MAX_PACKETS) ? LORABBIT_TP_FLAG_EXT_HEADER : 0;
+}
+
+// 1パケットあたりの最大ペイロード長を返すヘルパー関数（内部利用）
+static inline uint8_t lora_max_payload(uint8_t control_byte) {
+    return (control_byte & LORABBIT_TP_FLAG_EXT_HEADER) ? LORABBIT_TP_EXT_MAX_PAYLOAD : LORABBIT_TP_MAX_PAYLOAD;
+}
+
+// モジュールの設定 (payload_size) で送れる最大フレーム長を返す
+uint8_t lora_frame_size_limit(const LoraHandle_t *p_handle) {
+    switch (p_handle->current_config.payload_size) {
+        case LORA_PAYLOAD_SIZE_128_BYTE: return 128;
+        case LORA_PAYLOAD_SIZE_64_BYTE:  return 64;
+        case LORA_PAYLOAD_SIZE_32_BYTE:  return 32;
+        default:                         return LORABBIT_TP_MAX_FRAME_SIZE;
+    }
+}
+
+// ACKに載せるビットマップの最大長を返すヘルパー関数（内部利用）
+// 通常のヘッダでも max_length とモジュールの最大フレーム長を超えない長さにする
+static inline uint8_t lora_ack_bitmap_limit(const LoraHandle_t *p_handle, uint8_t control_byte, uint8_t max_length) {
+    uint8_t header_size = (control_byte & LORABBIT_TP_FLAG_EXT_HEADER) ? LORABBIT_TP_EXT_HEADER_SIZE : LORABBIT_TP_HEADER_SIZE;
+    uint8_t limit = lora_frame_size_limit(p_handle) - header_size;
+    return (limit < max_length) ? limit : max_length;
+}
+
+// コンパクトヘッダのACKのビットマップ長を返すヘルパー関数（内部利用）
+// コンパクトヘッダのACKは長さフィールドを持たないので、受信側がフレームの長さをヘッダから求められるよう
+// 応答の形式ごとに決まった長さにする。ストップアンドウェイトのACKはビットマップなし、
+// 選択ACKとNACKは cumulative (累積ACK / 最初の欠損パケット) から転送の末尾までを、最大長で切り詰めた長さ
+static inline uint8_t lora_compact_ack_bitmap_length(uint8_t control_byte, uint16_t total_packets, uint16_t cumulative) {
+    if ((control_byte & LORABBIT_TP_ARQ_MASK) == LORABBIT_TP_ARQ_STOP_AND_WAIT || cumulative >= total_packets) {
+        return 0;
+    }
+    uint16_t length = (total_packets - cumulative + 7) / 8;
+    return (length < LORABBIT_TP_COMPACT_BITMAP_MAX) ? (uint8_t)length : LORABBIT_TP_COMPACT_BITMAP_MAX;
+}
+
+// データパケットのヘッダ長を返すヘルパー関数（内部利用）
+// コンパクトヘッダの転送では、受信側が転送を認識した後のヘッダ長を返す
+static inline uint8_t lora_data_header_size(uint8_t control_byte) {
+    if (control_byte & LORABBIT_TP_FLAG_COMPACT) {
+        return (control_byte & LORABBIT_TP_FLAG_EXT_HEADER) ? LORABBIT_TP_COMPACT_HEADER_SIZE + 1 : LORABBIT_TP_COMPACT_HEADER_SIZE;
+    }
+    return (control_byte & LORABBIT_TP_FLAG_EXT_HEADER) ? LORABBIT_TP_EXT_HEADER_SIZE : LORABBIT_TP_HEADER_SIZE;
+}
+
+// 冗長パケットか判定するヘルパー関数（内部利用）
+static inline bool lora_is_repair_packet(const LoRabbitTP_Header_t *p_header) {
+    return !(p_header->control_byte & LORABBIT_TP_FLAG_IS_ACK) &&
+           (p_header->control_byte & LORABBIT_TP_FLAG_FEC) &&
+           (p_header->packet_index >= p_header->total_packets);
+}
+
+// データパケットのペイロード長から、パケットの間隔を求めるヘルパー関数（内部利用）
+// 末尾以外のデータパケットはパケットの間隔ちょうどの長さを持つ。末尾のパケットからは分からないので0を返す
+static inline uint8_t lora_data_fragment_length(const LoRabbitTP_Header_t *p_header) {
+    return (p_header->packet_index + 1 < p_header->total_packets) ? p_header->payload_length : 0;
+}
+
+// ヘッダの長さフィールドとフレーム長から、ペイロード長とパケットの間隔を求めるヘルパー関数（内部利用）
+// 長さフィールドの意味はパケットの種類で異なる:
+//   データパケット: ペイロード長 (従来の形式と同じ。パケットの間隔は末尾以外のパケットから求める)
+//   冗長パケット: 末尾のデータパケットの長さ (冗長断片の長さがパケットの間隔)
+//   ACK: ビットマップ長
+static void lora_apply_length_field(LoRabbitTP_Header_t *p_header, uint8_t length_field, int len) {
+    const uint8_t body_length = (uint8_t)(len - p_header->header_size);
+    p_header->payload_length = length_field;
+    if (p_header->control_byte & LORABBIT_TP_FLAG_IS_ACK) {
+        p_header->fragment_length = 0;
+    } else if (lora_is_repair_packet(p_header)) {
+        p_header->fragment_length = body_length;
+    } else {
+        p_header->fragment_length = lora_data_fragment_length(p_header);
+    }
+}
+
 // ヘッダを解析するヘルパー関数（内部利用）
-static void lora_parse_header(uint8_t *raw_packet, LoRabbitTP_Header_t *p_header) {
+// 戻り値: ヘッダ長。フレームがヘッダに満たない場合は0
+static uint8_t lora_parse_header(const uint8_t *raw_packet, int len, LoRabbitTP_Header_t *p_header) {
+    if (len < LORABBIT_TP_HEADER_SIZE) {
+        return 0;
+    }
     p_header->source_address = (raw_packet[0] << 8) | raw_packet[1];
     p_header->source_channel = raw_packet[2];
     p_header->control_byte   = raw_packet[3];
     p_header->transaction_id = raw_packet[4];
-    p_header->total_packets  = raw_packet[5];
-    p_header->packet_index   = raw_packet[6];
-    p_header->payload_length = raw_packet[7];
+
+    if (p_header->control_byte & LORABBIT_TP_FLAG_EXT_HEADER) {
+        if (len < LORABBIT_TP_EXT_HEADER_SIZE) {
+            return 0;
+        }
+        p_header->total_packets  = (raw_packet[5] << 8) | raw_packet[6];
+        p_header->packet_index   = (raw_packet[7] << 8) | raw_packet[8];
+        p_header->header_size    = LORABBIT_TP_EXT_HEADER_SIZE;
+    } else {
+        p_header->total_packets  = raw_packet[5];
+        p_header->packet_index   = raw_packet[6];
+        p_header->header_size    = LORABBIT_TP_HEADER_SIZE;
+    }
+    lora_apply_length_field(p_header, raw_packet[p_header->header_size - 1], len);
+    return p_header->header_size;
+}
+
+// 転送中のフレームのヘッダを解析するヘルパー関数（内部利用）
+// p_session はこの転送の相手 (source_address) と、転送全体で共通のフィールドを持つ。
+// コンパクトヘッダの転送では、先頭バイトが相手のアドレス上位バイトと一致するフレームを
+// 通常のヘッダ、それ以外をコンパクトヘッダとして解析し、省略されたフィールドを p_session から補う。
+// 送信側は、先頭バイトが自分のアドレス上位バイトと一致するフレームをコンパクトヘッダで送らない。
+// 戻り値: ヘッダ長。フレームがヘッダに満たない場合は0
+static uint8_t lora_parse_frame(const uint8_t *raw_packet,
+                                int len,
+                                const LoRabbitTP_Header_t *p_session,
+                                LoRabbitTP_Header_t *p_header)
+{
+    if (NULL == p_session || !(p_session->control_byte & LORABBIT_TP_FLAG_COMPACT) ||
+        (len > 0 && raw_packet[0] == (uint8_t)(p_session->source_address >> 8))) {
+        return lora_parse_header(raw_packet, len, p_header);
+    }
+
+    const uint8_t index_size = (p_session->control_byte & LORABBIT_TP_FLAG_EXT_HEADER) ? 2 : 1;
+    if (len < 2 + index_size) {
+        return 0;
+    }
+    p_header->source_address = p_session->source_address;
+    p_header->source_channel = p_session->source_channel;
+    p_header->control_byte   = raw_packet[0];
+    p_header->transaction_id = raw_packet[1];
+    p_header->total_packets  = p_session->total_packets;
+    p_header->packet_index   = (index_size == 2) ? ((raw_packet[2] << 8) | raw_packet[3]) : raw_packet[2];
+    p_header->header_size    = 2 + index_size;
+
+    // ペイロード長 (ACKではビットマップ長) はフレーム長から求める。
+    // 冗長パケットだけは末尾のデータパケットの長さを持ち、パケットの間隔は転送の情報から補う
+    const uint8_t body_length = (uint8_t)(len - p_header->header_size);
+    if (p_header->control_byte & LORABBIT_TP_FLAG_IS_ACK) {
+        p_header->fragment_length = 0;
+        p_header->payload_length  = body_length;
+    } else if (lora_is_repair_packet(p_header)) {
+        if (len < p_header->header_size + 1) {
+            return 0;
+        }
+        p_header->fragment_length = p_session->fragment_length;
+        p_header->payload_length  = raw_packet[p_header->header_size];
+        p_header->header_size++;
+    } else {
+        p_header->payload_length  = body_length;
+        p_header->fragment_length = lora_data_fragment_length(p_header);
+    }
+    return p_header->header_size;
+}
+
+// ヘッダを書き込むヘルパー関数（内部利用）
+// control_byte に LORABBIT_TP_FLAG_EXT_HEADER があれば拡張ヘッダを書き込む。
+// is_compact ならコンパクトヘッダ (長さフィールドは冗長パケットのみ) を書き込む。
+// length_field の意味は lora_apply_length_field() を参照
+// 戻り値: ヘッダ長
+static uint8_t lora_write_header(LoraHandle_t *p_handle,
+                                 uint8_t *p_packet,
+                                 uint8_t control_byte,
+                                 uint8_t transaction_id,
+                                 uint16_t total_packets,
+                                 uint16_t packet_index,
+                                 uint8_t length_field,
+                                 bool is_compact)
+{
+    if (is_compact) {
+        uint8_t header_size = 2;
+        p_packet[0] = control_byte;
+        p_packet[1] = transaction_id;
+        if (control_byte & LORABBIT_TP_FLAG_EXT_HEADER) {
+            p_packet[header_size++] = packet_index >> 8;
+        }
+        p_packet[header_size++] = packet_index & 0xFF;
+        if (!(control_byte & LORABBIT_TP_FLAG_IS_ACK) && (control_byte & LORABBIT_TP_FLAG_FEC) &&
+            packet_index >= total_packets) {
+            p_packet[header_size++] = length_field;
+        }
+        return header_size;
+    }
+
+    p_packet[0] = p_handle->current_config.own_address >> 8;
+    p_packet[1] = p_handle->current_config.own_address & 0xFF;
+    p_packet[2] = p_handle->current_config.own_channel;
+    p_packet[3] = control_byte;
+    p_packet[4] = transaction_id;
+
+    if (control_byte & LORABBIT_TP_FLAG_EXT_HEADER) {
+        p_packet[5] = total_packets >> 8;
+        p_packet[6] = total_packets & 0xFF;
+        p_packet[7] = packet_index >> 8;
+        p_packet[8] = packet_index & 0xFF;
+        p_packet[9] = length_field;
+        return LORABBIT_TP_EXT_HEADER_SIZE;
+    }
+    p_packet[5] = (uint8_t)total_packets;
+    p_packet[6] = (uint8_t)packet_index;
+    p_packet[7] = length_field;
+    return LORABBIT_TP_HEADER_SIZE;
+}
+
+// コンパクトヘッダで送れるか判定するヘルパー関数（内部利用）
+// 先頭バイト (コントロールバイト) が自分のアドレス上位バイトと一致すると、
+// 受信側で通常のヘッダと区別できないので通常のヘッダで送る
+static inline bool lora_can_use_compact(LoraHandle_t *p_handle, uint8_t control_byte) {
+    return (control_byte & LORABBIT_TP_FLAG_COMPACT) &&
+           (control_byte != (uint8_t)(p_handle->current_config.own_address >> 8));
+}
+
+// ACKのコントロールバイトを組み立てるヘルパー関数（内部利用）
+// ヘッダの種類 (拡張/コンパクト) はデータパケットに合わせる
+static inline uint8_t lora_ack_control_byte(const LoRabbitTP_Header_t *p_data_header, uint8_t flags) {
+    return LORABBIT_TP_FLAG_IS_ACK | flags |
+           (p_data_header->control_byte & (LORABBIT_TP_FLAG_EXT_HEADER | LORABBIT_TP_FLAG_COMPACT));
+}
+
+#if LORABBIT_TP_EXT_HEADER_SIZE + LORABBIT_TP_NACK_BITMAP_MAX > LORABBIT_TP_ACK_FRAME_SIZE_MAX
+#error "LORABBIT_TP_ACK_FRAME_SIZE_MAX is too small for the largest NACK frame"
+#endif
+
+// 受信中の転送の情報を、後続パケットの解析に使うヘッダの形で返すヘルパー関数（内部利用）
+static void lora_rx_session_header(const LoRabbitTP_RxSession_t *p_rx, LoRabbitTP_Header_t *p_session) {
+    memset(p_session, 0, sizeof(*p_session));
+    p_session->source_address  = p_rx->ack.address;
+    p_session->source_channel  = p_rx->ack.channel;
+    p_session->control_byte    = p_rx->ack.session_flags;
+    p_session->transaction_id  = p_rx->ack.transaction_id;
+    p_session->total_packets   = p_rx->ack.total_packets;
+    p_session->fragment_length = p_rx->ack.fragment_length;
+}
+
+// 受信中 (または受信完了した) 転送のパケットか判定するヘルパー関数（内部利用）
+// 送信元・トランザクションID・総パケット数・転送全体で共通のフラグが一致し、パケットの間隔と矛盾せず、
+// パケット番号が範囲内のデータパケット (または冗長パケット) であれば、その転送のパケットとみなす。
+// 末尾のデータパケットはパケットの間隔を持たないので、ペイロード長が間隔以下であることだけを確かめる
+// 戻り値: その転送のパケットであれば true (p_header に解析結果を格納し、パケットの間隔は転送の値にする)
+static bool lora_rx_session_match(const LoRabbitTP_RxSession_t *p_rx,
+                                  const uint8_t *raw_packet,
+                                  int len,
+                                  LoRabbitTP_Header_t *p_header)
+{
+    // コンパクトヘッダのパケットも解析できるよう、転送の情報を使う
+    LoRabbitTP_Header_t session;
+    lora_rx_session_header(p_rx, &session);
+    if (lora_parse_frame(raw_packet, len, &session, p_header) == 0) {
+        return false;
+    }
+    const uint8_t session_flags = LORABBIT_TP_FLAG_FEC | LORABBIT_TP_FLAG_COMPACT | LORABBIT_TP_FLAG_EXT_HEADER;
+    if ((p_header->control_byte & LORABBIT_TP_FLAG_IS_ACK) ||
+        (p_header->control_byte & session_flags) != p_rx->ack.session_flags ||
+        p_header->source_address  != p_rx->ack.address ||
+        p_header->transaction_id  != p_rx->ack.transaction_id ||
+        p_header->total_packets   != p_rx->ack.total_packets ||
+        (p_header->fragment_length != 0 && p_header->fragment_length != p_rx->ack.fragment_length) ||
+        p_header->payload_length  >  p_rx->ack.fragment_length) {
+        return false;
+    }
+    p_header->fragment_length = p_rx->ack.fragment_length;
+    if (lora_is_repair_packet(p_header)) {
+        // 冗長パケットは通常のヘッダの転送でのみ使う
+        return p_header->packet_index < LORABBIT_TP_STD_MAX_PACKETS;
+    }
+    return p_header->packet_index < p_header->total_packets &&
+           len >= p_header->header_size + p_header->payload_length;
+}
+
+// 受信を始めた転送の状態を初期化するヘルパー関数（内部利用）
+// ACKを返信するまでは、記録したACKはない状態になる
+static void lora_rx_session_begin(LoRabbitTP_RxSession_t *p_rx,
+                                  uint8_t *p_buffer,
+                                  const LoRabbitTP_Header_t *p_header)
+{
+    memset(p_rx, 0, sizeof(*p_rx));
+    p_rx->is_active           = true;
+    p_rx->is_multicast        = (p_header->control_byte & LORABBIT_TP_ARQ_MASK) == LORABBIT_TP_ARQ_MULTICAST;
+    p_rx->p_buffer            = p_buffer;
+    p_rx->last_event_ms       = lora_get_time_ms();
+    p_rx->ack.address         = p_header->source_address;
+    p_rx->ack.channel         = p_header->source_channel;
+    p_rx->ack.transaction_id  = p_header->transaction_id;
+    p_rx->ack.session_flags   = p_header->control_byte &
+                                (LORABBIT_TP_FLAG_FEC | LORABBIT_TP_FLAG_COMPACT | LORABBIT_TP_FLAG_EXT_HEADER);
+    p_rx->ack.total_packets   = p_header->total_packets;
+    p_rx->ack.fragment_length = p_header->fragment_length;
+}
+
+// 受信を終えた転送の状態を更新するヘルパー関数（内部利用）
+// 受信完了した転送は、完了時刻から送信側が再送を諦めるまでの間だけ再送にACKを返し直す
+static void lora_rx_session_end(LoRabbitTP_RxSession_t *p_rx, bool is_complete) {
+    p_rx->is_active = false;
+    if (is_complete) {
+        p_rx->completed_ms = lora_get_time_ms();
+    }
+}
+
+// 受信中の転送で、次のパケットを待つ時間を返すヘルパー関数（内部利用）
+// 送信側のACKタイムアウトと再送を待てるだけの時間。同報送信の送信側は、全ての返信スロットが終わってから再送する
+static TMO lora_rx_session_timeout(LoraHandle_t *p_handle, const LoRabbitTP_RxSession_t *p_rx) {
+    TMO timeout = lora_link_rx_timeout(lora_link_get(p_handle, p_rx->ack.address));
+    if (p_rx->is_multicast) {
+        timeout += (TMO)(LORABBIT_TP_MULTICAST_NACK_SLOTS * lora_link_reply_slot_ms(p_handle));
+    }
+    return timeout;
+}
+
+#if LORABBIT_TP_DELAYED_ACK_MS > 0 && !defined(LORABBIT_USE_RX_DISPATCHER)
+#error "LORABBIT_TP_DELAYED_ACK_MS requires LORABBIT_USE_RX_DISPATCHER"
+#endif
+
+#ifdef LORABBIT_USE_RX_DISPATCHER
+// ACKの送信を保留するヘルパー関数（内部利用）
+// LORABBIT_TP_DELAYED_ACK_MS 以内に同じ相手へデータパケットを送れば、その先頭に載せて送る。
+// 期限が来たら受信ディスパッチャが単独で送る。別の転送へのACKを保留していれば、先に単独で送る。
+// 保留するのは通常のヘッダのACKだけ (コンパクトヘッダのACKはビットマップ長をフレーム長から求めるので、
+// 後ろにデータパケットを続けられない)。同報送信のNACKは返信スロットを守るため保留しない。
+// 戻り値: 保留したら true
+static bool lora_delay_ack(LoraHandle_t *p_handle, const LoRabbitTP_AckCache_t *p_cache) {
+    if (LORABBIT_TP_DELAYED_ACK_MS <= 0 || p_handle->rx_dispatcher_task_id <= 0 ||
+        p_cache->frame[0] != (uint8_t)(p_handle->current_config.own_address >> 8) ||
+        (p_cache->frame[3] & LORABBIT_TP_ARQ_MASK) == LORABBIT_TP_ARQ_MULTICAST) {
+        return false;
+    }
+
+    LoRabbitTP_DelayedAck_t *p_delayed = &p_handle->tp_delayed_ack;
+    LoRabbitTP_DelayedAck_t previous;
+    previous.is_pending = false;
+
+    tk_wai_sem(p_handle->rx_queue_mutex_id, 1, TMO_FEVR);
+    bool is_same_transfer = p_delayed->is_pending && p_delayed->address == p_cache->address &&
+                            p_delayed->transaction_id == p_cache->transaction_id;
+    if (p_delayed->is_pending && !is_same_transfer) {
+        previous = *p_delayed;
+    }
+    if (!is_same_transfer) {
+        // 同じ転送のACKは新しいもので置き換え、期限は延ばさない
+        p_delayed->deadline_ms = (uint32_t)lora_get_time_ms() + LORABBIT_TP_DELAYED_ACK_MS;
+    }
+    p_delayed->address        = p_cache->address;
+    p_delayed->channel        = p_cache->channel;
+    p_delayed->transaction_id = p_cache->transaction_id;
+    p_delayed->length         = p_cache->length;
+    memcpy(p_delayed->frame, p_cache->frame, p_cache->length);
+    p_delayed->is_pending = true;
+    tk_sig_sem(p_handle->rx_queue_mutex_id, 1);
+
+    if (previous.is_pending) {
+        lora_send_frame_fire_and_forget_internal(p_handle, previous.address, previous.channel,
+                                                 previous.frame, previous.length);
+    }
+    return true;
+}
+
+// 指定した相手への保留中のACKを取り出すヘルパー関数（内部利用）
+// 戻り値: 取り出したACKの長さ。保留中のACKがなければ0
+static int lora_take_delayed_ack(LoraHandle_t *p_handle, uint16_t target_address, uint8_t target_channel,
+                                 uint8_t *p_frame)
+{
+    LoRabbitTP_DelayedAck_t *p_delayed = &p_handle->tp_delayed_ack;
+    int length = 0;
+
+    if (!p_delayed->is_pending) {
+        return 0;
+    }
+    tk_wai_sem(p_handle->rx_queue_mutex_id, 1, TMO_FEVR);
+    if (p_delayed->is_pending && p_delayed->address == target_address && p_delayed->channel == target_channel) {
+        memcpy(p_frame, p_delayed->frame, p_delayed->length);
+        length = p_delayed->length;
+        p_delayed->is_pending = false;
+    }
+    tk_sig_sem(p_handle->rx_queue_mutex_id, 1);
+    return length;
+}
+#endif
+
+// ACKフレームを記録してから送信するヘルパー関数（内部利用）
+// 最後のACKが欠損すると、送信側は受信完了後も同じパケットを再送してくるので、
+// lora_ack_cache_resend() で同じACKを返し直せるようにしておく
+static int lora_send_ack_frame(LoraHandle_t *p_handle, LoRabbitTP_AckCache_t *p_cache,
+                               const uint8_t *p_frame, uint8_t length)
+{
+    memcpy(p_cache->frame, p_frame, length);
+    p_cache->length   = length;
+    p_cache->is_valid = true;
+#ifdef LORABBIT_USE_RX_DISPATCHER
+    if (lora_delay_ack(p_handle, p_cache)) {
+        return LORABBIT_OK;
+    }
+#endif
+    return lora_send_frame_fire_and_forget_internal(p_handle, p_cache->address, p_cache->channel,
+                                                    p_cache->frame, p_cache->length);
+}
+
+// 受信完了した転送の再送パケットか判定し、そうであれば最後のACKを返し直すヘルパー関数（内部利用）
+// (トランザクションID, パケット番号) が完了した転送のものであれば重複とみなす。
+// 末尾のデータパケットはパケットの間隔を持たないので、間隔は末尾以外のパケットでだけ比べる。
+// ACK要求のないパケットと、返すACKのない転送 (同報送信) のパケットは、ACKを返さずに読み捨てる。
+// 送信側が再送してくる期間 (完了から lora_rx_session_timeout() の間) を過ぎたら、記録したACKは使わない
+// (再起動した送信側が、同じトランザクションIDで新しい転送を始めることがあるため)
+// 戻り値: 受信完了した転送のパケットであれば true
+static bool lora_ack_cache_resend(LoraHandle_t *p_handle, LoRabbitTP_RxSession_t *p_rx,
+                                  const uint8_t *raw_packet, int len)
+{
+    LoRabbitTP_Header_t header;
+    if (!p_rx->ack.is_valid || p_rx->completed_ms == 0) {
+        return false; // 受信完了していない (タイムアウトした転送を含む)
+    }
+    const LoRabbit_PeerLink_t *p_link = lora_link_find(p_handle, p_rx->ack.address);
+    if (NULL == p_link || lora_get_time_ms() - p_rx->completed_ms > (uint64_t)lora_rx_session_timeout(p_handle, p_rx) ||
+        !lora_rx_session_match(p_rx, raw_packet, len, &header)) {
+        return false;
+    }
+    if ((header.control_byte & LORABBIT_TP_FLAG_ACK_REQUEST) && p_rx->ack.length > 0) {
+        lora_send_frame_fire_and_forget_internal(p_handle, p_rx->ack.address, p_rx->ack.channel,
+                                                 p_rx->ack.frame, p_rx->ack.length);
+    }
+    return true;
 }
 
 // ACKパケットを送信するヘルパー関数（内部利用）
-static int lora_send_ack(LoraHandle_t *p_handle, LoRabbitTP_Header_t *p_data_header) {
-    uint8_t ack_payload[LORABBIT_TP_HEADER_SIZE];
+static int lora_send_ack(LoraHandle_t *p_handle, LoRabbitTP_AckCache_t *p_cache, LoRabbitTP_Header_t *p_data_header) {
+    uint8_t ack_payload[LORABBIT_TP_EXT_HEADER_SIZE];
+
+    // ACKのヘッダを組み立てる
+    uint8_t control_byte = lora_ack_control_byte(p_data_header, 0);
+    uint8_t header_size = lora_write_header(p_handle, ack_payload, control_byte, p_data_header->transaction_id,
+                                            p_data_header->total_packets, p_data_header->packet_index, 0,
+                                            lora_can_use_compact(p_handle, control_byte));
+
+    // ACK を送信 (待機なし)
+    return lora_send_ack_frame(p_handle, p_cache, ack_payload, header_size);
+}
+
+// 選択ACK (累積ACK + 受信ビットマップ) を送信するヘルパー関数（内部利用）
+static int lora_send_sack(LoraHandle_t *p_handle, LoRabbitTP_AckCache_t *p_cache,
+                          LoRabbitTP_Header_t *p_data_header, const uint8_t *p_received_bitmap) {
+    uint8_t ack_payload[LORABBIT_TP_EXT_HEADER_SIZE + LORABBIT_TP_SACK_BITMAP_MAX];
+    uint8_t sack[LORABBIT_TP_SACK_BITMAP_MAX];
+    uint8_t *p_sack = sack;
+    const uint16_t total_packets = p_data_header->total_packets;
+
+    // 累積ACK: 先頭から連続して受信済みのパケット数
+    uint16_t cumulative = 0;
+    while (cumulative < total_packets && lora_bitmap_test(p_received_bitmap, cumulative)) {
+        cumulative++;
+    }
+
+    // 累積ACK以降の受信状況をビットマップにする (bit n -> パケット cumulative + n)
+    uint8_t control_byte = lora_ack_control_byte(p_data_header, LORABBIT_TP_ARQ_WINDOW);
+    const bool is_compact = lora_can_use_compact(p_handle, control_byte);
+    uint16_t sack_len = (total_packets - cumulative + 7) / 8;
+    uint8_t sack_len_max = lora_ack_bitmap_limit(p_handle, control_byte, LORABBIT_TP_SACK_BITMAP_MAX);
+    if (sack_len > sack_len_max) {
+        sack_len = sack_len_max;
+    }
+    if (is_compact) {
+        sack_len = lora_compact_ack_bitmap_length(control_byte, total_packets, cumulative);
+    }
+    memset(p_sack, 0, sack_len);
+    for (uint16_t bit = 0; bit < sack_len * 8 && cumulative + bit < total_packets; bit++) {
+        if (lora_bitmap_test(p_received_bitmap, cumulative + bit)) {
+            lora_bitmap_set(p_sack, bit);
+        }
+    }
+
+    // ACKのヘッダを組み立てる (packet_index に累積ACK、payload_length にビットマップ長)
+    uint8_t header_size = lora_write_header(p_handle, ack_payload, control_byte, p_data_header->transaction_id,
+                                            total_packets, cumulative, (uint8_t)sack_len, is_compact);
+    memcpy(&ack_payload[header_size], sack, sack_len);
+
+    // ACK を送信 (待機なし)
+    return lora_send_ack_frame(p_handle, p_cache, ack_payload, header_size + sack_len);
+}
+
+// 欠損パケットのビットマップ (NACK) を送信するヘルパー関数（内部利用）
+// 欠損がなければビットマップ長0のNACKとなり、全パケットの受信完了を意味する。
+// 拡張ヘッダの転送ではビットマップが全パケットを覆えないことがあり、その場合は
+// LORABBIT_TP_FLAG_NACK_PARTIAL を立てて、範囲より後ろの受信状況が未確定であることを示す
+// (このときビットマップは最大長で送り、その長さで範囲を伝える)
+static int lora_send_nack(LoraHandle_t *p_handle, LoRabbitTP_AckCache_t *p_cache,
+                          LoRabbitTP_Header_t *p_data_header, const uint8_t *p_received_bitmap) {
+    uint8_t ack_payload[LORABBIT_TP_EXT_HEADER_SIZE + LORABBIT_TP_NACK_BITMAP_MAX];
+    uint8_t nack[LORABBIT_TP_NACK_BITMAP_MAX];
+    uint8_t *p_nack = nack;
+    uint8_t control_byte = lora_ack_control_byte(p_data_header, LORABBIT_TP_ARQ_BURST);
+    const uint16_t total_packets = p_data_header->total_packets;
+
+    // 先頭から連続して受信済みのパケット数 (= 最初の欠損パケット)
+    uint16_t cumulative = 0;
+    while (cumulative < total_packets && lora_bitmap_test(p_received_bitmap, cumulative)) {
+        cumulative++;
+    }
+
+    // 欠損パケットをビットマップにする (bit n -> パケット cumulative + n)。
+    // 最後の欠損パケットより後ろは受信済みなので送らない (コンパクトヘッダでは決まった長さで送る)
+    const bool is_compact = lora_can_use_compact(p_handle, control_byte);
+    const uint8_t nack_len_max = is_compact ? LORABBIT_TP_COMPACT_BITMAP_MAX
+                                            : lora_ack_bitmap_limit(p_handle, control_byte, LORABBIT_TP_NACK_BITMAP_MAX);
+    uint16_t nack_len = 0;
+    memset(p_nack, 0, LORABBIT_TP_NACK_BITMAP_MAX);
+    for (uint16_t bit = 0; bit < nack_len_max * 8 && cumulative + bit < total_packets; bit++) {
+        if (!lora_bitmap_test(p_received_bitmap, cumulative + bit)) {
+            lora_bitmap_set(p_nack, bit);
+            nack_len = bit / 8 + 1;
+        }
+    }
+
+    if ((uint32_t)cumulative + nack_len_max * 8 < total_packets) {
+        control_byte |= LORABBIT_TP_FLAG_NACK_PARTIAL;
+        nack_len = nack_len_max;
+    }
+    if (is_compact) {
+        nack_len = lora_compact_ack_bitmap_length(control_byte, total_packets, cumulative);
+    }
+
+    // NACKのヘッダを組み立てる (packet_index に最初の欠損パケット、payload_length にビットマップ長)
+    uint8_t header_size = lora_write_header(p_handle, ack_payload, control_byte, p_data_header->transaction_id,
+                                            total_packets, cumulative, (uint8_t)nack_len, is_compact);
+    memcpy(&ack_payload[header_size], nack, nack_len);
+
+    // NACK を送信 (待機なし)
+    return lora_send_ack_frame(p_handle, p_cache, ack_payload, header_size + nack_len);
+}
+
+// 送信側の転送情報 (ACKの解析に使う) を組み立てるヘルパー関数（内部利用）
+// session_flags には LORABBIT_TP_FLAG_COMPACT を指定できる
+static void lora_tx_session_init(LoRabbitTP_Header_t *p_session,
+                                 uint16_t target_address,
+                                 uint8_t target_channel,
+                                 uint8_t transaction_id,
+                                 uint16_t total_packets,
+                                 uint8_t fragment_length,
+                                 uint8_t session_flags)
+{
+    memset(p_session, 0, sizeof(LoRabbitTP_Header_t));
+    p_session->source_address  = target_address;
+    p_session->source_channel  = target_channel;
+    p_session->control_byte    = session_flags | lora_header_flags(total_packets);
+    p_session->transaction_id  = transaction_id;
+    p_session->total_packets   = total_packets;
+    p_session->fragment_length = fragment_length;
+}
+
+// データパケットをコンパクトヘッダで送るか判定するヘルパー関数（内部利用）
+// 転送の情報を持たない受信側は全てのフレームを通常のヘッダとして区切るので、コンパクトヘッダで送るのは
+// 受信側が転送を認識した (ACKが届いた) 後の、ACKを要求しないパケットだけにする。
+// ACKを要求するパケットは、受信を終えた受信側にも届いてACKを返し直してもらうことがあるため、通常のヘッダで送る。
+// 末尾のデータパケット (EOT) は短いことがあり、コンパクトヘッダでは受信側がフレームの長さを
+// ヘッダから求められないので、常に通常のヘッダで送る
+static bool lora_use_compact_header(LoraHandle_t *p_handle, uint8_t control_byte, bool is_peer_ready) {
+    return is_peer_ready && lora_can_use_compact(p_handle, control_byte) &&
+           !(control_byte & (LORABBIT_TP_FLAG_EOT | LORABBIT_TP_FLAG_ACK_REQUEST));
+}
+
+// データパケットを組み立てるヘルパー関数（内部利用）
+// データを fragment_length ごとに区切った packet_index 番目を載せる。
+// is_compact ならコンパクトヘッダを使う (lora_use_compact_header() で判定したもの)
+// 戻り値: 組み立てたパケットの長さ (ヘッダ込み)
+static int lora_build_data_packet(LoraHandle_t *p_handle,
+                                  uint8_t *p_packet,
+                                  uint8_t control_byte,
+                                  uint8_t transaction_id,
+                                  uint16_t total_packets,
+                                  uint8_t fragment_length,
+                                  uint16_t packet_index,
+                                  const uint8_t *p_data,
+                                  uint32_t size,
+                                  bool is_compact)
+{
+    uint32_t offset = (uint32_t)packet_index * fragment_length;
+    uint32_t remaining_size = size - offset;
+    uint8_t payload_len = (remaining_size > fragment_length) ? fragment_length : remaining_size;
+
+    uint8_t header_size = lora_write_header(p_handle, p_packet, control_byte, transaction_id,
+                                            total_packets, packet_index, payload_len, is_compact);
+
+    // ペイロードをコピー
+    memcpy(&p_packet[header_size], &p_data[offset], payload_len);
+
+    return header_size + payload_len;
+}
+
+#ifdef LORABBIT_USE_FEC
+// 冗長パケットを組み立てるヘルパー関数（内部利用）
+// 冗長断片の長さはパケットの間隔 (fragment_length) と同じ (末尾のデータパケットは0で埋めて符号化する)。
+// 冗長パケットの長さフィールドには、末尾のデータパケットの長さを入れる。
+// これにより、末尾のパケットが欠損しても受信側が元のデータサイズを知ることができる。
+// 戻り値: 組み立てたパケットの長さ (ヘッダ込み)
+static int lora_build_repair_packet(LoraHandle_t *p_handle,
+                                    uint8_t *p_packet,
+                                    uint8_t control_byte,
+                                    uint8_t transaction_id,
+                                    uint8_t total_packets,
+                                    uint8_t fragment_length,
+                                    uint8_t packet_index,
+                                    const uint8_t *p_data,
+                                    uint32_t size,
+                                    bool is_compact)
+{
+    uint8_t last_payload_length = (uint8_t)(size - (uint32_t)(total_packets - 1) * fragment_length);
+    uint16_t symbol_len = fragment_length;
+
+    uint8_t header_size = lora_write_header(p_handle, p_packet, control_byte, transaction_id,
+                                            total_packets, packet_index, last_payload_length, is_compact);
+
+    // 冗長断片を計算する
+    lora_fec_encode(p_data, size, total_packets, symbol_len, packet_index, &p_packet[header_size]);
+
+    return header_size + symbol_len;
+}
+
+// 冗長断片を保管できる空き位置 (未受信かつ冗長断片を保管していない位置) を探す（内部利用）
+// 戻り値: 位置。見つからなければ -1
+static int lora_fec_find_free_slot(const LoRabbitTP_FecRxState_t *p_state,
+                                   const uint8_t *p_received_bitmap,
+                                   uint8_t total_packets,
+                                   int exclude_slot)
+{
+    for (int slot = 0; slot < total_packets; slot++) {
+        if (slot == exclude_slot || lora_bitmap_test(p_received_bitmap, (uint16_t)slot)) {
+            continue;
+        }
+        bool is_held = false;
+        for (uint8_t k = 0; k < p_state->count; k++) {
+            if (p_state->slot[k] == slot) {
+                is_held = true;
+                break;
+            }
+        }
+        if (!is_held) {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+// 受信した冗長パケットを空き位置に保管する（内部利用）
+static void lora_fec_store_repair(LoRabbitTP_FecRxState_t *p_state,
+                                  uint8_t *p_buffer,
+                                  const uint8_t *p_received_bitmap,
+                                  const RecvFrameE220900T22SJP_t *p_frame,
+                                  const LoRabbitTP_Header_t *p_header)
+{
+    const uint8_t total_packets = p_header->total_packets;
+    const uint16_t symbol_len = p_header->fragment_length;
+    if (p_header->payload_length == 0) {
+        return; // 不正な冗長パケット
+    }
+    p_state->last_payload_length = p_header->payload_length;
+
+    for (uint8_t k = 0; k < p_state->count; k++) {
+        if (p_state->repair[k] == p_header->packet_index) {
+            return; // 重複
+        }
+    }
+    if (p_state->count >= LORABBIT_FEC_MAX_REPAIR_PACKETS) {
+        return;
+    }
+    int slot = lora_fec_find_free_slot(p_state, p_received_bitmap, total_packets, -1);
+    if (slot < 0) {
+        return; // すでに復号に十分な数が揃っている
+    }
+
+    memcpy(&p_buffer[(uint32_t)slot * symbol_len],
+           &p_frame->recv_data[p_header->header_size],
+           symbol_len);
+    p_state->slot[p_state->count] = (uint8_t)slot;
+    p_state->repair[p_state->count] = p_header->packet_index;
+    p_state->count++;
+}
+
+// データパケットを書き込む前に、その位置を空けて0で埋める（内部利用）
+// その位置に冗長断片を保管していた場合は別の空き位置へ移し、空きがなければ破棄する
+// (空きがない = 残りの冗長断片だけで復号できる)
+static void lora_fec_prepare_data_slot(LoRabbitTP_FecRxState_t *p_state,
+                                       uint8_t *p_buffer,
+                                       const uint8_t *p_received_bitmap,
+                                       const LoRabbitTP_Header_t *p_header)
+{
+    const uint8_t total_packets = p_header->total_packets;
+    const uint8_t index = p_header->packet_index;
+    const uint16_t symbol_len = p_header->fragment_length;
+    uint8_t *p_slot = &p_buffer[(uint32_t)index * symbol_len];
+
+    if (index == total_packets - 1) {
+        p_state->last_payload_length = p_header->payload_length;
+    }
+
+    for (uint8_t k = 0; k < p_state->count; k++) {
+        if (p_state->slot[k] != index) {
+            continue;
+        }
+        int new_slot = lora_fec_find_free_slot(p_state, p_received_bitmap, total_packets, index);
+        if (new_slot >= 0) {
+            memcpy(&p_buffer[(uint32_t)new_slot * symbol_len], p_slot, symbol_len);
+            p_state->slot[k] = (uint8_t)new_slot;
+        } else {
+            p_state->count--;
+            p_state->slot[k] = p_state->slot[p_state->count];
+            p_state->repair[k] = p_state->repair[p_state->count];
+        }
+        break;
+    }
+
+    // 末尾のパケットが短い場合に備え、復号で参照する範囲を0で埋めておく
+    memset(p_slot, 0, symbol_len);
+}
+
+// 保管した冗長断片と受信済みデータパケットで全体が揃っていれば復号する（内部利用）
+// 戻り値: 復号した場合は true
+static bool lora_fec_try_decode(LoRabbitTP_FecRxState_t *p_state,
+                                uint8_t *p_buffer,
+                                uint8_t *p_received_bitmap,
+                                uint8_t total_packets,
+                                uint8_t fragment_length,
+                                uint16_t *p_received_count,
+                                uint32_t *p_written_size)
+{
+    if (p_state->count == 0 || *p_received_count + p_state->count < total_packets) {
+        return false;
+    }
+
+    if (lora_fec_decode(p_buffer, total_packets, fragment_length,
+                        p_state->slot, p_state->repair, p_state->count) != LORABBIT_OK) {
+        p_state->count = 0; // 保管した冗長断片を捨て、欠損分の再送に任せる
+        return false;
+    }
+
+    for (uint8_t k = 0; k < p_state->count; k++) {
+        lora_bitmap_set(p_received_bitmap, p_state->slot[k]);
+        *p_written_size += (p_state->slot[k] == total_packets - 1) ? p_state->last_payload_length
+                                                                   : fragment_length;
+    }
+    *p_received_count += p_state->count;
+    p_state->count = 0;
+
+    return true;
+}
+#endif
+
+// 受信ディスパッチャが起動しているか判定するヘルパー関数（内部利用）
+static inline bool lora_rx_dispatcher_is_running(const LoraHandle_t *p_handle) {
+#ifdef LORABBIT_USE_RX_DISPATCHER
+    return p_handle->rx_dispatcher_task_id > 0;
+#else
+    (void)p_handle;
+    return false;
+#endif
+}
+
+// 受信中のフレームの長さを、ヘッダから求めるヘルパー関数（内部利用）
+// LoRabbit_ReceiveFrameWithLength() に渡す。p_context は転送の情報 (LoRabbitTP_Header_t)。
+// 通常のヘッダのフレームは長さフィールド (データパケットはペイロード長、ACKはビットマップ長) から、
+// コンパクトヘッダのACKは応答の形式から、コンパクトヘッダのデータパケットと冗長パケットはパケットの間隔から求める。
+// 末尾のデータパケットは常に通常のヘッダで送られるので、全てのフレームの長さを判定できる
+static int lora_tp_frame_length(const uint8_t *p_data, int len, void *p_context) {
+    const LoRabbitTP_Header_t *p_session = (const LoRabbitTP_Header_t *)p_context;
+    LoRabbitTP_Header_t header;
+    uint8_t header_size = lora_parse_frame(p_data, len, p_session, &header);
+    if (header_size == 0) {
+        return 0; // ヘッダがまだ届いていない
+    }
+
+    const bool is_compact = header_size < LORABBIT_TP_HEADER_SIZE;
+    int body_length;
+    if (header.control_byte & LORABBIT_TP_FLAG_IS_ACK) {
+        body_length = is_compact ? lora_compact_ack_bitmap_length(header.control_byte, header.total_packets,
+                                                                  header.packet_index)
+                                 : header.payload_length;
+    } else if (lora_is_repair_packet(&header)) {
+        body_length = p_session->fragment_length;
+    } else if (!is_compact) {
+        body_length = header.payload_length;
+    } else if (header.packet_index + 1 < header.total_packets) {
+        body_length = p_session->fragment_length;
+    } else {
+        return -1; // コンパクトヘッダの末尾のパケット (送らない)
+    }
+    if (!(header.control_byte & LORABBIT_TP_FLAG_IS_ACK) && body_length == 0) {
+        return -1;
+    }
+    return (header_size + body_length <= LORABBIT_TP_MAX_FRAME_SIZE) ? header_size + body_length : -1;
+}
+
+// 大容量データ転送のフレームを受信するヘルパー関数（内部利用）
+// 受信ディスパッチャの起動中は、is_ack に応じてACK/NACKまたはデータパケットに振り分けられたフレームを受け取る。
+// p_session (受信する転送の情報) があれば、ヘッダから求めたフレームの長さ分が届いた時点で受信を完了する
+static int lora_receive_tp_frame(LoraHandle_t *p_handle, bool is_ack, const LoRabbitTP_Header_t *p_session,
+                                 RecvFrameE220900T22SJP_t *p_frame, TMO timeout) {
+#ifdef LORABBIT_USE_RX_DISPATCHER
+    if (p_handle->rx_dispatcher_task_id > 0) {
+        return lora_rx_queue_pop(p_handle, is_ack ? LORABBIT_RX_CLASS_ACK : LORABBIT_RX_CLASS_DATA, p_frame, timeout);
+    }
+#else
+    (void)is_ack;
+#endif
+    if (NULL == p_session) {
+        return LoRabbit_ReceiveFrame(p_handle, p_frame, timeout);
+    }
+    return LoRabbit_ReceiveFrameWithLength(p_handle, p_frame, timeout, lora_tp_frame_length, (void *)p_session);
+}
+
+/**
+ * @brief 指定したトランザクションのACKを待つ
+ * @details 関係のないフレームは読み捨て、タイムアウトするまで待ち続ける。
+ * @param[in] p_session 送信中の転送情報 (lora_tx_session_init() で組み立てたもの)
+ * @retval LORABBIT_OK ACKを受信
+ * @retval LORABBIT_ERROR_TIMEOUT タイムアウト
+ */
+static ER lora_wait_for_ack(LoraHandle_t *p_handle,
+                            const LoRabbitTP_Header_t *p_session,
+                            TMO timeout,
+                            RecvFrameE220900T22SJP_t *p_out_frame,
+                            LoRabbitTP_Header_t *p_out_header)
+{
+    uint64_t deadline = lora_get_time_ms() + (uint64_t)timeout;
+
+    while (1) {
+        uint64_t now = lora_get_time_ms();
+        if (now >= deadline) {
+            return LORABBIT_ERROR_TIMEOUT;
+        }
+
+        int recv_len = lora_receive_tp_frame(p_handle, true, p_session, p_out_frame, (TMO)(deadline - now));
+        if (recv_len < 0) {
+            return recv_len;
+        }
+        if (lora_parse_frame(p_out_frame->recv_data, recv_len, p_session, p_out_header) == 0) {
+            continue; // タイムアウト、またはヘッダに満たないフレーム
+        }
+        if ((p_out_header->control_byte & LORABBIT_TP_FLAG_IS_ACK) &&
+            (p_out_header->transaction_id == p_session->transaction_id)) {
+            return LORABBIT_OK;
+        }
+    }
+}
+
+/**
+ * @brief 転送状態を「実行中」に設定するヘルパー
+ */
+static void lora_status_set_active(LoraHandle_t *p_handle, uint16_t total_packets, uint16_t current_index) {
+    tk_wai_sem(p_handle->status_mutex_id, 1, TMO_FEVR);
+    p_handle->transfer_status.is_active = true;
+    p_handle->transfer_status.total_packets = total_packets;
+    p_handle->transfer_status.current_packet_index = current_index;
+    tk_sig_sem(p_handle->status_mutex_id, 1);
+}
+
+/**
+ * @brief 転送状態の進捗を更新するヘルパー
+ */
+static void lora_status_set_progress(LoraHandle_t *p_handle, uint16_t current_index) {
+    tk_wai_sem(p_handle->status_mutex_id, 1, TMO_FEVR);
+    p_handle->transfer_status.current_packet_index = current_index;
+    tk_sig_sem(p_handle->status_mutex_id, 1);
+}
+
+/**
+ * @brief 転送状態を「アイドル」にリセットするヘルパー
+ */
+static void lora_status_set_idle(LoraHandle_t *p_handle) {
+    tk_wai_sem(p_handle->status_mutex_id, 1, TMO_FEVR);
+    p_handle->transfer_status.is_active = false;
+    p_handle->transfer_status.total_packets = 0;
+    p_handle->transfer_status.current_packet_index = 0;
+    tk_sig_sem(p_handle->status_mutex_id, 1);
+}
+
+#ifdef LORABBIT_USE_TRAFFIC_CLASS
+// 指定したクラスより上位のクラスの転送が送信権を待っているか判定するヘルパー関数（内部利用）
+static bool lora_tx_has_higher_waiter(const LoraHandle_t *p_handle, LoRabbit_TrafficClass_t traffic_class) {
+    for (int c = (int)traffic_class + 1; c < LORABBIT_TRAFFIC_CLASS_COUNT; c++) {
+        if (p_handle->tx_waiting_count[c] > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 送信権を待っている転送のうち、最上位のクラスの転送に送信権を渡すヘルパー関数（内部利用）
+// 同じクラスでは、割り込まれて再開を待っている転送を先に再開する。待っている転送がなければ送信権を手放す
+// status_mutex_id を取得した状態で呼ぶ
+static void lora_tx_handoff_locked(LoraHandle_t *p_handle) {
+    for (int c = LORABBIT_TRAFFIC_CLASS_COUNT - 1; c >= 0; c--) {
+        if (c < LORABBIT_TRAFFIC_CLASS_COUNT - 1 && p_handle->tx_preempted[c].is_active) {
+            p_handle->tx_preempted[c].is_active = false;
+            tk_sig_sem(p_handle->tx_preempted[c].resume_sem_id, 1);
+            return;
+        }
+        if (p_handle->tx_waiting_count[c] > 0) {
+            p_handle->tx_waiting_count[c]--;
+            tk_sig_sem(p_handle->tx_wait_sem_id[c], 1);
+            return;
+        }
+    }
+    p_handle->is_tx_busy = false;
+}
+
+// 大容量データ送信の送信権を得るヘルパー関数（内部利用）
+// 送信権を持っている転送があれば、自分のクラスのセマフォで送信権を渡されるまで待つ
+// 戻り値: 送信権を得るまで待った時間 (ms)
+static uint32_t lora_tx_acquire(LoraHandle_t *p_handle, LoRabbit_TrafficClass_t traffic_class) {
+    uint64_t start_time_ms = lora_get_time_ms();
+
+    tk_wai_sem(p_handle->status_mutex_id, 1, TMO_FEVR);
+    if (!p_handle->is_tx_busy) {
+        // 送信権を持っている転送がなければ、待っている転送もない
+        p_handle->is_tx_busy = true;
+        tk_sig_sem(p_handle->status_mutex_id, 1);
+    } else {
+        p_handle->tx_waiting_count[traffic_class]++;
+        tk_sig_sem(p_handle->status_mutex_id, 1);
+        // 待ち数は、送信権を渡した転送が減らす
+        tk_wai_sem(p_handle->tx_wait_sem_id[traffic_class], 1, TMO_FEVR);
+    }
+    p_handle->tx_class = traffic_class;
+
+    return (uint32_t)(lora_get_time_ms() - start_time_ms);
+}
+
+// 大容量データ送信の送信権を、待っている転送に渡すか手放すヘルパー関数（内部利用）
+static void lora_tx_release(LoraHandle_t *p_handle) {
+    tk_wai_sem(p_handle->status_mutex_id, 1, TMO_FEVR);
+    lora_tx_handoff_locked(p_handle);
+    tk_sig_sem(p_handle->status_mutex_id, 1);
+}
+
+// 上位のクラスの転送が送信権を待っていれば、譲って終わるのを待つヘルパー関数（内部利用）
+// 送信中の転送のパケットの合間 (ACKを待っていない時) に呼ぶ。
+// 割り込んだ転送が上書きするハンドル内の状態 (ビットマップ・進捗など) は、クラスごとの退避領域に退避して戻す
+static void lora_tx_preempt(LoraHandle_t *p_handle) {
+    const LoRabbit_TrafficClass_t traffic_class = p_handle->tx_class;
+    if (!lora_tx_has_higher_waiter(p_handle, traffic_class)) {
+        return;
+    }
+
+    // 上位のクラスがあるので、traffic_class は最上位のクラスではない
+    LoRabbitTP_TxPreempted_t *p_saved = &p_handle->tx_preempted[traffic_class];
+    memcpy(p_saved->acked_bitmap, p_handle->tp_tx_acked_bitmap, LORABBIT_TP_BITMAP_SIZE);
+    memcpy(p_saved->pending_bitmap, p_handle->tp_tx_pending_bitmap, LORABBIT_TP_BITMAP_SIZE);
+    p_saved->total_packets = p_handle->transfer_status.total_packets;
+    p_saved->current_index = p_handle->transfer_status.current_packet_index;
+#ifdef LORABBIT_USE_RX_DISPATCHER
+    p_saved->tp_tx = p_handle->tp_tx;
+    p_handle->tp_tx.is_active = false;
+#endif
+
+    LORA_PRINTF("preempted: class %d yields at packet %u\n", traffic_class, p_saved->current_index);
+    uint64_t start_time_ms = lora_get_time_ms();
+    tk_wai_sem(p_handle->status_mutex_id, 1, TMO_FEVR);
+    p_saved->is_active = true;
+    lora_tx_handoff_locked(p_handle);
+    tk_sig_sem(p_handle->status_mutex_id, 1);
+    // 上位のクラスの転送が全て終わると、同じクラスの他の転送より先に送信権が戻る
+    tk_wai_sem(p_saved->resume_sem_id, 1, TMO_FEVR);
+    p_handle->tx_class = traffic_class;
+    uint32_t preempted_ms = (uint32_t)(lora_get_time_ms() - start_time_ms);
+
+    memcpy(p_handle->tp_tx_acked_bitmap, p_saved->acked_bitmap, LORABBIT_TP_BITMAP_SIZE);
+    memcpy(p_handle->tp_tx_pending_bitmap, p_saved->pending_bitmap, LORABBIT_TP_BITMAP_SIZE);
+    lora_status_set_active(p_handle, p_saved->total_packets, p_saved->current_index);
+#ifdef LORABBIT_USE_RX_DISPATCHER
+    p_handle->tp_tx = p_saved->tp_tx;
+#endif
+
+    LoRabbit_TrafficClassStats_t *p_stats = &p_handle->tx_class_stats[traffic_class];
+    tk_wai_sem(p_handle->status_mutex_id, 1, TMO_FEVR);
+    p_stats->preempted_count++;
+    p_stats->total_preempted_ms += preempted_ms;
+    tk_sig_sem(p_handle->status_mutex_id, 1);
+}
+#else
+// 大容量データ送信の送信権を得るヘルパー関数（内部利用）
+// 送信権を持っている転送があれば、終わるまで待つ
+static void lora_tx_acquire(LoraHandle_t *p_handle, LoRabbit_TrafficClass_t traffic_class) {
+    (void)traffic_class;
+    tk_wai_sem(p_handle->api_mutex_id, 1, TMO_FEVR);
+}
+
+// 大容量データ送信の送信権を手放すヘルパー関数（内部利用）
+static void lora_tx_release(LoraHandle_t *p_handle) {
+    tk_sig_sem(p_handle->api_mutex_id, 1);
+}
+#endif // LORABBIT_USE_TRAFFIC_CLASS
+
+// フレームを送信しなかった (送信の制限で断られた) エラーかを返すヘルパー関数（内部利用）
+// 断られたパケットは無線に出ていないので、欠損として再送せず、転送をそのエラーで終える
+static inline bool lora_is_tx_refused(int err) {
+    return LORABBIT_ERROR_AIRTIME_EXHAUSTED == err || LORABBIT_ERROR_CHANNEL_BUSY == err;
+}
+
+// データパケットを送信するヘルパー関数（内部利用）
+// 上位のクラスの転送が待っていれば先に送らせる (LORABBIT_USE_TRAFFIC_CLASS 有効時)。送信先へのACKを保留していれば、フレームの先頭に載せる
+// (データパケットが通常のヘッダで、フレームに収まる場合。収まらなければACKを先に単独で送る)
+// 戻り値: LORABBIT_OK、または送信の制限で送信しなかった場合のエラー (lora_is_tx_refused())。
+// それ以外の送信の失敗はパケットの欠損と同じく再送で回復するので、LORABBIT_OK を返す
+static int lora_send_data_frame(LoraHandle_t *p_handle, uint16_t target_address, uint8_t target_channel,
+                                const uint8_t *p_packet, int packet_len)
+{
+#ifdef LORABBIT_USE_TRAFFIC_CLASS
+    lora_tx_preempt(p_handle);
+#endif
+    // エアタイム予算の予約分は、制御クラスの転送だけが使える (トラフィッククラスを使わない構成では使えない)
+#ifdef LORABBIT_USE_TRAFFIC_CLASS
+    const bool may_use_reserve = (p_handle->tx_class == LORABBIT_TRAFFIC_CLASS_CONTROL);
+#else
+    const bool may_use_reserve = false;
+#endif
+    int err;
+#ifdef LORABBIT_USE_RX_DISPATCHER
+    uint8_t frame[LORABBIT_TP_MAX_FRAME_SIZE];
+    int ack_len = lora_take_delayed_ack(p_handle, target_address, target_channel, frame);
+    if (ack_len > 0) {
+        if (p_packet[0] == (uint8_t)(p_handle->current_config.own_address >> 8) &&
+            ack_len + packet_len <= lora_frame_size_limit(p_handle)) {
+            memcpy(&frame[ack_len], p_packet, packet_len);
+            err = lora_send_frame_internal(p_handle, target_address, target_channel, frame, ack_len + packet_len,
+                                           may_use_reserve);
+            return lora_is_tx_refused(err) ? err : LORABBIT_OK;
+        }
+        err = lora_send_frame_fire_and_forget_internal(p_handle, target_address, target_channel, frame, ack_len);
+        if (lora_is_tx_refused(err)) {
+            return err;
+        }
+    }
+#endif
+    err = lora_send_frame_internal(p_handle, target_address, target_channel, (uint8_t *)p_packet, packet_len,
+                                   may_use_reserve);
+    return lora_is_tx_refused(err) ? err : LORABBIT_OK;
+}
+
+#if LORABBIT_TP_RX_LINGER_ROUNDS > 0
+// 受信完了後、送信側の再送を待って最後のACKを返し直すヘルパー関数（内部利用）
+// 再送が届くたびに待ち時間を延長し、再送が途絶えるか、再送以外のフレームを受信したら戻る。
+// 再送以外のフレームは読み捨てず、次の受信 (LoRabbit_ReceiveFrame() など) で返す。
+// 待つのは短い時間だけで、その後に届いた再送には、次の LoRabbit_ReceiveData() が記録したACKを返し直す
+static void lora_receive_linger(LoraHandle_t *p_handle,
+                                const LoRabbit_PeerLink_t *p_link,
+                                RecvFrameE220900T22SJP_t *p_frame)
+{
+    LoRabbitTP_Header_t session;
+    lora_rx_session_header(&p_handle->tp_rx, &session);
+
+    TMO remaining_timeout = lora_link_rx_linger_timeout(p_link);
+    while (remaining_timeout > 0) {
+        int recv_len = lora_receive_tp_frame(p_handle, false, &session, p_frame, remaining_timeout);
+        if (recv_len <= 0) {
+            break;
+        }
+        if (!lora_ack_cache_resend(p_handle, &p_handle->tp_rx, p_frame->recv_data, recv_len)) {
+            memcpy(&p_handle->held_frame, p_frame, sizeof(RecvFrameE220900T22SJP_t));
+            p_handle->has_held_frame = true;
+            break;
+        }
+        remaining_timeout = lora_link_rx_linger_timeout(p_link);
+    }
+}
+#endif
+
+/**
+ * @brief 受信したフレームが期待通りのパケットか検証する
+ * @details パケットの順序は問わない (受信済みかどうかの判定は呼び出し側で行う)。
+ * ただし、ストップアンドウェイトでACKを要求するパケットは先頭から順に送られるため、
+ * 最初のパケットとしてはパケット番号0のみを受け付ける。
+ * パケットの間隔は末尾以外のデータパケットか冗長パケットから求めるので、2パケット以上の転送の
+ * 末尾のパケットからは受信を始めない (送信側は欠損として再送する)。
+ * 後続のパケットは、送信元・トランザクションID・総パケット数・転送全体で共通のフラグを最初のパケットと照合する。
+ * @param[in] raw_packet 受信したフレーム
+ * @param[in] recv_len フレーム長
+ * @param[in] p_session 受信中の転送の最初のパケットのヘッダ (最初のパケットの場合は NULL)
+ * @param[out] p_out_header パースしたヘッダの格納先
+ * @retval LORABBIT_OK 期待通りのパケット
+ * @retval LORABBIT_ERROR_RETRY 期待しないパケット
+ */
+static ER lora_validate_packet(const uint8_t *raw_packet,
+                               int recv_len,
+                               const LoRabbitTP_Header_t *p_session,
+                               LoRabbitTP_Header_t *p_out_header)
+{
+    if (lora_parse_frame(raw_packet, recv_len, p_session, p_out_header) == 0) {
+        return LORABBIT_ERROR_RETRY; // ヘッダに満たないフレーム
+    }
+    if (!(p_out_header->control_byte & LORABBIT_TP_FLAG_IS_ACK) && !lora_is_repair_packet(p_out_header)) {
+        if (p_out_header->total_packets == 1) {
+            p_out_header->fragment_length = p_out_header->payload_length; // 1パケットの転送は書き込み位置が0のみ
+        } else if (p_out_header->fragment_length == 0 && NULL != p_session) {
+            p_out_header->fragment_length = p_session->fragment_length; // 末尾のデータパケットは転送の値を使う
+        }
+    }
+
+    // パケットを検証
+    bool is_valid = false;
+    if (p_out_header->total_packets == 0 ||
+        p_out_header->total_packets > LORABBIT_TP_MAX_PACKETS ||
+        p_out_header->fragment_length == 0 ||
+        p_out_header->fragment_length > lora_max_payload(p_out_header->control_byte) ||
+        p_out_header->payload_length > p_out_header->fragment_length) {
+        return LORABBIT_ERROR_RETRY; // 扱えない転送
+    }
+    if (!lora_is_repair_packet(p_out_header) &&
+        recv_len < p_out_header->header_size + p_out_header->payload_length) {
+        return LORABBIT_ERROR_RETRY; // ペイロードが欠けている
+    }
+    if (NULL != p_session && p_out_header->fragment_length != p_session->fragment_length) {
+        return LORABBIT_ERROR_RETRY; // 別の転送のパケット
+    }
+    // パケット番号が範囲内か
+    uint16_t index_limit = p_out_header->total_packets;
+#ifdef LORABBIT_USE_FEC
+    if (p_out_header->control_byte & LORABBIT_TP_FLAG_FEC) {
+        // total_packets 以降は冗長パケット (FECは通常のヘッダの転送でのみ使う)
+        index_limit = (p_out_header->control_byte & LORABBIT_TP_FLAG_EXT_HEADER) ? 0 : LORABBIT_TP_STD_MAX_PACKETS;
+    }
+#endif
+    bool is_in_range = !(p_out_header->control_byte & LORABBIT_TP_FLAG_IS_ACK) &&
+                       (p_out_header->packet_index < index_limit);
+    if (NULL == p_session) { // 最初のパケットの検証
+        // 先頭パケットが欠損や順序の入れ替わりで遅れることがあるため、任意のインデックスから受信を開始する
+        bool is_in_order = ((p_out_header->control_byte & LORABBIT_TP_ARQ_MASK) == LORABBIT_TP_ARQ_STOP_AND_WAIT) &&
+                           (p_out_header->control_byte & LORABBIT_TP_FLAG_ACK_REQUEST);
+        if (is_in_range && (p_out_header->packet_index == 0 || !is_in_order)) {
+            is_valid = true;
+        }
+    } else { // 後続パケットの検証
+        // 送信元・トランザクションID・総パケット数・転送全体で共通のフラグが一致するものだけを受け付ける
+        // (同じトランザクションIDを使った別の端末のパケットをバッファに書き込まないため)
+        const uint8_t session_flags = LORABBIT_TP_FLAG_FEC | LORABBIT_TP_FLAG_COMPACT | LORABBIT_TP_FLAG_EXT_HEADER;
+        if (is_in_range &&
+            (p_out_header->source_address == p_session->source_address) &&
+            (p_out_header->transaction_id == p_session->transaction_id) &&
+            (p_out_header->total_packets == p_session->total_packets) &&
+            ((p_out_header->control_byte & session_flags) == (p_session->control_byte & session_flags))) {
+            is_valid = true;
+        }
+    }
+
+    return is_valid ? LORABBIT_OK : LORABBIT_ERROR_RETRY;
+}
+
+#ifdef LORABBIT_USE_RX_DISPATCHER
+LoRabbit_RxClass_t lora_tp_classify_frame(LoraHandle_t *p_handle, const uint8_t *raw_packet, int len) {
+    LoRabbitTP_Header_t header;
+
+#ifdef LORABBIT_USE_AGGREGATION
+    // 短いメッセージの集約フレームは LoRabbit_ReceiveFrame() で受け取る
+    if (lora_agg_is_frame(raw_packet, len)) {
+        return LORABBIT_RX_CLASS_RAW;
+    }
+#endif
+
+    // 送信中の転送へのACK/NACK (コンパクトヘッダも解析できるよう、転送の情報を使う)
+    if (p_handle->tp_tx.is_active) {
+        LoRabbitTP_Header_t session;
+        lora_tx_session_init(&session, p_handle->tp_tx.target_address, 0, p_handle->tp_tx.transaction_id,
+                             p_handle->tp_tx.total_packets, 0, p_handle->tp_tx.session_flags);
+        if (lora_parse_frame(raw_packet, len, &session, &header) > 0 &&
+            (header.control_byte & LORABBIT_TP_FLAG_IS_ACK) &&
+            header.transaction_id == p_handle->tp_tx.transaction_id) {
+            return LORABBIT_RX_CLASS_ACK;
+        }
+    }
+
+    // 受信中 (または受信完了した) 転送のパケット。完了した転送への再送には、キャッシュしたACKを返し直す必要がある
+    if (lora_rx_session_match(&p_handle->tp_rx, raw_packet, len, &header)) {
+        return LORABBIT_RX_CLASS_DATA;
+    }
+#ifdef LORABBIT_USE_MULTI_SESSION
+    for (int i = 0; i < LORABBIT_TP_RX_SESSION_COUNT; i++) {
+        if (lora_rx_session_match(&p_handle->tp_rx_sessions[i], raw_packet, len, &header)) {
+            return LORABBIT_RX_CLASS_DATA;
+        }
+    }
+#endif
+
+    // 新しい転送のパケット
+    if (lora_validate_packet(raw_packet, len, NULL, &header) == LORABBIT_OK) {
+        return LORABBIT_RX_CLASS_DATA;
+    }
+    // パケットの間隔が分からず受信を始められない、新しい転送の末尾のデータパケットは読み捨てる (送信側が再送する)
+    if (lora_parse_header(raw_packet, len, &header) > 0 &&
+        !(header.control_byte & LORABBIT_TP_FLAG_IS_ACK) && (header.control_byte & LORABBIT_TP_FLAG_EOT) &&
+        header.total_packets > 1 && header.packet_index == header.total_packets - 1 &&
+        len == header.header_size + header.payload_length) {
+        return LORABBIT_RX_CLASS_NONE;
+    }
+
+    // 送信中のどの転送にも当てはまらないACK/NACK (送信を終えた後に届いた重複ACKや、割り込まれて
+    // 中断している転送へのACK) は、アプリケーションに渡さずに読み捨てる。
+    // 通常のヘッダで、ビットマップ長とフレーム長が一致するものだけを、大容量データ転送のACKとみなす
+    if (lora_parse_header(raw_packet, len, &header) > 0 &&
+        (header.control_byte & LORABBIT_TP_FLAG_IS_ACK) &&
+        header.payload_length <= LORABBIT_TP_NACK_BITMAP_MAX &&
+        len == header.header_size + header.payload_length) {
+        return LORABBIT_RX_CLASS_NONE;
+    }
+    return LORABBIT_RX_CLASS_RAW;
+}
+
+// 受信完了した転送の再送パケットであれば、最後のACKを返し直す
+bool lora_tp_answer_retransmission(LoraHandle_t *p_handle, const uint8_t *raw_packet, int len) {
+    if (!p_handle->tp_rx.is_active && lora_ack_cache_resend(p_handle, &p_handle->tp_rx, raw_packet, len)) {
+        return true;
+    }
+#ifdef LORABBIT_USE_MULTI_SESSION
+    for (int i = 0; i < LORABBIT_TP_RX_SESSION_COUNT; i++) {
+        LoRabbitTP_RxSession_t *p_rx = &p_handle->tp_rx_sessions[i];
+        if (!p_rx->is_active && lora_ack_cache_resend(p_handle, p_rx, raw_packet, len)) {
+            return true;
+        }
+    }
+#endif
+    return false;
+}
+
+// ACKを先頭に載せたデータパケットのフレームか判定する
+// ACKもデータパケットも通常のヘッダで、送信元アドレスが一致するものだけを分ける
+int lora_tp_piggyback_ack_length(const uint8_t *raw_packet, int len) {
+    LoRabbitTP_Header_t ack;
+    LoRabbitTP_Header_t data;
+
+    if (lora_parse_header(raw_packet, len, &ack) == 0 || !(ack.control_byte & LORABBIT_TP_FLAG_IS_ACK)) {
+        return 0;
+    }
+    int ack_len = ack.header_size + ack.payload_length;
+    if (ack_len >= len || lora_parse_header(&raw_packet[ack_len], len - ack_len, &data) == 0 ||
+        (data.control_byte & LORABBIT_TP_FLAG_IS_ACK) || data.source_address != ack.source_address) {
+        return 0;
+    }
+    return ack_len;
+}
+
+// 保留しているACKの期限が来ていれば、単独で送信する
+TMO lora_tp_flush_delayed_ack(LoraHandle_t *p_handle) {
+    LoRabbitTP_DelayedAck_t *p_delayed = &p_handle->tp_delayed_ack;
+    LoRabbitTP_DelayedAck_t expired;
+
+    if (!p_delayed->is_pending) {
+        return TMO_FEVR;
+    }
+    tk_wai_sem(p_handle->rx_queue_mutex_id, 1, TMO_FEVR);
+    int32_t remaining_ms = (int32_t)(p_delayed->deadline_ms - (uint32_t)lora_get_time_ms());
+    if (!p_delayed->is_pending || remaining_ms > 0) {
+        TMO timeout = p_delayed->is_pending ? (TMO)remaining_ms : TMO_FEVR;
+        tk_sig_sem(p_handle->rx_queue_mutex_id, 1);
+        return timeout;
+    }
+    expired = *p_delayed;
+    p_delayed->is_pending = false;
+    tk_sig_sem(p_handle->rx_queue_mutex_id, 1);
+
+    lora_send_frame_fire_and_forget_internal(p_handle, expired.address, expired.channel,
+                                             expired.frame, expired.length);
+    return TMO_FEVR;
+}
+#endif
+
+/**
+ * @brief パケットを1つ受信し、期待通りのものか検証する
+ * @details 検証の内容は lora_validate_packet() を参照。
+ * @param[in] p_handle ハンドル
+ * @param[in,out] p_remaining_timeout 残りタイムアウト時間(ms)へのポインタ。関数内で消費時間を減算する。
+ * @param[in] p_session 受信中の転送の最初のパケットのヘッダ (最初のパケットの場合は NULL)
+ * @param[out] p_out_frame 受信したフレームの格納先
+ * @param[out] p_out_header パースしたヘッダの格納先
+ * @retval LORABBIT_OK 期待通りのパケットを受信
+ * @retval LORABBIT_ERROR_TIMEOUT タイムアウト
+ * @retval LORABBIT_ERROR_RETRY 期待しないパケットを受信（リトライが必要）。
+ * 最初のパケットとして受信完了した転送の再送パケットを受信した場合は、最後のACKを返し直してからこれを返す
+ */
+static ER lora_receive_and_validate_packet(
+    LoraHandle_t *p_handle,
+    TMO *p_remaining_timeout,
+    const LoRabbitTP_Header_t *p_session,
+    RecvFrameE220900T22SJP_t *p_out_frame,
+    LoRabbitTP_Header_t *p_out_header)
+{
+    SYSTIM start_time, end_time;
+    tk_get_tim(&start_time);
+
+    // 最初のパケットは通常のヘッダで届くので、その長さフィールドから判定する (連続して届くフレームを分けるため)
+    LoRabbitTP_Header_t standard_session;
+    memset(&standard_session, 0, sizeof(standard_session));
+    int recv_len = lora_receive_tp_frame(p_handle, false, (NULL != p_session) ? p_session : &standard_session,
+                                         p_out_frame, *p_remaining_timeout);
+
+    // タイムアウトを更新
+    if (*p_remaining_timeout != TMO_FEVR) {
+        tk_get_tim(&end_time);
+        uint64_t start_ms = ((uint64_t)start_time.hi << 32) | start_time.lo;
+        uint64_t end_ms   = ((uint64_t)end_time.hi << 32) | end_time.lo;
+        if (end_ms > start_ms) {
+            *p_remaining_timeout -= (TMO)(end_ms - start_ms);
+        }
+    }
+
+    if (recv_len <= 0) {
+        return LORABBIT_ERROR_TIMEOUT;
+    }
+
+    if (NULL == p_session && lora_ack_cache_resend(p_handle, &p_handle->tp_rx, p_out_frame->recv_data, recv_len)) {
+        return LORABBIT_ERROR_RETRY; // 受信完了した転送の再送 (ACKを返し直した)
+    }
+    return lora_validate_packet(p_out_frame->recv_data, recv_len, p_session, p_out_header);
+}
+
+/**
+ * @brief ハンドル内のリングバッファに新しい通信ログを追加する
+ */
+static void lora_add_log_to_history(LoraHandle_t *p_handle, const LoraCommLog_t *p_log) {
+    memcpy(&p_handle->history[p_handle->history_index], p_log, sizeof(LoraCommLog_t));
+    p_handle->history_index++;
+    if (p_handle->history_index >= LORABBIT_HISTORY_SIZE) {
+        p_handle->history_index = 0;
+        p_handle->history_wrapped = true;
+    }
+}
+
+static const char* lora_tx_power_to_string(LoraTransmittingPower_t power) {
+    switch (power) {
+        case LORA_TRANSMITTING_POWER_13_DBM: return "13dBm";
+        case LORA_TRANSMITTING_POWER_7_DBM:  return "7dBm";
+        case LORA_TRANSMITTING_POWER_0_DBM:  return "0dBm";
+        default: return "Unknown";
+    }
+}
+
+/**
+ * @brief ストップアンドウェイト方式 (またはACKなし) でデータを送信する
+ */
+static int lora_send_data_stop_and_wait(LoraHandle_t *p_handle,
+                                        uint16_t target_address,
+                                        uint8_t target_channel,
+                                        uint8_t *p_data,
+                                        uint32_t size,
+                                        uint8_t transaction_id,
+                                        uint16_t total_packets,
+                                        uint8_t fragment_length,
+                                        uint8_t session_flags,
+                                        bool request_ack,
+                                        LoraCommLog_t *p_log)
+{
+    uint8_t packet_buffer[197];
+    LoRabbitTP_Header_t session;
+    LoRabbit_PeerLink_t *p_link = lora_link_get(p_handle, target_address);
+    bool is_rtt_sample_valid = true;
+    bool is_peer_ready = false; // 受信側が転送を認識したか (ACKを受信したか)
+
+    lora_tx_session_init(&session, target_address, target_channel, transaction_id, total_packets,
+                         fragment_length, session_flags);
+    const uint8_t data_frame_size = LORABBIT_TP_FRAME_ADDRESS_SIZE + lora_data_header_size(session.control_byte) + fragment_length;
+
+    uint64_t last_ack_time_ms = 0;
+    TMO peer_rx_timeout = 0;  // 受信側が転送を破棄するまでの最短の時間 (最後にACKを受信した時点の見積もり)
+    uint8_t restart_count = 0;
+    uint16_t i = 0;
+    while (i < total_packets) {
+        // 現在のパケット番号を更新 (iが0の時も呼ばれるが、動作に支障はない)
+        lora_status_set_progress(p_handle, i);
+
+        bool ack_received = false;
+        bool is_peer_lost = false; // 受信側が転送を破棄したかもしれない
+        for (uint8_t retry = 0; retry < lora_link_retry_budget(p_link); retry++) {
+            if (retry > 0) {
+                p_log->total_retries++; // リトライ回数をカウント
+            }
+
+            // パケットを組み立てる
+            uint8_t control_byte = LORABBIT_TP_ARQ_STOP_AND_WAIT | session.control_byte;
+            if (request_ack) control_byte |= LORABBIT_TP_FLAG_ACK_REQUEST;
+            if (i == total_packets - 1) control_byte |= LORABBIT_TP_FLAG_EOT;
+            int packet_len = lora_build_data_packet(p_handle, packet_buffer, control_byte,
+                                                    transaction_id, total_packets, fragment_length, i, p_data, size,
+                                                    lora_use_compact_header(p_handle, control_byte, is_peer_ready));
+
+            // 送信 (送信の制限で送れなければ、ACKを待たずにそのエラーで終える)
+            ER send_err = lora_send_data_frame(p_handle, target_address, target_channel, packet_buffer, packet_len);
+            if (send_err != LORABBIT_OK) {
+                return send_err;
+            }
+
+            if (!request_ack) {
+                ack_received = true;
+                break; // ACK不要ならリトライしない
+            }
+
+            // ACK待機 (待ち時間は推定した往復時間から決める)
+            // 前のパケットへの遅れたACKなど、別のパケット番号へのACKは読み捨てて待ち続ける
+            RecvFrameE220900T22SJP_t ack_frame;
+            LoRabbitTP_Header_t ack_header;
+            uint64_t sent_time_ms = lora_get_time_ms();
+            uint64_t deadline = sent_time_ms + (uint64_t)lora_link_ack_wait(p_handle, p_link);
+            ER err = LORABBIT_ERROR_TIMEOUT;
+            while (1) {
+                uint64_t now = lora_get_time_ms();
+                if (now >= deadline) {
+                    err = LORABBIT_ERROR_TIMEOUT;
+                    break;
+                }
+                err = lora_wait_for_ack(p_handle, &session, (TMO)(deadline - now), &ack_frame, &ack_header);
+                if (err != LORABBIT_OK || ack_header.packet_index == i) {
+                    break;
+                }
+            }
+            if (err == LORABBIT_OK) {
+                p_log->last_ack_rssi = ack_frame.rssi; // ACKのRSSIを記録
+                lora_link_on_ack(p_link, (uint32_t)(lora_get_time_ms() - sent_time_ms), is_rtt_sample_valid);
+                lora_link_on_data_result(p_link, data_frame_size, 1, 0);
+                is_rtt_sample_valid = true;
+                is_peer_ready = true;
+                ack_received = true;
+                last_ack_time_ms = lora_get_time_ms();
+                peer_rx_timeout = lora_link_peer_rx_timeout(p_link);
+                break; // 正しいACKを受信
+            }
+            if (err != LORABBIT_ERROR_TIMEOUT) {
+                return err;
+            }
+
+            // ACKが届かなかった -> 待ち時間を延ばして再送する
+            // (データとACKのどちらが欠損したかは区別できないので、データパケットの欠損として数える)
+            lora_link_on_ack_timeout(p_link);
+            lora_link_on_data_result(p_link, data_frame_size, 1, 1);
+            is_rtt_sample_valid = false;
+
+            // 他の送信側との衝突が続くなどして長くACKがないと、受信側は途絶えた転送を破棄する。
+            // 受信側はACKを要求する転送を先頭のパケットからしか受信し直さないので、先頭から送り直す
+            if (i > 0 && restart_count < LORABBIT_TP_RETRY_COUNT &&
+                lora_get_time_ms() - last_ack_time_ms >= (uint64_t)peer_rx_timeout) {
+                is_peer_lost = true;
+                break;
+            }
+        } // retry loop
+
+        if (ack_received) {
+            i++;
+        } else if (is_peer_lost) {
+            LORA_PRINTF("lora_send_data_stop_and_wait: no ACK for packet %u, restarting the transfer\n", i);
+            restart_count++;
+            is_peer_ready = false;
+            i = 0;
+        } else {
+            return LORABBIT_ERROR_ACK_FAILED; // ACKタイムアウト
+        }
+    } // main loop
+
+    return LORABBIT_OK;
+}
+
+/**
+ * @brief ウィンドウ送信モードにおける、送信済みパケット1つ分の管理情報
+ */
+typedef struct {
+    uint32_t sent_time_ms;     /**< 最後に送信した時刻 */
+    uint8_t  attempts;         /**< 送信回数 */
+    bool     needs_retransmit; /**< 欠損が判明し、再送が必要か */
+} LoRabbitTP_TxSlot_t;
+
+/**
+ * @brief スライディングウィンドウ + 選択的再送方式でデータを送信する
+ * @details 最大 window_size 個の未確認パケットを連続送信し、その最後のパケットでのみACKを要求する。
+ * 受信側から返る累積ACKと選択ACKビットマップにより、欠損したパケットのみを再送する。
+ * ACKがタイムアウトした場合は、最も古く送信した未確認パケットを再送して受信状況を問い合わせる。
+ */
+static int lora_send_data_window(LoraHandle_t *p_handle,
+                                 uint16_t target_address,
+                                 uint8_t target_channel,
+                                 uint8_t *p_data,
+                                 uint32_t size,
+                                 uint8_t transaction_id,
+                                 uint16_t total_packets,
+                                 uint8_t fragment_length,
+                                 uint8_t session_flags,
+                                 uint8_t window_size,
+                                 LoraCommLog_t *p_log)
+{
+    LoRabbitTP_TxSlot_t slots[LORABBIT_TP_WINDOW_SIZE_MAX];
+    uint8_t *acked_bitmap = p_handle->tp_tx_acked_bitmap;
+    uint16_t batch[LORABBIT_TP_WINDOW_SIZE_MAX];
+    uint8_t packet_buffer[197];
+    uint16_t base = 0; // 最も古い未確認パケット
+    uint16_t next = 0; // 次に初めて送信するパケット
+    LoRabbitTP_Header_t session;
+    LoRabbit_PeerLink_t *p_link = lora_link_get(p_handle, target_address);
+    bool is_rtt_sample_valid = true;
+    bool is_peer_ready = false; // 受信側が転送を認識したか (ACKを受信したか)
+
+    lora_tx_session_init(&session, target_address, target_channel, transaction_id, total_packets,
+                         fragment_length, session_flags);
+    const uint8_t data_frame_size = LORABBIT_TP_FRAME_ADDRESS_SIZE + lora_data_header_size(session.control_byte) + fragment_length;
+
+    memset(slots, 0, sizeof(slots));
+    memset(acked_bitmap, 0, LORABBIT_TP_BITMAP_SIZE);
+
+    while (base < total_packets) {
+        lora_status_set_progress(p_handle, base);
+
+        uint32_t window_end = (uint32_t)base + window_size;
+        if (window_end > total_packets) {
+            window_end = total_packets;
+        }
+
+        // 今回送信するパケットを選ぶ (未送信のもの + 欠損が判明したもの)
+        uint8_t batch_len = 0;
+        for (uint16_t i = base; i < window_end; i++) {
+            if (lora_bitmap_test(acked_bitmap, i)) {
+                continue;
+            }
+            LoRabbitTP_TxSlot_t *p_slot = &slots[i % LORABBIT_TP_WINDOW_SIZE_MAX];
+            if (i >= next) {
+                memset(p_slot, 0, sizeof(LoRabbitTP_TxSlot_t));
+                batch[batch_len++] = i;
+            } else if (p_slot->needs_retransmit) {
+                batch[batch_len++] = i;
+            }
+        }
+
+        if (batch_len == 0) {
+            // ACKが返ってこなかった (ACKの要求かACK自体が消失した)
+            // タイマが最も古いパケットを再送し、受信状況を問い合わせる
+            uint16_t oldest = base;
+            for (uint16_t i = base; i < window_end; i++) {
+                if (!lora_bitmap_test(acked_bitmap, i) &&
+                    (int32_t)(slots[i % LORABBIT_TP_WINDOW_SIZE_MAX].sent_time_ms -
+                              slots[oldest % LORABBIT_TP_WINDOW_SIZE_MAX].sent_time_ms) < 0) {
+                    oldest = i;
+                }
+            }
+            batch[batch_len++] = oldest;
+        }
+
+        // 連続送信 (最後のパケットでのみACKを要求する)
+        const uint8_t retry_budget = lora_link_retry_budget(p_link);
+        for (uint8_t k = 0; k < batch_len; k++) {
+            uint16_t index = batch[k];
+            LoRabbitTP_TxSlot_t *p_slot = &slots[index % LORABBIT_TP_WINDOW_SIZE_MAX];
+
+            if (p_slot->attempts >= retry_budget) {
+                return LORABBIT_ERROR_ACK_FAILED; // 再送回数の上限に達した
+            }
+            if (p_slot->attempts > 0) {
+                p_log->total_retries++; // リトライ回数をカウント
+            }
+
+            uint8_t control_byte = LORABBIT_TP_ARQ_WINDOW | session.control_byte;
+            if (k == batch_len - 1) control_byte |= LORABBIT_TP_FLAG_ACK_REQUEST;
+            if (index == total_packets - 1) control_byte |= LORABBIT_TP_FLAG_EOT;
+            int packet_len = lora_build_data_packet(p_handle, packet_buffer, control_byte,
+                                                    transaction_id, total_packets, fragment_length, index, p_data, size,
+                                                    lora_use_compact_header(p_handle, control_byte, is_peer_ready));
+
+            ER send_err = lora_send_data_frame(p_handle, target_address, target_channel, packet_buffer, packet_len);
+            if (send_err != LORABBIT_OK) {
+                return send_err;
+            }
+
+            p_slot->attempts++;
+            p_slot->sent_time_ms = (uint32_t)lora_get_time_ms();
+            p_slot->needs_retransmit = false;
+            if (index >= next) {
+                next = index + 1;
+            }
+        }
+
+        // 累積ACK + 選択ACKを待つ
+        RecvFrameE220900T22SJP_t ack_frame;
+        LoRabbitTP_Header_t ack_header;
+        uint64_t sent_time_ms = lora_get_time_ms();
+        ER err = lora_wait_for_ack(p_handle, &session, lora_link_ack_wait(p_handle, p_link), &ack_frame, &ack_header);
+        if (err == LORABBIT_ERROR_TIMEOUT) {
+            lora_link_on_ack_timeout(p_link);
+            is_rtt_sample_valid = false;
+            continue; // 次のループで問い合わせる
+        }
+        if (err != LORABBIT_OK) {
+            return err;
+        }
+        p_log->last_ack_rssi = ack_frame.rssi; // ACKのRSSIを記録
+        lora_link_on_ack(p_link, (uint32_t)(lora_get_time_ms() - sent_time_ms), is_rtt_sample_valid);
+        is_rtt_sample_valid = true;
+        is_peer_ready = true;
+
+        // 累積ACKまでを確認済みにする
+        // (新たに到着/欠損が判明したパケット数は、データパケットの損失率の推定に使う)
+        uint16_t delivered_count = 0;
+        uint16_t lost_count = 0;
+        uint16_t cumulative = ack_header.packet_index;
+        if (cumulative > total_packets) {
+            cumulative = total_packets;
+        }
+        if (cumulative < base) {
+            // 確認済みのパケットが受信側にない: 受信側は途絶えた転送を破棄し、再送したパケットから受信し直している。
+            // 累積ACKの位置から未送信として送り直す
+            LORA_PRINTF("lora_send_data_window: receiver restarted the transfer at packet %u\n", cumulative);
+            for (uint16_t i = cumulative; i < total_packets; i++) {
+                lora_bitmap_clear(acked_bitmap, i);
+            }
+            base = cumulative;
+            next = cumulative;
+        }
+        for (uint16_t i = base; i < cumulative; i++) {
+            if (!lora_bitmap_test(acked_bitmap, i)) {
+                lora_bitmap_set(acked_bitmap, i);
+                delivered_count++;
+            }
+        }
+
+        // 選択ACKを反映する。ACK要求より前に送信済みなのに未受信のパケットは欠損とみなす
+        uint16_t sack_bits = ack_header.payload_length;
+        if (sack_bits > LORABBIT_TP_SACK_BITMAP_MAX) {
+            sack_bits = LORABBIT_TP_SACK_BITMAP_MAX;
+        }
+        sack_bits *= 8;
+        const uint8_t *p_sack = &ack_frame.recv_data[ack_header.header_size];
+        for (uint16_t bit = 0; bit < sack_bits && cumulative + bit < total_packets; bit++) {
+            uint16_t i = cumulative + bit;
+            if (lora_bitmap_test(acked_bitmap, i)) {
+                continue;
+            }
+            if (lora_bitmap_test(p_sack, bit)) {
+                lora_bitmap_set(acked_bitmap, i);
+                delivered_count++;
+            } else if (i < next && i >= base && !slots[i % LORABBIT_TP_WINDOW_SIZE_MAX].needs_retransmit) {
+                slots[i % LORABBIT_TP_WINDOW_SIZE_MAX].needs_retransmit = true;
+                lost_count++;
+            }
+        }
+        lora_link_on_data_result(p_link, data_frame_size, delivered_count + lost_count, lost_count);
+
+        // ウィンドウを進める
+        while (base < total_packets && lora_bitmap_test(acked_bitmap, base)) {
+            base++;
+        }
+    }
+
+    return LORABBIT_OK;
+}
+
+/**
+ * @brief バースト送信方式でデータを送信する
+ * @details 未確認の全パケットをACKを待たずに連続送信し、その最後のパケットでのみACKを要求する。
+ * 受信側は欠損パケットのビットマップ(NACK)を1回だけ返すので、欠損したパケットのみを
+ * 次のラウンドで再送し、ビットマップが空になるまで繰り返す。
+ * 1ラウンドで1つも新たに確認できない状態が、損失率から決めた再送回数だけ続いたら失敗とする。
+ * repair_count が1以上なら、最初のラウンドでデータパケットに続けて冗長パケットを送信する。
+ * 受信側は冗長パケットで埋められる欠損をNACKに含めないため、再送は冗長パケットで補えない分だけになる。
+ */
+static int lora_send_data_burst(LoraHandle_t *p_handle,
+                                uint16_t target_address,
+                                uint8_t target_channel,
+                                uint8_t *p_data,
+                                uint32_t size,
+                                uint8_t transaction_id,
+                                uint16_t total_packets,
+                                uint8_t fragment_length,
+                                uint8_t session_flags,
+                                uint8_t repair_count,
+                                LoraCommLog_t *p_log)
+{
+    uint8_t *acked_bitmap = p_handle->tp_tx_acked_bitmap;
+    uint8_t *pending_bitmap = p_handle->tp_tx_pending_bitmap; // 今回のラウンドで送信するパケット
+    uint8_t packet_buffer[197];
+    const uint16_t send_count = total_packets + repair_count; // 冗長パケットを含むパケット数
+    uint16_t acked_count = 0;
+    uint8_t stalled_rounds = 0;
+    bool is_first_round = true;
+    LoRabbitTP_Header_t session;
+    LoRabbit_PeerLink_t *p_link = lora_link_get(p_handle, target_address);
+    bool is_rtt_sample_valid = true;
+    bool is_peer_ready = false; // 受信側が転送を認識したか (NACKを受信したか)
+
+    lora_tx_session_init(&session, target_address, target_channel, transaction_id, total_packets,
+                         fragment_length, session_flags);
+    const uint8_t data_frame_size = LORABBIT_TP_FRAME_ADDRESS_SIZE + lora_data_header_size(session.control_byte) + fragment_length;
+
+    memset(acked_bitmap, 0, LORABBIT_TP_BITMAP_SIZE);
+    memset(pending_bitmap, 0, LORABBIT_TP_BITMAP_SIZE);
+    for (uint16_t i = 0; i < send_count; i++) {
+        lora_bitmap_set(pending_bitmap, i);
+    }
+
+    while (acked_count < total_packets) {
+        // ACKを要求する、このラウンド最後のパケットを探す
+        uint16_t last = send_count;
+        for (uint16_t i = send_count; i > 0; i--) {
+            if (lora_bitmap_test(pending_bitmap, i - 1)) {
+                last = i - 1;
+                break;
+            }
+        }
+        if (last == send_count) {
+            // 送るべきパケットがない (NACKの範囲外に未確認パケットがある) -> 最初の未確認パケットで問い合わせる
+            for (last = 0; last < total_packets && lora_bitmap_test(acked_bitmap, last); last++) {
+            }
+            lora_bitmap_set(pending_bitmap, last);
+        }
+
+        // 連続送信
+        for (uint16_t i = 0; i <= last; i++) {
+            if (!lora_bitmap_test(pending_bitmap, i)) {
+                continue;
+            }
+            if (i < total_packets) {
+                lora_status_set_progress(p_handle, i);
+            }
+            if (!is_first_round) {
+                p_log->total_retries++; // リトライ回数をカウント
+            }
+
+            uint8_t control_byte = LORABBIT_TP_ARQ_BURST | session.control_byte;
+            if (repair_count > 0) control_byte |= LORABBIT_TP_FLAG_FEC;
+            if (i == last) control_byte |= LORABBIT_TP_FLAG_ACK_REQUEST;
+            if (i == total_packets - 1) control_byte |= LORABBIT_TP_FLAG_EOT;
+            const bool is_compact = lora_use_compact_header(p_handle, control_byte, is_peer_ready);
+            int packet_len;
+            if (i < total_packets) {
+                packet_len = lora_build_data_packet(p_handle, packet_buffer, control_byte,
+                                                    transaction_id, total_packets, fragment_length, i, p_data, size,
+                                                    is_compact);
+            } else {
+#ifdef LORABBIT_USE_FEC
+                packet_len = lora_build_repair_packet(p_handle, packet_buffer, control_byte,
+                                                      transaction_id, (uint8_t)total_packets, fragment_length,
+                                                      (uint8_t)i, p_data, size, is_compact);
+#else
+                continue; // FEC無効時は repair_count が常に0なので到達しない
+#endif
+            }
+
+            ER send_err = lora_send_data_frame(p_handle, target_address, target_channel, packet_buffer, packet_len);
+            if (send_err != LORABBIT_OK) {
+                return send_err;
+            }
+        }
+        memset(pending_bitmap, 0, LORABBIT_TP_BITMAP_SIZE);
+        is_first_round = false;
+
+        // ラウンド末尾のNACKを待つ
+        RecvFrameE220900T22SJP_t ack_frame;
+        LoRabbitTP_Header_t ack_header;
+        uint64_t sent_time_ms = lora_get_time_ms();
+        ER err = lora_wait_for_ack(p_handle, &session, lora_link_ack_wait(p_handle, p_link), &ack_frame, &ack_header);
+        if (err == LORABBIT_ERROR_TIMEOUT) {
+            // ACK要求かNACKが消失した -> 最後のパケットを再送して問い合わせる。
+            // ただし、NACKを一度も受信していなければ最初のラウンドが全て失われたかもしれない。
+            // 最後のパケットと冗長パケットでは受信側が転送を始められないので、先頭のパケットで問い合わせる
+            lora_link_on_ack_timeout(p_link);
+            is_rtt_sample_valid = false;
+            if (++stalled_rounds >= lora_link_retry_budget(p_link)) {
+                return LORABBIT_ERROR_ACK_FAILED;
+            }
+            lora_bitmap_set(pending_bitmap, is_peer_ready ? last : 0);
+            continue;
+        }
+        if (err != LORABBIT_OK) {
+            return err;
+        }
+        p_log->last_ack_rssi = ack_frame.rssi; // ACKのRSSIを記録
+        lora_link_on_ack(p_link, (uint32_t)(lora_get_time_ms() - sent_time_ms), is_rtt_sample_valid);
+        is_rtt_sample_valid = true;
+        is_peer_ready = true;
+
+        // NACKを反映する。cumulative より前と、ビットマップの範囲より後ろは受信済み
+        // (NACKが一部分だけの場合、ビットマップの範囲より後ろは未確定のまま残す)
+        uint16_t prev_acked_count = acked_count;
+        uint16_t cumulative = ack_header.packet_index;
+        if (cumulative > total_packets) {
+            cumulative = total_packets;
+        }
+        uint16_t nack_bits = ack_header.payload_length;
+        if (nack_bits > LORABBIT_TP_NACK_BITMAP_MAX) {
+            nack_bits = LORABBIT_TP_NACK_BITMAP_MAX;
+        }
+        nack_bits *= 8;
+        const uint8_t *p_nack = &ack_frame.recv_data[ack_header.header_size];
+        uint32_t known_end = total_packets;
+        if (ack_header.control_byte & LORABBIT_TP_FLAG_NACK_PARTIAL) {
+            known_end = (uint32_t)cumulative + nack_bits;
+        }
+        uint16_t lost_count = 0;
+        uint16_t reset_count = 0;
+        for (uint16_t i = 0; i < total_packets; i++) {
+            if (i >= known_end) {
+                continue;
+            }
+            const bool is_missing = i >= cumulative && i - cumulative < nack_bits &&
+                                    lora_bitmap_test(p_nack, i - cumulative);
+            if (lora_bitmap_test(acked_bitmap, i)) {
+                if (is_missing) {
+                    // 確認済みのパケットが受信側にない: 受信側は途絶えた転送を破棄し、
+                    // 問い合わせのパケットから受信し直している -> 次のラウンドで送り直す
+                    lora_bitmap_clear(acked_bitmap, i);
+                    lora_bitmap_set(pending_bitmap, i);
+                    acked_count--;
+                    reset_count++;
+                }
+                continue;
+            }
+            if (is_missing) {
+                lora_bitmap_set(pending_bitmap, i); // 欠損 -> 次のラウンドで再送
+                lost_count++;
+            } else {
+                lora_bitmap_set(acked_bitmap, i);
+                acked_count++;
+            }
+        }
+        // (冗長パケットで補える欠損はNACKに含まれないので、到着として数える)
+        lora_link_on_data_result(p_link, data_frame_size, acked_count + reset_count - prev_acked_count + lost_count,
+                                 lost_count);
+
+        if (acked_count <= prev_acked_count) {
+            if (++stalled_rounds >= lora_link_retry_budget(p_link)) {
+                return LORABBIT_ERROR_ACK_FAILED; // 再送しても欠損が埋まらない
+            }
+        } else {
+            stalled_rounds = 0;
+        }
+    }
+
+    return LORABBIT_OK;
+}
+
+/**
+ * @brief 同報送信で大容量データを送信する
+ * @details 全パケットを送信先 (0xFFFF や、複数の受信側が共有するアドレス) に1回ずつ連続送信し、
+ * ラウンド最後のパケットでNACKを要求する。欠損のある受信側だけが、LORABBIT_TP_MULTICAST_NACK_SLOTS 個の
+ * 返信スロットからランダムに選んだタイミングで欠損ビットマップ(NACK)を返す。
+ * スロットの終わりまでNACKを集めて欠損の和集合を取り、次のラウンドでそのパケットを1回ずつ再送する。
+ * 再送は受信側の数ではなく、いずれかの受信側が欠損したパケットの数だけ増える。
+ * 全て受信した受信側は返信しないため、NACKの返らない問い合わせが lora_link_silent_poll_count() 回
+ * 続いたら完了とする (応答のない受信側の受信完了は確認できない)。
+ * 和集合が前のラウンドから減らない状態が LORABBIT_TP_RETRY_COUNT_MAX 回続いたら失敗とする
+ * (受信側ごとに欠損が異なり、1ラウンドで全ては埋まらないことがあるため、上限まで粘る)。
+ * NACKは受信側ごとにスロットをずらして返るため、往復時間は測らない。
+ */
+static int lora_send_data_multicast(LoraHandle_t *p_handle,
+                                    uint16_t target_address,
+                                    uint8_t target_channel,
+                                    uint8_t *p_data,
+                                    uint32_t size,
+                                    uint8_t transaction_id,
+                                    uint16_t total_packets,
+                                    uint8_t fragment_length,
+                                    uint8_t repair_count,
+                                    LoraCommLog_t *p_log)
+{
+    uint8_t *pending_bitmap = p_handle->tp_tx_pending_bitmap; // 今回のラウンドで送信するパケット
+    uint8_t packet_buffer[197];
+    const uint16_t send_count = total_packets + repair_count; // 冗長パケットを含むパケット数
+    uint16_t prev_lost_count = send_count;
+    uint8_t stalled_rounds = 0;
+    uint8_t silent_polls = 0;
+    bool is_first_round = true;
+    bool is_nack_received = false; // この転送でNACKを受信したか
+    LoRabbitTP_Header_t session;
+    LoRabbit_PeerLink_t *p_link = lora_link_get(p_handle, target_address);
+
+    if (total_packets == 0) {
+        return LORABBIT_OK; // 送るデータがない (他の方式と同じく、何も送らずに成功とする)
+    }
+
+    lora_tx_session_init(&session, target_address, target_channel, transaction_id, total_packets,
+                         fragment_length, 0);
+    const uint8_t data_frame_size = LORABBIT_TP_FRAME_ADDRESS_SIZE + lora_data_header_size(session.control_byte) + fragment_length;
+    // 最も遅いスロットのNACKが届くまで待つ
+    const TMO nack_window = lora_link_ack_timeout(p_link) +
+                            (TMO)(LORABBIT_TP_MULTICAST_NACK_SLOTS * lora_link_reply_slot_ms(p_handle));
+
+    memset(pending_bitmap, 0, LORABBIT_TP_BITMAP_SIZE);
+    for (uint16_t i = 0; i < send_count; i++) {
+        lora_bitmap_set(pending_bitmap, i);
+    }
+
+    while (1) {
+        // NACKを要求する、このラウンド最後のパケットを探す
+        uint16_t last = send_count;
+        for (uint16_t i = send_count; i > 0; i--) {
+            if (lora_bitmap_test(pending_bitmap, i - 1)) {
+                last = i - 1;
+                break;
+            }
+        }
+        if (last == send_count) {
+            // 報告された欠損がない -> 最後のデータパケットで問い合わせる
+            last = total_packets - 1;
+            lora_bitmap_set(pending_bitmap, last);
+        }
+
+        // 連続送信
+        uint16_t round_data_count = 0;
+        for (uint16_t i = 0; i <= last; i++) {
+            if (!lora_bitmap_test(pending_bitmap, i)) {
+                continue;
+            }
+            if (!is_first_round) {
+                p_log->total_retries++; // リトライ回数をカウント
+            }
+
+            uint8_t control_byte = LORABBIT_TP_ARQ_MULTICAST | session.control_byte;
+            if (repair_count > 0) control_byte |= LORABBIT_TP_FLAG_FEC;
+            if (i == last) control_byte |= LORABBIT_TP_FLAG_ACK_REQUEST;
+            if (i == total_packets - 1) control_byte |= LORABBIT_TP_FLAG_EOT;
+            int packet_len;
+            if (i < total_packets) {
+                lora_status_set_progress(p_handle, i);
+                round_data_count++;
+                packet_len = lora_build_data_packet(p_handle, packet_buffer, control_byte,
+                                                    transaction_id, total_packets, fragment_length, i, p_data, size,
+                                                    false);
+            } else {
+#ifdef LORABBIT_USE_FEC
+                packet_len = lora_build_repair_packet(p_handle, packet_buffer, control_byte,
+                                                      transaction_id, (uint8_t)total_packets, fragment_length,
+                                                      (uint8_t)i, p_data, size, false);
+#else
+                continue; // FEC無効時は repair_count が常に0なので到達しない
+#endif
+            }
+
+            ER send_err = lora_send_data_frame(p_handle, target_address, target_channel, packet_buffer, packet_len);
+            if (send_err != LORABBIT_OK) {
+                return send_err;
+            }
+        }
+        memset(pending_bitmap, 0, LORABBIT_TP_BITMAP_SIZE);
+        is_first_round = false;
+
+        // 返信スロットが全て終わるまでNACKを集め、欠損の和集合を次のラウンドで再送する
+        uint16_t lost_count = 0;
+        uint16_t nack_count = 0;
+        uint64_t deadline = lora_get_time_ms() + (uint64_t)nack_window;
+        while (1) {
+            uint64_t now = lora_get_time_ms();
+            if (now >= deadline) {
+                break;
+            }
+            RecvFrameE220900T22SJP_t ack_frame;
+            LoRabbitTP_Header_t ack_header;
+            ER err = lora_wait_for_ack(p_handle, &session, (TMO)(deadline - now), &ack_frame, &ack_header);
+            if (err == LORABBIT_ERROR_TIMEOUT) {
+                break;
+            }
+            if (err != LORABBIT_OK) {
+                return err;
+            }
+            p_log->last_ack_rssi = ack_frame.rssi; // ACKのRSSIを記録
+            nack_count++;
+
+            // cumulative より前は受信済み。ビットマップの範囲より後ろは、その受信側の次のNACKで分かる
+            uint16_t cumulative = ack_header.packet_index;
+            uint16_t nack_bits = ack_header.payload_length;
+            if (nack_bits > LORABBIT_TP_NACK_BITMAP_MAX) {
+                nack_bits = LORABBIT_TP_NACK_BITMAP_MAX;
+            }
+            nack_bits *= 8;
+            const uint8_t *p_nack = &ack_frame.recv_data[ack_header.header_size];
+            for (uint16_t bit = 0; bit < nack_bits && (uint32_t)cumulative + bit < total_packets; bit++) {
+                if (lora_bitmap_test(p_nack, bit) && !lora_bitmap_test(pending_bitmap, cumulative + bit)) {
+                    lora_bitmap_set(pending_bitmap, cumulative + bit);
+                    lost_count++;
+                }
+            }
+        }
+
+        if (nack_count == 0) {
+            // 欠損を報告する受信側がいない。返信の届かない問い合わせが続く確率が十分小さくなるまで問い合わせる
+            if (++silent_polls >= lora_link_silent_poll_count(p_link, data_frame_size)) {
+                if (!is_nack_received) {
+                    // 最初のラウンドで全ての受信側が全パケットを受信した (次の転送の問い合わせ回数に反映する)
+                    lora_link_on_data_result(p_link, data_frame_size, total_packets, 0);
+                }
+                return LORABBIT_OK;
+            }
+            continue;
+        }
+        silent_polls = 0;
+        is_nack_received = true;
 
-    // ACKのヘッダを組み立てる
-    ack_payload[0] = p_handle->current_config.own_address >> 8;
-    ack_payload[1] = p_handle->current_config.own_address & 0xFF;
-    ack_payload[2] = p_handle->current_config.own_channel;
-    ack_payload[3] = LORABBIT_TP_FLAG_IS_ACK; // コントロールバイト
-    ack_payload[4] = p_data_header->transaction_id;
-    ack_payload[5] = p_data_header->total_packets;
-    ack_payload[6] = p_data_header->packet_index;
-    ack_payload[7] = 0; // ペイロード長
+        // 和集合の損失率は、いずれかの受信側がパケットを取りこぼす率として、パケット長の選択に使う
+        lora_link_on_data_result(p_link, data_frame_size, round_data_count,
+                                 (lost_count < round_data_count) ? lost_count : round_data_count);
 
-    // ACK を送信 (待機なし)
-    return lora_send_frame_fire_and_forget_internal(p_handle,
-                                                    p_data_header->source_address,
-                                                    p_data_header->source_channel,
-                                                    ack_payload,
-                                                    sizeof(ack_payload));
+        if (lost_count >= prev_lost_count) {
+            if (++stalled_rounds >= LORABBIT_TP_RETRY_COUNT_MAX) {
+                return LORABBIT_ERROR_ACK_FAILED; // 再送しても欠損が埋まらない
+            }
+        } else {
+            stalled_rounds = 0;
+        }
+        prev_lost_count = lost_count;
+    }
 }
 
-/**
- * @brief 転送状態を「実行中」に設定するヘルパー
- */
-static void lora_status_set_active(LoraHandle_t *p_handle, uint8_t total_packets, uint8_t current_index) {
-    tk_wai_sem(p_handle->status_mutex_id, 1, TMO_FEVR);
-    p_handle->transfer_status.is_active = true;
-    p_handle->transfer_status.total_packets = total_packets;
-    p_handle->transfer_status.current_packet_index = current_index;
-    tk_sig_sem(p_handle->status_mutex_id, 1);
+// 受信中の転送の欠損ビットマップ(NACK)を返すヘルパー関数（内部利用）
+static void lora_rx_session_send_nack(LoraHandle_t *p_handle,
+                                      LoRabbitTP_RxSession_t *p_rx,
+                                      LoRabbitTP_Header_t *p_header)
+{
+#ifdef LORABBIT_USE_FEC
+    if (p_rx->fec.count > 0) {
+        // 冗長断片を保管している欠損位置は、冗長パケットで補えるので再送を求めない
+        // (FECは通常のヘッダの転送でのみ使うので、255パケット分のビットマップで足りる)
+        uint8_t covered_bitmap[(LORABBIT_TP_STD_MAX_PACKETS + 7) / 8];
+        memcpy(covered_bitmap, p_rx->bitmap, sizeof(covered_bitmap));
+        for (uint8_t k = 0; k < p_rx->fec.count; k++) {
+            lora_bitmap_set(covered_bitmap, p_rx->fec.slot[k]);
+        }
+        lora_send_nack(p_handle, &p_rx->ack, p_header, covered_bitmap);
+        return;
+    }
+#endif
+    lora_send_nack(p_handle, &p_rx->ack, p_header, p_rx->bitmap);
 }
 
-/**
- * @brief 転送状態の進捗を更新するヘルパー
- */
-static void lora_status_set_progress(LoraHandle_t *p_handle, uint8_t current_index) {
-    tk_wai_sem(p_handle->status_mutex_id, 1, TMO_FEVR);
-    p_handle->transfer_status.current_packet_index = current_index;
-    tk_sig_sem(p_handle->status_mutex_id, 1);
+// 同報送信で、返信スロットが来たNACKを返すヘルパー関数（内部利用）
+// 戻り値: まだ返していないNACKがあれば、それを返す時刻 (なければ 0)
+static uint64_t lora_rx_session_poll_nack(LoraHandle_t *p_handle, LoRabbitTP_RxSession_t *p_rx) {
+    if (0 == p_rx->nack_due_ms) {
+        return 0;
+    }
+    if (lora_get_time_ms() < p_rx->nack_due_ms) {
+        return p_rx->nack_due_ms;
+    }
+    // NACKは転送の情報だけで組み立てられる (ACK要求を受けたパケットのヘッダは要らない)
+    LoRabbitTP_Header_t session;
+    lora_rx_session_header(p_rx, &session);
+    lora_rx_session_send_nack(p_handle, p_rx, &session);
+    p_rx->nack_due_ms   = 0;
+    p_rx->last_event_ms = lora_get_time_ms();
+    return 0;
 }
 
 /**
- * @brief 転送状態を「アイドル」にリセットするヘルパー
+ * @brief 受信中の転送にパケットを1つ反映する (全ての再送制御方式で共通)
+ * @details 受信済みパケットをビットマップで管理し、任意の順序で届いたパケットを
+ * index * パケットの間隔 の位置に書き込む (重複して届いたパケットは読み捨てる)。ACKを要求されたら、
+ * ストップアンドウェイトにはそのパケットのACKを、ウィンドウ送信には選択ACKを、
+ * バースト送信には欠損ビットマップ(NACK)を返す。
+ * 同報送信では、欠損がある間だけランダムな返信スロットでNACKを返し、全パケットが揃ったら返信せずに完了する。
+ * @param[in,out] p_rx 受信中の転送 (lora_rx_session_begin() で初期化したもの)
+ * @param[in] p_frame 受信したフレーム
+ * @param[in] p_header p_rx の転送のパケットと確認済みのヘッダ
+ * @return ビットマップが埋まり、全パケットの受信を通知したら (ACKなしの転送では埋まった時点で) true
  */
-static void lora_status_set_idle(LoraHandle_t *p_handle) {
-    tk_wai_sem(p_handle->status_mutex_id, 1, TMO_FEVR);
-    p_handle->transfer_status.is_active = false;
-    p_handle->transfer_status.total_packets = 0;
-    p_handle->transfer_status.current_packet_index = 0;
-    tk_sig_sem(p_handle->status_mutex_id, 1);
+static bool lora_rx_session_on_packet(LoraHandle_t *p_handle,
+                                      LoRabbitTP_RxSession_t *p_rx,
+                                      const RecvFrameE220900T22SJP_t *p_frame,
+                                      LoRabbitTP_Header_t *p_header)
+{
+    uint8_t *received_bitmap = p_rx->bitmap;
+    const uint16_t total_packets = p_rx->ack.total_packets;
+    const uint8_t fragment_length = p_rx->ack.fragment_length;
+    LoRabbit_PeerLink_t *p_link = lora_link_get(p_handle, p_rx->ack.address);
+
+    // 損失率を推定する: 初回送信の番号の飛びは欠損、受信済みパケットの再送はACKの欠損とみなす
+    uint64_t now_ms = lora_get_time_ms();
+    if (p_header->packet_index >= p_rx->next_new_index) {
+        if (p_header->packet_index == p_rx->next_new_index && p_rx->next_new_index > 0) {
+            lora_link_on_rx_gap(p_link, (uint32_t)(now_ms - p_rx->last_event_ms));
+        }
+        for (uint16_t k = p_rx->next_new_index; k < p_header->packet_index; k++) {
+            lora_link_on_rx_packet(p_link, true);
+        }
+        lora_link_on_rx_packet(p_link, false);
+        p_rx->next_new_index = p_header->packet_index + 1;
+    } else if (p_header->packet_index < total_packets &&
+               lora_bitmap_test(received_bitmap, p_header->packet_index)) {
+        lora_link_on_rx_packet(p_link, true);
+    }
+    p_rx->last_event_ms = now_ms;
+
+#ifdef LORABBIT_USE_FEC
+    if (p_header->packet_index >= total_packets) {
+        // 冗長パケットは欠損位置に一時保管する
+        lora_fec_store_repair(&p_rx->fec, p_rx->p_buffer, received_bitmap, p_frame, p_header);
+    }
+#endif
+    // 未受信のパケットであればバッファに書き込む (重複は読み捨てる)
+    if (p_header->packet_index < total_packets &&
+        !lora_bitmap_test(received_bitmap, p_header->packet_index)) {
+#ifdef LORABBIT_USE_FEC
+        if (p_header->control_byte & LORABBIT_TP_FLAG_FEC) {
+            lora_fec_prepare_data_slot(&p_rx->fec, p_rx->p_buffer, received_bitmap, p_header);
+        }
+#endif
+        memcpy(&p_rx->p_buffer[(uint32_t)p_header->packet_index * fragment_length],
+               &p_frame->recv_data[p_header->header_size],
+               p_header->payload_length);
+        lora_bitmap_set(received_bitmap, p_header->packet_index);
+        p_rx->received_count++;
+        p_rx->written_size += p_header->payload_length;
+    }
+#ifdef LORABBIT_USE_FEC
+    // 届いたパケットが全体でデータパケット数に達したら、欠損分を復元する
+    lora_fec_try_decode(&p_rx->fec, p_rx->p_buffer, received_bitmap, (uint8_t)total_packets, fragment_length,
+                        &p_rx->received_count, &p_rx->written_size);
+#endif
+
+    const uint8_t arq = p_header->control_byte & LORABBIT_TP_ARQ_MASK;
+    if (arq == LORABBIT_TP_ARQ_MULTICAST) {
+        if (p_rx->received_count == total_packets) {
+            // 返すACKはないが、以降の問い合わせを受信完了した転送の再送として読み捨てられるようにする
+            p_rx->ack.length   = 0;
+            p_rx->ack.is_valid = true;
+            return true;
+        }
+        if (p_header->control_byte & LORABBIT_TP_FLAG_ACK_REQUEST) {
+            // 他の受信側のNACKと重ならないよう、ランダムに選んだ返信スロットで返す。
+            // 返信スロットまでの間も受信を続けられるよう、待たずに返す時刻だけを決める (lora_rx_session_poll_nack())
+            uint32_t slot = lora_random(p_handle) % LORABBIT_TP_MULTICAST_NACK_SLOTS;
+            p_rx->nack_due_ms = now_ms + slot * lora_link_reply_slot_ms(p_handle);
+            lora_rx_session_poll_nack(p_handle, p_rx);
+        }
+        return false;
+    }
+
+    // ACK要求があれば、受信状況を返信する
+    if (p_header->control_byte & LORABBIT_TP_FLAG_ACK_REQUEST) {
+        if (arq == LORABBIT_TP_ARQ_STOP_AND_WAIT) {
+            // 受信済みのパケットでもACKを返す (ACKが欠損して再送されてきた場合)
+            lora_send_ack(p_handle, &p_rx->ack, p_header);
+        } else if (arq == LORABBIT_TP_ARQ_BURST) {
+            lora_rx_session_send_nack(p_handle, p_rx, p_header);
+        } else {
+            lora_send_sack(p_handle, &p_rx->ack, p_header, received_bitmap);
+        }
+        p_rx->last_event_ms = lora_get_time_ms();
+        return p_rx->received_count == total_packets; // 全パケットの受信を通知した
+    }
+    // ACKなしの転送は、全パケットが揃った時点で完了
+    return arq == LORABBIT_TP_ARQ_STOP_AND_WAIT && p_rx->received_count == total_packets;
 }
 
 /**
- * @brief パケットを1つ受信し、期待通りのものか検証する
- * @param[in] p_handle ハンドル
- * @param[in,out] p_remaining_timeout 残りタイムアウト時間(ms)へのポインタ。関数内で消費時間を減算する。
- * @param[in] expected_index 期待するパケットインデックス
- * @param[in] transaction_id_to_match 期待するトランザクションID (最初のパケットの場合は無視される)
- * @param[out] p_out_frame 受信したフレームの格納先
- * @param[out] p_out_header パースしたヘッダの格納先
- * @retval LORABBIT_OK 期待通りのパケットを受信
- * @retval LORABBIT_ERROR_TIMEOUT タイムアウト
- * @retval LORABBIT_ERROR_RETRY 期待しないパケットを受信（リトライが必要）
+ * @brief 分割されたデータを受信し、復元する (全ての再送制御方式で共通)
+ * @details 後続のパケットを1つずつ lora_rx_session_on_packet() に渡し、転送が完了するまで繰り返す。
+ * @param[in] p_frame 受信済みの最初のフレーム (ループ内で再利用する)
+ * @param[in] p_header 最初のフレームのヘッダ (ループ内で再利用する)
  */
-static ER lora_receive_and_validate_packet(
-    LoraHandle_t *p_handle,
-    TMO *p_remaining_timeout,
-    uint8_t expected_index,
-    uint8_t transaction_id_to_match,
-    RecvFrameE220900T22SJP_t *p_out_frame,
-    LoRabbitTP_Header_t *p_out_header)
+static int lora_receive_data_reassemble(LoraHandle_t *p_handle,
+                                        uint8_t *p_buffer,
+                                        RecvFrameE220900T22SJP_t *p_frame,
+                                        LoRabbitTP_Header_t *p_header,
+                                        uint32_t *p_written_size)
 {
-    SYSTIM start_time, end_time;
-    tk_get_tim(&start_time);
+    LoRabbitTP_RxSession_t *p_rx = &p_handle->tp_rx;
+    const LoRabbitTP_Header_t session = *p_header; // 後続のコンパクトヘッダの解析に使う
 
-    int recv_len = LoRabbit_ReceiveFrame(p_handle, p_out_frame, *p_remaining_timeout);
+    lora_rx_session_begin(p_rx, p_buffer, p_header);
 
-    // タイムアウトを更新
-    if (*p_remaining_timeout != TMO_FEVR) {
-        tk_get_tim(&end_time);
-        uint64_t start_ms = ((uint64_t)start_time.hi << 32) | start_time.lo;
-        uint64_t end_ms   = ((uint64_t)end_time.hi << 32) | end_time.lo;
-        if (end_ms > start_ms) {
-            *p_remaining_timeout -= (TMO)(end_ms - start_ms);
+    while (1) {
+        bool is_complete = lora_rx_session_on_packet(p_handle, p_rx, p_frame, p_header);
+        lora_status_set_progress(p_handle, p_rx->received_count);
+        if (is_complete) {
+            break;
+        }
+
+        // 次のパケットを待つ (最後のパケットかACKから、送信側のACKタイムアウトと再送を待てるだけの時間)。
+        // 同報送信でNACKを返す予定があれば、その返信スロットまでの間だけ待ってNACKを返し、待ち直す
+        ER ret = LORABBIT_ERROR_TIMEOUT;
+        while (1) {
+            uint64_t now_ms = lora_get_time_ms();
+            uint64_t nack_due_ms = lora_rx_session_poll_nack(p_handle, p_rx);
+            if (0 == nack_due_ms) {
+                now_ms = lora_get_time_ms(); // NACKを返した場合はその分進んでいる
+            }
+            uint64_t deadline_ms = p_rx->last_event_ms + lora_rx_session_timeout(p_handle, p_rx);
+            if (now_ms >= deadline_ms) {
+                ret = LORABBIT_ERROR_TIMEOUT;
+                break;
+            }
+            if (0 != nack_due_ms && nack_due_ms < deadline_ms) {
+                deadline_ms = nack_due_ms;
+            }
+            TMO remaining_timeout = (TMO)(deadline_ms - now_ms);
+            ret = lora_receive_and_validate_packet(p_handle,
+                                                   &remaining_timeout,
+                                                   &session,
+                                                   p_frame,
+                                                   p_header);
+            if (ret == LORABBIT_ERROR_TIMEOUT && 0 != p_rx->nack_due_ms) {
+                continue; // 返信スロットが来た
+            }
+            if (ret != LORABBIT_ERROR_RETRY) {
+                break;
+            }
+        }
+        if (ret != LORABBIT_OK) {
+            if (p_rx->received_count == p_rx->ack.total_packets) {
+                break; // ACK要求は届かなかったが、データは揃っている
+            }
+            lora_rx_session_end(p_rx, false);
+            return (ret == LORABBIT_ERROR_RETRY) ? LORABBIT_ERROR_TIMEOUT : ret;
         }
     }
+    lora_rx_session_end(p_rx, true);
 
-    if (recv_len <= 0) {
-        return LORABBIT_ERROR_TIMEOUT;
+#if LORABBIT_TP_RX_LINGER_ROUNDS > 0
+    // 最後のACKが欠損した場合に備え、送信側の再送を待ってACKを返し直す (返したACKがなければ待たない)
+    // 受信ディスパッチャの起動中は、ディスパッチャが返し直すので待たない
+    if (p_rx->ack.is_valid && p_rx->ack.length > 0 && !lora_rx_dispatcher_is_running(p_handle)) {
+        lora_receive_linger(p_handle, lora_link_get(p_handle, p_rx->ack.address), p_frame);
     }
+#endif
 
-    lora_parse_header(p_out_frame->recv_data, p_out_header);
+    *p_written_size = p_rx->written_size;
+    return LORABBIT_OK;
+}
 
-    // パケットを検証
-    bool is_valid = false;
-    if (expected_index == 0) { // 最初のパケットの検証
-        if (!(p_out_header->control_byte & LORABBIT_TP_FLAG_IS_ACK) &&
-             p_out_header->packet_index == 0) {
-            is_valid = true;
-        }
-    } else { // 後続パケットの検証
-        if (!(p_out_header->control_byte & LORABBIT_TP_FLAG_IS_ACK) &&
-            (p_out_header->transaction_id == transaction_id_to_match) &&
-            (p_out_header->packet_index == expected_index)) {
-            is_valid = true;
-        }
-    }
+// 1フレームのエアタイム (マイクロ秒) を返すヘルパー関数（内部利用）
+static inline uint32_t lora_frame_airtime_us(LoraAirDateRate_t air_data_rate, uint8_t frame_size) {
+    return LoRabbit_GetTimeOnAirUsec(air_data_rate, LORABBIT_TP_FRAME_ADDRESS_SIZE + frame_size);
+}
 
-    return is_valid ? LORABBIT_OK : LORABBIT_ERROR_RETRY;
+// 転送1回分のエアタイム (データパケットとACKの合計、マイクロ秒) を見積もるヘルパー関数（内部利用）
+// ack_interval 個のパケットごとに1回ACKが返るものとする (0ならACKなし)。
+// データパケットは、通信相手との間で観測した損失率から見込んだ再送の分も含める
+static double lora_estimate_transfer_airtime_us(LoraAirDateRate_t air_data_rate,
+                                                const LoRabbit_PeerLink_t *p_link,
+                                                uint32_t size,
+                                                uint8_t fragment_length,
+                                                uint8_t header_size,
+                                                uint8_t ack_header_size,
+                                                uint32_t ack_interval)
+{
+    uint32_t packet_count = (size + fragment_length - 1) / fragment_length;
+    uint8_t last_length = (uint8_t)(size - (packet_count - 1) * fragment_length);
+    uint8_t frame_size = header_size + fragment_length;
+    uint8_t last_frame_size = header_size + last_length;
+
+    // 1パケットが届くまでの平均送信回数は 1 / 届く確率
+    double airtime =
+        (double)(packet_count - 1) * lora_frame_airtime_us(air_data_rate, frame_size) /
+            lora_link_frame_delivery_rate(p_link, LORABBIT_TP_FRAME_ADDRESS_SIZE + frame_size) +
+        (double)lora_frame_airtime_us(air_data_rate, last_frame_size) /
+            lora_link_frame_delivery_rate(p_link, LORABBIT_TP_FRAME_ADDRESS_SIZE + last_frame_size);
+    if (ack_interval > 0) {
+        airtime += (double)((packet_count + ack_interval - 1) / ack_interval) *
+                   lora_frame_airtime_us(air_data_rate, ack_header_size);
+    }
+    return airtime;
 }
 
 /**
- * @brief ハンドル内のリングバッファに新しい通信ログを追加する
+ * @brief 転送全体のエアタイムが最小になるパケットの間隔 (1パケットのペイロード長) を選ぶ
+ * @details LoRa のエアタイムはシンボル単位でしか変わらないため、最後のシンボルを埋め切る長さの
+ * パケットが有利になる。LoRabbit_GetTimeOnAirUsec() の計算式で全ての長さを試し、データパケットと
+ * ACKのエアタイムの合計が最小になるもの (同じなら長いもの) を選ぶ。
+ * 通信相手との間でデータパケットの欠損を観測していれば、長いフレームほど欠損しやすいことを
+ * 見込んで再送の分も含めて比べるので、損失の多いリンクでは短いパケットが選ばれる。
+ * フレーム長は、通常のヘッダでもモジュールの設定 (payload_size) に収まる長さに制限する。
+ * @param[in] p_link 通信相手のリンク状態
+ * @param[in] size 送信するデータのサイズ (1以上)
+ * @param[in] ack_interval 何パケットごとにACKが返るか (0ならACKなし)
+ * @param[in] is_data_compact データパケットの大半をコンパクトヘッダで送るか
+ * @param[in] is_ack_compact ACKをコンパクトヘッダで返すか
+ * @return パケットの間隔。LORABBIT_TP_MAX_PACKETS に収まらなければ0
  */
-static void lora_add_log_to_history(LoraHandle_t *p_handle, const LoraCommLog_t *p_log) {
-    memcpy(&p_handle->history[p_handle->history_index], p_log, sizeof(LoraCommLog_t));
-    p_handle->history_index++;
-    if (p_handle->history_index >= LORABBIT_HISTORY_SIZE) {
-        p_handle->history_index = 0;
-        p_handle->history_wrapped = true;
+static uint8_t lora_select_fragment_length(LoraHandle_t *p_handle,
+                                           const LoRabbit_PeerLink_t *p_link,
+                                           uint32_t size,
+                                           uint32_t ack_interval,
+                                           bool is_data_compact,
+                                           bool is_ack_compact)
+{
+    const LoraAirDateRate_t air_data_rate = p_handle->current_config.air_data_rate;
+    const uint8_t frame_limit = lora_frame_size_limit(p_handle);
+    uint8_t best_length = 0;
+    double best_airtime = 0.0;
+
+    for (uint8_t length = frame_limit - LORABBIT_TP_HEADER_SIZE; length > 0; length--) {
+        uint32_t packet_count = (size + length - 1) / length;
+        if (packet_count > LORABBIT_TP_MAX_PACKETS) {
+            break; // これより短いとパケット数の上限を超える
+        }
+        const bool is_ext = (packet_count > LORABBIT_TP_STD_MAX_PACKETS);
+        const uint8_t full_header_size = is_ext ? LORABBIT_TP_EXT_HEADER_SIZE : LORABBIT_TP_HEADER_SIZE;
+        if (full_header_size + length > frame_limit) {
+            continue;
+        }
+        const uint8_t ext_flag = is_ext ? LORABBIT_TP_FLAG_EXT_HEADER : 0;
+        const uint8_t header_size = lora_data_header_size(ext_flag | (is_data_compact ? LORABBIT_TP_FLAG_COMPACT : 0));
+        const uint8_t ack_header_size = lora_data_header_size(ext_flag | (is_ack_compact ? LORABBIT_TP_FLAG_COMPACT : 0));
+
+        double airtime = lora_estimate_transfer_airtime_us(air_data_rate, p_link, size, length,
+                                                           header_size, ack_header_size, ack_interval);
+        if (best_length == 0 || airtime < best_airtime) {
+            best_airtime = airtime;
+            best_length = length;
+        }
     }
-}
 
-static const char* lora_tx_power_to_string(LoraTransmittingPower_t power) {
-    switch (power) {
-        case LORA_TRANSMITTING_POWER_13_DBM: return "13dBm";
-        case LORA_TRANSMITTING_POWER_7_DBM:  return "7dBm";
-        case LORA_TRANSMITTING_POWER_0_DBM:  return "0dBm";
-        default: return "Unknown";
+    // 1パケットに収まる場合は、その長さを間隔とする (冗長断片の長さも同じになる)
+    if (best_length > 0 && size <= best_length) {
+        best_length = (uint8_t)size;
     }
+    return best_length;
 }
 
 // =====================================
@@ -193,6 +2425,25 @@ int LoRabbit_SendData(LoraHandle_t *p_handle,
                            uint32_t size,
                            bool request_ack)
 {
+    LoRabbit_SendOptions_t options = {
+        .mode        = request_ack ? LORABBIT_TP_MODE_STOP_AND_WAIT : LORABBIT_TP_MODE_NO_ACK,
+        .window_size = 0,
+    };
+
+    return LoRabbit_SendDataWithOptions(p_handle, target_address, target_channel, p_data, size, &options);
+}
+
+int LoRabbit_SendDataWithOptions(LoraHandle_t *p_handle,
+                                 uint16_t target_address,
+                                 uint8_t target_channel,
+                                 uint8_t *p_data,
+                                 uint32_t size,
+                                 const LoRabbit_SendOptions_t *p_options)
+{
+    if (NULL == p_options) {
+        return LORABBIT_ERROR_INVALID_ARGUMENT;
+    }
+
     // ログ構造体を準備し、送信前パラメータを記録
     LoraCommLog_t new_log;
     memset(&new_log, 0, sizeof(new_log));
@@ -200,98 +2451,169 @@ int LoRabbit_SendData(LoraHandle_t *p_handle,
     new_log.data_size = size;
     new_log.air_data_rate = p_handle->current_config.air_data_rate;
     new_log.transmitting_power = p_handle->current_config.transmitting_power;
-    new_log.ack_requested = request_ack;
+    new_log.ack_requested = (p_options->mode != LORABBIT_TP_MODE_NO_ACK);
 
-    if (size > LORABBIT_TP_MAX_TOTAL_SIZE) {
-        return LORABBIT_ERROR_INVALID_ARGUMENT; // サイズ超過
+    // 同報送信では受信側ごとに転送を認識した時点が異なるため、ヘッダを省略できない
+    if (p_options->mode == LORABBIT_TP_MODE_MULTICAST && p_options->use_compact_header) {
+        return LORABBIT_ERROR_INVALID_ARGUMENT;
     }
 
-    static uint8_t transaction_id_counter = 0;
-    const uint8_t transaction_id = transaction_id_counter++;
-    const uint8_t total_packets = (size + LORABBIT_TP_MAX_PAYLOAD - 1) / LORABBIT_TP_MAX_PAYLOAD;
-
-    uint8_t packet_buffer[197];
-    uint32_t sent_size = 0;
-
-    // 転送開始を記録
-    lora_status_set_active(p_handle, total_packets, 0);
-
-    for (uint8_t i = 0; i < total_packets; i++) {
-        // 現在のパケット番号を更新 (iが0の時も呼ばれるが、動作に支障はない)
-        lora_status_set_progress(p_handle, i);
-
-        bool ack_received = false;
-        for (uint8_t retry = 0; retry < LORABBIT_TP_RETRY_COUNT; retry++) {
-            if (retry > 0) {
-                new_log.total_retries++; // リトライ回数をカウント
-            }
-
-            // ヘッダを組み立てる
-            packet_buffer[0] = p_handle->current_config.own_address >> 8;
-            packet_buffer[1] = p_handle->current_config.own_address & 0xFF;
-            packet_buffer[2] = p_handle->current_config.own_channel;
-
-            uint8_t control_byte = 0;
-            if (request_ack) control_byte |= LORABBIT_TP_FLAG_ACK_REQUEST;
-            if (i == total_packets - 1) control_byte |= LORABBIT_TP_FLAG_EOT;
-            packet_buffer[3] = control_byte;
-
-            packet_buffer[4] = transaction_id;
-            packet_buffer[5] = total_packets;
-            packet_buffer[6] = i;
+    uint8_t window_size = p_options->window_size;
+    if (p_options->mode == LORABBIT_TP_MODE_WINDOW) {
+        if (window_size == 0) {
+            window_size = LORABBIT_TP_WINDOW_SIZE_DEFAULT;
+        }
+        if (window_size > LORABBIT_TP_WINDOW_SIZE_MAX) {
+            return LORABBIT_ERROR_INVALID_ARGUMENT;
+        }
+    }
 
-            uint32_t remaining_size = size - sent_size;
-            uint8_t payload_len = (remaining_size > LORABBIT_TP_MAX_PAYLOAD) ? LORABBIT_TP_MAX_PAYLOAD : remaining_size;
-            packet_buffer[7] = payload_len;
+    // パケットの長さを決める。ACKの頻度は再送制御方式で、欠損の見込みは通信相手との損失率で決まる
+    uint32_t ack_interval = 0;
+    switch (p_options->mode) {
+        case LORABBIT_TP_MODE_STOP_AND_WAIT: ack_interval = 1; break;
+        case LORABBIT_TP_MODE_WINDOW:        ack_interval = window_size; break;
+        case LORABBIT_TP_MODE_BURST:         ack_interval = LORABBIT_TP_MAX_PACKETS; break; // 1ラウンドに1回
+        case LORABBIT_TP_MODE_MULTICAST:     ack_interval = LORABBIT_TP_MAX_PACKETS; break;
+        default:                             break;
+    }
+    // コンパクトヘッダで送るのは受信側がACKを返した後の、ACKを要求しないデータパケットだけなので
+    // (lora_use_compact_header())、データパケットの大半がコンパクトヘッダになるのはウィンドウ送信だけ
+    const bool is_data_compact = p_options->use_compact_header && p_options->mode == LORABBIT_TP_MODE_WINDOW;
+    uint8_t fragment_length = lora_frame_size_limit(p_handle) - LORABBIT_TP_HEADER_SIZE;
+    if (size > 0) {
+        fragment_length = lora_select_fragment_length(p_handle, lora_link_get(p_handle, target_address),
+                                                      size, ack_interval, is_data_compact,
+                                                      p_options->use_compact_header);
+        if (fragment_length == 0) {
+            return LORABBIT_ERROR_INVALID_ARGUMENT; // サイズ超過
+        }
+    }
+    // 255パケットに収まらなければ、拡張ヘッダ (16ビットのパケット番号) を使う
+    const uint16_t total_packets = (uint16_t)((size + fragment_length - 1) / fragment_length);
+
+    // 冗長パケット数を決める (データパケット数 x 冗長度、切り上げ)
+    uint8_t repair_count = 0;
+    if (p_options->fec_redundancy_percent > 0) {
+        if (p_options->mode != LORABBIT_TP_MODE_BURST && p_options->mode != LORABBIT_TP_MODE_MULTICAST) {
+            return LORABBIT_ERROR_INVALID_ARGUMENT;
+        }
+#ifdef LORABBIT_USE_FEC
+        // 冗長パケットの番号も8ビットに収める必要があるため、冗長パケットを1つも置けない転送
+        // (拡張ヘッダの転送を含む) では使えない
+        if (total_packets >= LORABBIT_TP_STD_MAX_PACKETS) {
+            return LORABBIT_ERROR_INVALID_ARGUMENT;
+        }
+        uint32_t count = ((uint32_t)total_packets * p_options->fec_redundancy_percent + 99) / 100;
+        if (count > LORABBIT_FEC_MAX_REPAIR_PACKETS) {
+            count = LORABBIT_FEC_MAX_REPAIR_PACKETS;
+        }
+        if (count > (uint32_t)(LORABBIT_TP_STD_MAX_PACKETS - total_packets)) {
+            count = (uint32_t)(LORABBIT_TP_STD_MAX_PACKETS - total_packets);
+        }
+        repair_count = (uint8_t)count;
+#else
+        return LORABBIT_ERROR_UNSUPPORTED;
+#endif
+    }
 
-            // ペイロードをコピー
-            memcpy(&packet_buffer[LORABBIT_TP_HEADER_SIZE], &p_data[sent_size], payload_len);
+    if ((unsigned)p_options->traffic_class >= LORABBIT_TRAFFIC_CLASS_COUNT) {
+        return LORABBIT_ERROR_INVALID_ARGUMENT;
+    }
 
-            // 送信
-            LoRabbit_SendFrame(p_handle, target_address, target_channel, packet_buffer, LORABBIT_TP_HEADER_SIZE + payload_len);
+#ifdef LORABBIT_USE_AIRTIME_BUDGET
+    // 転送の途中で予算が尽きないよう、データパケット (見込んだ再送と冗長パケットを含む) が
+    // 予算に収まるまで待ってから始める。ACKの分は受信側の予算から送られる
+    if (size > 0) {
+        const LoraAirDateRate_t rate = p_handle->current_config.air_data_rate;
+        const uint8_t header_size = (total_packets > LORABBIT_TP_STD_MAX_PACKETS) ? LORABBIT_TP_EXT_HEADER_SIZE
+                                                                                  : LORABBIT_TP_HEADER_SIZE;
+        double airtime_us = lora_estimate_transfer_airtime_us(rate, lora_link_get(p_handle, target_address),
+                                                              size, fragment_length, header_size, 0, 0);
+        airtime_us += (double)repair_count * lora_frame_airtime_us(rate, header_size + fragment_length);
+#ifdef LORABBIT_USE_TRAFFIC_CLASS
+        const bool may_use_reserve = (p_options->traffic_class == LORABBIT_TRAFFIC_CLASS_CONTROL);
+#else
+        const bool may_use_reserve = false;
+#endif
+        int err = lora_airtime_wait_for(p_handle, (uint64_t)airtime_us, may_use_reserve);
+        if (err < 0) {
+            return err;
+        }
+    }
+#endif
 
-            if (!request_ack) {
-                ack_received = true;
-                break; // ACK不要ならリトライしない
-            }
+    // 複数のタスクから呼ばれても、モジュールへの送信とACK待ちが混ざらないよう1転送ずつ行う
+#ifdef LORABBIT_USE_TRAFFIC_CLASS
+    // (上位のクラスの転送は、送信中の転送がパケットの合間で譲る)
+    uint32_t queue_delay_ms = lora_tx_acquire(p_handle, p_options->traffic_class);
+    LoRabbit_TrafficClassStats_t *p_stats = &p_handle->tx_class_stats[p_options->traffic_class];
+    tk_wai_sem(p_handle->status_mutex_id, 1, TMO_FEVR);
+    p_stats->transfer_count++;
+    p_stats->last_queue_delay_ms = queue_delay_ms;
+    p_stats->total_queue_delay_ms += queue_delay_ms;
+    if (queue_delay_ms > p_stats->max_queue_delay_ms) {
+        p_stats->max_queue_delay_ms = queue_delay_ms;
+    }
+    tk_sig_sem(p_handle->status_mutex_id, 1);
+#else
+    lora_tx_acquire(p_handle, p_options->traffic_class);
+#endif
 
-            // ACK待機
-            RecvFrameE220900T22SJP_t ack_frame;
-            int recv_len = LoRabbit_ReceiveFrame(p_handle, &ack_frame, LORABBIT_TP_ACK_TIMEOUT_MS);
-            if (recv_len > 0) {
-                LoRabbitTP_Header_t ack_header;
-                lora_parse_header(ack_frame.recv_data, &ack_header);
-                if ((ack_header.control_byte & LORABBIT_TP_FLAG_IS_ACK) &&
-                    (ack_header.transaction_id == transaction_id) &&
-                    (ack_header.packet_index == i))
-                {
-                    new_log.last_ack_rssi = ack_frame.rssi; // ACKのRSSIを記録
-                    ack_received = true;
-                    break; // 正しいACKを受信
-                }
-            }
-        } // retry loop
+    const uint8_t transaction_id = lora_next_transaction_id(p_handle);
+    const uint8_t session_flags = p_options->use_compact_header ? LORABBIT_TP_FLAG_COMPACT : 0;
 
-        if (!ack_received) {
-            // 最終結果を記録
-            new_log.ack_success = false;
-            lora_add_log_to_history(p_handle, &new_log);
+    // 転送開始を記録
+    lora_status_set_active(p_handle, total_packets, 0);
+#ifdef LORABBIT_USE_RX_DISPATCHER
+    // 受信ディスパッチャがこの転送へのACKを見分けられるよう、転送の情報を登録する
+    p_handle->tp_tx.target_address = target_address;
+    p_handle->tp_tx.transaction_id = transaction_id;
+    p_handle->tp_tx.total_packets  = total_packets;
+    p_handle->tp_tx.session_flags  = session_flags;
+    p_handle->tp_tx.is_active      = true;
+#endif
 
-            // 転送終了（失敗）を記録
-            lora_status_set_idle(p_handle);
-            return LORABBIT_ERROR_ACK_FAILED; // ACKタイムアウト
-        }
-        sent_size += packet_buffer[7]; // payload_len
-    } // main loop
+    int ret;
+    switch (p_options->mode) {
+        case LORABBIT_TP_MODE_NO_ACK:
+        case LORABBIT_TP_MODE_STOP_AND_WAIT:
+            ret = lora_send_data_stop_and_wait(p_handle, target_address, target_channel, p_data, size,
+                                               transaction_id, total_packets, fragment_length, session_flags,
+                                               p_options->mode == LORABBIT_TP_MODE_STOP_AND_WAIT, &new_log);
+            break;
+        case LORABBIT_TP_MODE_WINDOW:
+            ret = lora_send_data_window(p_handle, target_address, target_channel, p_data, size,
+                                        transaction_id, total_packets, fragment_length, session_flags,
+                                        window_size, &new_log);
+            break;
+        case LORABBIT_TP_MODE_BURST:
+            ret = lora_send_data_burst(p_handle, target_address, target_channel, p_data, size,
+                                       transaction_id, total_packets, fragment_length, session_flags,
+                                       repair_count, &new_log);
+            break;
+        case LORABBIT_TP_MODE_MULTICAST:
+            ret = lora_send_data_multicast(p_handle, target_address, target_channel, p_data, size,
+                                           transaction_id, total_packets, fragment_length,
+                                           repair_count, &new_log);
+            break;
+        default:
+            ret = LORABBIT_ERROR_INVALID_ARGUMENT;
+            break;
+    }
 
     // 最終結果を記録
-    new_log.ack_success = true;
+    new_log.ack_success = (ret == LORABBIT_OK);
     lora_add_log_to_history(p_handle, &new_log);
 
-    // 転送終了（成功）を記録
+    // 転送終了を記録
+#ifdef LORABBIT_USE_RX_DISPATCHER
+    p_handle->tp_tx.is_active = false;
+#endif
     lora_status_set_idle(p_handle);
+    lora_tx_release(p_handle);
 
-    return LORABBIT_OK; // 成功
+    return ret;
 }
 
 int LoRabbit_ReceiveData(LoraHandle_t *p_handle,
@@ -315,7 +2637,7 @@ int LoRabbit_ReceiveData(LoraHandle_t *p_handle,
     // 最初のパケットを受信するループ
     TMO remaining_timeout = timeout;
     while (remaining_timeout > 0 || timeout == TMO_FEVR) {
-        ret = lora_receive_and_validate_packet(p_handle, &remaining_timeout, 0, 0, &frame, &header);
+        ret = lora_receive_and_validate_packet(p_handle, &remaining_timeout, NULL, &frame, &header);
         if (ret == LORABBIT_OK) {
             break; // 成功！
         }
@@ -329,7 +2651,7 @@ int LoRabbit_ReceiveData(LoraHandle_t *p_handle,
     }
 
     // バッファサイズをチェック
-    if ((uint32_t)header.total_packets * LORABBIT_TP_MAX_PAYLOAD > buffer_size) {
+    if ((uint32_t)header.total_packets * header.fragment_length > buffer_size) {
         ret = LORABBIT_ERROR_BUFFER_OVERFLOW; // バッファサイズ不足
         goto cleanup_and_exit;
     }
@@ -337,93 +2659,174 @@ int LoRabbit_ReceiveData(LoraHandle_t *p_handle,
     // 状態を更新（総パケット数）
     lora_status_set_active(p_handle, header.total_packets, 0);
 
-    // 最初のパケットを処理
-    // データをバッファにコピー
-    memcpy(p_buffer, &frame.recv_data[LORABBIT_TP_HEADER_SIZE], header.payload_length);
+    // 後続のパケットを任意の順序で受信し、ビットマップが埋まるまで復元する
+    ret = lora_receive_data_reassemble(p_handle, p_buffer, &frame, &header, &written_size);
+    if (ret == LORABBIT_OK && p_received_size) {
+        *p_received_size = written_size;
+    }
 
-    // 合計サイズを更新
-    written_size += header.payload_length;
+cleanup_and_exit:
+    lora_status_set_idle(p_handle);
+    return ret;
+}
 
-    // ACK要求があれば返信する
-    if (header.control_byte & LORABBIT_TP_FLAG_ACK_REQUEST) {
-        lora_send_ack(p_handle, &header);
-    }
+#ifdef LORABBIT_USE_MULTI_SESSION
+// 完了した転送の情報を返すヘルパー関数（内部利用）
+static void lora_rx_session_result(const LoRabbitTP_RxSession_t *p_rx,
+                                   uint8_t buffer_index,
+                                   LoRabbit_ReceiveResult_t *p_result)
+{
+    p_result->buffer_index   = buffer_index;
+    p_result->source_address = p_rx->ack.address;
+    p_result->source_channel = p_rx->ack.channel;
+    p_result->received_size  = p_rx->written_size;
+}
 
-    // 伝送完了チェック
-    if (header.control_byte & LORABBIT_TP_FLAG_EOT) {
-        if(p_received_size) {
-            *p_received_size = written_size;
+// 新しい転送に割り当てる受信状態を探すヘルパー関数（内部利用）
+// 受信中でないものから、再送に返すACKを持たないもの、最も古く完了したものの順に選ぶ
+// 戻り値: 受信状態の番号。全て受信中なら session_count
+static uint8_t lora_rx_session_find_free(const LoraHandle_t *p_handle, uint8_t session_count) {
+    uint8_t found = session_count;
+    for (uint8_t i = 0; i < session_count; i++) {
+        const LoRabbitTP_RxSession_t *p_rx = &p_handle->tp_rx_sessions[i];
+        if (p_rx->is_active) {
+            continue;
+        }
+        if (!p_rx->ack.is_valid) {
+            return i;
+        }
+        if (found == session_count || p_rx->last_event_ms < p_handle->tp_rx_sessions[found].last_event_ms) {
+            found = i;
         }
-        ret = LORABBIT_OK; // 1パケットで完了
-        goto cleanup_and_exit;
     }
+    return found;
+}
 
-    // 後続パケットを受信するループ
-    for (uint8_t expected_index = 1; expected_index < header.total_packets; expected_index++) {
-        lora_status_set_progress(p_handle, expected_index);
-        remaining_timeout = LORABBIT_TP_ACK_TIMEOUT_MS;
+int LoRabbit_ReceiveDataMulti(LoraHandle_t *p_handle,
+                              uint8_t *const p_buffers[],
+                              uint8_t buffer_count,
+                              uint32_t buffer_size,
+                              LoRabbit_ReceiveResult_t *p_result,
+                              TMO timeout)
+{
+    RecvFrameE220900T22SJP_t frame;
+    LoRabbitTP_Header_t header;
 
-        while (remaining_timeout > 0) {
-            ret = lora_receive_and_validate_packet(p_handle,
-                                                   &remaining_timeout,
-                                                   expected_index,
-                                                   header.transaction_id,
-                                                   &frame,
-                                                   &header);
-            if (ret == LORABBIT_OK) {
-                break; // 成功！
-            }
-            if (ret != LORABBIT_ERROR_RETRY) {
-                goto cleanup_and_exit; // タイムアウトか致命的エラー
+    if (NULL == p_handle || NULL == p_buffers || NULL == p_result || buffer_count == 0) {
+        return LORABBIT_ERROR_INVALID_ARGUMENT;
+    }
+    const uint8_t session_count = (buffer_count < LORABBIT_TP_RX_SESSION_COUNT) ? buffer_count
+                                                                                : LORABBIT_TP_RX_SESSION_COUNT;
+    const uint64_t start_ms = lora_get_time_ms();
+
+    while (1) {
+        // パケットが途絶えた転送を破棄し、次に途絶える転送までの時間だけ受信を待つ
+        uint64_t now_ms = lora_get_time_ms();
+        TMO wait_ms = TMO_FEVR;
+        if (timeout != TMO_FEVR) {
+            if (now_ms - start_ms >= (uint64_t)timeout) {
+                return LORABBIT_ERROR_TIMEOUT;
             }
-            // LORABBIT_ERROR_RETRY の場合はループを継続
+            wait_ms = (TMO)(timeout - (now_ms - start_ms));
         }
-        if (ret != LORABBIT_OK) {
-            goto cleanup_and_exit;
+        for (uint8_t i = 0; i < session_count; i++) {
+            LoRabbitTP_RxSession_t *p_rx = &p_handle->tp_rx_sessions[i];
+            if (!p_rx->is_active) {
+                continue;
+            }
+            // 同報送信でNACKを返す予定があれば、返信スロットが来たら返し、来るまでの時間だけ受信を待つ
+            uint64_t nack_due_ms = lora_rx_session_poll_nack(p_handle, p_rx);
+            if (0 != nack_due_ms) {
+                if (wait_ms == TMO_FEVR || nack_due_ms - now_ms < (uint64_t)wait_ms) {
+                    wait_ms = (TMO)(nack_due_ms - now_ms);
+                }
+            }
+            uint64_t deadline_ms = p_rx->last_event_ms + lora_rx_session_timeout(p_handle, p_rx);
+            if (now_ms >= deadline_ms) {
+                const bool is_complete = (p_rx->received_count == p_rx->ack.total_packets);
+                lora_rx_session_end(p_rx, is_complete);
+                if (is_complete) {
+                    // ACK要求は届かなかったが、データは揃っている
+                    lora_rx_session_result(p_rx, i, p_result);
+                    return LORABBIT_OK;
+                }
+                LORA_PRINTF("LoRabbit_ReceiveDataMulti: transfer from 0x%04X timed out (%u/%u)\n",
+                            p_rx->ack.address, p_rx->received_count, p_rx->ack.total_packets);
+                continue;
+            }
+            if (wait_ms == TMO_FEVR || deadline_ms - now_ms < (uint64_t)wait_ms) {
+                wait_ms = (TMO)(deadline_ms - now_ms);
+            }
         }
 
-        // データをバッファにコピー
-        memcpy(&p_buffer[written_size],
-               &frame.recv_data[LORABBIT_TP_HEADER_SIZE],
-               header.payload_length);
-
-        // 合計サイズを更新
-        written_size += header.payload_length;
+        // コンパクトヘッダの転送は受け付けないので、フレームの長さは通常のヘッダの長さフィールドから判定する
+        LoRabbitTP_Header_t standard_session;
+        memset(&standard_session, 0, sizeof(standard_session));
+        int recv_len = lora_receive_tp_frame(p_handle, false, &standard_session, &frame, wait_ms);
+        if (recv_len <= 0) {
+            continue;
+        }
 
-        // ACK要求があれば返信する
-        if (header.control_byte & LORABBIT_TP_FLAG_ACK_REQUEST) {
-            lora_send_ack(p_handle, &header);
+        // 受信中の転送のパケットか
+        uint8_t index = session_count;
+        for (uint8_t i = 0; i < session_count; i++) {
+            if (p_handle->tp_rx_sessions[i].is_active &&
+                lora_rx_session_match(&p_handle->tp_rx_sessions[i], frame.recv_data, recv_len, &header)) {
+                index = i;
+                break;
+            }
         }
 
-        // EOTフラグの検証
-        bool is_last_packet = (expected_index == header.total_packets - 1);
-        bool has_eot_flag = (header.control_byte & LORABBIT_TP_FLAG_EOT);
+        if (index == session_count) {
+            // 受信完了した転送の再送であれば、最後のACKを返し直す
+            bool is_duplicate = false;
+            for (uint8_t i = 0; i < session_count && !is_duplicate; i++) {
+                is_duplicate = !p_handle->tp_rx_sessions[i].is_active &&
+                               lora_ack_cache_resend(p_handle, &p_handle->tp_rx_sessions[i], frame.recv_data, recv_len);
+            }
+            if (is_duplicate) {
+                continue;
+            }
 
-        if (is_last_packet && !has_eot_flag) {
-            // 最後のパケットのはずなのにEOTフラグがない -> プロトコルエラー
-            ret = LORABBIT_ERROR_INVALID_PACKET;
-            goto cleanup_and_exit;
+            // 新しい転送の最初のパケットであれば、空いているバッファに割り当てる
+            if (lora_validate_packet(frame.recv_data, recv_len, NULL, &header) != LORABBIT_OK) {
+                continue;
+            }
+            if (header.control_byte & LORABBIT_TP_FLAG_COMPACT) {
+                // コンパクトヘッダのフレームは送信元アドレスを持たないので、同じトランザクションIDの
+                // 別の送信元の転送と区別できない。取り違えてデータを壊さないよう、受け付けない。
+                // 送信側はACKを受け取れずに失敗するので、どの送信元かを呼び出し元に知らせる
+                LORA_PRINTF("LoRabbit_ReceiveDataMulti: compact header transfer from 0x%04X is not supported\n",
+                            header.source_address);
+                p_result->buffer_index   = session_count;
+                p_result->source_address = header.source_address;
+                p_result->source_channel = header.source_channel;
+                p_result->received_size  = 0;
+                return LORABBIT_ERROR_UNSUPPORTED;
+            }
+            if ((uint32_t)header.total_packets * header.fragment_length > buffer_size) {
+                LORA_PRINTF("LoRabbit_ReceiveDataMulti: transfer from 0x%04X does not fit in the buffer\n",
+                            header.source_address);
+                continue;
+            }
+            index = lora_rx_session_find_free(p_handle, session_count);
+            if (index == session_count) {
+                continue; // 空きがない (送信側の再送を待つ)
+            }
+            lora_rx_session_begin(&p_handle->tp_rx_sessions[index], p_buffers[index], &header);
         }
 
-        // MEMO: ここのチェックは厳密すぎるかも
-#if 0
-        if (!is_last_packet && has_eot_flag) {
-            // 最後ではないのにEOTフラグがある -> プロトコルエラー
-            ret = LORABBIT_ERROR_INVALID_PACKET;
-            goto cleanup_and_exit;
+        LoRabbitTP_RxSession_t *p_rx = &p_handle->tp_rx_sessions[index];
+        if (lora_rx_session_on_packet(p_handle, p_rx, &frame, &header)) {
+            lora_rx_session_end(p_rx, true);
+            lora_rx_session_result(p_rx, index, p_result);
+            return LORABBIT_OK;
         }
-#endif
-    }
-
-    if (p_received_size) {
-        *p_received_size = written_size;
     }
-
-cleanup_and_exit:
-    lora_status_set_idle(p_handle);
-    return ret;
 }
 
+#endif // LORABBIT_USE_MULTI_SESSION
+
 // TODO: heatshrink のエラーコードチェック
 int LoRabbit_SendCompressedData(LoraHandle_t *p_handle,
                                 uint16_t target_address,
@@ -602,6 +3005,36 @@ int LoRabbit_GetTransferStatus(LoraHandle_t *p_handle, LoRabbit_TransferStatus_t
     return LORABBIT_OK;
 }
 
+#ifdef LORABBIT_USE_TRAFFIC_CLASS
+int LoRabbit_GetTrafficClassStats(LoraHandle_t *p_handle, LoRabbit_TrafficClass_t traffic_class,
+                                  LoRabbit_TrafficClassStats_t *p_stats)
+{
+    if (NULL == p_handle || NULL == p_stats || (unsigned)traffic_class >= LORABBIT_TRAFFIC_CLASS_COUNT) {
+        return LORABBIT_ERROR_INVALID_ARGUMENT;
+    }
+
+    tk_wai_sem(p_handle->status_mutex_id, 1, TMO_FEVR);
+    memcpy(p_stats, &p_handle->tx_class_stats[traffic_class], sizeof(LoRabbit_TrafficClassStats_t));
+    tk_sig_sem(p_handle->status_mutex_id, 1);
+
+    return LORABBIT_OK;
+}
+#endif
+
+int LoRabbit_GetPeerLink(LoraHandle_t *p_handle, uint16_t address, LoRabbit_PeerLink_t *p_link) {
+    if (NULL == p_handle || NULL == p_link) {
+        return LORABBIT_ERROR_INVALID_ARGUMENT;
+    }
+
+    const LoRabbit_PeerLink_t *p_found = lora_link_find(p_handle, address);
+    if (NULL == p_found) {
+        return LORABBIT_ERROR_INVALID_ARGUMENT; // まだ通信していない相手
+    }
+    memcpy(p_link, p_found, sizeof(LoRabbit_PeerLink_t));
+
+    return LORABBIT_OK;
+}
+
 void LoRabbit_DumpHistory(LoraHandle_t *p_handle) {
     if (NULL == p_handle) {
         LORA_PRINTF("p_handle is NULL.\n");
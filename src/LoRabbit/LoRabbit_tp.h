@@ -21,7 +21,7 @@
  * @param[in] target_address 送信先アドレス
  * @param[in] target_channel 送信先チャンネル
  * @param[in] p_data 送信するデータが格納されたバッファ
- * @param[in] size 送信するデータのサイズ (最大 約47KB)
+ * @param[in] size 送信するデータのサイズ (最大 LORABBIT_TP_MAX_PACKETS x 187 バイト。初期値で約47KB。モジュールの payload_size が200バイト未満なら、その分小さくなる)
  * @param[in] request_ack ACKを要求するかどうか (true: 信頼性通信, false: 高速通信)
  * @retval LORABBIT_OK 成功
  * @retval LORABBIT_ERROR_INVALID_ARGUMENT データサイズが大きすぎる
@@ -35,8 +35,68 @@ int LoRabbit_SendData(LoraHandle_t *p_handle,
                            uint32_t size,
                            bool request_ack);
 
+/**
+ * @brief 再送制御方式などを指定して、パケットサイズを超えるようなデータを分割して送信する。処理が完了するまでブロックする。
+ * @details LORABBIT_TP_MODE_WINDOW を指定すると、最大 window_size 個のパケットをACKを待たずに連続送信し、
+ * ウィンドウの最後のパケットでのみACKを要求します。受信側は累積ACKと選択ACK(ビットマップ)を返し、
+ * 送信側は欠損したパケットのみを再送します。
+ * LORABBIT_TP_MODE_BURST を指定すると、全パケットを連続送信して最後のパケットでのみACKを要求し、
+ * 受信側が返す欠損ビットマップ(NACK)に従って欠損分のみを再送します。ビットマップが空になるまで繰り返します。
+ * LORABBIT_USE_FEC 有効時にバースト送信で fec_redundancy_percent を指定すると、最初のラウンドで
+ * データパケットに続けて冗長パケットを送信します。受信側は届いたパケットが全体でデータパケット数に
+ * 達した時点で欠損分を復元するため、冗長パケット数までの欠損は再送なしで回復できます。
+ * 冗長パケット数は LORABBIT_FEC_MAX_REPAIR_PACKETS と、合計255パケットの上限に収まるよう切り詰めます
+ * (データパケットだけで255個に達する転送では LORABBIT_ERROR_INVALID_ARGUMENT を返します)。
+ * LORABBIT_TP_MODE_MULTICAST を指定すると、0xFFFF (ブロードキャスト) など複数の受信側が受け取る
+ * 送信先に全パケットを1回ずつ送信し、最後のパケットでNACKを要求します。欠損のある受信側だけが
+ * LORABBIT_TP_MULTICAST_NACK_SLOTS 個の返信スロットからランダムに選んだタイミングでNACKを返し、
+ * 送信側はその和集合のパケットだけを再送します。全て受信した受信側は返信しないため、
+ * NACKの返らない問い合わせが、観測した損失率から決めた回数 (LORABBIT_TP_MULTICAST_SILENT_POLLS 以上
+ * LORABBIT_TP_RETRY_COUNT_MAX 以下) 続いた時点で成功とします
+ * (受信側が1台も応答しない場合や、NACKがその回数続けて失われた場合も成功になります)。FECは使えますが、コンパクトヘッダは使えません。
+ * 255パケットを超える転送では、パケット番号が16ビットの拡張ヘッダを自動的に使います。
+ * use_compact_header を指定すると、ACKと、受信側が転送を認識した後のACKを要求しないデータパケットのヘッダを
+ * コントロールバイト・トランザクションID・パケット番号だけに省略します (データパケットで5バイト、ACKで5バイト短くなります)。
+ * 1パケットの長さは、モジュールの payload_size に収まる範囲で、空中データレートごとのエアタイムが最小になるように自動で決めます。
+ * 送信先との間でデータパケットの欠損を観測していれば、再送の見込みも含めて決めるため、損失の多いリンクでは短くなります。
+ * いずれのモードでも、受信側は LoRabbit_ReceiveData() をそのまま利用できます
+ * (コンパクトヘッダの転送は LoRabbit_ReceiveDataMulti() では受信できません)。
+ * 別のタスクが送信中の場合は、その転送が終わるまで待ちます。ただし LORABBIT_USE_TRAFFIC_CLASS が有効で、
+ * traffic_class が送信中の転送より上位なら、送信中の転送がパケットの合間で中断し、こちらの転送を先に送信します。
+ * 同じ送信先への転送で割り込む場合、受信側は LoRabbit_ReceiveDataMulti() で受信して下さい。
+ * @param[in,out] p_handle 操作対象のハンドル
+ * @param[in] target_address 送信先アドレス
+ * @param[in] target_channel 送信先チャンネル
+ * @param[in] p_data 送信するデータが格納されたバッファ
+ * @param[in] size 送信するデータのサイズ (最大 LORABBIT_TP_MAX_PACKETS x 187 バイト。初期値で約47KB。モジュールの payload_size が200バイト未満なら、その分小さくなる)
+ * @param[in] p_options 送信オプション
+ * @retval LORABBIT_OK 成功
+ * @retval LORABBIT_ERROR_INVALID_ARGUMENT データサイズが大きすぎる、またはオプションが不正
+ * @retval LORABBIT_ERROR_UNSUPPORTED LORABBIT_USE_FEC が無効なのにFECを指定した
+ * @retval LORABBIT_ERROR_ACK_FAILED ACKが返ってこない
+ * @retval LORABBIT_ERROR_AIRTIME_EXHAUSTED 送信時間の制限 (LORABBIT_USE_AIRTIME_BUDGET) に収まらず、転送を始めなかった、
+ *         または転送の途中でパケットを送信できなかった
+ * @retval LORABBIT_ERROR_CHANNEL_BUSY キャリアセンス (LORABBIT_USE_LBT) でチャンネルが空かず、転送の途中でパケットを送信できなかった
+ * @retval その他 負値のエラーコード
+ */
+int LoRabbit_SendDataWithOptions(LoraHandle_t *p_handle,
+                                 uint16_t target_address,
+                                 uint8_t target_channel,
+                                 uint8_t *p_data,
+                                 uint32_t size,
+                                 const LoRabbit_SendOptions_t *p_options);
+
 /**
  * @brief 分割されたデータを受信し、一つのデータに復元する。処理が完了するまでブロックする。
+ * @details p_buffer には、総パケット数 x 1パケットの長さ (送信側が決める。最大189バイト) 以上のサイズが必要です。
+ * 送信するデータのサイズ + 189 バイトあれば足ります。
+ * 受信済みのパケットをビットマップで管理し、再送制御方式によらず、届いた順序のまま
+ * パケット番号 x 1パケットの長さ の位置に書き込みます。重複して届いたパケットは読み捨て
+ * (ACKを要求されていればACKだけ返し)、全パケットが揃った時点で完了します。
+ * 最後のACKが欠損した場合に備え、完了後もパケット間隔1回分程度だけ再送を待ち、
+ * 完了した転送のパケットが届いたら同じACKを返し直してから戻ります。
+ * 待つ間に受信した再送以外のフレームは、次の受信で返します。
+ * 受信ディスパッチャの起動中は、ディスパッチャが返し直すので待たずに戻ります。
  * @param[in,out] p_handle 操作対象のハンドル
  * @param[out] p_buffer 受信データを書き出すバッファ
  * @param[in] buffer_size p_bufferの最大サイズ
@@ -53,6 +113,44 @@ int LoRabbit_ReceiveData(LoraHandle_t *p_handle,
                               uint32_t *p_received_size,
                               TMO timeout);
 
+#ifdef LORABBIT_USE_MULTI_SESSION
+/**
+ * @brief 複数の送信元からの転送を同時に受信し、いずれか1つの転送が完了するまでブロックする。
+ * @details 転送を (送信元アドレス, トランザクションID) で区別し、最大 LORABBIT_TP_RX_SESSION_COUNT 個の
+ * 転送を並行して受信します。各転送は空いているバッファに1つずつ割り当て、受信した順に
+ * 該当する転送のバッファへ復元します。転送の途中で戻っても、他の転送の受信状態はハンドルに残り、
+ * 次の呼び出しで続きから受信します。そのため、呼び出しごとに同じ p_buffers を渡して下さい。
+ * 完了した転送のバッファは、次の呼び出しで別の転送に割り当てられることがあります。
+ * 次の呼び出しの前にデータを取り出して下さい。
+ * 全てのバッファが使用中の間に届いた新しい転送のパケットは読み捨てます。
+ * 送信側の再送によって、空きができてから受信を始めます。
+ * 一定時間 (送信側の再送を待てるだけの時間) パケットが届かない転送は破棄します。
+ * 完了した転送に再送されてきたパケットには、最後に返したACKを返し直します。
+ * コンパクトヘッダ (use_compact_header) の転送は、送信元を区別できないので受け付けません。
+ * その最初のパケットを受信すると、p_result に送信元を格納して LORABBIT_ERROR_UNSUPPORTED を返します
+ * (受信中の転送はそのまま残ります)。送信側は再送のたびにパケットを送り直すので、同じ送信元で繰り返し返ることがあります。
+ * LoRabbit_ReceiveData() とは受信状態を共有しないので、同じハンドルで同時に使わないで下さい。
+ * LORABBIT_USE_MULTI_SESSION が有効な場合のみ利用できます。
+ * @param[in,out] p_handle 操作対象のハンドル
+ * @param[in] p_buffers 受信データを書き出すバッファの配列
+ * @param[in] buffer_count p_buffers の数 (LORABBIT_TP_RX_SESSION_COUNT を超える分は使いません)
+ * @param[in] buffer_size 各バッファの最大サイズ (必要なサイズは LoRabbit_ReceiveData() と同じ)。
+ * これに収まらない転送は読み捨てます
+ * @param[out] p_result 完了した転送の情報の格納先
+ * @param[in] timeout 転送の完了を待つ最大時間(ms)。TMO_FEVRで無限待ち。
+ * @retval LORABBIT_OK いずれかの転送が完了
+ * @retval LORABBIT_ERROR_INVALID_ARGUMENT 引数が不正
+ * @retval LORABBIT_ERROR_UNSUPPORTED コンパクトヘッダの転送を受信した (p_result の送信元のみ有効)
+ * @retval LORABBIT_ERROR_TIMEOUT タイムアウト (受信中の転送はそのまま残ります)
+ */
+int LoRabbit_ReceiveDataMulti(LoraHandle_t *p_handle,
+                              uint8_t *const p_buffers[],
+                              uint8_t buffer_count,
+                              uint32_t buffer_size,
+                              LoRabbit_ReceiveResult_t *p_result,
+                              TMO timeout);
+#endif // LORABBIT_USE_MULTI_SESSION
+
 /**
  * @brief データを圧縮し、分割して送信する。処理が完了するまでブロックする。
  * @param[in,out] p_handle 操作対象のハンドル
@@ -107,6 +205,33 @@ int LoRabbit_ReceiveCompressedData(LoraHandle_t *p_handle,
  */
 int LoRabbit_GetTransferStatus(LoraHandle_t *p_handle, LoRabbit_TransferStatus_t *p_status);
 
+/**
+ * @brief 通信相手ごとに推定している、往復時間と損失率を取得する
+ * @details トランスポート層はこの推定値から、ACKや次のパケットを待つ時間と、各パケットの再送回数、
+ * 大容量データ転送の1パケットの長さを決めます。
+ * 推定値は LORABBIT_TP_PEER_TABLE_SIZE 件まで保持され、一度も通信していない相手の推定値はありません。
+ * @param[in] p_handle 操作対象のハンドル
+ * @param[in] address 通信相手のアドレス
+ * @param[out] p_link 取得した推定値を格納する構造体へのポインタ
+ * @retval LORABBIT_OK 成功
+ * @retval LORABBIT_ERROR_INVALID_ARGUMENT 引数がNULL、または推定値がない
+ */
+int LoRabbit_GetPeerLink(LoraHandle_t *p_handle, uint16_t address, LoRabbit_PeerLink_t *p_link);
+
+#ifdef LORABBIT_USE_TRAFFIC_CLASS
+/**
+ * @brief トラフィッククラスごとの送信待ち時間の統計を取得する
+ * @details LORABBIT_USE_TRAFFIC_CLASS が有効な場合のみ利用できます。
+ * @param[in] p_handle 操作対象のハンドル
+ * @param[in] traffic_class トラフィッククラス
+ * @param[out] p_stats 取得した統計を格納する構造体へのポインタ
+ * @retval LORABBIT_OK 成功
+ * @retval LORABBIT_ERROR_INVALID_ARGUMENT 引数がNULL、またはクラスが範囲外
+ */
+int LoRabbit_GetTrafficClassStats(LoraHandle_t *p_handle, LoRabbit_TrafficClass_t traffic_class,
+                                  LoRabbit_TrafficClassStats_t *p_stats);
+#endif
+
 /**
  * @name Communication History Management
  * @brief 通信履歴の管理・操作を行う関数群
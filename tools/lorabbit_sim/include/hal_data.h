@@ -0,0 +1,111 @@
+/**
+ * @file hal_data.h
+ * @brief シミュレータ用の FSP API (LoRabbit が使う範囲のみ)
+ * @details 型と定数は Renesas FSP に合わせています。UARTとピンの実装は sim_e220.c です。
+ * UARTの read() は、受信のDTC転送を指定した端末 (sim_node_use_uart_dtc()) でのみ使えます。
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define __DMB() __sync_synchronize()
+
+typedef enum e_fsp_err {
+    FSP_SUCCESS    = 0,
+    FSP_ERR_ASSERTION = 1,
+    FSP_ERR_IN_USE = 8,
+} fsp_err_t;
+
+/** @brief ピン番号 (上位8ビットがポート、下位8ビットがピン)。シミュレータは端末ごとに別のポートを割り当てる */
+typedef enum e_bsp_io_port_pin {
+    BSP_IO_PORT_FF_PIN_FF = 0xFFFF,
+} bsp_io_port_pin_t;
+
+typedef enum e_bsp_io_level {
+    BSP_IO_LEVEL_LOW = 0,
+    BSP_IO_LEVEL_HIGH,
+} bsp_io_level_t;
+
+typedef enum e_bsp_delay_units {
+    BSP_DELAY_UNITS_SECONDS      = 1000000,
+    BSP_DELAY_UNITS_MILLISECONDS = 1000,
+    BSP_DELAY_UNITS_MICROSECONDS = 1,
+} bsp_delay_units_t;
+
+typedef struct st_ioport_instance_ctrl {
+    uint32_t open;
+} ioport_instance_ctrl_t;
+
+extern ioport_instance_ctrl_t g_ioport_ctrl;
+
+void R_BSP_SoftwareDelay(uint32_t delay, bsp_delay_units_t units);
+fsp_err_t R_IOPORT_PinWrite(ioport_instance_ctrl_t *p_ctrl, bsp_io_port_pin_t pin, bsp_io_level_t level);
+fsp_err_t R_IOPORT_PinRead(ioport_instance_ctrl_t *p_ctrl, bsp_io_port_pin_t pin, bsp_io_level_t *p_pin_value);
+
+#define FSP_CRITICAL_SECTION_DEFINE uint32_t old_mask_level = 0U
+#define FSP_CRITICAL_SECTION_ENTER  (void)old_mask_level
+#define FSP_CRITICAL_SECTION_EXIT   (void)old_mask_level
+
+typedef enum e_uart_event {
+    UART_EVENT_RX_COMPLETE   = (1UL << 0),
+    UART_EVENT_TX_COMPLETE   = (1UL << 1),
+    UART_EVENT_RX_CHAR       = (1UL << 2),
+    UART_EVENT_ERR_PARITY    = (1UL << 3),
+    UART_EVENT_ERR_FRAMING   = (1UL << 4),
+    UART_EVENT_ERR_OVERFLOW  = (1UL << 5),
+    UART_EVENT_BREAK_DETECT  = (1UL << 6),
+    UART_EVENT_TX_DATA_EMPTY = (1UL << 7),
+} uart_event_t;
+
+typedef struct st_uart_callback_arg {
+    uint32_t     channel;
+    uart_event_t event;
+    uint32_t     data;
+    void const  *p_context;
+} uart_callback_args_t;
+
+typedef struct st_transfer_properties {
+    uint32_t block_count_remaining;
+    uint32_t transfer_length_remaining;
+    uint32_t block_count_max;
+    uint32_t transfer_length_max;
+} transfer_properties_t;
+
+typedef void transfer_ctrl_t;
+
+typedef struct st_transfer_api {
+    fsp_err_t (*infoGet)(transfer_ctrl_t * const p_ctrl, transfer_properties_t * const p_properties);
+} transfer_api_t;
+
+typedef struct st_transfer_instance {
+    transfer_ctrl_t      *p_ctrl;
+    void const           *p_cfg;
+    transfer_api_t const *p_api;
+} transfer_instance_t;
+
+typedef struct st_uart_cfg {
+    uint8_t                    channel;
+    transfer_instance_t const *p_transfer_tx;
+    transfer_instance_t const *p_transfer_rx;
+} uart_cfg_t;
+
+typedef void uart_ctrl_t;
+
+typedef struct st_uart_api {
+    fsp_err_t (*write)(uart_ctrl_t * const p_ctrl, uint8_t const * const p_src, uint32_t const bytes);
+    fsp_err_t (*read)(uart_ctrl_t * const p_ctrl, uint8_t * const p_dest, uint32_t const bytes);
+    fsp_err_t (*readStop)(uart_ctrl_t * const p_ctrl, uint32_t * remaining_bytes);
+} uart_api_t;
+
+typedef struct st_uart_instance {
+    uart_ctrl_t      *p_ctrl;
+    uart_cfg_t const *p_cfg;
+    uart_api_t const *p_api;
+} uart_instance_t;
+
+typedef struct st_external_irq_callback_args {
+    void const *p_context;
+    uint32_t    channel;
+} external_irq_callback_args_t;
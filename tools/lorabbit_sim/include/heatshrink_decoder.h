@@ -0,0 +1,40 @@
+/**
+ * @file heatshrink_decoder.h
+ * @brief シミュレータ用の heatshrink デコーダ API
+ * @details 列挙値と関数は本物の heatshrink に合わせています。実装 (sim_heatshrink.c) は圧縮せずに
+ * 入力をそのまま出力するため、圧縮APIの呼び出しの流れだけを確かめられます。
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    uint8_t  buffer[256];
+    uint16_t count;
+    uint8_t  is_finishing;
+} heatshrink_decoder;
+
+typedef enum {
+    HSDR_SINK_OK,
+    HSDR_SINK_FULL,
+    HSDR_SINK_ERROR_NULL = -1,
+} HSD_sink_res;
+
+typedef enum {
+    HSDR_POLL_EMPTY,
+    HSDR_POLL_MORE,
+    HSDR_POLL_ERROR_NULL = -1,
+    HSDR_POLL_ERROR_UNKNOWN = -2,
+} HSD_poll_res;
+
+typedef enum {
+    HSDR_FINISH_DONE,
+    HSDR_FINISH_MORE,
+    HSDR_FINISH_ERROR_NULL = -1,
+} HSD_finish_res;
+
+void heatshrink_decoder_reset(heatshrink_decoder *hsd);
+HSD_sink_res heatshrink_decoder_sink(heatshrink_decoder *hsd, uint8_t *in_buf, size_t size, size_t *input_size);
+HSD_poll_res heatshrink_decoder_poll(heatshrink_decoder *hsd, uint8_t *out_buf, size_t out_buf_size, size_t *output_size);
+HSD_finish_res heatshrink_decoder_finish(heatshrink_decoder *hsd);
@@ -0,0 +1,40 @@
+/**
+ * @file heatshrink_encoder.h
+ * @brief シミュレータ用の heatshrink エンコーダ API
+ * @details 列挙値と関数は本物の heatshrink に合わせています。実装 (sim_heatshrink.c) は圧縮せずに
+ * 入力をそのまま出力するため、圧縮APIの呼び出しの流れだけを確かめられます。
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    uint8_t  buffer[256];
+    uint16_t count;
+    uint8_t  is_finishing;
+} heatshrink_encoder;
+
+typedef enum {
+    HSER_SINK_OK,
+    HSER_SINK_ERROR_NULL = -1,
+    HSER_SINK_ERROR_MISUSE = -2,
+} HSE_sink_res;
+
+typedef enum {
+    HSER_POLL_EMPTY,
+    HSER_POLL_MORE,
+    HSER_POLL_ERROR_NULL = -1,
+    HSER_POLL_ERROR_MISUSE = -2,
+} HSE_poll_res;
+
+typedef enum {
+    HSER_FINISH_DONE,
+    HSER_FINISH_MORE,
+    HSER_FINISH_ERROR_NULL = -1,
+} HSE_finish_res;
+
+void heatshrink_encoder_reset(heatshrink_encoder *hse);
+HSE_sink_res heatshrink_encoder_sink(heatshrink_encoder *hse, uint8_t *in_buf, size_t size, size_t *input_size);
+HSE_poll_res heatshrink_encoder_poll(heatshrink_encoder *hse, uint8_t *out_buf, size_t out_buf_size, size_t *output_size);
+HSE_finish_res heatshrink_encoder_finish(heatshrink_encoder *hse);
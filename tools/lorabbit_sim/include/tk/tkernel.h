@@ -0,0 +1,127 @@
+/**
+ * @file tkernel.h
+ * @brief シミュレータ用の μT-Kernel 3.0 API (LoRabbit が使う範囲のみ)
+ * @details 型と定数は μT-Kernel 3.0 の仕様に合わせています。実装は sim_kernel.c です。
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef int8_t   B;
+typedef int16_t  H;
+typedef int32_t  W;
+typedef uint8_t  UB;
+typedef uint16_t UH;
+typedef uint32_t UW;
+typedef int      INT;
+typedef unsigned int UINT;
+typedef INT      ID;
+typedef INT      ER;
+typedef INT      PRI;
+typedef W        TMO;
+typedef UW       RELTIM;
+typedef UINT     ATR;
+typedef INT      SZ;
+typedef UINT     FLGPTN;
+typedef void    (*FP)(INT stacd, void *exinf);
+
+#define LOCAL  static
+#define EXPORT
+
+/** @brief システム時刻 (ミリ秒。上位32ビットと下位32ビット) */
+typedef struct {
+    W  hi;
+    UW lo;
+} SYSTIM;
+
+#define E_OK     0
+#define E_SYS    (-5)
+#define E_NOSPT  (-9)
+#define E_PAR    (-17)
+#define E_ID     (-18)
+#define E_CTX    (-25)
+#define E_NOMEM  (-33)
+#define E_LIMIT  (-34)
+#define E_OBJ    (-41)
+#define E_NOEXS  (-42)
+#define E_QOVR   (-43)
+#define E_RLWAI  (-49)
+#define E_TMOUT  (-50)
+
+#define TMO_POL  0
+#define TMO_FEVR (-1)
+
+#define TA_HLNG   0x00000001
+#define TA_RNG0   0x00000000
+#define TA_RNG3   0x00000300
+#define TA_USERBUF 0x00000020
+#define TA_TFIFO  0x00000000
+#define TA_TPRI   0x00000001
+#define TA_FIRST  0x00000000
+#define TA_CNT    0x00000002
+#define TA_WSGL   0x00000000
+#define TA_WMUL   0x00000008
+
+#define TWF_ANDW  0x00000000
+#define TWF_ORW   0x00000001
+#define TWF_CLR   0x00000010
+#define TWF_BITCLR 0x00000020
+
+typedef struct {
+    void *exinf;
+    ATR   sematr;
+    INT   isemcnt;
+    INT   maxsem;
+    UB    dsname[8];
+} T_CSEM;
+
+typedef struct {
+    void *exinf;
+    ATR   tskatr;
+    FP    task;
+    PRI   itskpri;
+    SZ    stksz;
+    UB    dsname[8];
+    void *bufptr;
+} T_CTSK;
+
+typedef struct {
+    void *exinf;
+    ATR   mbfatr;
+    SZ    bufsz;
+    INT   maxmsz;
+    UB    dsname[8];
+    void *bufptr;
+} T_CMBF;
+
+typedef struct {
+    void  *exinf;
+    ATR    flgatr;
+    FLGPTN iflgptn;
+    UB     dsname[8];
+} T_CFLG;
+
+ID tk_cre_tsk(const T_CTSK *pk_ctsk);
+ER tk_sta_tsk(ID tskid, INT stacd);
+void tk_ext_tsk(void);
+ID tk_get_tid(void);
+ER tk_dly_tsk(RELTIM dlytim);
+ER tk_dis_dsp(void);
+ER tk_ena_dsp(void);
+ER tk_get_tim(SYSTIM *pk_tim);
+
+ID tk_cre_sem(const T_CSEM *pk_csem);
+ER tk_del_sem(ID semid);
+ER tk_wai_sem(ID semid, INT cnt, TMO tmout);
+ER tk_sig_sem(ID semid, INT cnt);
+
+ID tk_cre_mbf(const T_CMBF *pk_cmbf);
+ER tk_snd_mbf(ID mbfid, const void *msg, INT msgsz, TMO tmout);
+INT tk_rcv_mbf(ID mbfid, void *msg, TMO tmout);
+
+ID tk_cre_flg(const T_CFLG *pk_cflg);
+ER tk_set_flg(ID flgid, FLGPTN setptn);
+ER tk_clr_flg(ID flgid, FLGPTN clrptn);
+ER tk_wai_flg(ID flgid, FLGPTN waiptn, UINT wfmode, FLGPTN *p_flgptn, TMO tmout);
@@ -0,0 +1,10 @@
+/**
+ * @file tmonitor.h
+ * @brief シミュレータ用の T-Monitor API (コンソール出力のみ)
+ */
+#pragma once
+
+#include <tk/tkernel.h>
+
+INT tm_printf(UB *format, ...);
+INT tm_putstring(UB *buff);
@@ -0,0 +1,174 @@
+/**
+ * @file scenario_aggregation.c
+ * @brief 短いメッセージの集約送信のエアタイム
+ * @details 送信側が12バイトのメッセージを一定の間隔で LoRabbit_SendMessage() に渡し、受信側が
+ * LoRabbit_ReceiveFrame() と LoRabbit_UnpackMessages() で取り出します。max_delay_ms が0 (集約なし、
+ * 1つずつ送る) の場合と、メッセージを溜める場合で、送信したフレームの数とエアタイムの合計を比べます。
+ * 集約フレームはACKによる再送をしないため、損失のない無線区間で動かします。
+ * 受信のタイムアウトで送信側の終了を確かめるため、AUXピンをつないだ端末で動かします。
+ * 全てのメッセージを受け取った試行を成功とします。
+ */
+#include "scenarios.h"
+#include "sim_scenario.h"
+#include "LoRabbit_agg.h"
+#include <stdio.h>
+#include <string.h>
+
+#define AGG_MESSAGE_SIZE  12
+#define AGG_MESSAGE_MAX   300 /**< 1回の試行で送るメッセージの最大数 */
+#define AGG_UNPACK_MAX    32
+
+#define AGG_VALUE_RECEIVED 0 /**< value[]: 受け取れたメッセージの数 */
+#define AGG_VALUE_FRAMES   1 /**< value[]: 送信した集約フレームの数 (LoRabbit_GetAggregationStats()) */
+#define AGG_VALUE_LATENCY  2 /**< value[]: メッセージを渡してから受け取るまでの時間の最大値 (ミリ秒) */
+
+static volatile bool s_is_sender_done; // 試行ごとに子プロセスで初期化される
+static volatile bool s_is_receiver_ready;
+static uint64_t s_submitted_us[AGG_MESSAGE_MAX];
+
+typedef struct {
+    LoraAirDateRate_t air_data_rate;
+    const char *rate_name;
+    uint32_t interval_ms;  // メッセージを渡す間隔
+    int      message_count;
+    uint32_t max_delay_ms; // LoRabbit_SendMessage() の max_delay_ms
+    uint32_t seed;
+} AggParams_t;
+
+typedef struct {
+    const AggParams_t *p_params;
+    SimNode_t *p_node;
+    SimTrialResult_t *p_result;
+} AggContext_t;
+
+static uint32_t agg_pattern_seed(uint32_t seed, int index) {
+    return seed * AGG_MESSAGE_MAX + (uint32_t)index;
+}
+
+// メッセージ: 番号 (2バイト) と、番号から決まるデータ
+static void agg_fill_message(uint8_t *p_message, uint32_t seed, int index) {
+    p_message[0] = (uint8_t)(index >> 8);
+    p_message[1] = (uint8_t)index;
+    sim_fill_pattern(&p_message[2], AGG_MESSAGE_SIZE - 2, agg_pattern_seed(seed, index));
+}
+
+static void agg_sender_task(INT stacd, void *exinf) {
+    (void)stacd;
+    AggContext_t *p_context = (AggContext_t *)exinf;
+    const AggParams_t *p_params = p_context->p_params;
+    LoraConfigItem_t config = sim_default_config(0x0001, p_params->air_data_rate);
+    sim_node_boot(p_context->p_node, &config);
+    LoraHandle_t *p_handle = sim_node_handle(p_context->p_node);
+    int ret = LoRabbit_StartAggregator(p_handle, SIM_TASK_PRIORITY - 1);
+    tk_dly_tsk(SIM_BOOT_SETTLE_MS);
+    while (!s_is_receiver_ready) {
+        tk_dly_tsk(10);
+    }
+
+    p_context->p_result->start_us = sim_now_us();
+    for (int i = 0; i < p_params->message_count && LORABBIT_OK == ret; i++) {
+        uint8_t message[AGG_MESSAGE_SIZE];
+        agg_fill_message(message, p_params->seed, i);
+        s_submitted_us[i] = sim_now_us();
+        ret = LoRabbit_SendMessage(p_handle, 0x0002, 0, message, sizeof(message), p_params->max_delay_ms);
+        tk_dly_tsk(p_params->interval_ms);
+    }
+    // 最後に溜めたメッセージが送信期限に送られ、受信側に届くのを待つ
+    tk_dly_tsk(p_params->max_delay_ms + 1000);
+    LoRabbit_AggStats_t stats;
+    if (LORABBIT_OK == ret) {
+        ret = LoRabbit_GetAggregationStats(p_handle, &stats);
+        p_context->p_result->value[AGG_VALUE_FRAMES] = (double)stats.frame_count;
+    }
+    p_context->p_result->ret[0] = ret;
+    s_is_sender_done = true;
+    tk_ext_tsk();
+}
+
+static void agg_receiver_task(INT stacd, void *exinf) {
+    (void)stacd;
+    AggContext_t *p_context = (AggContext_t *)exinf;
+    const AggParams_t *p_params = p_context->p_params;
+    LoraConfigItem_t config = sim_default_config(0x0002, p_params->air_data_rate);
+    sim_node_boot(p_context->p_node, &config);
+    LoraHandle_t *p_handle = sim_node_handle(p_context->p_node);
+    s_is_receiver_ready = true;
+
+    bool is_received[AGG_MESSAGE_MAX] = {false};
+    while (!s_is_sender_done) {
+        RecvFrameE220900T22SJP_t frame;
+        if (LoRabbit_ReceiveFrame(p_handle, &frame, SIM_RECEIVE_POLL_MS) <= 0) {
+            continue;
+        }
+        uint16_t source_address;
+        LoRabbit_Message_t messages[AGG_UNPACK_MAX];
+        int count = LoRabbit_UnpackMessages(&frame, &source_address, messages, AGG_UNPACK_MAX);
+        for (int m = 0; m < count; m++) {
+            if (AGG_MESSAGE_SIZE != messages[m].length) {
+                continue;
+            }
+            int index = (messages[m].p_data[0] << 8) | messages[m].p_data[1];
+            uint8_t expected[AGG_MESSAGE_SIZE];
+            if (index >= p_params->message_count || is_received[index]) {
+                continue;
+            }
+            agg_fill_message(expected, p_params->seed, index);
+            if (0x0001 == source_address && 0 == memcmp(expected, messages[m].p_data, AGG_MESSAGE_SIZE)) {
+                is_received[index] = true;
+                p_context->p_result->value[AGG_VALUE_RECEIVED] += 1.0;
+                double latency_ms = (double)(sim_now_us() - s_submitted_us[index]) / 1000.0;
+                if (latency_ms > p_context->p_result->value[AGG_VALUE_LATENCY]) {
+                    p_context->p_result->value[AGG_VALUE_LATENCY] = latency_ms;
+                }
+            }
+        }
+    }
+    tk_ext_tsk();
+}
+
+static void agg_trial(const void *p_params, SimTrialResult_t *p_result) {
+    const AggParams_t *p = (const AggParams_t *)p_params;
+    SimChannelModel_t model = {0};
+    sim_e220_init(&model);
+    AggContext_t sender = {p, sim_node_create(true), p_result};
+    AggContext_t receiver = {p, sim_node_create(true), p_result};
+    sim_start_task(agg_sender_task, &sender, SIM_TASK_PRIORITY);
+    sim_start_task(agg_receiver_task, &receiver, SIM_TASK_PRIORITY);
+    sim_trial_run(p_result);
+    p_result->is_ok = SIM_RUN_DONE == p_result->run_result && LORABBIT_OK == p_result->ret[0] &&
+                      p->message_count == p_result->value[AGG_VALUE_RECEIVED];
+}
+
+void scenario_aggregation(void) {
+    static const AggParams_t s_params[] = {
+        {LORA_AIR_DATA_RATE_62500_BPS_SF_5_BW_500, "SF5/500", 20, 300, 0, 0},
+        {LORA_AIR_DATA_RATE_62500_BPS_SF_5_BW_500, "SF5/500", 20, 300, 200, 0},
+        {LORA_AIR_DATA_RATE_62500_BPS_SF_5_BW_500, "SF5/500", 20, 300, 1000, 0},
+        {LORA_AIR_DATA_RATE_1758_BPS_SF_9_BW_125, "SF9/125", 200, 100, 0, 0},
+        {LORA_AIR_DATA_RATE_1758_BPS_SF_9_BW_125, "SF9/125", 200, 100, 1000, 0},
+        {LORA_AIR_DATA_RATE_1758_BPS_SF_9_BW_125, "SF9/125", 200, 100, 5000, 0},
+    };
+    printf("%-8s %-11s %-9s %-9s %9s %9s %10s %10s\n", "rate", "interval", "max_delay", "ok/trials", "received",
+           "frames", "airtime_ms", "latency_ms");
+    for (size_t i = 0; i < sizeof(s_params) / sizeof(s_params[0]); i++) {
+        AggParams_t params = s_params[i];
+        SimSummary_t summary = {0};
+        for (int seed = 1; seed <= g_sim_seeds; seed++) {
+            params.seed = (uint32_t)seed;
+            SimTrialResult_t result;
+            if (!sim_trial(agg_trial, &params, (uint32_t)seed, &result)) {
+                result.is_ok = false;
+            }
+            sim_summary_add(&summary, &result);
+        }
+        char interval_text[16];
+        char ok_text[16];
+        snprintf(interval_text, sizeof(interval_text), "%ums x%d", params.interval_ms, params.message_count);
+        snprintf(ok_text, sizeof(ok_text), "%d/%d", summary.ok_count, summary.trials);
+        printf("%-8s %-11s %-9u %-9s %9.1f %9.1f %10.0f %10.0f\n", params.rate_name, interval_text,
+               params.max_delay_ms, ok_text, sim_summary_mean(&summary, summary.sum[AGG_VALUE_RECEIVED]),
+               sim_summary_mean(&summary, summary.sum[AGG_VALUE_FRAMES]),
+               sim_summary_mean(&summary, summary.airtime_ms_sum),
+               sim_summary_mean(&summary, summary.sum[AGG_VALUE_LATENCY]));
+    }
+}
@@ -0,0 +1,281 @@
+/**
+ * @file scenario_budget.c
+ * @brief 送信時間の制限 (エアタイム予算) による送信の遅延と拒否
+ * @details lorabbit_sim_budget は、期間を1分、予算を6秒 (ARIB STD-T108 の1時間・360秒と同じ10%) に縮めてビルドします。
+ * 送信側 (0x0001) は受信側 (0x0002) へ次の順に送信します。
+ * 1. 予算全体より長い30000バイトのウィンドウ送信。予算を使い切った後のパケットは、
+ *    区間が予算に戻るまで LORABBIT_AIRTIME_MAX_WAIT_MS より長く待つ必要があるため、転送の途中で
+ *    LORABBIT_ERROR_AIRTIME_EXHAUSTED を返すはずです
+ * 2. すぐに2000バイトのバルク転送。予算に収まるまでの待ち時間が長すぎるため、フレームを送らずに拒否されるはずです
+ * 3. 20バイトの制御クラス (LORABBIT_TRAFFIC_CLASS_CONTROL) の転送。予約分を使って送れるはずです
+ * 4. 180秒の間、2000バイトのバルク転送を繰り返す (拒否されたら1秒後にやり直す)。予算が空くのを待って送ります
+ * 送信側のフレームのエアタイムを100ミリ秒ごとに記録し、任意の1分間の合計の最大値が予算に収まるかを調べます。
+ * 受信のタイムアウトで送信側の終了を確かめるため、AUXピンをつないだ端末で動かします。
+ * 1〜3が期待どおりの結果を返し、成功を返した転送と受信できた転送が一致し、1分間のエアタイムが予算以下の試行を成功とします。
+ */
+#include "scenarios.h"
+#include "sim_scenario.h"
+#include <stdio.h>
+
+#ifdef LORABBIT_USE_AIRTIME_BUDGET
+#include "LoRabbit_airtime.h"
+#include <stdlib.h>
+
+#define BUDGET_LARGE_SIZE    30000
+#define BUDGET_BULK_SIZE     2000
+#define BUDGET_CONTROL_SIZE  20
+#define BUDGET_PACED_MS      180000 /**< 4. でバルク転送を繰り返す時間 */
+#define BUDGET_RETRY_MS      1000   /**< 4. で拒否された転送をやり直すまでの時間 */
+#define BUDGET_SAMPLE_MS     100    /**< エアタイムを記録する間隔 */
+#define BUDGET_SAMPLE_MAX    6000   /**< エアタイムを記録する回数の上限 (600秒分) */
+#define BUDGET_PACED_MAX     64     /**< 4. の転送の数の上限 */
+
+#define BUDGET_VALUE_LARGE_REFUSED 0 /**< value[]: 1. が途中で LORABBIT_ERROR_AIRTIME_EXHAUSTED を返した (1/0) */
+#define BUDGET_VALUE_BULK_REJECTED 1 /**< value[]: 2. がフレームを送らずに LORABBIT_ERROR_AIRTIME_EXHAUSTED を返した (1/0) */
+#define BUDGET_VALUE_CONTROL_OK    2 /**< value[]: 3. が届き、成功を返した (1/0) */
+#define BUDGET_VALUE_PACED_SENT    3 /**< value[]: 4. で成功を返した転送の数 */
+#define BUDGET_VALUE_PACED_REJECTED 4 /**< value[]: 4. で拒否された回数 */
+#define BUDGET_VALUE_DELAYED       5 /**< value[]: 予算が空くのを待ってから送信した回数 (LoRabbit_GetAirtimeBudget()) */
+#define BUDGET_VALUE_MAX_WINDOW_MS 6 /**< value[]: 送信側の任意の1分間のエアタイムの合計の最大値 (ミリ秒) */
+#define BUDGET_VALUE_MISMATCH      7 /**< value[]: 成功を返した転送と、受信できた転送が一致しなかった数 */
+
+static volatile bool s_is_sender_done; // 試行ごとに子プロセスで初期化される
+static volatile bool s_is_receiver_ready;
+static volatile int  s_receive_return_count; // 受信側の LoRabbit_ReceiveData() が戻った回数
+static bool s_is_paced_sent[BUDGET_PACED_MAX];
+static bool s_is_large_received;
+static bool s_is_control_received;
+static bool s_is_bulk_received;
+static bool s_is_paced_received[BUDGET_PACED_MAX];
+static uint64_t s_airtime_samples[BUDGET_SAMPLE_MAX];
+static int s_sample_count;
+
+typedef struct {
+    double   frame_loss;
+    uint32_t seed;
+} BudgetParams_t;
+
+typedef struct {
+    const BudgetParams_t *p_params;
+    SimNode_t *p_node;
+    SimTrialResult_t *p_result;
+} BudgetContext_t;
+
+// 転送ごとのデータのシード (0: 1.、1: 2.、2: 3.、3以降: 4.)
+static uint32_t budget_pattern_seed(uint32_t seed, int index) {
+    return seed * 100 + (uint32_t)index;
+}
+
+static int budget_send(LoraHandle_t *p_handle, uint32_t seed, int index, uint32_t size,
+                       LoRabbit_TpMode_t mode, LoRabbit_TrafficClass_t traffic_class) {
+    uint8_t *p_data = malloc(size);
+    sim_fill_pattern(p_data, size, budget_pattern_seed(seed, index));
+    LoRabbit_SendOptions_t options = {.mode = mode, .traffic_class = traffic_class};
+    int ret = LoRabbit_SendDataWithOptions(p_handle, 0x0002, 0, p_data, size, &options);
+    free(p_data);
+    return ret;
+}
+
+static void budget_sender_task(INT stacd, void *exinf) {
+    (void)stacd;
+    BudgetContext_t *p_context = (BudgetContext_t *)exinf;
+    const uint32_t seed = p_context->p_params->seed;
+    double *p_value = p_context->p_result->value;
+    LoraConfigItem_t config = sim_default_config(0x0001, LORA_AIR_DATA_RATE_5469_BPS_SF_7_BW_125);
+    sim_node_boot(p_context->p_node, &config);
+    LoraHandle_t *p_handle = sim_node_handle(p_context->p_node);
+    const SimNodeStats_t *p_stats = sim_node_stats(p_context->p_node);
+    tk_dly_tsk(SIM_BOOT_SETTLE_MS);
+    while (!s_is_receiver_ready) {
+        tk_dly_tsk(10);
+    }
+
+    // 1. 予算全体より長い転送
+    uint32_t frames_before = p_stats->tx_frame_count;
+    int ret = budget_send(p_handle, seed, 0, BUDGET_LARGE_SIZE, LORABBIT_TP_MODE_WINDOW, LORABBIT_TRAFFIC_CLASS_BULK);
+    p_value[BUDGET_VALUE_LARGE_REFUSED] =
+        (LORABBIT_ERROR_AIRTIME_EXHAUSTED == ret && p_stats->tx_frame_count > frames_before) ? 1.0 : 0.0;
+    const int return_count = s_receive_return_count;
+
+    // 2. 予算を使い切った直後のバルク転送
+    frames_before = p_stats->tx_frame_count;
+    ret = budget_send(p_handle, seed, 1, BUDGET_BULK_SIZE, LORABBIT_TP_MODE_WINDOW, LORABBIT_TRAFFIC_CLASS_BULK);
+    p_value[BUDGET_VALUE_BULK_REJECTED] =
+        (LORABBIT_ERROR_AIRTIME_EXHAUSTED == ret && p_stats->tx_frame_count == frames_before) ? 1.0 : 0.0;
+
+    // 受信側が途中で止まった1. の受信をあきらめるまで待つ (受信中の転送の相手からの次の転送は受け取れない)
+    while (return_count == s_receive_return_count) {
+        tk_dly_tsk(10);
+    }
+
+    // 3. 制御クラスの転送 (届いたかは受信側の結果と合わせて判定する)
+    ret = budget_send(p_handle, seed, 2, BUDGET_CONTROL_SIZE, LORABBIT_TP_MODE_STOP_AND_WAIT,
+                      LORABBIT_TRAFFIC_CLASS_CONTROL);
+    p_value[BUDGET_VALUE_CONTROL_OK] = (LORABBIT_OK == ret) ? 1.0 : 0.0;
+
+    // 4. 予算が空くのを待って送るバルク転送
+    const uint64_t paced_end_us = sim_now_us() + (uint64_t)BUDGET_PACED_MS * 1000;
+    int index = 0;
+    while (sim_now_us() < paced_end_us && index < BUDGET_PACED_MAX) {
+        ret = budget_send(p_handle, seed, 3 + index, BUDGET_BULK_SIZE, LORABBIT_TP_MODE_WINDOW,
+                          LORABBIT_TRAFFIC_CLASS_BULK);
+        if (LORABBIT_ERROR_AIRTIME_EXHAUSTED == ret) {
+            p_value[BUDGET_VALUE_PACED_REJECTED] += 1.0;
+            tk_dly_tsk(BUDGET_RETRY_MS);
+            continue;
+        }
+        if (LORABBIT_OK == ret) {
+            s_is_paced_sent[index] = true;
+            p_value[BUDGET_VALUE_PACED_SENT] += 1.0;
+        }
+        index++;
+    }
+
+    LoRabbit_AirtimeBudget_t budget;
+    LoRabbit_GetAirtimeBudget(p_handle, &budget);
+    p_value[BUDGET_VALUE_DELAYED] = (double)budget.delayed_count;
+    // 最後の転送の再送にACKを返し直す受信側を待つ
+    tk_dly_tsk(SIM_RECEIVE_POLL_MS);
+    s_is_sender_done = true;
+    tk_ext_tsk();
+}
+
+static void budget_receiver_task(INT stacd, void *exinf) {
+    (void)stacd;
+    BudgetContext_t *p_context = (BudgetContext_t *)exinf;
+    const uint32_t seed = p_context->p_params->seed;
+    LoraConfigItem_t config = sim_default_config(0x0002, LORA_AIR_DATA_RATE_5469_BPS_SF_7_BW_125);
+    sim_node_boot(p_context->p_node, &config);
+    LoraHandle_t *p_handle = sim_node_handle(p_context->p_node);
+    s_is_receiver_ready = true;
+
+    uint8_t *p_buffer = malloc(BUDGET_LARGE_SIZE + 200);
+    while (!s_is_sender_done) {
+        uint32_t received_size = 0;
+        if (LORABBIT_OK != LoRabbit_ReceiveData(p_handle, p_buffer, BUDGET_LARGE_SIZE + 200, &received_size,
+                                                SIM_RECEIVE_POLL_MS)) {
+            s_receive_return_count++;
+            continue;
+        }
+        s_receive_return_count++;
+        if (BUDGET_LARGE_SIZE == received_size && sim_check_pattern(p_buffer, received_size, budget_pattern_seed(seed, 0))) {
+            s_is_large_received = true;
+        } else if (BUDGET_CONTROL_SIZE == received_size &&
+                   sim_check_pattern(p_buffer, received_size, budget_pattern_seed(seed, 2))) {
+            s_is_control_received = true;
+        } else if (BUDGET_BULK_SIZE == received_size) {
+            if (sim_check_pattern(p_buffer, received_size, budget_pattern_seed(seed, 1))) {
+                s_is_bulk_received = true;
+            }
+            for (int i = 0; i < BUDGET_PACED_MAX; i++) {
+                if (sim_check_pattern(p_buffer, received_size, budget_pattern_seed(seed, 3 + i))) {
+                    s_is_paced_received[i] = true;
+                }
+            }
+        }
+    }
+    free(p_buffer);
+    tk_ext_tsk();
+}
+
+// 送信側のエアタイムの合計を一定間隔で記録するタスク
+static void budget_monitor_task(INT stacd, void *exinf) {
+    (void)stacd;
+    BudgetContext_t *p_context = (BudgetContext_t *)exinf;
+    const SimNodeStats_t *p_stats = sim_node_stats(p_context->p_node);
+    while (!s_is_sender_done && s_sample_count < BUDGET_SAMPLE_MAX) {
+        s_airtime_samples[s_sample_count++] = p_stats->tx_airtime_us;
+        tk_dly_tsk(BUDGET_SAMPLE_MS);
+    }
+    tk_ext_tsk();
+}
+
+// 記録したエアタイムから、任意の1分間 (LORABBIT_AIRTIME_WINDOW_MS) の合計の最大値を求める
+static double budget_max_window_ms(void) {
+    const int window_samples = LORABBIT_AIRTIME_WINDOW_MS / BUDGET_SAMPLE_MS;
+    uint64_t max_us = 0;
+    for (int i = 0; i < s_sample_count; i++) {
+        int end = (i + window_samples < s_sample_count) ? i + window_samples : s_sample_count - 1;
+        uint64_t used_us = s_airtime_samples[end] - s_airtime_samples[i];
+        if (used_us > max_us) {
+            max_us = used_us;
+        }
+    }
+    return (double)max_us / 1000.0;
+}
+
+static void budget_trial(const void *p_params, SimTrialResult_t *p_result) {
+    const BudgetParams_t *p = (const BudgetParams_t *)p_params;
+    SimChannelModel_t model = {.frame_loss = p->frame_loss};
+    sim_e220_init(&model);
+    BudgetContext_t sender = {p, sim_node_create(true), p_result};
+    BudgetContext_t receiver = {p, sim_node_create(true), p_result};
+    sim_start_task(budget_sender_task, &sender, SIM_TASK_PRIORITY);
+    sim_start_task(budget_receiver_task, &receiver, SIM_TASK_PRIORITY);
+    sim_start_task(budget_monitor_task, &sender, SIM_TASK_PRIORITY);
+    sim_trial_run(p_result);
+
+    double *p_value = p_result->value;
+    p_value[BUDGET_VALUE_MAX_WINDOW_MS] = budget_max_window_ms();
+    p_value[BUDGET_VALUE_CONTROL_OK] = (p_value[BUDGET_VALUE_CONTROL_OK] > 0.0 && s_is_control_received) ? 1.0 : 0.0;
+    p_value[BUDGET_VALUE_MISMATCH] = (s_is_large_received ? 1.0 : 0.0) + (s_is_bulk_received ? 1.0 : 0.0);
+    for (int i = 0; i < BUDGET_PACED_MAX; i++) {
+        if (s_is_paced_sent[i] != s_is_paced_received[i]) {
+            p_value[BUDGET_VALUE_MISMATCH] += 1.0;
+        }
+    }
+    p_result->is_ok = SIM_RUN_DONE == p_result->run_result && p_value[BUDGET_VALUE_LARGE_REFUSED] > 0.0 &&
+                      p_value[BUDGET_VALUE_BULK_REJECTED] > 0.0 && p_value[BUDGET_VALUE_CONTROL_OK] > 0.0 &&
+                      0.0 == p_value[BUDGET_VALUE_MISMATCH] &&
+                      p_value[BUDGET_VALUE_MAX_WINDOW_MS] <= (double)LORABBIT_AIRTIME_BUDGET_MS;
+}
+
+void scenario_budget(void) {
+    static const double s_losses[] = {0.0, 0.1};
+    printf("budget: %d ms / %d ms\n", LORABBIT_AIRTIME_BUDGET_MS, LORABBIT_AIRTIME_WINDOW_MS);
+    printf("%-5s %-9s %9s %9s %9s %9s %9s %9s %13s\n", "loss", "ok/trials", "refused", "rejected", "control",
+           "paced", "retried", "delayed", "max_window_ms");
+    for (size_t l = 0; l < sizeof(s_losses) / sizeof(s_losses[0]); l++) {
+        BudgetParams_t params = {s_losses[l], 0};
+        SimSummary_t summary = {0};
+        double refused_sum = 0.0;
+        double rejected_sum = 0.0;
+        double control_sum = 0.0;
+        double max_window_ms = 0.0;
+        for (int seed = 1; seed <= g_sim_seeds; seed++) {
+            params.seed = (uint32_t)seed;
+            SimTrialResult_t result;
+            if (!sim_trial(budget_trial, &params, (uint32_t)seed, &result)) {
+                result.is_ok = false;
+                result.value[BUDGET_VALUE_LARGE_REFUSED] = 0.0;
+                result.value[BUDGET_VALUE_BULK_REJECTED] = 0.0;
+                result.value[BUDGET_VALUE_CONTROL_OK] = 0.0;
+                result.value[BUDGET_VALUE_MAX_WINDOW_MS] = 0.0;
+            }
+            sim_summary_add(&summary, &result);
+            refused_sum += result.value[BUDGET_VALUE_LARGE_REFUSED];
+            rejected_sum += result.value[BUDGET_VALUE_BULK_REJECTED];
+            control_sum += result.value[BUDGET_VALUE_CONTROL_OK];
+            if (result.value[BUDGET_VALUE_MAX_WINDOW_MS] > max_window_ms) {
+                max_window_ms = result.value[BUDGET_VALUE_MAX_WINDOW_MS];
+            }
+        }
+        char ok_text[16];
+        char refused_text[16];
+        char rejected_text[16];
+        char control_text[16];
+        snprintf(ok_text, sizeof(ok_text), "%d/%d", summary.ok_count, summary.trials);
+        snprintf(refused_text, sizeof(refused_text), "%.0f/%d", refused_sum, summary.trials);
+        snprintf(rejected_text, sizeof(rejected_text), "%.0f/%d", rejected_sum, summary.trials);
+        snprintf(control_text, sizeof(control_text), "%.0f/%d", control_sum, summary.trials);
+        printf("%3.0f%%  %-9s %9s %9s %9s %9.1f %9.1f %9.1f %13.0f\n", s_losses[l] * 100.0, ok_text, refused_text,
+               rejected_text, control_text, sim_summary_mean(&summary, summary.sum[BUDGET_VALUE_PACED_SENT]),
+               sim_summary_mean(&summary, summary.sum[BUDGET_VALUE_PACED_REJECTED]),
+               sim_summary_mean(&summary, summary.sum[BUDGET_VALUE_DELAYED]), max_window_ms);
+    }
+}
+#else
+void scenario_budget(void) {
+    fprintf(stderr, "budget: run with lorabbit_sim_budget\n");
+}
+#endif // LORABBIT_USE_AIRTIME_BUDGET
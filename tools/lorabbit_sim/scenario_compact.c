@@ -0,0 +1,175 @@
+/**
+ * @file scenario_compact.c
+ * @brief コンパクトヘッダによるエアタイムの削減
+ * @details 前半は LoRabbit_GetTimeOnAirMsec() で計算した、フレームごとのエアタイムの表です。
+ * 後半は20000バイトの転送を、通常のヘッダとコンパクトヘッダ (use_compact_header) で行い、
+ * 両方向の全フレームのエアタイムの合計を比べます。両方向の全フレームが独立に指定の確率で失われます。
+ * ACKのタイムアウトを待つため、AUXピンをつないだ端末を使います。
+ * 受信側がデータを受信し、送信側も成功を返した試行を成功とします。
+ */
+#include "scenarios.h"
+#include "sim_scenario.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define COMPACT_SIZE          20000
+#define COMPACT_RX_TIMEOUT_MS 600000
+#define COMPACT_WINDOW_SIZE   8
+
+static volatile bool s_is_sender_done; // 試行ごとに子プロセスで初期化される
+
+typedef struct {
+    LoraAirDateRate_t air_data_rate;
+    const char *p_name;
+} CompactRate_t;
+
+static const CompactRate_t s_all_rates[] = {
+    {LORA_AIR_DATA_RATE_15625_BPS_SF_5_BW_125, "SF5/125"},  {LORA_AIR_DATA_RATE_9375_BPS_SF_6_BW_125, "SF6/125"},
+    {LORA_AIR_DATA_RATE_5469_BPS_SF_7_BW_125, "SF7/125"},   {LORA_AIR_DATA_RATE_3125_BPS_SF_8_BW_125, "SF8/125"},
+    {LORA_AIR_DATA_RATE_1758_BPS_SF_9_BW_125, "SF9/125"},   {LORA_AIR_DATA_RATE_31250_BPS_SF_5_BW_250, "SF5/250"},
+    {LORA_AIR_DATA_RATE_18750_BPS_SF_6_BW_250, "SF6/250"},  {LORA_AIR_DATA_RATE_10938_BPS_SF_7_BW_250, "SF7/250"},
+    {LORA_AIR_DATA_RATE_6250_BPS_SF_8_BW_250, "SF8/250"},   {LORA_AIR_DATA_RATE_3516_BPS_SF_9_BW_250, "SF9/250"},
+    {LORA_AIR_DATA_RATE_1953_BPS_SF_10_BW_250, "SF10/250"}, {LORA_AIR_DATA_RATE_62500_BPS_SF_5_BW_500, "SF5/500"},
+    {LORA_AIR_DATA_RATE_37500_BPS_SF_6_BW_500, "SF6/500"},  {LORA_AIR_DATA_RATE_21875_BPS_SF_7_BW_500, "SF7/500"},
+    {LORA_AIR_DATA_RATE_12500_BPS_SF_8_BW_500, "SF8/500"},  {LORA_AIR_DATA_RATE_7031_BPS_SF_9_BW_500, "SF9/500"},
+    {LORA_AIR_DATA_RATE_3906_BPS_SF_10_BW_500, "SF10/500"}, {LORA_AIR_DATA_RATE_2148_BPS_SF_11_BW_500, "SF11/500"},
+};
+
+typedef struct {
+    LoraAirDateRate_t air_data_rate;
+    LoRabbit_TpMode_t mode;
+    bool     use_compact_header;
+    double   frame_loss;
+    uint32_t seed;
+} CompactParams_t;
+
+typedef struct {
+    const CompactParams_t *p_params;
+    SimNode_t *p_node;
+    SimTrialResult_t *p_result;
+} CompactContext_t;
+
+static void compact_sender_task(INT stacd, void *exinf) {
+    (void)stacd;
+    CompactContext_t *p_context = (CompactContext_t *)exinf;
+    const CompactParams_t *p_params = p_context->p_params;
+    LoraConfigItem_t config = sim_default_config(0x0001, p_params->air_data_rate);
+    sim_node_boot(p_context->p_node, &config);
+    tk_dly_tsk(SIM_BOOT_SETTLE_MS);
+
+    uint8_t *p_data = malloc(COMPACT_SIZE);
+    sim_fill_pattern(p_data, COMPACT_SIZE, p_params->seed);
+    LoRabbit_SendOptions_t options = {
+        .mode = p_params->mode,
+        .window_size = COMPACT_WINDOW_SIZE,
+        .use_compact_header = p_params->use_compact_header,
+    };
+    p_context->p_result->start_us = sim_now_us();
+    p_context->p_result->ret[0] = LoRabbit_SendDataWithOptions(sim_node_handle(p_context->p_node), 0x0002, 0,
+                                                               p_data, COMPACT_SIZE, &options);
+    s_is_sender_done = true;
+    free(p_data);
+    tk_ext_tsk();
+}
+
+static void compact_receiver_task(INT stacd, void *exinf) {
+    (void)stacd;
+    CompactContext_t *p_context = (CompactContext_t *)exinf;
+    const CompactParams_t *p_params = p_context->p_params;
+    SimTrialResult_t *p_result = p_context->p_result;
+    LoraConfigItem_t config = sim_default_config(0x0002, p_params->air_data_rate);
+    sim_node_boot(p_context->p_node, &config);
+
+    uint8_t *p_buffer = calloc(1, COMPACT_SIZE + 200);
+    uint32_t received_size = 0;
+    uint64_t done_us = 0;
+    int ret = sim_receive_data_until_done(sim_node_handle(p_context->p_node), p_buffer, COMPACT_SIZE + 200,
+                                          &received_size, COMPACT_RX_TIMEOUT_MS, &s_is_sender_done, &done_us);
+    p_result->ret[1] = ret;
+    p_result->is_ok = (LORABBIT_OK == ret && COMPACT_SIZE == received_size &&
+                       sim_check_pattern(p_buffer, received_size, p_params->seed));
+    free(p_buffer);
+    tk_ext_tsk();
+}
+
+static void compact_trial(const void *p_params, SimTrialResult_t *p_result) {
+    const CompactParams_t *p = (const CompactParams_t *)p_params;
+    SimChannelModel_t model = {.frame_loss = p->frame_loss};
+    sim_e220_init(&model);
+    CompactContext_t sender = {p, sim_node_create(true), p_result};
+    CompactContext_t receiver = {p, sim_node_create(true), p_result};
+    sim_start_task(compact_sender_task, &sender, SIM_TASK_PRIORITY);
+    sim_start_task(compact_receiver_task, &receiver, SIM_TASK_PRIORITY);
+    sim_trial_run(p_result);
+    p_result->is_ok = p_result->is_ok && LORABBIT_OK == p_result->ret[0] && SIM_RUN_DONE == p_result->run_result;
+}
+
+// 通常のヘッダとコンパクトヘッダのフレーム長の組ごとのエアタイムを表示するヘルパー関数（内部利用）
+static void compact_print_frame_airtime(void) {
+    // データパケット、拡張ヘッダのデータパケット、ACK、選択ACK (1バイト)、NACK (4バイト)
+    static const uint8_t s_lengths[][2] = {{197, 192}, {197, 193}, {8, 3}, {9, 4}, {12, 7}};
+    printf("%-9s", "rate");
+    for (size_t k = 0; k < sizeof(s_lengths) / sizeof(s_lengths[0]); k++) {
+        char heading[16];
+        snprintf(heading, sizeof(heading), "%u->%u", (unsigned)s_lengths[k][0], (unsigned)s_lengths[k][1]);
+        printf(" %11s", heading);
+    }
+    printf("\n");
+    for (size_t r = 0; r < sizeof(s_all_rates) / sizeof(s_all_rates[0]); r++) {
+        printf("%-9s", s_all_rates[r].p_name);
+        for (size_t k = 0; k < sizeof(s_lengths) / sizeof(s_lengths[0]); k++) {
+            char cell[16];
+            snprintf(cell, sizeof(cell), "%d->%d", LoRabbit_GetTimeOnAirMsec(s_all_rates[r].air_data_rate, s_lengths[k][0]),
+                     LoRabbit_GetTimeOnAirMsec(s_all_rates[r].air_data_rate, s_lengths[k][1]));
+            printf(" %11s", cell);
+        }
+        printf("\n");
+    }
+}
+
+// 1つの条件の試行を全シードで実行し、成功した試行のエアタイムの平均を返すヘルパー関数（内部利用）
+static double compact_run(CompactParams_t *p_params, int *p_ok_count) {
+    SimSummary_t summary = {0};
+    for (int seed = 1; seed <= g_sim_seeds; seed++) {
+        p_params->seed = (uint32_t)seed;
+        SimTrialResult_t result;
+        if (!sim_trial(compact_trial, p_params, (uint32_t)seed, &result)) {
+            result.is_ok = false;
+        }
+        sim_summary_add(&summary, &result);
+    }
+    *p_ok_count = summary.ok_count;
+    return sim_summary_mean(&summary, summary.airtime_ms_sum);
+}
+
+void scenario_compact(void) {
+    compact_print_frame_airtime();
+    printf("\n");
+
+    static const LoRabbit_TpMode_t s_modes[] = {
+        LORABBIT_TP_MODE_STOP_AND_WAIT, LORABBIT_TP_MODE_WINDOW, LORABBIT_TP_MODE_BURST,
+    };
+    static const char *const s_mode_names[] = {"stop-and-wait", "window", "burst"};
+    static const double s_losses[] = {0.0, 0.10};
+    printf("%-9s %-14s %-5s %-9s %-9s %11s %11s %9s\n", "rate", "mode", "loss", "ok", "ok_compact", "airtime_ms",
+           "compact_ms", "reduction");
+    for (size_t r = 0; r < sizeof(s_all_rates) / sizeof(s_all_rates[0]); r++) {
+        for (size_t m = 0; m < sizeof(s_modes) / sizeof(s_modes[0]); m++) {
+            for (size_t l = 0; l < sizeof(s_losses) / sizeof(s_losses[0]); l++) {
+                CompactParams_t params = {s_all_rates[r].air_data_rate, s_modes[m], false, s_losses[l], 0};
+                int ok_count = 0;
+                int ok_compact_count = 0;
+                double airtime_ms = compact_run(&params, &ok_count);
+                params.use_compact_header = true;
+                double compact_ms = compact_run(&params, &ok_compact_count);
+                char ok_text[16];
+                char ok_compact_text[16];
+                snprintf(ok_text, sizeof(ok_text), "%d/%d", ok_count, g_sim_seeds);
+                snprintf(ok_compact_text, sizeof(ok_compact_text), "%d/%d", ok_compact_count, g_sim_seeds);
+                printf("%-9s %-14s %3.0f%%  %-9s %-9s %11.0f %11.0f %8.1f%%\n", s_all_rates[r].p_name, s_mode_names[m],
+                       s_losses[l] * 100, ok_text, ok_compact_text, airtime_ms, compact_ms,
+                       (airtime_ms > 0.0) ? (airtime_ms - compact_ms) * 100.0 / airtime_ms : 0.0);
+            }
+        }
+    }
+}
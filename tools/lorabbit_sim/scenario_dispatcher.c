@@ -0,0 +1,244 @@
+/**
+ * @file scenario_dispatcher.c
+ * @brief 受信ディスパッチャによる送受信の同時実行
+ * @details 端末A (0x0001) と端末B (0x0002) が、互いに2000バイトの転送を同時に送り合います。
+ * 各端末では送信のタスクと LoRabbit_ReceiveData() のタスクが別々に動き、端末Bではさらに
+ * LoRabbit_ReceiveFrame() のタスクが、端末C (0x0003) から届く短いイベントフレームを受け取ります。
+ * 受信ディスパッチャ (LoRabbit_StartRxDispatcher()) を起動しない場合とする場合で、転送とイベントフレームが
+ * 届いた数を比べます。
+ * 受信のタイムアウトで送信側の終了を確かめるため、AUXピンをつないだ端末で動かします。
+ * イベントフレームは、無線区間で転送のフレームと重なるか、UARTで転送のフレームと続けて出力されると失われるため、
+ * 端末BのモジュールがUARTに区切って出力したイベントフレームを全て受け取れたかを調べます。
+ * 両方向の転送を受信し、両方の送信が成功を返し、区切って出力されたイベントフレームを全て1回ずつ受け取った試行を
+ * 成功とします。
+ */
+#include "scenarios.h"
+#include "sim_scenario.h"
+#include "LoRabbit_service.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DISPATCHER_SIZE           2000
+#define DISPATCHER_EVENT_COUNT    10  /**< 端末Cが送るイベントフレームの数 */
+#define DISPATCHER_EVENT_INTERVAL 400 /**< イベントフレームの送信間隔 (ミリ秒) */
+#define DISPATCHER_EVENT_SIZE     4   /**< イベントフレームの長さ (大容量データ転送のヘッダより短い) */
+
+#define DISPATCHER_VALUE_RECEIVED 0 /**< value[]: 受信できた転送の数 */
+#define DISPATCHER_VALUE_SENT     1 /**< value[]: 送信が成功を返した転送の数 */
+#define DISPATCHER_VALUE_EVENTS   2 /**< value[]: 受け取れたイベントフレームの数 */
+#define DISPATCHER_VALUE_ARRIVED  3 /**< value[]: 端末BのモジュールがUARTに区切って出力したイベントフレームの数 */
+#define DISPATCHER_VALUE_DROPPED  4 /**< value[]: 受信ディスパッチャのキューが満杯で捨てたフレームの数 */
+
+#define DISPATCHER_NODE_COUNT 2 /**< 転送を送り合う端末の数 */
+
+static volatile int  s_sender_done_count; // 試行ごとに子プロセスで初期化される
+static volatile bool s_is_event_done;
+static volatile bool s_is_node_ready[DISPATCHER_NODE_COUNT];
+
+typedef struct {
+    bool     use_dispatcher; // LoRabbit_StartRxDispatcher() を使うか
+    double   frame_loss;
+    uint32_t seed;
+} DispatcherParams_t;
+
+typedef struct {
+    const DispatcherParams_t *p_params;
+    SimNode_t *p_node;
+    SimTrialResult_t *p_result;
+    int index; // 端末の番号 (0: 端末A、1: 端末B、-1: 端末C)
+} DispatcherContext_t;
+
+static SimNode_t *s_p_event_node; // 端末C
+
+static uint16_t dispatcher_address(int index) {
+    return (uint16_t)(0x0001 + index);
+}
+
+static uint32_t dispatcher_pattern_seed(uint32_t seed, int index) {
+    return seed * 10 + (uint32_t)index;
+}
+
+static void dispatcher_wait_ready(int index) {
+    tk_dly_tsk(SIM_BOOT_SETTLE_MS);
+    while (!s_is_node_ready[index]) {
+        tk_dly_tsk(10);
+    }
+}
+
+static void dispatcher_send_task(INT stacd, void *exinf) {
+    (void)stacd;
+    DispatcherContext_t *p_context = (DispatcherContext_t *)exinf;
+    const DispatcherParams_t *p_params = p_context->p_params;
+    LoraHandle_t *p_handle = sim_node_handle(p_context->p_node);
+    // 送信のタスクが端末を起動し、受信ディスパッチャを起動する
+    LoraConfigItem_t config =
+        sim_default_config(dispatcher_address(p_context->index), LORA_AIR_DATA_RATE_62500_BPS_SF_5_BW_500);
+    sim_node_boot(p_context->p_node, &config);
+    if (p_params->use_dispatcher) {
+        int ret = LoRabbit_StartRxDispatcher(p_handle, SIM_TASK_PRIORITY - 1);
+        if (LORABBIT_OK != ret) {
+            p_context->p_result->ret[p_context->index] = ret;
+        }
+    }
+    s_is_node_ready[p_context->index] = true;
+    dispatcher_wait_ready(p_context->index);
+
+    uint8_t *p_data = malloc(DISPATCHER_SIZE);
+    sim_fill_pattern(p_data, DISPATCHER_SIZE, dispatcher_pattern_seed(p_params->seed, p_context->index));
+    if (0 == p_context->index) {
+        p_context->p_result->start_us = sim_now_us();
+    }
+    LoRabbit_SendOptions_t options = {.mode = LORABBIT_TP_MODE_WINDOW};
+    int ret = LoRabbit_SendDataWithOptions(p_handle, dispatcher_address(1 - p_context->index), 0, p_data,
+                                           DISPATCHER_SIZE, &options);
+    if (LORABBIT_OK == ret) {
+        p_context->p_result->value[DISPATCHER_VALUE_SENT] += 1.0;
+    }
+    free(p_data);
+    s_sender_done_count++;
+    tk_ext_tsk();
+}
+
+static void dispatcher_receive_task(INT stacd, void *exinf) {
+    (void)stacd;
+    DispatcherContext_t *p_context = (DispatcherContext_t *)exinf;
+    const uint32_t peer_seed = dispatcher_pattern_seed(p_context->p_params->seed, 1 - p_context->index);
+    dispatcher_wait_ready(p_context->index);
+    LoraHandle_t *p_handle = sim_node_handle(p_context->p_node);
+
+    uint8_t *p_buffer = calloc(1, DISPATCHER_SIZE + 200);
+    bool is_received = false;
+    // 両方の送信が終わるまで受信を続け、完了後に届いた再送にもACKを返し直す
+    while (s_sender_done_count < DISPATCHER_NODE_COUNT) {
+        uint32_t received_size = 0;
+        if (LORABBIT_OK == LoRabbit_ReceiveData(p_handle, p_buffer, DISPATCHER_SIZE + 200, &received_size,
+                                                SIM_RECEIVE_POLL_MS) &&
+            !is_received && DISPATCHER_SIZE == received_size &&
+            sim_check_pattern(p_buffer, received_size, peer_seed)) {
+            is_received = true;
+            p_context->p_result->value[DISPATCHER_VALUE_RECEIVED] += 1.0;
+            p_context->p_result->elapsed_us = sim_now_us() - p_context->p_result->start_us;
+        }
+    }
+    free(p_buffer);
+    tk_ext_tsk();
+}
+
+static void dispatcher_event_receive_task(INT stacd, void *exinf) {
+    (void)stacd;
+    DispatcherContext_t *p_context = (DispatcherContext_t *)exinf;
+    dispatcher_wait_ready(p_context->index);
+    LoraHandle_t *p_handle = sim_node_handle(p_context->p_node);
+
+    bool is_received[DISPATCHER_EVENT_COUNT] = {false};
+    while (!s_is_event_done || s_sender_done_count < DISPATCHER_NODE_COUNT) {
+        RecvFrameE220900T22SJP_t frame;
+        if (LoRabbit_ReceiveFrame(p_handle, &frame, SIM_RECEIVE_POLL_MS) <= 0) {
+            continue;
+        }
+        // 'E' 'V' 番号 シードの下位バイト
+        if (DISPATCHER_EVENT_SIZE == frame.recv_data_len && 'E' == frame.recv_data[0] &&
+            'V' == frame.recv_data[1] && frame.recv_data[2] < DISPATCHER_EVENT_COUNT &&
+            (uint8_t)p_context->p_params->seed == frame.recv_data[3] && !is_received[frame.recv_data[2]]) {
+            is_received[frame.recv_data[2]] = true;
+            p_context->p_result->value[DISPATCHER_VALUE_EVENTS] += 1.0;
+        }
+    }
+    p_context->p_result->value[DISPATCHER_VALUE_ARRIVED] =
+        (double)sim_node_rx_separable_count_from(p_context->p_node, s_p_event_node);
+#ifdef LORABBIT_USE_RX_DISPATCHER
+    for (int c = 0; c < LORABBIT_RX_CLASS_COUNT; c++) {
+        p_context->p_result->value[DISPATCHER_VALUE_DROPPED] +=
+            (double)LoRabbit_GetRxDroppedCount(p_handle, (LoRabbit_RxClass_t)c);
+    }
+#endif
+    tk_ext_tsk();
+}
+
+static void dispatcher_event_send_task(INT stacd, void *exinf) {
+    (void)stacd;
+    DispatcherContext_t *p_context = (DispatcherContext_t *)exinf;
+    LoraConfigItem_t config = sim_default_config(0x0003, LORA_AIR_DATA_RATE_62500_BPS_SF_5_BW_500);
+    sim_node_boot(p_context->p_node, &config);
+    LoraHandle_t *p_handle = sim_node_handle(p_context->p_node);
+    tk_dly_tsk(SIM_BOOT_SETTLE_MS);
+
+    for (int i = 0; i < DISPATCHER_EVENT_COUNT; i++) {
+        tk_dly_tsk(DISPATCHER_EVENT_INTERVAL);
+        uint8_t event[DISPATCHER_EVENT_SIZE] = {'E', 'V', (uint8_t)i, (uint8_t)p_context->p_params->seed};
+        LoRabbit_SendFrame(p_handle, dispatcher_address(1), 0, event, sizeof(event));
+    }
+    // 最後のイベントフレームが端末Bに届くのを待つ
+    tk_dly_tsk(DISPATCHER_EVENT_INTERVAL);
+    s_is_event_done = true;
+    tk_ext_tsk();
+}
+
+static void dispatcher_trial(const void *p_params, SimTrialResult_t *p_result) {
+    const DispatcherParams_t *p = (const DispatcherParams_t *)p_params;
+    SimChannelModel_t model = {.frame_loss = p->frame_loss};
+    sim_e220_init(&model);
+    DispatcherContext_t nodes[DISPATCHER_NODE_COUNT];
+    for (int i = 0; i < DISPATCHER_NODE_COUNT; i++) {
+        nodes[i] = (DispatcherContext_t){p, sim_node_create(true), p_result, i};
+        sim_start_task(dispatcher_send_task, &nodes[i], SIM_TASK_PRIORITY);
+        sim_start_task(dispatcher_receive_task, &nodes[i], SIM_TASK_PRIORITY);
+    }
+    sim_start_task(dispatcher_event_receive_task, &nodes[1], SIM_TASK_PRIORITY);
+    s_p_event_node = sim_node_create(true);
+    DispatcherContext_t event_sender = {p, s_p_event_node, p_result, -1};
+    sim_start_task(dispatcher_event_send_task, &event_sender, SIM_TASK_PRIORITY);
+    sim_trial_run(p_result);
+    p_result->is_ok = SIM_RUN_DONE == p_result->run_result && LORABBIT_OK == p_result->ret[0] &&
+                      LORABBIT_OK == p_result->ret[1] &&
+                      DISPATCHER_NODE_COUNT == p_result->value[DISPATCHER_VALUE_RECEIVED] &&
+                      DISPATCHER_NODE_COUNT == p_result->value[DISPATCHER_VALUE_SENT] &&
+                      p_result->value[DISPATCHER_VALUE_ARRIVED] == p_result->value[DISPATCHER_VALUE_EVENTS];
+}
+
+void scenario_dispatcher(void) {
+    static const double s_losses[] = {0.0, 0.1};
+    printf("%-5s %-10s %-9s %9s %9s %9s %9s %9s\n", "loss", "dispatcher", "ok/trials", "received", "sent", "events",
+           "dropped", "mean_ms");
+    for (size_t l = 0; l < sizeof(s_losses) / sizeof(s_losses[0]); l++) {
+        for (int use_dispatcher = 0; use_dispatcher <= 1; use_dispatcher++) {
+            DispatcherParams_t params = {(1 == use_dispatcher), s_losses[l], 0};
+            SimSummary_t summary = {0};
+            double received_sum = 0.0;
+            double sent_sum = 0.0;
+            double events_sum = 0.0;
+            double arrived_sum = 0.0;
+            double dropped_sum = 0.0;
+            for (int seed = 1; seed <= g_sim_seeds; seed++) {
+                params.seed = (uint32_t)seed;
+                SimTrialResult_t result;
+                if (!sim_trial(dispatcher_trial, &params, (uint32_t)seed, &result)) {
+                    result.is_ok = false;
+                    result.value[DISPATCHER_VALUE_RECEIVED] = 0.0;
+                    result.value[DISPATCHER_VALUE_SENT] = 0.0;
+                    result.value[DISPATCHER_VALUE_EVENTS] = 0.0;
+                    result.value[DISPATCHER_VALUE_ARRIVED] = 0.0;
+                    result.value[DISPATCHER_VALUE_DROPPED] = 0.0;
+                }
+                sim_summary_add(&summary, &result);
+                received_sum += result.value[DISPATCHER_VALUE_RECEIVED];
+                sent_sum += result.value[DISPATCHER_VALUE_SENT];
+                events_sum += result.value[DISPATCHER_VALUE_EVENTS];
+                arrived_sum += result.value[DISPATCHER_VALUE_ARRIVED];
+                dropped_sum += result.value[DISPATCHER_VALUE_DROPPED];
+            }
+            const double transfer_total = (double)(DISPATCHER_NODE_COUNT * summary.trials);
+            char ok_text[16];
+            char received_text[16];
+            char sent_text[16];
+            char events_text[16];
+            snprintf(ok_text, sizeof(ok_text), "%d/%d", summary.ok_count, summary.trials);
+            snprintf(received_text, sizeof(received_text), "%.0f/%.0f", received_sum, transfer_total);
+            snprintf(sent_text, sizeof(sent_text), "%.0f/%.0f", sent_sum, transfer_total);
+            snprintf(events_text, sizeof(events_text), "%.0f/%.0f", events_sum, arrived_sum);
+            printf("%3.0f%%  %-10s %-9s %9s %9s %9s %9.0f %9.0f\n", s_losses[l] * 100.0,
+                   use_dispatcher ? "on" : "off", ok_text, received_text, sent_text, events_text, dropped_sum,
+                   sim_summary_mean(&summary, summary.elapsed_ms_sum));
+        }
+    }
+}
@@ -0,0 +1,198 @@
+/**
+ * @file scenario_dtc.c
+ * @brief DTC転送によるUART受信 (LORABBIT_USE_UART_DTC) の割り込みの回数
+ * @details 両方の端末のUARTに受信のDTC転送を指定しない場合 (1バイトごとの受信) と指定した場合で、
+ * MCUが受けたUART受信の割り込みの回数を比べます。
+ * - transfer: 10000バイトのウィンドウ送信 (SF7/500kHz)。損失率は 0% と 10% です
+ * - frames: 8バイトのフレームを LoRabbit_SendFrame() で300ミリ秒ごとに30個送り、LoRabbit_ReceiveFrame() で受け取ります。
+ *   フレームは LORABBIT_UART_DTC_BLOCK_SIZE より短く、DTC転送の途中までの受信データを読み出せなければ、
+ *   次のフレームが届くまで受け取れません
+ * 受信のタイムアウトで送信側の終了を確かめるため、AUXピンをつないだ端末で動かします。
+ * transfer は受信側が全データを受信し、送信側も成功を返した試行を、frames は全てのフレームを別々に
+ * 受け取った試行を成功とします。
+ */
+#include "scenarios.h"
+#include "sim_scenario.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DTC_TRANSFER_SIZE     10000
+#define DTC_RX_TIMEOUT_MS     120000
+#define DTC_FRAME_COUNT       30
+#define DTC_FRAME_SIZE        8
+#define DTC_FRAME_INTERVAL_MS 300
+
+#define DTC_VALUE_RX_IRQ     0 /**< value[]: 受信側のUART受信の割り込みの回数 */
+#define DTC_VALUE_RX_BYTES   1 /**< value[]: 受信側のMCUが受け取ったバイトの数 */
+#define DTC_VALUE_TX_IRQ     2 /**< value[]: 送信側のUART受信の割り込みの回数 (ACKとモジュールの設定の応答) */
+#define DTC_VALUE_TX_BYTES   3 /**< value[]: 送信側のMCUが受け取ったバイトの数 */
+#define DTC_VALUE_FRAMES     4 /**< value[]: frames で受け取れたフレームの数 */
+#define DTC_VALUE_LATENCY_MS 5 /**< value[]: frames でフレームを送ってから受け取るまでの時間の最大値 (ミリ秒) */
+
+static volatile bool s_is_sender_done; // 試行ごとに子プロセスで初期化される
+static uint64_t s_sent_us[DTC_FRAME_COUNT];
+
+typedef struct {
+    bool     use_dtc;
+    bool     is_frames; // false: transfer、true: frames
+    double   frame_loss;
+    uint32_t seed;
+} DtcParams_t;
+
+typedef struct {
+    const DtcParams_t *p_params;
+    SimNode_t *p_node;
+    SimTrialResult_t *p_result;
+} DtcContext_t;
+
+static LoraHandle_t *dtc_boot(DtcContext_t *p_context, uint16_t address) {
+    if (p_context->p_params->use_dtc) {
+        sim_node_use_uart_dtc(p_context->p_node);
+    }
+    LoraConfigItem_t config = sim_default_config(address, LORA_AIR_DATA_RATE_21875_BPS_SF_7_BW_500);
+    sim_node_boot(p_context->p_node, &config);
+    return sim_node_handle(p_context->p_node);
+}
+
+static void dtc_sender_task(INT stacd, void *exinf) {
+    (void)stacd;
+    DtcContext_t *p_context = (DtcContext_t *)exinf;
+    const DtcParams_t *p_params = p_context->p_params;
+    LoraHandle_t *p_handle = dtc_boot(p_context, 0x0001);
+    tk_dly_tsk(SIM_BOOT_SETTLE_MS);
+
+    p_context->p_result->start_us = sim_now_us();
+    if (p_params->is_frames) {
+        for (int i = 0; i < DTC_FRAME_COUNT; i++) {
+            uint8_t frame[DTC_FRAME_SIZE];
+            frame[0] = (uint8_t)i;
+            sim_fill_pattern(&frame[1], DTC_FRAME_SIZE - 1, p_params->seed * DTC_FRAME_COUNT + (uint32_t)i);
+            s_sent_us[i] = sim_now_us();
+            LoRabbit_SendFrame(p_handle, 0x0002, 0, frame, sizeof(frame));
+            tk_dly_tsk(DTC_FRAME_INTERVAL_MS);
+        }
+        p_context->p_result->ret[0] = LORABBIT_OK;
+    } else {
+        uint8_t *p_data = malloc(DTC_TRANSFER_SIZE);
+        sim_fill_pattern(p_data, DTC_TRANSFER_SIZE, p_params->seed);
+        LoRabbit_SendOptions_t options = {
+            .mode = LORABBIT_TP_MODE_WINDOW,
+        };
+        p_context->p_result->ret[0] = LoRabbit_SendDataWithOptions(p_handle, 0x0002, 0, p_data, DTC_TRANSFER_SIZE,
+                                                                   &options);
+        free(p_data);
+    }
+    const SimNodeStats_t *p_stats = sim_node_stats(p_context->p_node);
+    p_context->p_result->value[DTC_VALUE_TX_IRQ] = p_stats->uart_rx_irq_count;
+    p_context->p_result->value[DTC_VALUE_TX_BYTES] = p_stats->uart_rx_byte_count;
+    s_is_sender_done = true;
+    tk_ext_tsk();
+}
+
+static void dtc_receive_frames(DtcContext_t *p_context, LoraHandle_t *p_handle) {
+    SimTrialResult_t *p_result = p_context->p_result;
+    bool is_received[DTC_FRAME_COUNT] = {false};
+    while (!s_is_sender_done) {
+        RecvFrameE220900T22SJP_t frame;
+        if (DTC_FRAME_SIZE != LoRabbit_ReceiveFrame(p_handle, &frame, SIM_RECEIVE_POLL_MS)) {
+            continue;
+        }
+        int index = frame.recv_data[0];
+        if (index >= DTC_FRAME_COUNT || is_received[index] ||
+            !sim_check_pattern(&frame.recv_data[1], DTC_FRAME_SIZE - 1,
+                               p_context->p_params->seed * DTC_FRAME_COUNT + (uint32_t)index)) {
+            continue;
+        }
+        is_received[index] = true;
+        p_result->value[DTC_VALUE_FRAMES] += 1.0;
+        double latency_ms = (double)(sim_now_us() - s_sent_us[index]) / 1000.0;
+        if (latency_ms > p_result->value[DTC_VALUE_LATENCY_MS]) {
+            p_result->value[DTC_VALUE_LATENCY_MS] = latency_ms;
+        }
+    }
+    p_result->is_ok = (DTC_FRAME_COUNT == p_result->value[DTC_VALUE_FRAMES]);
+}
+
+static void dtc_receiver_task(INT stacd, void *exinf) {
+    (void)stacd;
+    DtcContext_t *p_context = (DtcContext_t *)exinf;
+    const DtcParams_t *p_params = p_context->p_params;
+    SimTrialResult_t *p_result = p_context->p_result;
+    LoraHandle_t *p_handle = dtc_boot(p_context, 0x0002);
+
+    if (p_params->is_frames) {
+        dtc_receive_frames(p_context, p_handle);
+    } else {
+        uint8_t *p_buffer = calloc(1, DTC_TRANSFER_SIZE + 200);
+        uint32_t received_size = 0;
+        uint64_t done_us = 0;
+        int ret = sim_receive_data_until_done(p_handle, p_buffer, DTC_TRANSFER_SIZE + 200, &received_size,
+                                              DTC_RX_TIMEOUT_MS, &s_is_sender_done, &done_us);
+        p_result->elapsed_us = done_us - p_result->start_us;
+        p_result->is_ok = (LORABBIT_OK == ret && DTC_TRANSFER_SIZE == received_size &&
+                           sim_check_pattern(p_buffer, received_size, p_params->seed));
+        free(p_buffer);
+    }
+    const SimNodeStats_t *p_stats = sim_node_stats(p_context->p_node);
+    p_result->value[DTC_VALUE_RX_IRQ] = p_stats->uart_rx_irq_count;
+    p_result->value[DTC_VALUE_RX_BYTES] = p_stats->uart_rx_byte_count;
+    tk_ext_tsk();
+}
+
+static void dtc_trial(const void *p_params, SimTrialResult_t *p_result) {
+    const DtcParams_t *p = (const DtcParams_t *)p_params;
+    SimChannelModel_t model = {.frame_loss = p->frame_loss};
+    sim_e220_init(&model);
+    DtcContext_t sender = {p, sim_node_create(true), p_result};
+    DtcContext_t receiver = {p, sim_node_create(true), p_result};
+    sim_start_task(dtc_sender_task, &sender, SIM_TASK_PRIORITY);
+    sim_start_task(dtc_receiver_task, &receiver, SIM_TASK_PRIORITY);
+    sim_trial_run(p_result);
+    p_result->is_ok = p_result->is_ok && SIM_RUN_DONE == p_result->run_result && LORABBIT_OK == p_result->ret[0];
+}
+
+static void dtc_run(const DtcParams_t *p_params, SimSummary_t *p_summary, char *p_ok_text, char *p_rx_text,
+                    char *p_tx_text) {
+    DtcParams_t params = *p_params;
+    for (int seed = 1; seed <= g_sim_seeds; seed++) {
+        params.seed = (uint32_t)seed;
+        SimTrialResult_t result;
+        if (!sim_trial(dtc_trial, &params, (uint32_t)seed, &result)) {
+            result.is_ok = false;
+        }
+        sim_summary_add(p_summary, &result);
+    }
+    snprintf(p_ok_text, 16, "%d/%d", p_summary->ok_count, p_summary->trials);
+    snprintf(p_rx_text, 32, "%.0f/%.0f", sim_summary_mean(p_summary, p_summary->sum[DTC_VALUE_RX_IRQ]),
+             sim_summary_mean(p_summary, p_summary->sum[DTC_VALUE_RX_BYTES]));
+    snprintf(p_tx_text, 32, "%.0f/%.0f", sim_summary_mean(p_summary, p_summary->sum[DTC_VALUE_TX_IRQ]),
+             sim_summary_mean(p_summary, p_summary->sum[DTC_VALUE_TX_BYTES]));
+}
+
+void scenario_dtc(void) {
+    char ok_text[16];
+    char rx_text[32];
+    char tx_text[32];
+    printf("%-8s %-4s %-5s %-9s %8s %14s %12s\n", "case", "dtc", "loss", "ok/trials", "time_ms", "rx_irq/bytes",
+           "tx_irq/bytes");
+    static const double s_losses[] = {0.0, 0.10};
+    for (size_t l = 0; l < sizeof(s_losses) / sizeof(s_losses[0]); l++) {
+        for (int use_dtc = 0; use_dtc <= 1; use_dtc++) {
+            DtcParams_t params = {(1 == use_dtc), false, s_losses[l], 0};
+            SimSummary_t summary = {0};
+            dtc_run(&params, &summary, ok_text, rx_text, tx_text);
+            printf("%-8s %-4s %3.0f%%  %-9s %8.0f %14s %12s\n", "transfer", use_dtc ? "on" : "off",
+                   s_losses[l] * 100, ok_text, sim_summary_mean(&summary, summary.elapsed_ms_sum), rx_text, tx_text);
+        }
+    }
+
+    printf("%-8s %-4s %-9s %8s %10s %14s\n", "case", "dtc", "ok/trials", "frames", "latency_ms", "rx_irq/bytes");
+    for (int use_dtc = 0; use_dtc <= 1; use_dtc++) {
+        DtcParams_t params = {(1 == use_dtc), true, 0.0, 0};
+        SimSummary_t summary = {0};
+        dtc_run(&params, &summary, ok_text, rx_text, tx_text);
+        printf("%-8s %-4s %-9s %8.1f %10.0f %14s\n", "frames", use_dtc ? "on" : "off", ok_text,
+               sim_summary_mean(&summary, summary.sum[DTC_VALUE_FRAMES]),
+               sim_summary_mean(&summary, summary.sum[DTC_VALUE_LATENCY_MS]), rx_text);
+    }
+}
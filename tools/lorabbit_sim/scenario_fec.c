@@ -0,0 +1,120 @@
+/**
+ * @file scenario_fec.c
+ * @brief FECの冗長度と損失率によるグッドプット
+ * @details 5000バイトのバースト送信の完了時間を、冗長パケットの割合 (fec_redundancy_percent) と損失率を変えて比べます。
+ * 両方向の全フレームが独立に指定の確率で失われます。ACKのタイムアウトを待つため、AUXピンをつないだ端末を使います。
+ * 完了時間は送信開始から受信側の LoRabbit_ReceiveData() が全データを返すまで、
+ * グッドプットはデータサイズを平均完了時間で割った値です。受信側がデータを受信できた試行を成功とします。
+ */
+#include "scenarios.h"
+#include "sim_scenario.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define FEC_SIZE          5000
+#define FEC_RX_TIMEOUT_MS 120000
+
+static volatile bool s_is_sender_done; // 試行ごとに子プロセスで初期化される
+
+typedef struct {
+    uint8_t  redundancy_percent;
+    double   frame_loss;
+    uint32_t seed;
+} FecParams_t;
+
+typedef struct {
+    const FecParams_t *p_params;
+    SimNode_t *p_node;
+    SimTrialResult_t *p_result;
+} FecContext_t;
+
+static void fec_sender_task(INT stacd, void *exinf) {
+    (void)stacd;
+    FecContext_t *p_context = (FecContext_t *)exinf;
+    const FecParams_t *p_params = p_context->p_params;
+    LoraConfigItem_t config = sim_default_config(0x0001, LORA_AIR_DATA_RATE_21875_BPS_SF_7_BW_500);
+    sim_node_boot(p_context->p_node, &config);
+    tk_dly_tsk(SIM_BOOT_SETTLE_MS);
+
+    uint8_t *p_data = malloc(FEC_SIZE);
+    sim_fill_pattern(p_data, FEC_SIZE, p_params->seed);
+    LoRabbit_SendOptions_t options = {
+        .mode = LORABBIT_TP_MODE_BURST,
+        .fec_redundancy_percent = p_params->redundancy_percent,
+    };
+    p_context->p_result->start_us = sim_now_us();
+    p_context->p_result->ret[0] = LoRabbit_SendDataWithOptions(sim_node_handle(p_context->p_node), 0x0002, 0,
+                                                               p_data, FEC_SIZE, &options);
+    s_is_sender_done = true;
+    free(p_data);
+    tk_ext_tsk();
+}
+
+static void fec_receiver_task(INT stacd, void *exinf) {
+    (void)stacd;
+    FecContext_t *p_context = (FecContext_t *)exinf;
+    const FecParams_t *p_params = p_context->p_params;
+    SimTrialResult_t *p_result = p_context->p_result;
+    LoraConfigItem_t config = sim_default_config(0x0002, LORA_AIR_DATA_RATE_21875_BPS_SF_7_BW_500);
+    sim_node_boot(p_context->p_node, &config);
+
+    uint8_t *p_buffer = calloc(1, FEC_SIZE + 200);
+    uint32_t received_size = 0;
+    uint64_t done_us = 0;
+    int ret = sim_receive_data_until_done(sim_node_handle(p_context->p_node), p_buffer, FEC_SIZE + 200,
+                                          &received_size, FEC_RX_TIMEOUT_MS, &s_is_sender_done, &done_us);
+    p_result->ret[1] = ret;
+    p_result->elapsed_us = done_us - p_result->start_us;
+    p_result->is_ok = (LORABBIT_OK == ret && FEC_SIZE == received_size &&
+                       sim_check_pattern(p_buffer, received_size, p_params->seed));
+    free(p_buffer);
+    tk_ext_tsk();
+}
+
+static void fec_trial(const void *p_params, SimTrialResult_t *p_result) {
+    const FecParams_t *p = (const FecParams_t *)p_params;
+    SimChannelModel_t model = {.frame_loss = p->frame_loss};
+    sim_e220_init(&model);
+    FecContext_t sender = {p, sim_node_create(true), p_result};
+    FecContext_t receiver = {p, sim_node_create(true), p_result};
+    sim_start_task(fec_sender_task, &sender, SIM_TASK_PRIORITY);
+    sim_start_task(fec_receiver_task, &receiver, SIM_TASK_PRIORITY);
+    sim_trial_run(p_result);
+    p_result->is_ok = p_result->is_ok && SIM_RUN_DONE == p_result->run_result;
+}
+
+void scenario_fec(void) {
+    static const double s_losses[] = {0.0, 0.05, 0.10, 0.20, 0.30};
+    static const uint8_t s_redundancies[] = {0, 10, 25, 50};
+    printf("%-5s %-10s %-9s %-9s %9s %9s %13s\n", "loss", "redundancy", "rx_ok", "tx_ok", "mean_ms", "max_ms",
+           "goodput_kbps");
+    for (size_t l = 0; l < sizeof(s_losses) / sizeof(s_losses[0]); l++) {
+        for (size_t r = 0; r < sizeof(s_redundancies) / sizeof(s_redundancies[0]); r++) {
+            FecParams_t params = {s_redundancies[r], s_losses[l], 0};
+            SimSummary_t summary = {0};
+            int tx_ok_count = 0;
+            double max_ms = 0.0;
+            for (int seed = 1; seed <= g_sim_seeds; seed++) {
+                params.seed = (uint32_t)seed;
+                SimTrialResult_t result;
+                if (!sim_trial(fec_trial, &params, (uint32_t)seed, &result)) {
+                    result.is_ok = false;
+                }
+                sim_summary_add(&summary, &result);
+                if (result.is_ok) {
+                    tx_ok_count += (LORABBIT_OK == result.ret[0]) ? 1 : 0;
+                    double elapsed_ms = (double)result.elapsed_us / 1000.0;
+                    max_ms = (elapsed_ms > max_ms) ? elapsed_ms : max_ms;
+                }
+            }
+            double mean_ms = sim_summary_mean(&summary, summary.elapsed_ms_sum);
+            char rx_ok_text[16];
+            char tx_ok_text[16];
+            snprintf(rx_ok_text, sizeof(rx_ok_text), "%d/%d", summary.ok_count, summary.trials);
+            snprintf(tx_ok_text, sizeof(tx_ok_text), "%d/%d", tx_ok_count, summary.trials);
+            printf("%3.0f%%  %3u%%       %-9s %-9s %9.0f %9.0f %13.1f\n", s_losses[l] * 100,
+                   (unsigned)s_redundancies[r], rx_ok_text, tx_ok_text, mean_ms, max_ms,
+                   (mean_ms > 0.0) ? FEC_SIZE * 8.0 / mean_ms : 0.0);
+        }
+    }
+}
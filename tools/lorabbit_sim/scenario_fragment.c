@@ -0,0 +1,240 @@
+/**
+ * @file scenario_fragment.c
+ * @brief パケット長の自動選択
+ * @details 前半は6000バイト (payload_size が32バイトでも LORABBIT_TP_MAX_PACKETS の初期値 255 に収まるサイズ) のウィンドウ送信で、
+ * 空中データレートと payload_size ごとに選ばれたパケット長と両方向の全フレームのエアタイムの合計を表示します。損失はありません。
+ * 後半は1バイトあたりの誤り率が一定の (長いフレームほど失われやすい) リンクで、10000バイトの転送を
+ * 8回続け、2回目以降の平均を、損失率の推定を使う場合と使わない場合 (毎回推定値を消す) で比べます。
+ * 全ての転送を受信側が受信でき、送信側も成功を返した試行を成功とします。
+ */
+#include "scenarios.h"
+#include "sim_scenario.h"
+#include "LoRabbit_internal.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define FRAGMENT_SIZE           6000
+#define FRAGMENT_WINDOW_SIZE    8
+#define FRAGMENT_RX_TIMEOUT_MS  600000
+#define FRAGMENT_LOSSY_SIZE     10000
+#define FRAGMENT_LOSSY_TRANSFERS 8
+#define FRAGMENT_LOSSY_GAP_MS   3000 // 受信側が前の転送の再送を待つのをやめるまでの間隔 (SIM_RECEIVE_POLL_MS より長く)
+#define FRAGMENT_REFERENCE_FRAME 197 // 損失率を表示するフレーム長
+#define FRAGMENT_FRAME_OVERHEAD  11  // データフレームのうち、送信先指定 (3バイト) とヘッダ (8バイト) の長さ
+
+static volatile bool s_is_sent[FRAGMENT_LOSSY_TRANSFERS]; // 試行ごとに子プロセスで初期化される
+
+typedef struct {
+    LoraAirDateRate_t air_data_rate;
+    LoraPayloadSize_t payload_size;
+    LoRabbit_TpMode_t mode;
+    double   byte_error_rate;
+    bool     use_loss_estimate;
+    int      transfer_count;
+    uint32_t size;
+    uint32_t seed;
+} FragmentParams_t;
+
+typedef struct {
+    const FragmentParams_t *p_params;
+    SimNode_t *p_node;
+    SimTrialResult_t *p_result;
+} FragmentContext_t;
+
+// 試行の値の位置
+enum {
+    FRAGMENT_VALUE_LENGTH,      // 最後の転送のパケット長
+    FRAGMENT_VALUE_PACKETS,     // 最後の転送のパケット数
+    FRAGMENT_VALUE_AIRTIME_MS,  // 2回目以降の転送のエアタイムの平均
+    FRAGMENT_VALUE_TRANSFER_MS, // 2回目以降の転送時間の平均
+};
+
+static void fragment_sender_task(INT stacd, void *exinf) {
+    (void)stacd;
+    FragmentContext_t *p_context = (FragmentContext_t *)exinf;
+    const FragmentParams_t *p_params = p_context->p_params;
+    SimTrialResult_t *p_result = p_context->p_result;
+    LoraConfigItem_t config = sim_default_config(0x0001, p_params->air_data_rate);
+    config.payload_size = p_params->payload_size;
+    sim_node_boot(p_context->p_node, &config);
+    tk_dly_tsk(SIM_BOOT_SETTLE_MS);
+
+    LoraHandle_t *p_handle = sim_node_handle(p_context->p_node);
+    uint8_t *p_data = malloc(p_params->size);
+    LoRabbit_SendOptions_t options = {
+        .mode = p_params->mode,
+        .window_size = FRAGMENT_WINDOW_SIZE,
+    };
+    double airtime_ms_sum = 0.0;
+    double transfer_ms_sum = 0.0;
+    int ret = LORABBIT_OK;
+    p_result->start_us = sim_now_us();
+    for (int k = 0; k < p_params->transfer_count && LORABBIT_OK == ret; k++) {
+        if (k > 0) {
+            tk_dly_tsk(FRAGMENT_LOSSY_GAP_MS);
+        }
+        if (!p_params->use_loss_estimate) {
+            lora_link_get(p_handle, 0x0002)->data_loss_permille = 0;
+        }
+        sim_fill_pattern(p_data, p_params->size, p_params->seed + (uint32_t)k);
+        uint64_t start_us = sim_now_us();
+        uint64_t start_airtime_us = sim_total_airtime_us();
+        ret = LoRabbit_SendDataWithOptions(p_handle, 0x0002, 0, p_data, p_params->size, &options);
+        if (k > 0 || 1 == p_params->transfer_count) {
+            airtime_ms_sum += (double)(sim_total_airtime_us() - start_airtime_us) / 1000.0;
+            transfer_ms_sum += (double)(sim_now_us() - start_us) / 1000.0;
+        }
+        s_is_sent[k] = true;
+    }
+    // 選ばれたパケット長は、送信側が損失率とともに記録したデータフレームの長さから求める
+    // (255パケット以下の転送なので、ヘッダは通常の8バイト)
+    const LoRabbit_PeerLink_t *p_link = lora_link_find(p_handle, 0x0002);
+    if (NULL != p_link && p_link->data_frame_size > FRAGMENT_FRAME_OVERHEAD) {
+        uint32_t length = p_link->data_frame_size - FRAGMENT_FRAME_OVERHEAD;
+        p_result->value[FRAGMENT_VALUE_LENGTH] = length;
+        p_result->value[FRAGMENT_VALUE_PACKETS] = (p_params->size + length - 1) / length;
+    }
+    const int measured_count = (p_params->transfer_count > 1) ? p_params->transfer_count - 1 : 1;
+    p_result->ret[0] = ret;
+    p_result->value[FRAGMENT_VALUE_AIRTIME_MS] = airtime_ms_sum / measured_count;
+    p_result->value[FRAGMENT_VALUE_TRANSFER_MS] = transfer_ms_sum / measured_count;
+    free(p_data);
+    tk_ext_tsk();
+}
+
+static void fragment_receiver_task(INT stacd, void *exinf) {
+    (void)stacd;
+    FragmentContext_t *p_context = (FragmentContext_t *)exinf;
+    const FragmentParams_t *p_params = p_context->p_params;
+    SimTrialResult_t *p_result = p_context->p_result;
+    LoraConfigItem_t config = sim_default_config(0x0002, p_params->air_data_rate);
+    config.payload_size = p_params->payload_size;
+    sim_node_boot(p_context->p_node, &config);
+
+    LoraHandle_t *p_handle = sim_node_handle(p_context->p_node);
+    uint8_t *p_buffer = calloc(1, p_params->size + 200);
+    bool is_ok = true;
+    for (int k = 0; k < p_params->transfer_count && is_ok; k++) {
+        uint32_t received_size = 0;
+        uint64_t done_us = 0;
+        int ret = sim_receive_data_until_done(p_handle, p_buffer, p_params->size + 200, &received_size,
+                                              FRAGMENT_RX_TIMEOUT_MS, &s_is_sent[k], &done_us);
+        is_ok = (LORABBIT_OK == ret && p_params->size == received_size &&
+                 sim_check_pattern(p_buffer, received_size, p_params->seed + (uint32_t)k));
+    }
+    p_result->is_ok = is_ok;
+    free(p_buffer);
+    tk_ext_tsk();
+}
+
+static void fragment_trial(const void *p_params, SimTrialResult_t *p_result) {
+    const FragmentParams_t *p = (const FragmentParams_t *)p_params;
+    SimChannelModel_t model = {.byte_error_rate = p->byte_error_rate};
+    sim_e220_init(&model);
+    FragmentContext_t sender = {p, sim_node_create(true), p_result};
+    FragmentContext_t receiver = {p, sim_node_create(true), p_result};
+    sim_start_task(fragment_sender_task, &sender, SIM_TASK_PRIORITY);
+    sim_start_task(fragment_receiver_task, &receiver, SIM_TASK_PRIORITY);
+    sim_trial_run(p_result);
+    p_result->is_ok = p_result->is_ok && LORABBIT_OK == p_result->ret[0] && SIM_RUN_DONE == p_result->run_result;
+}
+
+// 1つの条件の試行を全シードで実行して集計するヘルパー関数（内部利用）
+static void fragment_run(FragmentParams_t *p_params, SimSummary_t *p_summary) {
+    for (int seed = 1; seed <= g_sim_seeds; seed++) {
+        p_params->seed = (uint32_t)seed;
+        SimTrialResult_t result;
+        if (!sim_trial(fragment_trial, p_params, (uint32_t)seed, &result)) {
+            result.is_ok = false;
+        }
+        sim_summary_add(p_summary, &result);
+    }
+}
+
+// payload_size ごとに選ばれるパケット長を表示するヘルパー関数（内部利用）
+static void fragment_print_lengths(void) {
+    static const struct {
+        LoraAirDateRate_t air_data_rate;
+        const char *p_name;
+    } s_rates[] = {
+        {LORA_AIR_DATA_RATE_62500_BPS_SF_5_BW_500, "SF5/500"},
+        {LORA_AIR_DATA_RATE_10938_BPS_SF_7_BW_250, "SF7/250"},
+        {LORA_AIR_DATA_RATE_1758_BPS_SF_9_BW_125, "SF9/125"},
+    };
+    static const struct {
+        LoraPayloadSize_t payload_size;
+        int bytes;
+    } s_payload_sizes[] = {
+        {LORA_PAYLOAD_SIZE_200_BYTE, 200},
+        {LORA_PAYLOAD_SIZE_128_BYTE, 128},
+        {LORA_PAYLOAD_SIZE_64_BYTE, 64},
+        {LORA_PAYLOAD_SIZE_32_BYTE, 32},
+    };
+    printf("%-9s %-12s %-9s %8s %8s %11s\n", "rate", "payload_size", "ok", "length", "packets", "airtime_ms");
+    for (size_t r = 0; r < sizeof(s_rates) / sizeof(s_rates[0]); r++) {
+        for (size_t p = 0; p < sizeof(s_payload_sizes) / sizeof(s_payload_sizes[0]); p++) {
+            FragmentParams_t params = {
+                .air_data_rate = s_rates[r].air_data_rate,
+                .payload_size = s_payload_sizes[p].payload_size,
+                .mode = LORABBIT_TP_MODE_WINDOW,
+                .use_loss_estimate = true,
+                .transfer_count = 1,
+                .size = FRAGMENT_SIZE,
+            };
+            SimSummary_t summary = {0};
+            fragment_run(&params, &summary);
+            char ok_text[16];
+            snprintf(ok_text, sizeof(ok_text), "%d/%d", summary.ok_count, summary.trials);
+            printf("%-9s %-12d %-9s %8.0f %8.0f %11.0f\n", s_rates[r].p_name, s_payload_sizes[p].bytes, ok_text,
+                   sim_summary_mean(&summary, summary.sum[FRAGMENT_VALUE_LENGTH]),
+                   sim_summary_mean(&summary, summary.sum[FRAGMENT_VALUE_PACKETS]),
+                   sim_summary_mean(&summary, summary.sum[FRAGMENT_VALUE_AIRTIME_MS]));
+        }
+    }
+}
+
+// 損失のあるリンクで、損失率の推定の有無を比べるヘルパー関数（内部利用）
+static void fragment_print_lossy(void) {
+    static const LoRabbit_TpMode_t s_modes[] = {LORABBIT_TP_MODE_WINDOW, LORABBIT_TP_MODE_BURST};
+    static const char *const s_mode_names[] = {"window", "burst"};
+    static const double s_byte_error_rates[] = {0.0003, 0.002, 0.004};
+    printf("%-7s %-9s %-9s %-9s %7s %7s %10s %10s %11s %11s\n", "mode", "loss@197", "ok", "ok_est", "length",
+           "len_est", "airtime", "air_est", "transfer", "xfer_est");
+    for (size_t m = 0; m < sizeof(s_modes) / sizeof(s_modes[0]); m++) {
+        for (size_t e = 0; e < sizeof(s_byte_error_rates) / sizeof(s_byte_error_rates[0]); e++) {
+            FragmentParams_t params = {
+                .air_data_rate = LORA_AIR_DATA_RATE_21875_BPS_SF_7_BW_500,
+                .payload_size = LORA_PAYLOAD_SIZE_200_BYTE,
+                .mode = s_modes[m],
+                .byte_error_rate = s_byte_error_rates[e],
+                .use_loss_estimate = false,
+                .transfer_count = FRAGMENT_LOSSY_TRANSFERS,
+                .size = FRAGMENT_LOSSY_SIZE,
+            };
+            SimSummary_t plain = {0};
+            SimSummary_t estimated = {0};
+            fragment_run(&params, &plain);
+            params.use_loss_estimate = true;
+            fragment_run(&params, &estimated);
+            char ok_text[16];
+            char ok_estimated_text[16];
+            snprintf(ok_text, sizeof(ok_text), "%d/%d", plain.ok_count, plain.trials);
+            snprintf(ok_estimated_text, sizeof(ok_estimated_text), "%d/%d", estimated.ok_count, estimated.trials);
+            printf("%-7s %7.0f%%  %-9s %-9s %7.0f %7.0f %10.0f %10.0f %11.0f %11.0f\n", s_mode_names[m],
+                   (1.0 - pow(1.0 - s_byte_error_rates[e], FRAGMENT_REFERENCE_FRAME)) * 100, ok_text,
+                   ok_estimated_text, sim_summary_mean(&plain, plain.sum[FRAGMENT_VALUE_LENGTH]),
+                   sim_summary_mean(&estimated, estimated.sum[FRAGMENT_VALUE_LENGTH]),
+                   sim_summary_mean(&plain, plain.sum[FRAGMENT_VALUE_AIRTIME_MS]),
+                   sim_summary_mean(&estimated, estimated.sum[FRAGMENT_VALUE_AIRTIME_MS]),
+                   sim_summary_mean(&plain, plain.sum[FRAGMENT_VALUE_TRANSFER_MS]),
+                   sim_summary_mean(&estimated, estimated.sum[FRAGMENT_VALUE_TRANSFER_MS]));
+        }
+    }
+}
+
+void scenario_fragment(void) {
+    fragment_print_lengths();
+    printf("\n");
+    fragment_print_lossy();
+}
@@ -0,0 +1,176 @@
+/**
+ * @file scenario_lbt.c
+ * @brief 送信前のキャリアセンス (LORABBIT_USE_LBT) による送信の延期
+ * @details 同じチャンネルで、妨害側 (0x0030) が100バイトのフレームを150〜350ミリ秒の間隔で送り続け、
+ * 試験側 (0x0010) が20バイトのフレームを LoRabbit_SendFrame() で40回送ります。宛先はそれぞれ別の受信側
+ * (0x0031 と 0x0011) で、LoRabbit_ReceiveFrame() で受け取ったフレームを数えます。
+ * LORABBIT_USE_LBT を有効にした lorabbit_sim_lbt で、試験側のモジュールの設定の rssi_ambient_noise_flag を
+ * 無効 (キャリアセンスなし) にした場合と有効にした場合で、両方のフレームが届いた数と、試験側のキャリアセンスの
+ * 統計 (LoRabbit_GetLbtStats()) を比べます。妨害側はキャリアセンスをしません。
+ * 損失はなく、フレームが失われるのは送信の重なりだけです。
+ * 受信のタイムアウトで送信側の終了を確かめるため、AUXピンをつないだ端末で動かします。
+ * 試験側の全ての送信が、成功か LORABBIT_ERROR_CHANNEL_BUSY (送信しなかった) を返し、
+ * 成功を返した数が試験側の送信したフレームの数と一致した試行を成功とします。
+ */
+#include "scenarios.h"
+#include "sim_scenario.h"
+#include <stdio.h>
+
+#ifdef LORABBIT_USE_LBT
+#include <string.h>
+
+#define LBT_FRAME_COUNT      40  /**< 試験側が送るフレームの数 */
+#define LBT_FRAME_SIZE       20
+#define LBT_INTERVAL_MIN_MS  100 /**< 試験側の送信の間隔 (この値から2倍までの間でランダム) */
+#define LBT_NOISE_SIZE       100
+#define LBT_NOISE_GAP_MIN_MS 150 /**< 妨害側の送信の間隔 (この値から200ミリ秒長い値までの間でランダム) */
+
+#define LBT_VALUE_SENT           0 /**< value[]: 試験側の送信が成功を返した数 */
+#define LBT_VALUE_BUSY           1 /**< value[]: 試験側の送信が LORABBIT_ERROR_CHANNEL_BUSY を返した数 */
+#define LBT_VALUE_RECEIVED       2 /**< value[]: 試験側のフレームが届いた数 */
+#define LBT_VALUE_NOISE_SENT     3 /**< value[]: 妨害側が送ったフレームの数 */
+#define LBT_VALUE_NOISE_RECEIVED 4 /**< value[]: 妨害側のフレームが届いた数 */
+#define LBT_VALUE_DEFERRED       5 /**< value[]: 試験側が使用中のため送信を遅らせたフレームの数 (LoRabbit_GetLbtStats()) */
+#define LBT_VALUE_BACKOFF_MS     6 /**< value[]: 試験側がバックオフで待った時間の合計 (ミリ秒) */
+#define LBT_VALUE_TX_FRAMES      7 /**< value[]: 試験側の端末が送信したフレームの数 */
+
+static volatile bool s_is_sender_done; // 試行ごとに子プロセスで初期化される
+
+typedef struct {
+    bool     use_lbt; // 試験側で rssi_ambient_noise_flag を有効にして、送信前にチャンネルを確かめるか
+    uint32_t seed;
+} LbtParams_t;
+
+typedef struct {
+    const LbtParams_t *p_params;
+    SimNode_t *p_node;
+    SimTrialResult_t *p_result;
+    uint16_t address;
+    int value_index; // 受信側が、届いたフレームを数える value[] の添字
+} LbtContext_t;
+
+static LoraHandle_t *lbt_boot(LbtContext_t *p_context, bool use_lbt) {
+    LoraConfigItem_t config = sim_default_config(p_context->address, LORA_AIR_DATA_RATE_5469_BPS_SF_7_BW_125);
+    config.rssi_ambient_noise_flag = use_lbt ? LORA_FLAG_ENABLED : LORA_FLAG_DISABLED;
+    sim_node_boot(p_context->p_node, &config);
+    return sim_node_handle(p_context->p_node);
+}
+
+static void lbt_sender_task(INT stacd, void *exinf) {
+    (void)stacd;
+    LbtContext_t *p_context = (LbtContext_t *)exinf;
+    double *p_value = p_context->p_result->value;
+    LoraHandle_t *p_handle = lbt_boot(p_context, p_context->p_params->use_lbt);
+    tk_dly_tsk(SIM_BOOT_SETTLE_MS);
+
+    uint8_t frame[LBT_FRAME_SIZE];
+    for (int i = 0; i < LBT_FRAME_COUNT; i++) {
+        tk_dly_tsk(LBT_INTERVAL_MIN_MS + (RELTIM)(sim_random() * LBT_INTERVAL_MIN_MS));
+        sim_fill_pattern(frame, sizeof(frame), p_context->p_params->seed * 100 + (uint32_t)i);
+        int ret = LoRabbit_SendFrame(p_handle, 0x0011, 0, frame, sizeof(frame));
+        if (LORABBIT_OK == ret) {
+            p_value[LBT_VALUE_SENT] += 1.0;
+        } else if (LORABBIT_ERROR_CHANNEL_BUSY == ret) {
+            p_value[LBT_VALUE_BUSY] += 1.0;
+        }
+    }
+    // 最後のフレームが届くのを待つ
+    tk_dly_tsk(SIM_RECEIVE_POLL_MS);
+
+    LoRabbit_LbtStats_t stats;
+    LoRabbit_GetLbtStats(p_handle, &stats);
+    p_value[LBT_VALUE_DEFERRED] = (double)stats.deferred_count;
+    p_value[LBT_VALUE_BACKOFF_MS] = (double)stats.total_backoff_ms;
+    p_value[LBT_VALUE_TX_FRAMES] = (double)sim_node_stats(p_context->p_node)->tx_frame_count;
+    s_is_sender_done = true;
+    tk_ext_tsk();
+}
+
+// キャリアセンスをせずに、フレームを送り続けるタスク
+static void lbt_noise_task(INT stacd, void *exinf) {
+    (void)stacd;
+    LbtContext_t *p_context = (LbtContext_t *)exinf;
+    LoraHandle_t *p_handle = lbt_boot(p_context, false);
+    tk_dly_tsk((RELTIM)(sim_random() * SIM_BOOT_SETTLE_MS));
+
+    uint8_t frame[LBT_NOISE_SIZE];
+    memset(frame, 0x55, sizeof(frame));
+    while (!s_is_sender_done) {
+        if (LORABBIT_OK == LoRabbit_SendFrame(p_handle, 0x0031, 0, frame, sizeof(frame))) {
+            p_context->p_result->value[LBT_VALUE_NOISE_SENT] += 1.0;
+        }
+        tk_dly_tsk(LBT_NOISE_GAP_MIN_MS + (RELTIM)(sim_random() * 200));
+    }
+    tk_ext_tsk();
+}
+
+static void lbt_receiver_task(INT stacd, void *exinf) {
+    (void)stacd;
+    LbtContext_t *p_context = (LbtContext_t *)exinf;
+    LoraHandle_t *p_handle = lbt_boot(p_context, false);
+    while (!s_is_sender_done) {
+        RecvFrameE220900T22SJP_t frame;
+        if (LoRabbit_ReceiveFrame(p_handle, &frame, SIM_RECEIVE_POLL_MS) > 0) {
+            p_context->p_result->value[p_context->value_index] += 1.0;
+        }
+    }
+    tk_ext_tsk();
+}
+
+static void lbt_trial(const void *p_params, SimTrialResult_t *p_result) {
+    const LbtParams_t *p = (const LbtParams_t *)p_params;
+    SimChannelModel_t model = {0};
+    sim_e220_init(&model);
+    LbtContext_t sender = {p, sim_node_create(true), p_result, 0x0010, 0};
+    LbtContext_t receiver = {p, sim_node_create(true), p_result, 0x0011, LBT_VALUE_RECEIVED};
+    LbtContext_t noise = {p, sim_node_create(true), p_result, 0x0030, 0};
+    LbtContext_t noise_receiver = {p, sim_node_create(true), p_result, 0x0031, LBT_VALUE_NOISE_RECEIVED};
+    sim_start_task(lbt_sender_task, &sender, SIM_TASK_PRIORITY);
+    sim_start_task(lbt_receiver_task, &receiver, SIM_TASK_PRIORITY);
+    sim_start_task(lbt_noise_task, &noise, SIM_TASK_PRIORITY);
+    sim_start_task(lbt_receiver_task, &noise_receiver, SIM_TASK_PRIORITY);
+    sim_trial_run(p_result);
+
+    const double *p_value = p_result->value;
+    p_result->is_ok = SIM_RUN_DONE == p_result->run_result &&
+                      LBT_FRAME_COUNT == p_value[LBT_VALUE_SENT] + p_value[LBT_VALUE_BUSY] &&
+                      p_value[LBT_VALUE_SENT] == p_value[LBT_VALUE_TX_FRAMES];
+}
+
+void scenario_lbt(void) {
+    printf("%-4s %-9s %9s %9s %9s %13s %9s %10s\n", "lbt", "ok/trials", "sent", "busy", "received", "noise_recv",
+           "deferred", "backoff_ms");
+    for (int use_lbt = 0; use_lbt <= 1; use_lbt++) {
+        LbtParams_t params = {(1 == use_lbt), 0};
+        SimSummary_t summary = {0};
+        double noise_sent_sum = 0.0;
+        for (int seed = 1; seed <= g_sim_seeds; seed++) {
+            params.seed = (uint32_t)seed;
+            SimTrialResult_t result;
+            if (!sim_trial(lbt_trial, &params, (uint32_t)seed, &result)) {
+                result.is_ok = false;
+            }
+            sim_summary_add(&summary, &result);
+            if (result.is_ok) {
+                noise_sent_sum += result.value[LBT_VALUE_NOISE_SENT];
+            }
+        }
+        char ok_text[16];
+        char noise_text[32];
+        snprintf(ok_text, sizeof(ok_text), "%d/%d", summary.ok_count, summary.trials);
+        snprintf(noise_text, sizeof(noise_text), "%.1f/%.1f",
+                 sim_summary_mean(&summary, summary.sum[LBT_VALUE_NOISE_RECEIVED]),
+                 sim_summary_mean(&summary, noise_sent_sum));
+        printf("%-4s %-9s %9.1f %9.1f %9.1f %13s %9.1f %10.0f\n", use_lbt ? "on" : "off", ok_text,
+               sim_summary_mean(&summary, summary.sum[LBT_VALUE_SENT]),
+               sim_summary_mean(&summary, summary.sum[LBT_VALUE_BUSY]),
+               sim_summary_mean(&summary, summary.sum[LBT_VALUE_RECEIVED]), noise_text,
+               sim_summary_mean(&summary, summary.sum[LBT_VALUE_DEFERRED]),
+               sim_summary_mean(&summary, summary.sum[LBT_VALUE_BACKOFF_MS]));
+    }
+}
+#else
+void scenario_lbt(void) {
+    fprintf(stderr, "lbt: run with lorabbit_sim_lbt\n");
+}
+#endif // LORABBIT_USE_LBT
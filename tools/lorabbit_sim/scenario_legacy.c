@@ -0,0 +1,135 @@
+/**
+ * @file scenario_legacy.c
+ * @brief 旧版の端末との相互接続
+ * @details 旧版 (sim_legacy.c) と現行版の組み合わせで、データが一致して届くことを確かめます。
+ * 最後のパケットが短くなるサイズと、189バイトちょうどで割り切れるサイズを含めます。
+ * tx_ms は送信側の API が戻るまで (ACKありなら最後のACKを受け取るまで)、rx_ms は受信側の API が戻るまでの時間です。
+ * 旧版どうしの結果も参考に出力します。旧版の受信も、AUXピンを使わない LoRabbit_ReceiveFrame() でフレームを受け取ります。
+ */
+#include "scenarios.h"
+#include "sim_legacy.h"
+#include "sim_scenario.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define LEGACY_BUFFER_SIZE (255 * SIM_LEGACY_MAX_PAYLOAD)
+
+typedef enum {
+    LEGACY_TO_CURRENT,       // 旧版の送信 -> LoRabbit_ReceiveData()
+    CURRENT_TO_LEGACY,       // LoRabbit_SendData() -> 旧版の受信
+    LEGACY_TO_LEGACY,        // 旧版どうし (比較のための参考)
+    LEGACY_DIRECTION_COUNT,
+} LegacyDirection_t;
+
+typedef struct {
+    LegacyDirection_t direction;
+    bool     request_ack;
+    uint32_t size;
+    LoraAirDateRate_t air_data_rate;
+    uint32_t seed;
+} LegacyParams_t;
+
+typedef struct {
+    const LegacyParams_t *p_params;
+    SimNode_t *p_node;
+    SimTrialResult_t *p_result;
+} LegacyContext_t;
+
+static void legacy_sender_task(INT stacd, void *exinf) {
+    (void)stacd;
+    LegacyContext_t *p_context = (LegacyContext_t *)exinf;
+    const LegacyParams_t *p_params = p_context->p_params;
+    LoraConfigItem_t config = sim_default_config(0x0001, p_params->air_data_rate);
+    sim_node_boot(p_context->p_node, &config);
+    tk_dly_tsk(SIM_BOOT_SETTLE_MS);
+
+    uint8_t *p_data = malloc(p_params->size);
+    sim_fill_pattern(p_data, p_params->size, p_params->seed);
+    LoraHandle_t *p_handle = sim_node_handle(p_context->p_node);
+    p_context->p_result->start_us = sim_now_us();
+    if (CURRENT_TO_LEGACY == p_params->direction) {
+        p_context->p_result->ret[0] = LoRabbit_SendData(p_handle, 0x0002, 0, p_data, p_params->size, p_params->request_ack);
+    } else {
+        p_context->p_result->ret[0] = sim_legacy_send_data(p_handle, 0x0002, 0, p_data, p_params->size, p_params->request_ack);
+    }
+    p_context->p_result->value[0] = (double)(sim_now_us() - p_context->p_result->start_us) / 1000.0;
+    free(p_data);
+    tk_ext_tsk();
+}
+
+static void legacy_receiver_task(INT stacd, void *exinf) {
+    (void)stacd;
+    LegacyContext_t *p_context = (LegacyContext_t *)exinf;
+    const LegacyParams_t *p_params = p_context->p_params;
+    SimTrialResult_t *p_result = p_context->p_result;
+    LoraConfigItem_t config = sim_default_config(0x0002, p_params->air_data_rate);
+    sim_node_boot(p_context->p_node, &config);
+
+    uint8_t *p_buffer = calloc(1, LEGACY_BUFFER_SIZE);
+    LoraHandle_t *p_handle = sim_node_handle(p_context->p_node);
+    uint32_t received_size = 0;
+    int ret;
+    if (CURRENT_TO_LEGACY == p_params->direction || LEGACY_TO_LEGACY == p_params->direction) {
+        ret = sim_legacy_receive_data(p_handle, p_buffer, LEGACY_BUFFER_SIZE, &received_size, 60000);
+    } else {
+        ret = LoRabbit_ReceiveData(p_handle, p_buffer, LEGACY_BUFFER_SIZE, &received_size, 60000);
+    }
+    p_result->ret[1] = ret;
+    p_result->elapsed_us = sim_now_us() - p_result->start_us;
+    p_result->is_ok = (LORABBIT_OK == ret && received_size == p_params->size &&
+                       sim_check_pattern(p_buffer, received_size, p_params->seed));
+    free(p_buffer);
+    tk_ext_tsk();
+}
+
+static void legacy_trial(const void *p_params, SimTrialResult_t *p_result) {
+    const LegacyParams_t *p = (const LegacyParams_t *)p_params;
+    SimChannelModel_t model = {0};
+    sim_e220_init(&model);
+    LegacyContext_t sender = {p, sim_node_create(false), p_result};
+    LegacyContext_t receiver = {p, sim_node_create(false), p_result};
+    sim_start_task(legacy_sender_task, &sender, SIM_TASK_PRIORITY);
+    sim_start_task(legacy_receiver_task, &receiver, SIM_TASK_PRIORITY);
+    sim_trial_run(p_result);
+    // 受信側の完了と、送信側の最後のACKの受信がともに成功していること
+    p_result->is_ok = p_result->is_ok && SIM_RUN_DONE == p_result->run_result && LORABBIT_OK == p_result->ret[0];
+}
+
+void scenario_legacy(void) {
+    static const char *const s_direction_names[] = {
+        "legacy -> ReceiveData",
+        "SendData -> legacy",
+        "legacy -> legacy (reference)",
+    };
+    static const uint32_t s_sizes[] = {50, 3 * SIM_LEGACY_MAX_PAYLOAD, 1000, 5000};
+    static const LoraAirDateRate_t s_rates[] = {
+        LORA_AIR_DATA_RATE_62500_BPS_SF_5_BW_500,
+        LORA_AIR_DATA_RATE_1758_BPS_SF_9_BW_125,
+    };
+    printf("%-28s %-4s %-5s %6s  %-9s %9s %9s\n", "direction", "ack", "rate", "size", "ok/trials", "tx_ms", "rx_ms");
+    for (int direction = 0; direction < LEGACY_DIRECTION_COUNT; direction++) {
+        for (int ack = 1; ack >= 0; ack--) {
+            for (size_t r = 0; r < sizeof(s_rates) / sizeof(s_rates[0]); r++) {
+                for (size_t s = 0; s < sizeof(s_sizes) / sizeof(s_sizes[0]); s++) {
+                    SimSummary_t summary = {0};
+                    for (int seed = 1; seed <= g_sim_seeds; seed++) {
+                        LegacyParams_t params = {
+                            (LegacyDirection_t)direction, ack != 0, s_sizes[s], s_rates[r], (uint32_t)seed,
+                        };
+                        SimTrialResult_t result;
+                        if (!sim_trial(legacy_trial, &params, (uint32_t)seed, &result)) {
+                            result.is_ok = false;
+                        }
+                        sim_summary_add(&summary, &result);
+                    }
+                    char ok_text[16];
+                    snprintf(ok_text, sizeof(ok_text), "%d/%d", summary.ok_count, summary.trials);
+                    printf("%-28s %-4s %-5s %6u  %-9s %9.0f %9.0f\n", s_direction_names[direction], ack ? "yes" : "no",
+                           (0 == r) ? "SF5" : "SF9", (unsigned)s_sizes[s], ok_text,
+                           sim_summary_mean(&summary, summary.sum[0]),
+                           sim_summary_mean(&summary, summary.elapsed_ms_sum));
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,206 @@
+/**
+ * @file scenario_length.c
+ * @brief AUXピンを使わない受信で、フレームの長さからフレームの終わりを判定する受信 (LoRabbit_ReceiveFrameWithLength())
+ * @details AUXピンをつながない端末どうしで動かします (SF5/500kHz)。
+ * - frames: 送信側が先頭1バイトにフレームの長さを書いた120〜180バイトのフレームを LoRabbit_SendFrame() で続けて
+ *   20個送ります。受信側が LoRabbit_ReceiveFrame() で受け取る場合と、LoRabbit_ReceiveFrameWithLength() で
+ *   先頭の長さを使って受け取る場合で、別々に受け取れたフレームの数と、送信の呼び出しから受け取るまでの時間を比べます。
+ *   全てのフレームを別々に受け取った試行を成功とします
+ * - transfer: 10000バイトの転送を、再送制御方式とヘッダ (通常とコンパクト) を変えて行います。
+ *   大容量データ転送はヘッダから求めた長さでフレームの終わりを判定します。損失率は 0% と 10% です。
+ *   受信側が全データを受信し、送信側も成功を返した試行を成功とします
+ */
+#include "scenarios.h"
+#include "sim_scenario.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define LENGTH_FRAME_COUNT     20
+#define LENGTH_FRAME_MIN_SIZE  120
+#define LENGTH_FRAME_SIZE_STEP 20
+#define LENGTH_FRAME_SIZE_KINDS 4   /**< フレームの長さは 120・140・160・180 バイトを順に使う */
+#define LENGTH_TRANSFER_SIZE   10000
+#define LENGTH_RX_TIMEOUT_MS   120000
+
+#define LENGTH_VALUE_FRAMES         0 /**< value[]: frames で受け取れたフレームの数 */
+#define LENGTH_VALUE_LATENCY_SUM_MS 1 /**< value[]: frames でフレームを送ってから受け取るまでの時間の合計 (ミリ秒) */
+#define LENGTH_VALUE_LATENCY_MS     2 /**< value[]: frames でフレームを送ってから受け取るまでの時間の最大値 (ミリ秒) */
+
+static volatile bool s_is_sender_done; // 試行ごとに子プロセスで初期化される
+static uint64_t s_sent_us[LENGTH_FRAME_COUNT];
+
+typedef struct {
+    bool              is_frames;   // false: transfer、true: frames
+    bool              use_length;  // frames: LoRabbit_ReceiveFrameWithLength() で受け取る
+    LoRabbit_TpMode_t mode;        // transfer: 再送制御方式
+    bool              use_compact; // transfer: コンパクトヘッダを使う
+    double            frame_loss;
+    uint32_t          seed;
+} LengthParams_t;
+
+typedef struct {
+    const LengthParams_t *p_params;
+    SimNode_t *p_node;
+    SimTrialResult_t *p_result;
+} LengthContext_t;
+
+// フレームの先頭1バイトに書いた長さを返す
+static int length_frame_length(const uint8_t *p_data, int len, void *p_context) {
+    (void)p_context;
+    return (len >= 1) ? p_data[0] : 0;
+}
+
+static LoraHandle_t *length_boot(LengthContext_t *p_context, uint16_t address) {
+    LoraConfigItem_t config = sim_default_config(address, LORA_AIR_DATA_RATE_62500_BPS_SF_5_BW_500);
+    sim_node_boot(p_context->p_node, &config);
+    return sim_node_handle(p_context->p_node);
+}
+
+static void length_sender_task(INT stacd, void *exinf) {
+    (void)stacd;
+    LengthContext_t *p_context = (LengthContext_t *)exinf;
+    const LengthParams_t *p_params = p_context->p_params;
+    LoraHandle_t *p_handle = length_boot(p_context, 0x0001);
+    tk_dly_tsk(SIM_BOOT_SETTLE_MS);
+
+    p_context->p_result->start_us = sim_now_us();
+    if (p_params->is_frames) {
+        for (int i = 0; i < LENGTH_FRAME_COUNT; i++) {
+            uint8_t frame[LENGTH_FRAME_MIN_SIZE + LENGTH_FRAME_SIZE_STEP * (LENGTH_FRAME_SIZE_KINDS - 1)];
+            uint8_t size = (uint8_t)(LENGTH_FRAME_MIN_SIZE + LENGTH_FRAME_SIZE_STEP * (i % LENGTH_FRAME_SIZE_KINDS));
+            frame[0] = size;
+            frame[1] = (uint8_t)i;
+            sim_fill_pattern(&frame[2], size - 2, p_params->seed * LENGTH_FRAME_COUNT + (uint32_t)i);
+            s_sent_us[i] = sim_now_us();
+            LoRabbit_SendFrame(p_handle, 0x0002, 0, frame, size);
+        }
+        p_context->p_result->ret[0] = LORABBIT_OK;
+    } else {
+        uint8_t *p_data = malloc(LENGTH_TRANSFER_SIZE);
+        sim_fill_pattern(p_data, LENGTH_TRANSFER_SIZE, p_params->seed);
+        LoRabbit_SendOptions_t options = {
+            .mode = p_params->mode,
+            .use_compact_header = p_params->use_compact,
+        };
+        p_context->p_result->ret[0] = LoRabbit_SendDataWithOptions(p_handle, 0x0002, 0, p_data, LENGTH_TRANSFER_SIZE,
+                                                                   &options);
+        free(p_data);
+    }
+    s_is_sender_done = true;
+    tk_ext_tsk();
+}
+
+static void length_receive_frames(LengthContext_t *p_context, LoraHandle_t *p_handle) {
+    const LengthParams_t *p_params = p_context->p_params;
+    double *p_value = p_context->p_result->value;
+    bool is_received[LENGTH_FRAME_COUNT] = {false};
+    while (!s_is_sender_done || p_value[LENGTH_VALUE_FRAMES] < LENGTH_FRAME_COUNT) {
+        RecvFrameE220900T22SJP_t frame;
+        int recv_len = p_params->use_length ?
+                           LoRabbit_ReceiveFrameWithLength(p_handle, &frame, SIM_RECEIVE_POLL_MS, length_frame_length,
+                                                           NULL) :
+                           LoRabbit_ReceiveFrame(p_handle, &frame, SIM_RECEIVE_POLL_MS);
+        if (recv_len <= 0) {
+            if (s_is_sender_done) {
+                break; // 送信を終え、届くフレームがもうない
+            }
+            continue;
+        }
+        int index = frame.recv_data[1];
+        if (recv_len != frame.recv_data[0] || index >= LENGTH_FRAME_COUNT || is_received[index] ||
+            !sim_check_pattern(&frame.recv_data[2], recv_len - 2,
+                               p_params->seed * LENGTH_FRAME_COUNT + (uint32_t)index)) {
+            continue; // つながったフレームや、途中で切れたフレーム
+        }
+        is_received[index] = true;
+        p_value[LENGTH_VALUE_FRAMES] += 1.0;
+        double latency_ms = (double)(sim_now_us() - s_sent_us[index]) / 1000.0;
+        p_value[LENGTH_VALUE_LATENCY_SUM_MS] += latency_ms;
+        if (latency_ms > p_value[LENGTH_VALUE_LATENCY_MS]) {
+            p_value[LENGTH_VALUE_LATENCY_MS] = latency_ms;
+        }
+    }
+    p_context->p_result->is_ok = (LENGTH_FRAME_COUNT == p_value[LENGTH_VALUE_FRAMES]);
+}
+
+static void length_receiver_task(INT stacd, void *exinf) {
+    (void)stacd;
+    LengthContext_t *p_context = (LengthContext_t *)exinf;
+    const LengthParams_t *p_params = p_context->p_params;
+    SimTrialResult_t *p_result = p_context->p_result;
+    LoraHandle_t *p_handle = length_boot(p_context, 0x0002);
+
+    if (p_params->is_frames) {
+        length_receive_frames(p_context, p_handle);
+    } else {
+        uint8_t *p_buffer = calloc(1, LENGTH_TRANSFER_SIZE + 200);
+        uint32_t received_size = 0;
+        uint64_t done_us = 0;
+        int ret = sim_receive_data_until_done(p_handle, p_buffer, LENGTH_TRANSFER_SIZE + 200, &received_size,
+                                              LENGTH_RX_TIMEOUT_MS, &s_is_sender_done, &done_us);
+        p_result->elapsed_us = done_us - p_result->start_us;
+        p_result->is_ok = (LORABBIT_OK == ret && LENGTH_TRANSFER_SIZE == received_size &&
+                           sim_check_pattern(p_buffer, received_size, p_params->seed));
+        free(p_buffer);
+    }
+    tk_ext_tsk();
+}
+
+static void length_trial(const void *p_params, SimTrialResult_t *p_result) {
+    const LengthParams_t *p = (const LengthParams_t *)p_params;
+    SimChannelModel_t model = {.frame_loss = p->frame_loss};
+    sim_e220_init(&model);
+    LengthContext_t sender = {p, sim_node_create(false), p_result};
+    LengthContext_t receiver = {p, sim_node_create(false), p_result};
+    sim_start_task(length_sender_task, &sender, SIM_TASK_PRIORITY);
+    sim_start_task(length_receiver_task, &receiver, SIM_TASK_PRIORITY);
+    sim_trial_run(p_result);
+    p_result->is_ok = p_result->is_ok && SIM_RUN_DONE == p_result->run_result && LORABBIT_OK == p_result->ret[0];
+}
+
+static void length_run(const LengthParams_t *p_params, SimSummary_t *p_summary, char *p_ok_text) {
+    LengthParams_t params = *p_params;
+    for (int seed = 1; seed <= g_sim_seeds; seed++) {
+        params.seed = (uint32_t)seed;
+        SimTrialResult_t result;
+        if (!sim_trial(length_trial, &params, (uint32_t)seed, &result)) {
+            result.is_ok = false;
+        }
+        sim_summary_add(p_summary, &result);
+    }
+    snprintf(p_ok_text, 16, "%d/%d", p_summary->ok_count, p_summary->trials);
+}
+
+void scenario_length(void) {
+    char ok_text[16];
+    printf("%-8s %-10s %-9s %8s %10s %10s\n", "case", "receive", "ok/trials", "frames", "latency_ms", "max_ms");
+    for (int use_length = 0; use_length <= 1; use_length++) {
+        LengthParams_t params = {true, (1 == use_length), LORABBIT_TP_MODE_STOP_AND_WAIT, false, 0.0, 0};
+        SimSummary_t summary = {0};
+        length_run(&params, &summary, ok_text);
+        double frames = sim_summary_mean(&summary, summary.sum[LENGTH_VALUE_FRAMES]);
+        double latency_sum_ms = sim_summary_mean(&summary, summary.sum[LENGTH_VALUE_LATENCY_SUM_MS]);
+        printf("%-8s %-10s %-9s %8.1f %10.1f %10.1f\n", "frames", use_length ? "length" : "gap", ok_text, frames,
+               (frames > 0.0) ? latency_sum_ms / frames : 0.0,
+               sim_summary_mean(&summary, summary.sum[LENGTH_VALUE_LATENCY_MS]));
+    }
+
+    static const LoRabbit_TpMode_t s_modes[] = {
+        LORABBIT_TP_MODE_STOP_AND_WAIT, LORABBIT_TP_MODE_WINDOW, LORABBIT_TP_MODE_BURST,
+    };
+    static const char *const s_mode_names[] = {"stop-and-wait", "window", "burst"};
+    static const double s_losses[] = {0.0, 0.10};
+    printf("%-8s %-14s %-8s %-5s %-9s %8s\n", "case", "mode", "header", "loss", "ok/trials", "time_ms");
+    for (size_t m = 0; m < sizeof(s_modes) / sizeof(s_modes[0]); m++) {
+        for (int use_compact = 0; use_compact <= 1; use_compact++) {
+            for (size_t l = 0; l < sizeof(s_losses) / sizeof(s_losses[0]); l++) {
+                LengthParams_t params = {false, false, s_modes[m], (1 == use_compact), s_losses[l], 0};
+                SimSummary_t summary = {0};
+                length_run(&params, &summary, ok_text);
+                printf("%-8s %-14s %-8s %3.0f%%  %-9s %8.0f\n", "transfer", s_mode_names[m],
+                       use_compact ? "compact" : "standard", s_losses[l] * 100, ok_text,
+                       sim_summary_mean(&summary, summary.elapsed_ms_sum));
+            }
+        }
+    }
+}
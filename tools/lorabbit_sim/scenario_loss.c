@@ -0,0 +1,114 @@
+/**
+ * @file scenario_loss.c
+ * @brief 損失のあるリンクでの再送制御方式ごとの転送
+ * @details 10000バイトの転送を、再送制御方式と損失率を変えて行います。
+ * 両方向の全フレームが独立に指定の確率で失われます。ACKのタイムアウトを待つため、AUXピンをつないだ端末を使います。
+ * rx_ok は受信側がデータを受信できた試行、tx_ok はさらに送信側も成功を返した試行の数です。
+ * 時間は送信開始から受信側の LoRabbit_ReceiveData() が全データを返すまでの、受信できた試行の平均です。
+ */
+#include "scenarios.h"
+#include "sim_scenario.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define LOSS_SIZE          10000
+#define LOSS_RX_TIMEOUT_MS 120000
+
+static volatile bool s_is_sender_done; // 試行ごとに子プロセスで初期化される
+
+typedef struct {
+    LoRabbit_TpMode_t mode;
+    double   frame_loss;
+    uint32_t seed;
+} LossParams_t;
+
+typedef struct {
+    const LossParams_t *p_params;
+    SimNode_t *p_node;
+    SimTrialResult_t *p_result;
+} LossContext_t;
+
+static void loss_sender_task(INT stacd, void *exinf) {
+    (void)stacd;
+    LossContext_t *p_context = (LossContext_t *)exinf;
+    const LossParams_t *p_params = p_context->p_params;
+    LoraConfigItem_t config = sim_default_config(0x0001, LORA_AIR_DATA_RATE_21875_BPS_SF_7_BW_500);
+    sim_node_boot(p_context->p_node, &config);
+    tk_dly_tsk(SIM_BOOT_SETTLE_MS);
+
+    uint8_t *p_data = malloc(LOSS_SIZE);
+    sim_fill_pattern(p_data, LOSS_SIZE, p_params->seed);
+    LoRabbit_SendOptions_t options = {
+        .mode = p_params->mode,
+    };
+    p_context->p_result->start_us = sim_now_us();
+    p_context->p_result->ret[0] = LoRabbit_SendDataWithOptions(sim_node_handle(p_context->p_node), 0x0002, 0,
+                                                               p_data, LOSS_SIZE, &options);
+    s_is_sender_done = true;
+    free(p_data);
+    tk_ext_tsk();
+}
+
+static void loss_receiver_task(INT stacd, void *exinf) {
+    (void)stacd;
+    LossContext_t *p_context = (LossContext_t *)exinf;
+    const LossParams_t *p_params = p_context->p_params;
+    SimTrialResult_t *p_result = p_context->p_result;
+    LoraConfigItem_t config = sim_default_config(0x0002, LORA_AIR_DATA_RATE_21875_BPS_SF_7_BW_500);
+    sim_node_boot(p_context->p_node, &config);
+
+    uint8_t *p_buffer = calloc(1, LOSS_SIZE + 200);
+    uint32_t received_size = 0;
+    uint64_t done_us = 0;
+    int ret = sim_receive_data_until_done(sim_node_handle(p_context->p_node), p_buffer, LOSS_SIZE + 200,
+                                          &received_size, LOSS_RX_TIMEOUT_MS, &s_is_sender_done, &done_us);
+    p_result->elapsed_us = done_us - p_result->start_us;
+    p_result->is_ok = (LORABBIT_OK == ret && LOSS_SIZE == received_size &&
+                       sim_check_pattern(p_buffer, received_size, p_params->seed));
+    free(p_buffer);
+    tk_ext_tsk();
+}
+
+static void loss_trial(const void *p_params, SimTrialResult_t *p_result) {
+    const LossParams_t *p = (const LossParams_t *)p_params;
+    SimChannelModel_t model = {.frame_loss = p->frame_loss};
+    sim_e220_init(&model);
+    LossContext_t sender = {p, sim_node_create(true), p_result};
+    LossContext_t receiver = {p, sim_node_create(true), p_result};
+    sim_start_task(loss_sender_task, &sender, SIM_TASK_PRIORITY);
+    sim_start_task(loss_receiver_task, &receiver, SIM_TASK_PRIORITY);
+    sim_trial_run(p_result);
+    p_result->is_ok = p_result->is_ok && SIM_RUN_DONE == p_result->run_result;
+}
+
+void scenario_loss(void) {
+    static const LoRabbit_TpMode_t s_modes[] = {
+        LORABBIT_TP_MODE_STOP_AND_WAIT, LORABBIT_TP_MODE_WINDOW, LORABBIT_TP_MODE_BURST,
+    };
+    static const char *const s_mode_names[] = {"stop-and-wait", "window", "burst"};
+    static const double s_losses[] = {0.0, 0.05, 0.10, 0.20};
+    printf("%-14s %-5s %-9s %-9s %9s %11s\n", "mode", "loss", "rx_ok", "tx_ok", "rx_ms", "airtime_ms");
+    for (size_t m = 0; m < sizeof(s_modes) / sizeof(s_modes[0]); m++) {
+        for (size_t l = 0; l < sizeof(s_losses) / sizeof(s_losses[0]); l++) {
+            LossParams_t params = {s_modes[m], s_losses[l], 0};
+            SimSummary_t summary = {0};
+            int tx_ok_count = 0;
+            for (int seed = 1; seed <= g_sim_seeds; seed++) {
+                params.seed = (uint32_t)seed;
+                SimTrialResult_t result;
+                if (!sim_trial(loss_trial, &params, (uint32_t)seed, &result)) {
+                    result.is_ok = false;
+                }
+                sim_summary_add(&summary, &result);
+                tx_ok_count += (result.is_ok && LORABBIT_OK == result.ret[0]) ? 1 : 0;
+            }
+            char rx_ok_text[16];
+            char tx_ok_text[16];
+            snprintf(rx_ok_text, sizeof(rx_ok_text), "%d/%d", summary.ok_count, summary.trials);
+            snprintf(tx_ok_text, sizeof(tx_ok_text), "%d/%d", tx_ok_count, summary.trials);
+            printf("%-14s %3.0f%%  %-9s %-9s %9.0f %11.0f\n", s_mode_names[m], s_losses[l] * 100, rx_ok_text,
+                   tx_ok_text, sim_summary_mean(&summary, summary.elapsed_ms_sum),
+                   sim_summary_mean(&summary, summary.airtime_ms_sum));
+        }
+    }
+}
@@ -0,0 +1,173 @@
+/**
+ * @file scenario_multi.c
+ * @brief 複数の送信元からの同時受信
+ * @details 3台の送信側が4000バイトの転送を2回ずつ同時に始め、1台の受信側が受信します。
+ * 受信側が LoRabbit_ReceiveData() を繰り返す場合と、LoRabbit_ReceiveDataMulti() を繰り返す場合で、
+ * 全ての転送を受信し終えるまでの時間を比べます。時間は送信開始から受信側が最後の転送を受信し終えるまでです。
+ * 損失はなく、フレームが失われるのは衝突と半二重による取りこぼしだけです。
+ * 受信のタイムアウトで送信側の終了を確かめるため、AUXピンをつないだ端末で動かします。
+ * 全ての転送を受信し、全ての送信側が成功を返した試行を成功とします。
+ */
+#include "scenarios.h"
+#include "sim_scenario.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MULTI_SIZE           4000
+#define MULTI_SENDER_COUNT   3
+#define MULTI_TRANSFER_COUNT 2 /**< 送信側1台あたりの転送の数 */
+#define MULTI_BUFFER_COUNT   4
+#define MULTI_WINDOW_SIZE    8
+
+#define MULTI_VALUE_RECEIVED 0 /**< value[]: 受信できた転送の数 */
+#define MULTI_VALUE_SENT     1 /**< value[]: 送信側が成功を返した転送の数 */
+
+static volatile int s_sender_done_count; // 試行ごとに子プロセスで初期化される
+
+typedef struct {
+    LoRabbit_TpMode_t mode;
+    bool     use_multi;  // 受信側が LoRabbit_ReceiveDataMulti() を使うか
+    uint32_t seed;
+} MultiParams_t;
+
+typedef struct {
+    const MultiParams_t *p_params;
+    SimNode_t *p_node;
+    SimTrialResult_t *p_result;
+    int index;  // 送信側の番号 (受信側は -1)
+} MultiContext_t;
+
+// 送信側ごと・転送ごとのデータのシードを返すヘルパー関数（内部利用）
+static uint32_t multi_pattern_seed(uint32_t seed, int sender, int transfer) {
+    return seed * 100 + (uint32_t)(sender * MULTI_TRANSFER_COUNT + transfer);
+}
+
+static void multi_sender_task(INT stacd, void *exinf) {
+    (void)stacd;
+    MultiContext_t *p_context = (MultiContext_t *)exinf;
+    const MultiParams_t *p_params = p_context->p_params;
+    LoraConfigItem_t config =
+        sim_default_config((uint16_t)(0x0010 + p_context->index), LORA_AIR_DATA_RATE_62500_BPS_SF_5_BW_500);
+    sim_node_boot(p_context->p_node, &config);
+    tk_dly_tsk(SIM_BOOT_SETTLE_MS + (RELTIM)(sim_random() * 100));
+
+    uint8_t *p_data = malloc(MULTI_SIZE);
+    LoRabbit_SendOptions_t options = {
+        .mode = p_params->mode,
+        .window_size = MULTI_WINDOW_SIZE,
+    };
+    p_context->p_result->start_us = sim_now_us();
+    for (int k = 0; k < MULTI_TRANSFER_COUNT; k++) {
+        sim_fill_pattern(p_data, MULTI_SIZE, multi_pattern_seed(p_params->seed, p_context->index, k));
+        int ret = LoRabbit_SendDataWithOptions(sim_node_handle(p_context->p_node), 0x0001, 0, p_data, MULTI_SIZE,
+                                               &options);
+        if (LORABBIT_OK == ret) {
+            p_context->p_result->value[MULTI_VALUE_SENT] += 1.0;
+        }
+    }
+    s_sender_done_count++;
+    free(p_data);
+    tk_ext_tsk();
+}
+
+// 受信したデータがどの転送のものかを調べ、初めて受信した転送なら記録するヘルパー関数（内部利用）
+static void multi_record(MultiContext_t *p_context, bool *p_is_received, const uint8_t *p_data, uint32_t size) {
+    if (MULTI_SIZE != size) {
+        return;
+    }
+    for (int j = 0; j < MULTI_SENDER_COUNT * MULTI_TRANSFER_COUNT; j++) {
+        uint32_t seed = multi_pattern_seed(p_context->p_params->seed, j / MULTI_TRANSFER_COUNT, j % MULTI_TRANSFER_COUNT);
+        if (!p_is_received[j] && sim_check_pattern(p_data, size, seed)) {
+            p_is_received[j] = true;
+            p_context->p_result->value[MULTI_VALUE_RECEIVED] += 1.0;
+            p_context->p_result->elapsed_us = sim_now_us() - p_context->p_result->start_us;
+            return;
+        }
+    }
+}
+
+static void multi_receiver_task(INT stacd, void *exinf) {
+    (void)stacd;
+    MultiContext_t *p_context = (MultiContext_t *)exinf;
+    LoraConfigItem_t config = sim_default_config(0x0001, LORA_AIR_DATA_RATE_62500_BPS_SF_5_BW_500);
+    sim_node_boot(p_context->p_node, &config);
+    LoraHandle_t *p_handle = sim_node_handle(p_context->p_node);
+
+    static uint8_t s_buffers[MULTI_BUFFER_COUNT][MULTI_SIZE + 200];
+    uint8_t *const buffers[MULTI_BUFFER_COUNT] = {s_buffers[0], s_buffers[1], s_buffers[2], s_buffers[3]};
+    bool is_received[MULTI_SENDER_COUNT * MULTI_TRANSFER_COUNT] = {false};
+    // 送信側が全て終わるまで受信を続け、完了後に届いた再送にもACKを返し直す
+    while (s_sender_done_count < MULTI_SENDER_COUNT) {
+        if (p_context->p_params->use_multi) {
+            LoRabbit_ReceiveResult_t result;
+            if (LORABBIT_OK == LoRabbit_ReceiveDataMulti(p_handle, buffers, MULTI_BUFFER_COUNT, sizeof(s_buffers[0]),
+                                                         &result, SIM_RECEIVE_POLL_MS)) {
+                multi_record(p_context, is_received, buffers[result.buffer_index], result.received_size);
+            }
+        } else {
+            uint32_t received_size = 0;
+            if (LORABBIT_OK == LoRabbit_ReceiveData(p_handle, buffers[0], sizeof(s_buffers[0]), &received_size,
+                                                    SIM_RECEIVE_POLL_MS)) {
+                multi_record(p_context, is_received, buffers[0], received_size);
+            }
+        }
+    }
+    tk_ext_tsk();
+}
+
+static void multi_trial(const void *p_params, SimTrialResult_t *p_result) {
+    const MultiParams_t *p = (const MultiParams_t *)p_params;
+    SimChannelModel_t model = {0};
+    sim_e220_init(&model);
+    MultiContext_t senders[MULTI_SENDER_COUNT];
+    MultiContext_t receiver = {p, sim_node_create(true), p_result, -1};
+    for (int i = 0; i < MULTI_SENDER_COUNT; i++) {
+        senders[i] = (MultiContext_t){p, sim_node_create(true), p_result, i};
+        sim_start_task(multi_sender_task, &senders[i], SIM_TASK_PRIORITY);
+    }
+    sim_start_task(multi_receiver_task, &receiver, SIM_TASK_PRIORITY);
+    sim_trial_run(p_result);
+    const double transfer_count = MULTI_SENDER_COUNT * MULTI_TRANSFER_COUNT;
+    p_result->is_ok = SIM_RUN_DONE == p_result->run_result &&
+                      transfer_count == p_result->value[MULTI_VALUE_RECEIVED] &&
+                      transfer_count == p_result->value[MULTI_VALUE_SENT];
+}
+
+void scenario_multi(void) {
+    static const LoRabbit_TpMode_t s_modes[] = {
+        LORABBIT_TP_MODE_STOP_AND_WAIT, LORABBIT_TP_MODE_WINDOW, LORABBIT_TP_MODE_BURST,
+    };
+    static const char *const s_mode_names[] = {"stop-and-wait", "window", "burst"};
+    printf("%-14s %-18s %-9s %13s %9s %9s\n", "mode", "receiver", "ok/trials", "received", "sent", "mean_ms");
+    for (size_t m = 0; m < sizeof(s_modes) / sizeof(s_modes[0]); m++) {
+        for (int use_multi = 0; use_multi <= 1; use_multi++) {
+            MultiParams_t params = {s_modes[m], (1 == use_multi), 0};
+            SimSummary_t summary = {0};
+            double received_sum = 0.0;
+            double sent_sum = 0.0;
+            for (int seed = 1; seed <= g_sim_seeds; seed++) {
+                params.seed = (uint32_t)seed;
+                SimTrialResult_t result;
+                if (!sim_trial(multi_trial, &params, (uint32_t)seed, &result)) {
+                    result.is_ok = false;
+                    result.value[MULTI_VALUE_RECEIVED] = 0.0;
+                    result.value[MULTI_VALUE_SENT] = 0.0;
+                }
+                sim_summary_add(&summary, &result);
+                // 失敗した試行も含めた、転送ごとの成否
+                received_sum += result.value[MULTI_VALUE_RECEIVED];
+                sent_sum += result.value[MULTI_VALUE_SENT];
+            }
+            const double transfer_total = (double)(MULTI_SENDER_COUNT * MULTI_TRANSFER_COUNT * summary.trials);
+            char ok_text[16];
+            char received_text[16];
+            char sent_text[16];
+            snprintf(ok_text, sizeof(ok_text), "%d/%d", summary.ok_count, summary.trials);
+            snprintf(received_text, sizeof(received_text), "%.0f/%.0f", received_sum, transfer_total);
+            snprintf(sent_text, sizeof(sent_text), "%.0f/%.0f", sent_sum, transfer_total);
+            printf("%-14s %-18s %-9s %13s %9s %9.0f\n", s_mode_names[m],
+                   use_multi ? "ReceiveDataMulti" : "ReceiveData", ok_text, received_text, sent_text,
+                   sim_summary_mean(&summary, summary.elapsed_ms_sum));
+        }
+    }
+}
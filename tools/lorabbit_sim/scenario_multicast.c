@@ -0,0 +1,132 @@
+/**
+ * @file scenario_multicast.c
+ * @brief 複数の受信側への同報送信
+ * @details 1台の送信側から複数の受信側に同じデータを配るのにかかったエアタイムの合計を、
+ * 受信側ごとに1回ずつバースト送信した場合と、同報送信 (LORABBIT_TP_MODE_MULTICAST) で比べます。
+ * 各フレームは受信側ごとに独立に指定の確率で失われます。
+ * 送信側はNACKの返信スロットを受信のタイムアウトで待つため、AUXピンをつないだ端末で動かします。
+ * 全ての受信側がデータを受信できた試行を成功とします。
+ */
+#include "scenarios.h"
+#include "sim_scenario.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MULTICAST_SIZE         4000
+#define MULTICAST_MAX_RECEIVERS 8
+#define MULTICAST_RX_TIMEOUT_MS 120000
+
+static volatile bool s_is_sender_done; // 試行ごとに子プロセスで初期化される
+
+typedef struct {
+    LoRabbit_TpMode_t mode;  // LORABBIT_TP_MODE_BURST (受信側ごと) か LORABBIT_TP_MODE_MULTICAST
+    uint8_t  fec_redundancy_percent;
+    int      receiver_count;
+    double   frame_loss;
+    uint32_t seed;
+} MulticastParams_t;
+
+typedef struct {
+    const MulticastParams_t *p_params;
+    SimNode_t *p_node;
+    SimTrialResult_t *p_result;
+    uint16_t address;
+} MulticastContext_t;
+
+static void multicast_sender_task(INT stacd, void *exinf) {
+    (void)stacd;
+    MulticastContext_t *p_context = (MulticastContext_t *)exinf;
+    const MulticastParams_t *p_params = p_context->p_params;
+    LoraConfigItem_t config = sim_default_config(p_context->address, LORA_AIR_DATA_RATE_62500_BPS_SF_5_BW_500);
+    sim_node_boot(p_context->p_node, &config);
+    tk_dly_tsk(SIM_BOOT_SETTLE_MS);
+
+    uint8_t *p_data = malloc(MULTICAST_SIZE);
+    sim_fill_pattern(p_data, MULTICAST_SIZE, p_params->seed);
+    LoraHandle_t *p_handle = sim_node_handle(p_context->p_node);
+    LoRabbit_SendOptions_t options = {
+        .mode = p_params->mode,
+        .fec_redundancy_percent = p_params->fec_redundancy_percent,
+    };
+    p_context->p_result->start_us = sim_now_us();
+    int ret = LORABBIT_OK;
+    if (LORABBIT_TP_MODE_MULTICAST == p_params->mode) {
+        ret = LoRabbit_SendDataWithOptions(p_handle, 0xFFFF, 0, p_data, MULTICAST_SIZE, &options);
+    } else {
+        for (int i = 0; i < p_params->receiver_count && LORABBIT_OK == ret; i++) {
+            ret = LoRabbit_SendDataWithOptions(p_handle, (uint16_t)(0x0010 + i), 0, p_data, MULTICAST_SIZE, &options);
+        }
+    }
+    p_context->p_result->ret[0] = ret;
+    s_is_sender_done = true;
+    free(p_data);
+    tk_ext_tsk();
+}
+
+static void multicast_receiver_task(INT stacd, void *exinf) {
+    (void)stacd;
+    MulticastContext_t *p_context = (MulticastContext_t *)exinf;
+    const MulticastParams_t *p_params = p_context->p_params;
+    LoraConfigItem_t config = sim_default_config(p_context->address, LORA_AIR_DATA_RATE_62500_BPS_SF_5_BW_500);
+    sim_node_boot(p_context->p_node, &config);
+
+    uint8_t *p_buffer = calloc(1, MULTICAST_SIZE + 200);
+    uint32_t received_size = 0;
+    uint64_t done_us = 0;
+    int ret = sim_receive_data_until_done(sim_node_handle(p_context->p_node), p_buffer, MULTICAST_SIZE + 200,
+                                          &received_size, MULTICAST_RX_TIMEOUT_MS, &s_is_sender_done, &done_us);
+    if (LORABBIT_OK == ret && MULTICAST_SIZE == received_size &&
+        sim_check_pattern(p_buffer, received_size, p_params->seed)) {
+        p_context->p_result->value[0] += 1.0; // 受信できた受信側の数
+    }
+    free(p_buffer);
+    tk_ext_tsk();
+}
+
+static void multicast_trial(const void *p_params, SimTrialResult_t *p_result) {
+    const MulticastParams_t *p = (const MulticastParams_t *)p_params;
+    SimChannelModel_t model = {.frame_loss = p->frame_loss};
+    sim_e220_init(&model);
+    MulticastContext_t sender = {p, sim_node_create(true), p_result, 0x0001};
+    MulticastContext_t receivers[MULTICAST_MAX_RECEIVERS];
+    sim_start_task(multicast_sender_task, &sender, SIM_TASK_PRIORITY);
+    for (int i = 0; i < p->receiver_count; i++) {
+        receivers[i] = (MulticastContext_t){p, sim_node_create(true), p_result, (uint16_t)(0x0010 + i)};
+        sim_start_task(multicast_receiver_task, &receivers[i], SIM_TASK_PRIORITY);
+    }
+    sim_trial_run(p_result);
+    p_result->is_ok = SIM_RUN_DONE == p_result->run_result && LORABBIT_OK == p_result->ret[0] &&
+                      p_result->value[0] == (double)p->receiver_count;
+}
+
+void scenario_multicast(void) {
+    static const double s_losses[] = {0.05, 0.20};
+    static const int s_receiver_counts[] = {1, 4, 8};
+    printf("%-5s %-9s %-22s %-9s %11s\n", "loss", "receivers", "mode", "ok/trials", "airtime_ms");
+    for (size_t l = 0; l < sizeof(s_losses) / sizeof(s_losses[0]); l++) {
+        for (size_t r = 0; r < sizeof(s_receiver_counts) / sizeof(s_receiver_counts[0]); r++) {
+            for (int variant = 0; variant < 3; variant++) {
+                MulticastParams_t params = {
+                    .mode = (0 == variant) ? LORABBIT_TP_MODE_BURST : LORABBIT_TP_MODE_MULTICAST,
+                    .fec_redundancy_percent = (2 == variant) ? 20 : 0,
+                    .receiver_count = s_receiver_counts[r],
+                    .frame_loss = s_losses[l],
+                };
+                SimSummary_t summary = {0};
+                for (int seed = 1; seed <= g_sim_seeds; seed++) {
+                    params.seed = (uint32_t)seed;
+                    SimTrialResult_t result;
+                    if (!sim_trial(multicast_trial, &params, (uint32_t)seed, &result)) {
+                        result.is_ok = false;
+                    }
+                    sim_summary_add(&summary, &result);
+                }
+                static const char *const s_variant_names[] = {"burst (per receiver)", "multicast", "multicast + FEC 20%"};
+                char ok_text[16];
+                snprintf(ok_text, sizeof(ok_text), "%d/%d", summary.ok_count, summary.trials);
+                printf("%3.0f%%  %-9d %-22s %-9s %11.0f\n", s_losses[l] * 100, s_receiver_counts[r],
+                       s_variant_names[variant], ok_text, sim_summary_mean(&summary, summary.airtime_ms_sum));
+            }
+        }
+    }
+}
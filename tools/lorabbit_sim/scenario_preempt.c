@@ -0,0 +1,175 @@
+/**
+ * @file scenario_preempt.c
+ * @brief トラフィッククラスによる急ぎの転送の割り込み
+ * @details 送信側の端末で、1つ目のタスクが30000バイトのバースト送信を始め、その500ミリ秒後に2つ目のタスクが
+ * 20バイトの制御メッセージをストップアンドウェイトで送信します。送信先はどちらも同じ受信側です。
+ * 制御メッセージのトラフィッククラスが LORABBIT_TRAFFIC_CLASS_BULK (初期値) の場合と
+ * LORABBIT_TRAFFIC_CLASS_CONTROL の場合で、制御メッセージの送信の呼び出しにかかった時間と、
+ * 送信を始めるまでの待ち時間 (LoRabbit_GetTrafficClassStats())、大きな転送の時間を比べます。
+ * 受信側は、送信元が同じ2つの転送を同時に受信するため、LoRabbit_ReceiveDataMulti() を繰り返します。
+ * 受信のタイムアウトで送信側の終了を確かめるため、AUXピンをつないだ端末で動かします。
+ * 両方の転送を受信し、両方の送信が成功を返した試行を成功とします。
+ */
+#include "scenarios.h"
+#include "sim_scenario.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define PREEMPT_BULK_SIZE      30000
+#define PREEMPT_CONTROL_SIZE   20
+#define PREEMPT_CONTROL_DELAY  500 /**< 大きな転送を始めてから制御メッセージを送るまでの時間 (ミリ秒) */
+#define PREEMPT_BUFFER_COUNT   2
+#define PREEMPT_TRANSFER_COUNT 2   /**< 大きな転送と制御メッセージ */
+
+#define PREEMPT_VALUE_RECEIVED   0 /**< value[]: 受信できた転送の数 */
+#define PREEMPT_VALUE_SENT       1 /**< value[]: 送信が成功を返した転送の数 */
+#define PREEMPT_VALUE_CONTROL_MS 2 /**< value[]: 制御メッセージの送信の呼び出しにかかった時間 (ミリ秒) */
+#define PREEMPT_VALUE_QUEUE_MS   3 /**< value[]: 制御メッセージが送信を始めるまでの待ち時間 (ミリ秒) */
+#define PREEMPT_VALUE_BULK_MS    4 /**< value[]: 大きな転送の送信の呼び出しにかかった時間 (ミリ秒) */
+
+static volatile int  s_sender_done_count; // 試行ごとに子プロセスで初期化される
+static volatile bool s_is_sender_ready;
+static uint8_t s_buffers[PREEMPT_BUFFER_COUNT][PREEMPT_BULK_SIZE + 200];
+
+typedef struct {
+    LoRabbit_TrafficClass_t control_class; // 制御メッセージのトラフィッククラス
+    double   frame_loss;
+    uint32_t seed;
+} PreemptParams_t;
+
+typedef struct {
+    const PreemptParams_t *p_params;
+    SimNode_t *p_node;
+    SimTrialResult_t *p_result;
+    int index; // 0: 大きな転送のタスク、1: 制御メッセージのタスク、-1: 受信側
+} PreemptContext_t;
+
+static uint32_t preempt_size(int index) {
+    return (0 == index) ? PREEMPT_BULK_SIZE : PREEMPT_CONTROL_SIZE;
+}
+
+static uint32_t preempt_pattern_seed(uint32_t seed, int index) {
+    return seed * 10 + (uint32_t)index;
+}
+
+static void preempt_sender_task(INT stacd, void *exinf) {
+    (void)stacd;
+    PreemptContext_t *p_context = (PreemptContext_t *)exinf;
+    const PreemptParams_t *p_params = p_context->p_params;
+    LoraHandle_t *p_handle = sim_node_handle(p_context->p_node);
+    if (0 == p_context->index) {
+        // 大きな転送のタスクが端末を起動する
+        LoraConfigItem_t config = sim_default_config(0x0001, LORA_AIR_DATA_RATE_62500_BPS_SF_5_BW_500);
+        sim_node_boot(p_context->p_node, &config);
+        s_is_sender_ready = true;
+    }
+    tk_dly_tsk(SIM_BOOT_SETTLE_MS);
+    while (!s_is_sender_ready) {
+        tk_dly_tsk(10);
+    }
+
+    const uint32_t size = preempt_size(p_context->index);
+    uint8_t *p_data = malloc(size);
+    sim_fill_pattern(p_data, size, preempt_pattern_seed(p_params->seed, p_context->index));
+    LoRabbit_SendOptions_t options = {.mode = LORABBIT_TP_MODE_BURST};
+    if (1 == p_context->index) {
+        tk_dly_tsk(PREEMPT_CONTROL_DELAY);
+        options.mode = LORABBIT_TP_MODE_STOP_AND_WAIT;
+        options.traffic_class = p_params->control_class;
+    } else {
+        p_context->p_result->start_us = sim_now_us();
+    }
+    uint64_t call_us = sim_now_us();
+    int ret = LoRabbit_SendDataWithOptions(p_handle, 0x0002, 0, p_data, size, &options);
+    double call_ms = (double)(sim_now_us() - call_us) / 1000.0;
+    if (LORABBIT_OK == ret) {
+        p_context->p_result->value[PREEMPT_VALUE_SENT] += 1.0;
+    }
+    if (1 == p_context->index) {
+        LoRabbit_TrafficClassStats_t stats;
+        LoRabbit_GetTrafficClassStats(p_handle, p_params->control_class, &stats);
+        p_context->p_result->value[PREEMPT_VALUE_CONTROL_MS] = call_ms;
+        p_context->p_result->value[PREEMPT_VALUE_QUEUE_MS] = (double)stats.last_queue_delay_ms;
+    } else {
+        p_context->p_result->value[PREEMPT_VALUE_BULK_MS] = call_ms;
+    }
+    free(p_data);
+    s_sender_done_count++;
+    tk_ext_tsk();
+}
+
+static void preempt_receiver_task(INT stacd, void *exinf) {
+    (void)stacd;
+    PreemptContext_t *p_context = (PreemptContext_t *)exinf;
+    LoraConfigItem_t config = sim_default_config(0x0002, LORA_AIR_DATA_RATE_62500_BPS_SF_5_BW_500);
+    sim_node_boot(p_context->p_node, &config);
+    LoraHandle_t *p_handle = sim_node_handle(p_context->p_node);
+
+    uint8_t *buffers[PREEMPT_BUFFER_COUNT];
+    for (int i = 0; i < PREEMPT_BUFFER_COUNT; i++) {
+        buffers[i] = s_buffers[i];
+    }
+    bool is_received[PREEMPT_TRANSFER_COUNT] = {false};
+    // 送信側が全て終わるまで受信を続け、完了後に届いた再送にもACKを返し直す
+    while (s_sender_done_count < PREEMPT_TRANSFER_COUNT) {
+        LoRabbit_ReceiveResult_t result;
+        if (LORABBIT_OK != LoRabbit_ReceiveDataMulti(p_handle, buffers, PREEMPT_BUFFER_COUNT, sizeof(s_buffers[0]),
+                                                     &result, SIM_RECEIVE_POLL_MS)) {
+            continue;
+        }
+        for (int j = 0; j < PREEMPT_TRANSFER_COUNT; j++) {
+            if (!is_received[j] && preempt_size(j) == result.received_size &&
+                sim_check_pattern(buffers[result.buffer_index], result.received_size,
+                                  preempt_pattern_seed(p_context->p_params->seed, j))) {
+                is_received[j] = true;
+                p_context->p_result->value[PREEMPT_VALUE_RECEIVED] += 1.0;
+            }
+        }
+    }
+    tk_ext_tsk();
+}
+
+static void preempt_trial(const void *p_params, SimTrialResult_t *p_result) {
+    const PreemptParams_t *p = (const PreemptParams_t *)p_params;
+    SimChannelModel_t model = {.frame_loss = p->frame_loss};
+    sim_e220_init(&model);
+    SimNode_t *p_sender_node = sim_node_create(true);
+    PreemptContext_t senders[PREEMPT_TRANSFER_COUNT];
+    PreemptContext_t receiver = {p, sim_node_create(true), p_result, -1};
+    for (int i = 0; i < PREEMPT_TRANSFER_COUNT; i++) {
+        senders[i] = (PreemptContext_t){p, p_sender_node, p_result, i};
+        sim_start_task(preempt_sender_task, &senders[i], SIM_TASK_PRIORITY);
+    }
+    sim_start_task(preempt_receiver_task, &receiver, SIM_TASK_PRIORITY);
+    sim_trial_run(p_result);
+    p_result->is_ok = SIM_RUN_DONE == p_result->run_result &&
+                      PREEMPT_TRANSFER_COUNT == p_result->value[PREEMPT_VALUE_RECEIVED] &&
+                      PREEMPT_TRANSFER_COUNT == p_result->value[PREEMPT_VALUE_SENT];
+}
+
+void scenario_preempt(void) {
+    static const double s_losses[] = {0.0, 0.1};
+    static const LoRabbit_TrafficClass_t s_classes[] = {LORABBIT_TRAFFIC_CLASS_BULK, LORABBIT_TRAFFIC_CLASS_CONTROL};
+    printf("%-5s %-8s %-9s %10s %9s %9s\n", "loss", "class", "ok/trials", "control_ms", "queue_ms", "bulk_ms");
+    for (size_t l = 0; l < sizeof(s_losses) / sizeof(s_losses[0]); l++) {
+        for (size_t c = 0; c < sizeof(s_classes) / sizeof(s_classes[0]); c++) {
+            PreemptParams_t params = {s_classes[c], s_losses[l], 0};
+            SimSummary_t summary = {0};
+            for (int seed = 1; seed <= g_sim_seeds; seed++) {
+                params.seed = (uint32_t)seed;
+                SimTrialResult_t result;
+                if (!sim_trial(preempt_trial, &params, (uint32_t)seed, &result)) {
+                    result.is_ok = false;
+                }
+                sim_summary_add(&summary, &result);
+            }
+            char ok_text[16];
+            snprintf(ok_text, sizeof(ok_text), "%d/%d", summary.ok_count, summary.trials);
+            printf("%3.0f%%  %-8s %-9s %10.0f %9.0f %9.0f\n", s_losses[l] * 100.0,
+                   (LORABBIT_TRAFFIC_CLASS_CONTROL == s_classes[c]) ? "CONTROL" : "BULK", ok_text,
+                   sim_summary_mean(&summary, summary.sum[PREEMPT_VALUE_CONTROL_MS]),
+                   sim_summary_mean(&summary, summary.sum[PREEMPT_VALUE_QUEUE_MS]),
+                   sim_summary_mean(&summary, summary.sum[PREEMPT_VALUE_BULK_MS]));
+        }
+    }
+}
@@ -0,0 +1,155 @@
+/**
+ * @file scenario_reqresp.c
+ * @brief 要求と応答を交互に送り合う転送とピギーバックACK
+ * @details 端末A (0x0001) が40バイトの要求をストップアンドウェイトで送り、端末B (0x0002) が受信するたびに
+ * 80バイトの応答を同じくストップアンドウェイトで返します。これを20回繰り返します。
+ * 両方の端末で受信ディスパッチャ (LoRabbit_StartRxDispatcher()) を起動し、送信のフレームの数とエアタイムを
+ * 数えます。ACKを保留する時間 (LORABBIT_TP_DELAYED_ACK_MS) はコンパイル時の設定のため、
+ * lorabbit_sim_aux (0: 保留しない) と lorabbit_sim_delayed_ack (保留する) で実行して比べます。
+ * 受信のタイムアウトで送信側の終了を確かめるため、AUXピンをつないだ端末で動かします。
+ * 全ての要求と応答が届き、全ての送信が成功を返した試行を成功とします。
+ */
+#include "scenarios.h"
+#include "sim_scenario.h"
+#include <stdio.h>
+
+#define REQRESP_EXCHANGE_COUNT 20
+#define REQRESP_REQUEST_SIZE   40
+#define REQRESP_RESPONSE_SIZE  80
+#define REQRESP_TIMEOUT_MS     10000 /**< 要求を送ってから応答を受信するまで待つ時間 */
+
+#define REQRESP_VALUE_EXCHANGES 0 /**< value[]: 応答まで届いた要求の数 */
+#define REQRESP_VALUE_SENT      1 /**< value[]: 送信が成功を返した要求と応答の数 */
+
+static volatile bool s_is_client_done; // 試行ごとに子プロセスで初期化される
+static volatile bool s_is_server_ready;
+
+typedef struct {
+    double   frame_loss;
+    uint32_t seed;
+} ReqRespParams_t;
+
+typedef struct {
+    const ReqRespParams_t *p_params;
+    SimNode_t *p_node;
+    SimTrialResult_t *p_result;
+    int index; // 0: 端末A (要求を送る)、1: 端末B (応答を返す)
+} ReqRespContext_t;
+
+static uint32_t reqresp_pattern_seed(uint32_t seed, int exchange, int index) {
+    return (seed * REQRESP_EXCHANGE_COUNT + (uint32_t)exchange) * 2 + (uint32_t)index;
+}
+
+static LoraHandle_t *reqresp_boot(ReqRespContext_t *p_context) {
+    LoraConfigItem_t config =
+        sim_default_config((uint16_t)(0x0001 + p_context->index), LORA_AIR_DATA_RATE_62500_BPS_SF_5_BW_500);
+    sim_node_boot(p_context->p_node, &config);
+    LoraHandle_t *p_handle = sim_node_handle(p_context->p_node);
+    int ret = LoRabbit_StartRxDispatcher(p_handle, SIM_TASK_PRIORITY - 1);
+    if (LORABBIT_OK != ret) {
+        p_context->p_result->ret[p_context->index] = ret;
+    }
+    return p_handle;
+}
+
+static void reqresp_client_task(INT stacd, void *exinf) {
+    (void)stacd;
+    ReqRespContext_t *p_context = (ReqRespContext_t *)exinf;
+    const uint32_t seed = p_context->p_params->seed;
+    LoraHandle_t *p_handle = reqresp_boot(p_context);
+    tk_dly_tsk(SIM_BOOT_SETTLE_MS);
+    while (!s_is_server_ready) {
+        tk_dly_tsk(10);
+    }
+
+    p_context->p_result->start_us = sim_now_us();
+    for (int i = 0; i < REQRESP_EXCHANGE_COUNT; i++) {
+        uint8_t request[REQRESP_REQUEST_SIZE];
+        sim_fill_pattern(request, sizeof(request), reqresp_pattern_seed(seed, i, 0));
+        if (LORABBIT_OK != LoRabbit_SendData(p_handle, 0x0002, 0, request, sizeof(request), true)) {
+            break;
+        }
+        p_context->p_result->value[REQRESP_VALUE_SENT] += 1.0;
+
+        uint8_t response[REQRESP_RESPONSE_SIZE + 200];
+        uint32_t received_size = 0;
+        if (LORABBIT_OK != LoRabbit_ReceiveData(p_handle, response, sizeof(response), &received_size,
+                                                REQRESP_TIMEOUT_MS) ||
+            REQRESP_RESPONSE_SIZE != received_size ||
+            !sim_check_pattern(response, received_size, reqresp_pattern_seed(seed, i, 1))) {
+            break;
+        }
+        p_context->p_result->value[REQRESP_VALUE_EXCHANGES] += 1.0;
+    }
+    p_context->p_result->elapsed_us = sim_now_us() - p_context->p_result->start_us;
+    s_is_client_done = true;
+    tk_ext_tsk();
+}
+
+static void reqresp_server_task(INT stacd, void *exinf) {
+    (void)stacd;
+    ReqRespContext_t *p_context = (ReqRespContext_t *)exinf;
+    const uint32_t seed = p_context->p_params->seed;
+    LoraHandle_t *p_handle = reqresp_boot(p_context);
+    s_is_server_ready = true;
+
+    int exchange = 0;
+    // 要求を受信するたびに応答を返す。最後の応答の送信は、端末AのACKを受け取ってから戻る
+    while (!s_is_client_done) {
+        uint8_t request[REQRESP_REQUEST_SIZE + 200];
+        uint32_t received_size = 0;
+        if (LORABBIT_OK != LoRabbit_ReceiveData(p_handle, request, sizeof(request), &received_size,
+                                                SIM_RECEIVE_POLL_MS) ||
+            exchange >= REQRESP_EXCHANGE_COUNT || REQRESP_REQUEST_SIZE != received_size ||
+            !sim_check_pattern(request, received_size, reqresp_pattern_seed(seed, exchange, 0))) {
+            continue;
+        }
+        uint8_t response[REQRESP_RESPONSE_SIZE];
+        sim_fill_pattern(response, sizeof(response), reqresp_pattern_seed(seed, exchange, 1));
+        if (LORABBIT_OK == LoRabbit_SendData(p_handle, 0x0001, 0, response, sizeof(response), true)) {
+            p_context->p_result->value[REQRESP_VALUE_SENT] += 1.0;
+        }
+        exchange++;
+    }
+    tk_ext_tsk();
+}
+
+static void reqresp_trial(const void *p_params, SimTrialResult_t *p_result) {
+    const ReqRespParams_t *p = (const ReqRespParams_t *)p_params;
+    SimChannelModel_t model = {.frame_loss = p->frame_loss};
+    sim_e220_init(&model);
+    ReqRespContext_t client = {p, sim_node_create(true), p_result, 0};
+    ReqRespContext_t server = {p, sim_node_create(true), p_result, 1};
+    sim_start_task(reqresp_client_task, &client, SIM_TASK_PRIORITY);
+    sim_start_task(reqresp_server_task, &server, SIM_TASK_PRIORITY);
+    sim_trial_run(p_result);
+    p_result->is_ok = SIM_RUN_DONE == p_result->run_result && LORABBIT_OK == p_result->ret[0] &&
+                      LORABBIT_OK == p_result->ret[1] &&
+                      REQRESP_EXCHANGE_COUNT == p_result->value[REQRESP_VALUE_EXCHANGES] &&
+                      2 * REQRESP_EXCHANGE_COUNT == p_result->value[REQRESP_VALUE_SENT];
+}
+
+void scenario_reqresp(void) {
+    static const double s_losses[] = {0.0, 0.1};
+    printf("%-5s %-8s %-9s %9s %9s %10s %9s\n", "loss", "delay_ms", "ok/trials", "exchanges", "frames",
+           "airtime_ms", "mean_ms");
+    for (size_t l = 0; l < sizeof(s_losses) / sizeof(s_losses[0]); l++) {
+        ReqRespParams_t params = {s_losses[l], 0};
+        SimSummary_t summary = {0};
+        for (int seed = 1; seed <= g_sim_seeds; seed++) {
+            params.seed = (uint32_t)seed;
+            SimTrialResult_t result;
+            if (!sim_trial(reqresp_trial, &params, (uint32_t)seed, &result)) {
+                result.is_ok = false;
+            }
+            sim_summary_add(&summary, &result);
+        }
+        char ok_text[16];
+        snprintf(ok_text, sizeof(ok_text), "%d/%d", summary.ok_count, summary.trials);
+        printf("%3.0f%%  %-8d %-9s %9.1f %9.1f %10.0f %9.0f\n", s_losses[l] * 100.0, LORABBIT_TP_DELAYED_ACK_MS,
+               ok_text, sim_summary_mean(&summary, summary.sum[REQRESP_VALUE_EXCHANGES]),
+               sim_summary_mean(&summary, summary.tx_frames_sum),
+               sim_summary_mean(&summary, summary.airtime_ms_sum),
+               sim_summary_mean(&summary, summary.elapsed_ms_sum));
+    }
+}
@@ -0,0 +1,152 @@
+/**
+ * @file scenario_ring.c
+ * @brief UART受信用リングバッファの溢れと、失われたバイト数 (LoRabbit_GetRxOverflowCount())
+ * @details 送信側が100バイトのフレームを LoRabbit_SendFrame() で続けて6個送る間、受信側は読み出さずに待ちます。
+ * モジュールがMCUへ出力したバイトのうち、リングバッファ (LORABBIT_RX_BUFFER_SIZE バイト) に入りきらなかった分が
+ * LoRabbit_GetRxOverflowCount() の値と一致するかを確かめます。続いて受信側が溜まったデータを読み捨て、
+ * 送信側が20バイトのフレームを300ミリ秒ごとに5個送り、受信側が全て受け取れるか (溢れた後も受信できるか) を確かめます。
+ * 受信側のUARTに受信のDTC転送を指定しない場合と指定した場合で動かします。
+ * 受信のタイムアウトで送信側の終了を確かめるため、AUXピンをつないだ端末で動かします。
+ * 失われたバイト数が期待どおりで、後の5個のフレームを全て受け取った試行を成功とします。
+ */
+#include "scenarios.h"
+#include "sim_scenario.h"
+#include <stdio.h>
+
+#define RING_BURST_COUNT       6
+#define RING_BURST_SIZE        100
+#define RING_FRAME_COUNT       5
+#define RING_FRAME_SIZE        20
+#define RING_FRAME_INTERVAL_MS 300
+#define RING_OUTPUT_SETTLE_MS  500 /**< 最後のフレームをモジュールがMCUへ出力し終えるのを待つ時間 */
+
+#define RING_VALUE_OVERFLOW 0 /**< value[]: LoRabbit_GetRxOverflowCount() の値 */
+#define RING_VALUE_EXPECTED 1 /**< value[]: MCUが受け取ったバイトのうち、リングバッファに入りきらないバイトの数 */
+#define RING_VALUE_FRAMES   2 /**< value[]: 後で送ったフレームを受け取れた数 */
+
+static volatile bool s_is_burst_done; // 試行ごとに子プロセスで初期化される
+static volatile bool s_is_drained;
+static volatile bool s_is_sender_done;
+
+typedef struct {
+    bool     use_dtc;
+    uint32_t seed;
+} RingParams_t;
+
+typedef struct {
+    const RingParams_t *p_params;
+    SimNode_t *p_node;
+    SimTrialResult_t *p_result;
+} RingContext_t;
+
+static void ring_sender_task(INT stacd, void *exinf) {
+    (void)stacd;
+    RingContext_t *p_context = (RingContext_t *)exinf;
+    LoraConfigItem_t config = sim_default_config(0x0001, LORA_AIR_DATA_RATE_21875_BPS_SF_7_BW_500);
+    sim_node_boot(p_context->p_node, &config);
+    LoraHandle_t *p_handle = sim_node_handle(p_context->p_node);
+    tk_dly_tsk(SIM_BOOT_SETTLE_MS);
+
+    uint8_t burst[RING_BURST_SIZE];
+    sim_fill_pattern(burst, sizeof(burst), p_context->p_params->seed);
+    for (int i = 0; i < RING_BURST_COUNT; i++) {
+        LoRabbit_SendFrame(p_handle, 0x0002, 0, burst, sizeof(burst));
+    }
+    s_is_burst_done = true;
+    while (!s_is_drained) {
+        tk_dly_tsk(10);
+    }
+
+    for (int i = 0; i < RING_FRAME_COUNT; i++) {
+        uint8_t frame[RING_FRAME_SIZE];
+        frame[0] = (uint8_t)i;
+        sim_fill_pattern(&frame[1], RING_FRAME_SIZE - 1, p_context->p_params->seed * RING_FRAME_COUNT + (uint32_t)i);
+        LoRabbit_SendFrame(p_handle, 0x0002, 0, frame, sizeof(frame));
+        tk_dly_tsk(RING_FRAME_INTERVAL_MS);
+    }
+    s_is_sender_done = true;
+    tk_ext_tsk();
+}
+
+static void ring_receiver_task(INT stacd, void *exinf) {
+    (void)stacd;
+    RingContext_t *p_context = (RingContext_t *)exinf;
+    SimTrialResult_t *p_result = p_context->p_result;
+    if (p_context->p_params->use_dtc) {
+        sim_node_use_uart_dtc(p_context->p_node);
+    }
+    LoraConfigItem_t config = sim_default_config(0x0002, LORA_AIR_DATA_RATE_21875_BPS_SF_7_BW_500);
+    sim_node_boot(p_context->p_node, &config);
+    LoraHandle_t *p_handle = sim_node_handle(p_context->p_node);
+
+    // 起動時の設定の応答は読み出し済みなので、ここから受け取ったバイトがリングバッファに溜まる
+    const uint32_t start_bytes = sim_node_stats(p_context->p_node)->uart_rx_byte_count;
+    while (!s_is_burst_done) {
+        tk_dly_tsk(10);
+    }
+    tk_dly_tsk(RING_OUTPUT_SETTLE_MS);
+    uint32_t overflow_count = 0;
+    LoRabbit_GetRxOverflowCount(p_handle, &overflow_count);
+    const uint32_t buffered = sim_node_stats(p_context->p_node)->uart_rx_byte_count - start_bytes;
+    p_result->value[RING_VALUE_OVERFLOW] = overflow_count;
+    p_result->value[RING_VALUE_EXPECTED] = (buffered > LORABBIT_RX_BUFFER_SIZE) ? buffered - LORABBIT_RX_BUFFER_SIZE : 0;
+
+    // 溜まったデータ (溢れてつながったフレーム) を読み捨てる
+    RecvFrameE220900T22SJP_t frame;
+    while (LoRabbit_ReceiveFrame(p_handle, &frame, TMO_POL) > 0) {
+    }
+    s_is_drained = true;
+
+    bool is_received[RING_FRAME_COUNT] = {false};
+    while (!s_is_sender_done) {
+        if (RING_FRAME_SIZE != LoRabbit_ReceiveFrame(p_handle, &frame, SIM_RECEIVE_POLL_MS)) {
+            continue;
+        }
+        int index = frame.recv_data[0];
+        if (index < RING_FRAME_COUNT && !is_received[index] &&
+            sim_check_pattern(&frame.recv_data[1], RING_FRAME_SIZE - 1,
+                              p_context->p_params->seed * RING_FRAME_COUNT + (uint32_t)index)) {
+            is_received[index] = true;
+            p_result->value[RING_VALUE_FRAMES] += 1.0;
+        }
+    }
+    tk_ext_tsk();
+}
+
+static void ring_trial(const void *p_params, SimTrialResult_t *p_result) {
+    const RingParams_t *p = (const RingParams_t *)p_params;
+    SimChannelModel_t model = {0};
+    sim_e220_init(&model);
+    RingContext_t sender = {p, sim_node_create(true), p_result};
+    RingContext_t receiver = {p, sim_node_create(true), p_result};
+    sim_start_task(ring_sender_task, &sender, SIM_TASK_PRIORITY);
+    sim_start_task(ring_receiver_task, &receiver, SIM_TASK_PRIORITY);
+    sim_trial_run(p_result);
+
+    const double *p_value = p_result->value;
+    p_result->is_ok = SIM_RUN_DONE == p_result->run_result && p_value[RING_VALUE_EXPECTED] > 0.0 &&
+                      p_value[RING_VALUE_OVERFLOW] == p_value[RING_VALUE_EXPECTED] &&
+                      RING_FRAME_COUNT == p_value[RING_VALUE_FRAMES];
+}
+
+void scenario_ring(void) {
+    printf("%-4s %-9s %9s %9s %9s\n", "dtc", "ok/trials", "overflow", "expected", "frames");
+    for (int use_dtc = 0; use_dtc <= 1; use_dtc++) {
+        RingParams_t params = {(1 == use_dtc), 0};
+        SimSummary_t summary = {0};
+        for (int seed = 1; seed <= g_sim_seeds; seed++) {
+            params.seed = (uint32_t)seed;
+            SimTrialResult_t result;
+            if (!sim_trial(ring_trial, &params, (uint32_t)seed, &result)) {
+                result.is_ok = false;
+            }
+            sim_summary_add(&summary, &result);
+        }
+        char ok_text[16];
+        snprintf(ok_text, sizeof(ok_text), "%d/%d", summary.ok_count, summary.trials);
+        printf("%-4s %-9s %9.1f %9.1f %9.1f\n", use_dtc ? "on" : "off", ok_text,
+               sim_summary_mean(&summary, summary.sum[RING_VALUE_OVERFLOW]),
+               sim_summary_mean(&summary, summary.sum[RING_VALUE_EXPECTED]),
+               sim_summary_mean(&summary, summary.sum[RING_VALUE_FRAMES]));
+    }
+}
@@ -0,0 +1,249 @@
+/**
+ * @file scenario_service.c
+ * @brief 送信サービスへの送信要求の投入
+ * @details 送信側の端末で3つのアプリケーションタスクが、2000バイトの転送を2回ずつ同時に送信します。
+ * 各タスクが LoRabbit_SendDataWithOptions() を直接呼ぶ場合と、LoRabbit_SubmitSend() で送信サービスに
+ * 投入する場合で、アプリケーションタスクが送信の呼び出しで止まっていた時間と、全ての転送が届くまでの時間を比べます。
+ * 送信サービスでは、タスクごとに完了の知り方を変えます (イベントフラグ、コールバック、is_done のポーリング)。
+ * 受信のタイムアウトで送信側の終了を確かめるため、AUXピンをつないだ端末で動かします。
+ * 全ての転送を受信し、全ての送信が成功を返し、送信サービスでは全ての完了通知が1回ずつ届いた試行を成功とします。
+ */
+#include "scenarios.h"
+#include "sim_scenario.h"
+#include "LoRabbit_service.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SERVICE_SIZE           2000
+#define SERVICE_TASK_COUNT     3
+#define SERVICE_TRANSFER_COUNT 2 /**< アプリケーションタスク1つあたりの転送の数 */
+#define SERVICE_TRANSFER_TOTAL (SERVICE_TASK_COUNT * SERVICE_TRANSFER_COUNT)
+
+#define SERVICE_VALUE_RECEIVED 0 /**< value[]: 受信できた転送の数 */
+#define SERVICE_VALUE_SENT     1 /**< value[]: 送信が成功を返した転送の数 */
+#define SERVICE_VALUE_CALL_MS  2 /**< value[]: 送信の呼び出し1回あたりの、アプリケーションタスクが止まっていた時間 (ミリ秒) */
+
+// 完了の知り方 (送信サービスのみ)
+typedef enum {
+    SERVICE_NOTIFY_FLAG,     // イベントフラグを待つ
+    SERVICE_NOTIFY_CALLBACK, // コールバックで数える
+    SERVICE_NOTIFY_POLL,     // is_done を見る
+} ServiceNotify_t;
+
+static volatile int s_sender_done_count;  // 試行ごとに子プロセスで初期化される
+static volatile int s_callback_count;
+static volatile bool s_is_service_ready;
+
+typedef struct {
+    bool     use_service; // LoRabbit_SubmitSend() を使うか
+    double   frame_loss;
+    uint32_t seed;
+} ServiceParams_t;
+
+typedef struct {
+    const ServiceParams_t *p_params;
+    SimNode_t *p_node;
+    SimTrialResult_t *p_result;
+    int index; // アプリケーションタスクの番号 (受信側は -1)
+} ServiceContext_t;
+
+static uint32_t service_pattern_seed(uint32_t seed, int task, int transfer) {
+    return seed * 100 + (uint32_t)(task * SERVICE_TRANSFER_COUNT + transfer);
+}
+
+static void service_done_callback(LoRabbit_TxRequest_t *p_request) {
+    (void)p_request;
+    s_callback_count++;
+}
+
+// 送信サービスに転送を全て投入し、タスクごとの方法で完了を待つヘルパー関数（内部利用）
+static int service_submit_all(ServiceContext_t *p_context, LoraHandle_t *p_handle, uint8_t **pp_data,
+                              double *p_call_ms_sum) {
+    LoRabbit_TxRequest_t requests[SERVICE_TRANSFER_COUNT] = {0};
+    const ServiceNotify_t notify = (ServiceNotify_t)p_context->index;
+    ID flag_id = 0;
+    if (SERVICE_NOTIFY_FLAG == notify) {
+        T_CFLG cflg = {.flgatr = TA_TFIFO | TA_WMUL, .iflgptn = 0};
+        flag_id = tk_cre_flg(&cflg);
+    }
+    for (int k = 0; k < SERVICE_TRANSFER_COUNT; k++) {
+        LoRabbit_TxRequest_t *p_request = &requests[k];
+        p_request->target_address = 0x0002;
+        p_request->p_data = pp_data[k];
+        p_request->size = SERVICE_SIZE;
+        p_request->options.mode = LORABBIT_TP_MODE_WINDOW;
+        if (SERVICE_NOTIFY_FLAG == notify) {
+            p_request->done_flag_id = flag_id;
+            p_request->done_flag_pattern = 1U << k;
+        } else if (SERVICE_NOTIFY_CALLBACK == notify) {
+            p_request->pf_done_callback = service_done_callback;
+        }
+        uint64_t call_us = sim_now_us();
+        int ret = LoRabbit_SubmitSend(p_handle, p_request, TMO_FEVR);
+        *p_call_ms_sum += (double)(sim_now_us() - call_us) / 1000.0;
+        if (LORABBIT_OK != ret) {
+            return ret;
+        }
+    }
+
+    // 完了を待つ
+    const UINT all_pattern = (1U << SERVICE_TRANSFER_COUNT) - 1;
+    if (SERVICE_NOTIFY_FLAG == notify) {
+        FLGPTN pattern = 0;
+        tk_wai_flg(flag_id, all_pattern, TWF_ANDW | TWF_CLR, &pattern, TMO_FEVR);
+    }
+    for (int k = 0; k < SERVICE_TRANSFER_COUNT; k++) {
+        while (!requests[k].is_done) {
+            tk_dly_tsk(100);
+        }
+        if (LORABBIT_OK == requests[k].result) {
+            p_context->p_result->value[SERVICE_VALUE_SENT] += 1.0;
+        }
+    }
+    return LORABBIT_OK;
+}
+
+static void service_app_task(INT stacd, void *exinf) {
+    (void)stacd;
+    ServiceContext_t *p_context = (ServiceContext_t *)exinf;
+    const ServiceParams_t *p_params = p_context->p_params;
+    LoraHandle_t *p_handle = sim_node_handle(p_context->p_node);
+    if (0 == p_context->index) {
+        // 1つ目のタスクが端末を起動し、送信サービスを起動する
+        LoraConfigItem_t config = sim_default_config(0x0001, LORA_AIR_DATA_RATE_62500_BPS_SF_5_BW_500);
+        sim_node_boot(p_context->p_node, &config);
+        if (p_params->use_service) {
+            p_context->p_result->ret[0] = LoRabbit_StartTxService(p_handle, SIM_TASK_PRIORITY);
+        }
+        s_is_service_ready = true;
+    }
+    tk_dly_tsk(SIM_BOOT_SETTLE_MS);
+    while (!s_is_service_ready) {
+        tk_dly_tsk(10);
+    }
+
+    uint8_t *p_data[SERVICE_TRANSFER_COUNT];
+    for (int k = 0; k < SERVICE_TRANSFER_COUNT; k++) {
+        p_data[k] = malloc(SERVICE_SIZE);
+        sim_fill_pattern(p_data[k], SERVICE_SIZE, service_pattern_seed(p_params->seed, p_context->index, k));
+    }
+    p_context->p_result->start_us = sim_now_us();
+    double call_ms_sum = 0.0;
+    if (p_params->use_service) {
+        int ret = service_submit_all(p_context, p_handle, p_data, &call_ms_sum);
+        if (LORABBIT_OK != ret) {
+            p_context->p_result->ret[1] = ret;
+        }
+    } else {
+        LoRabbit_SendOptions_t options = {.mode = LORABBIT_TP_MODE_WINDOW};
+        for (int k = 0; k < SERVICE_TRANSFER_COUNT; k++) {
+            uint64_t call_us = sim_now_us();
+            int ret = LoRabbit_SendDataWithOptions(p_handle, 0x0002, 0, p_data[k], SERVICE_SIZE, &options);
+            call_ms_sum += (double)(sim_now_us() - call_us) / 1000.0;
+            if (LORABBIT_OK == ret) {
+                p_context->p_result->value[SERVICE_VALUE_SENT] += 1.0;
+            }
+        }
+    }
+    p_context->p_result->value[SERVICE_VALUE_CALL_MS] += call_ms_sum / SERVICE_TRANSFER_TOTAL;
+    for (int k = 0; k < SERVICE_TRANSFER_COUNT; k++) {
+        free(p_data[k]);
+    }
+    s_sender_done_count++;
+    tk_ext_tsk();
+}
+
+// 受信したデータがどの転送のものかを調べ、初めて受信した転送なら記録するヘルパー関数（内部利用）
+static void service_record(ServiceContext_t *p_context, bool *p_is_received, const uint8_t *p_data, uint32_t size) {
+    if (SERVICE_SIZE != size) {
+        return;
+    }
+    for (int j = 0; j < SERVICE_TRANSFER_TOTAL; j++) {
+        uint32_t seed = service_pattern_seed(p_context->p_params->seed, j / SERVICE_TRANSFER_COUNT,
+                                             j % SERVICE_TRANSFER_COUNT);
+        if (!p_is_received[j] && sim_check_pattern(p_data, size, seed)) {
+            p_is_received[j] = true;
+            p_context->p_result->value[SERVICE_VALUE_RECEIVED] += 1.0;
+            p_context->p_result->elapsed_us = sim_now_us() - p_context->p_result->start_us;
+            return;
+        }
+    }
+}
+
+static void service_receiver_task(INT stacd, void *exinf) {
+    (void)stacd;
+    ServiceContext_t *p_context = (ServiceContext_t *)exinf;
+    LoraConfigItem_t config = sim_default_config(0x0002, LORA_AIR_DATA_RATE_62500_BPS_SF_5_BW_500);
+    sim_node_boot(p_context->p_node, &config);
+    LoraHandle_t *p_handle = sim_node_handle(p_context->p_node);
+
+    uint8_t *p_buffer = calloc(1, SERVICE_SIZE + 200);
+    bool is_received[SERVICE_TRANSFER_TOTAL] = {false};
+    // 送信側が全て終わるまで受信を続け、完了後に届いた再送にもACKを返し直す
+    while (s_sender_done_count < SERVICE_TASK_COUNT) {
+        uint32_t received_size = 0;
+        if (LORABBIT_OK == LoRabbit_ReceiveData(p_handle, p_buffer, SERVICE_SIZE + 200, &received_size,
+                                                SIM_RECEIVE_POLL_MS)) {
+            service_record(p_context, is_received, p_buffer, received_size);
+        }
+    }
+    free(p_buffer);
+    tk_ext_tsk();
+}
+
+static void service_trial(const void *p_params, SimTrialResult_t *p_result) {
+    const ServiceParams_t *p = (const ServiceParams_t *)p_params;
+    SimChannelModel_t model = {.frame_loss = p->frame_loss};
+    sim_e220_init(&model);
+    SimNode_t *p_sender_node = sim_node_create(true);
+    ServiceContext_t apps[SERVICE_TASK_COUNT];
+    ServiceContext_t receiver = {p, sim_node_create(true), p_result, -1};
+    for (int i = 0; i < SERVICE_TASK_COUNT; i++) {
+        apps[i] = (ServiceContext_t){p, p_sender_node, p_result, i};
+        sim_start_task(service_app_task, &apps[i], SIM_TASK_PRIORITY);
+    }
+    sim_start_task(service_receiver_task, &receiver, SIM_TASK_PRIORITY);
+    sim_trial_run(p_result);
+    p_result->is_ok = SIM_RUN_DONE == p_result->run_result && LORABBIT_OK == p_result->ret[0] &&
+                      LORABBIT_OK == p_result->ret[1] &&
+                      SERVICE_TRANSFER_TOTAL == p_result->value[SERVICE_VALUE_RECEIVED] &&
+                      SERVICE_TRANSFER_TOTAL == p_result->value[SERVICE_VALUE_SENT] &&
+                      (!p->use_service || SERVICE_TRANSFER_COUNT == s_callback_count);
+}
+
+void scenario_service(void) {
+    static const double s_losses[] = {0.0, 0.1};
+    printf("%-5s %-13s %-9s %9s %9s %9s %9s\n", "loss", "api", "ok/trials", "received", "sent", "call_ms",
+           "mean_ms");
+    for (size_t l = 0; l < sizeof(s_losses) / sizeof(s_losses[0]); l++) {
+        for (int use_service = 0; use_service <= 1; use_service++) {
+            ServiceParams_t params = {(1 == use_service), s_losses[l], 0};
+            SimSummary_t summary = {0};
+            double received_sum = 0.0;
+            double sent_sum = 0.0;
+            for (int seed = 1; seed <= g_sim_seeds; seed++) {
+                params.seed = (uint32_t)seed;
+                SimTrialResult_t result;
+                if (!sim_trial(service_trial, &params, (uint32_t)seed, &result)) {
+                    result.is_ok = false;
+                    result.value[SERVICE_VALUE_RECEIVED] = 0.0;
+                    result.value[SERVICE_VALUE_SENT] = 0.0;
+                }
+                sim_summary_add(&summary, &result);
+                received_sum += result.value[SERVICE_VALUE_RECEIVED];
+                sent_sum += result.value[SERVICE_VALUE_SENT];
+            }
+            const double transfer_total = (double)(SERVICE_TRANSFER_TOTAL * summary.trials);
+            char ok_text[16];
+            char received_text[16];
+            char sent_text[16];
+            snprintf(ok_text, sizeof(ok_text), "%d/%d", summary.ok_count, summary.trials);
+            snprintf(received_text, sizeof(received_text), "%.0f/%.0f", received_sum, transfer_total);
+            snprintf(sent_text, sizeof(sent_text), "%.0f/%.0f", sent_sum, transfer_total);
+            printf("%3.0f%%  %-13s %-9s %9s %9s %9.0f %9.0f\n", s_losses[l] * 100.0,
+                   use_service ? "SubmitSend" : "SendData", ok_text, received_text, sent_text,
+                   sim_summary_mean(&summary, summary.sum[SERVICE_VALUE_CALL_MS]),
+                   sim_summary_mean(&summary, summary.elapsed_ms_sum));
+        }
+    }
+}
@@ -0,0 +1,192 @@
+/**
+ * @file scenario_survey.c
+ * @brief チャンネルの調査 (LORABBIT_USE_CHANNEL_SURVEY) と、通信相手と示し合わせたチャンネル移動
+ * @details 要求側 (0x0040) と相手 (0x0041) がチャンネル0にいて、妨害側がチャンネル0 (使用中の割合の高い)
+ * とチャンネル2 (低い) で100バイトのフレームを送り続けます。チャンネル1と3は空いています。
+ * 要求側は LoRabbit_SurveyChannels() でチャンネル0〜3を調べ、最も空いているチャンネルへ
+ * LoRabbit_MoveChannel() で相手と移ります。相手は受信したフレームを LoRabbit_AcceptChannelMove() に渡します。
+ * 要求側が受け取る応答を、損失のモデルとは別に sim_node_drop_rx() で失わせ、最初の応答が失われた場合と
+ * 全ての応答が失われた場合も確かめます。妨害側と重なったフレームも失われます。
+ * 受信のタイムアウトで送信側の終了を確かめるため、AUXピンをつないだ端末で動かします。
+ * 調査の結果の先頭が空いているチャンネル1で、チャンネル0を使用中と数え、
+ * 移動が成功した場合は両方のモジュールが移動先に、失敗した場合は要求側のモジュールが元のチャンネルにいる
+ * 試行を成功とします。失敗した場合に相手だけが移動先にいること (stranded) は、API の説明の通りの動作です。
+ */
+#include "scenarios.h"
+#include "sim_scenario.h"
+#include "LoRabbit_survey.h"
+#include <stdio.h>
+#include <string.h>
+
+#define SURVEY_FIRST_CHANNEL   0
+#define SURVEY_LAST_CHANNEL    3
+#define SURVEY_CHANNEL_COUNT   (SURVEY_LAST_CHANNEL - SURVEY_FIRST_CHANNEL + 1)
+#define SURVEY_HOME_CHANNEL    0 /**< 要求側と相手が最初にいるチャンネル (妨害側も送る) */
+#define SURVEY_LIGHT_CHANNEL   2 /**< 妨害側がまばらに送るチャンネル */
+#define SURVEY_QUIET_CHANNEL   1 /**< 調査の結果の先頭になるはずのチャンネル (空いているうち番号の小さい方) */
+#define SURVEY_NOISE_SIZE      100
+#define SURVEY_SETTLE_MS       1000 /**< 移動を終えてから、両方のモジュールのチャンネルを確かめるまでの時間 */
+
+#define SURVEY_VALUE_MOVED      0 /**< value[]: LoRabbit_MoveChannel() が成功した試行 (1か0) */
+#define SURVEY_VALUE_FAILED     1 /**< value[]: LoRabbit_MoveChannel() が LORABBIT_ERROR_ACK_FAILED を返した試行 */
+#define SURVEY_VALUE_STRANDED   2 /**< value[]: 移動が失敗し、相手だけが移動先にいる試行 */
+#define SURVEY_VALUE_RECOVERED  3 /**< value[]: 相手が移動先で要求を受け取った (応答が失われた後の確認) 試行 */
+#define SURVEY_VALUE_HOME_BUSY  4 /**< value[]: 調査で求めたチャンネル0の使用中の割合 (%) */
+#define SURVEY_VALUE_LIGHT_BUSY 5 /**< value[]: 調査で求めたチャンネル2の使用中の割合 (%) */
+#define SURVEY_VALUE_SURVEY_MS  6 /**< value[]: LoRabbit_SurveyChannels() にかかった時間 (ミリ秒) */
+#define SURVEY_VALUE_MOVE_MS    7 /**< value[]: LoRabbit_MoveChannel() にかかった時間 (ミリ秒) */
+
+static volatile bool s_is_requester_done; // 試行ごとに子プロセスで初期化される
+
+typedef struct {
+    const char *name;
+    double   frame_loss;
+    uint32_t dropped_acks; // 要求側が受け取る応答のうち、sim_node_drop_rx() で失わせる数
+} SurveyParams_t;
+
+typedef struct {
+    const SurveyParams_t *p_params;
+    SimNode_t *p_node;
+    SimTrialResult_t *p_result;
+    uint16_t address;
+    uint8_t  noise_channel;     // 妨害側が送るチャンネル
+    uint32_t noise_gap_min_ms;  // 妨害側の送信の間隔 (この値から200ミリ秒長い値までの間でランダム)
+} SurveyContext_t;
+
+static LoraHandle_t *survey_boot(SurveyContext_t *p_context) {
+    LoraConfigItem_t config = sim_default_config(p_context->address, LORA_AIR_DATA_RATE_5469_BPS_SF_7_BW_125);
+    config.own_channel = SURVEY_HOME_CHANNEL;
+    sim_node_boot(p_context->p_node, &config);
+    return sim_node_handle(p_context->p_node);
+}
+
+static void survey_requester_task(INT stacd, void *exinf) {
+    (void)stacd;
+    SurveyContext_t *p_context = (SurveyContext_t *)exinf;
+    SimTrialResult_t *p_result = p_context->p_result;
+    LoraHandle_t *p_handle = survey_boot(p_context);
+    tk_dly_tsk(SIM_BOOT_SETTLE_MS);
+
+    LoRabbit_ChannelSurvey_t results[SURVEY_CHANNEL_COUNT];
+    double start_ms = sim_now_ms();
+    int count = LoRabbit_SurveyChannels(p_handle, SURVEY_FIRST_CHANNEL, SURVEY_LAST_CHANNEL, results,
+                                        SURVEY_CHANNEL_COUNT);
+    p_result->value[SURVEY_VALUE_SURVEY_MS] = sim_now_ms() - start_ms;
+    p_result->ret[0] = count;
+    for (int i = 0; i < count; i++) {
+        if (SURVEY_HOME_CHANNEL == results[i].channel) {
+            p_result->value[SURVEY_VALUE_HOME_BUSY] = results[i].busy_percent;
+        } else if (SURVEY_LIGHT_CHANNEL == results[i].channel) {
+            p_result->value[SURVEY_VALUE_LIGHT_BUSY] = results[i].busy_percent;
+        }
+    }
+
+    if (SURVEY_CHANNEL_COUNT == count) {
+        p_result->ret[2] = results[0].channel;
+        sim_node_drop_rx(p_context->p_node, p_context->p_params->dropped_acks);
+        start_ms = sim_now_ms();
+        p_result->ret[1] = LoRabbit_MoveChannel(p_handle, 0x0041, SURVEY_HOME_CHANNEL, results[0].channel);
+        p_result->value[SURVEY_VALUE_MOVE_MS] = sim_now_ms() - start_ms;
+        sim_node_drop_rx(p_context->p_node, 0);
+    }
+    tk_dly_tsk(SURVEY_SETTLE_MS);
+    s_is_requester_done = true;
+    tk_ext_tsk();
+}
+
+static void survey_peer_task(INT stacd, void *exinf) {
+    (void)stacd;
+    SurveyContext_t *p_context = (SurveyContext_t *)exinf;
+    LoraHandle_t *p_handle = survey_boot(p_context);
+    while (!s_is_requester_done) {
+        RecvFrameE220900T22SJP_t frame;
+        if (LoRabbit_ReceiveFrame(p_handle, &frame, SIM_RECEIVE_POLL_MS) <= 0) {
+            continue;
+        }
+        const uint8_t channel = p_handle->current_config.own_channel;
+        int new_channel = LoRabbit_AcceptChannelMove(p_handle, &frame, NULL);
+        if (new_channel >= 0 && new_channel == channel) {
+            // 既に移動先にいる: 要求側が応答を受け取れず、移動先で要求を送り直した
+            p_context->p_result->value[SURVEY_VALUE_RECOVERED] = 1.0;
+        }
+    }
+    tk_ext_tsk();
+}
+
+// キャリアセンスをせずに、フレームを送り続けるタスク
+static void survey_noise_task(INT stacd, void *exinf) {
+    (void)stacd;
+    SurveyContext_t *p_context = (SurveyContext_t *)exinf;
+    LoraHandle_t *p_handle = survey_boot(p_context);
+    tk_dly_tsk((RELTIM)(sim_random() * SIM_BOOT_SETTLE_MS));
+
+    uint8_t frame[SURVEY_NOISE_SIZE];
+    memset(frame, 0x55, sizeof(frame));
+    while (!s_is_requester_done) {
+        LoRabbit_SendFrame(p_handle, 0x0050, p_context->noise_channel, frame, sizeof(frame));
+        tk_dly_tsk(p_context->noise_gap_min_ms + (RELTIM)(sim_random() * 200));
+    }
+    tk_ext_tsk();
+}
+
+static void survey_trial(const void *p_params, SimTrialResult_t *p_result) {
+    const SurveyParams_t *p = (const SurveyParams_t *)p_params;
+    SimChannelModel_t model = {p->frame_loss, 0.0};
+    sim_e220_init(&model);
+    SurveyContext_t requester = {p, sim_node_create(true), p_result, 0x0040, 0, 0};
+    SurveyContext_t peer = {p, sim_node_create(true), p_result, 0x0041, 0, 0};
+    SurveyContext_t home_noise = {p, sim_node_create(true), p_result, 0x0030, SURVEY_HOME_CHANNEL, 150};
+    SurveyContext_t light_noise = {p, sim_node_create(true), p_result, 0x0031, SURVEY_LIGHT_CHANNEL, 500};
+    sim_start_task(survey_requester_task, &requester, SIM_TASK_PRIORITY);
+    sim_start_task(survey_peer_task, &peer, SIM_TASK_PRIORITY);
+    sim_start_task(survey_noise_task, &home_noise, SIM_TASK_PRIORITY);
+    sim_start_task(survey_noise_task, &light_noise, SIM_TASK_PRIORITY);
+    sim_trial_run(p_result);
+
+    const uint8_t new_channel = (uint8_t)p_result->ret[2];
+    const uint8_t requester_channel = sim_node_channel(requester.p_node);
+    const uint8_t peer_channel = sim_node_channel(peer.p_node);
+    bool is_consistent = false;
+    if (LORABBIT_OK == p_result->ret[1]) {
+        p_result->value[SURVEY_VALUE_MOVED] = 1.0;
+        is_consistent = (new_channel == requester_channel && new_channel == peer_channel);
+    } else if (LORABBIT_ERROR_ACK_FAILED == p_result->ret[1]) {
+        p_result->value[SURVEY_VALUE_FAILED] = 1.0;
+        p_result->value[SURVEY_VALUE_STRANDED] = (new_channel == peer_channel) ? 1.0 : 0.0;
+        is_consistent = (SURVEY_HOME_CHANNEL == requester_channel);
+    }
+    p_result->is_ok = SIM_RUN_DONE == p_result->run_result && SURVEY_CHANNEL_COUNT == p_result->ret[0] &&
+                      SURVEY_QUIET_CHANNEL == new_channel && p_result->value[SURVEY_VALUE_HOME_BUSY] > 0.0 &&
+                      is_consistent;
+}
+
+void scenario_survey(void) {
+    static const SurveyParams_t s_params[] = {
+        {"none", 0.0, 0},
+        {"ack1", 0.0, 1},
+        {"ack_all", 0.0, 100},
+        {"loss20", 0.2, 0},
+    };
+    printf("%-8s %-9s %8s %8s %9s %6s %6s %6s %8s %9s\n", "lost", "ok/trials", "ch0_busy", "ch2_busy",
+           "survey_ms", "moved", "failed", "strand", "recover", "move_ms");
+    for (size_t i = 0; i < sizeof(s_params) / sizeof(s_params[0]); i++) {
+        SurveyParams_t params = s_params[i];
+        SimSummary_t summary = {0};
+        for (int seed = 1; seed <= g_sim_seeds; seed++) {
+            SimTrialResult_t result;
+            if (!sim_trial(survey_trial, &params, (uint32_t)seed, &result)) {
+                result.is_ok = false;
+            }
+            sim_summary_add(&summary, &result);
+        }
+        char ok_text[16];
+        snprintf(ok_text, sizeof(ok_text), "%d/%d", summary.ok_count, summary.trials);
+        printf("%-8s %-9s %8.1f %8.1f %9.0f %6.0f %6.0f %6.0f %8.0f %9.0f\n", params.name, ok_text,
+               sim_summary_mean(&summary, summary.sum[SURVEY_VALUE_HOME_BUSY]),
+               sim_summary_mean(&summary, summary.sum[SURVEY_VALUE_LIGHT_BUSY]),
+               sim_summary_mean(&summary, summary.sum[SURVEY_VALUE_SURVEY_MS]),
+               summary.sum[SURVEY_VALUE_MOVED], summary.sum[SURVEY_VALUE_FAILED],
+               summary.sum[SURVEY_VALUE_STRANDED], summary.sum[SURVEY_VALUE_RECOVERED],
+               sim_summary_mean(&summary, summary.sum[SURVEY_VALUE_MOVE_MS]));
+    }
+}
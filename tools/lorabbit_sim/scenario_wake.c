@@ -0,0 +1,154 @@
+/**
+ * @file scenario_wake.c
+ * @brief AUXピンを使わない受信の待ち (UARTの受信割り込みで起こす受信と、受信のタイムアウト)
+ * @details AUXピンをつながない端末どうしで動かします。受信側は、まだ何も届かない間に
+ * LoRabbit_ReceiveFrame() を500ミリ秒のタイムアウトで3回呼び、0を返すまでの時間を測ります。
+ * 続いて送信側が8バイトのフレームを LoRabbit_SendFrame() で300ミリ秒ごとに20個送り、受信側が
+ * LoRabbit_ReceiveFrame() で受け取るまでの時間 (送信の呼び出しから) の平均と最大を測ります (SF7/500kHz)。
+ * 受信側のUARTに受信のDTC転送を指定しない場合と指定した場合で動かします。
+ * タイムアウトした受信が全て0を返して指定の時間で戻り、全てのフレームを別々に受け取った試行を成功とします。
+ */
+#include "scenarios.h"
+#include "sim_scenario.h"
+#include <stdio.h>
+
+#define WAKE_TIMEOUT_MS        500
+#define WAKE_TIMEOUT_COUNT     3
+#define WAKE_TIMEOUT_SLACK_MS  2   /**< タイムアウトした受信が戻るまでの時間の、指定との差の許容値 */
+#define WAKE_FRAME_COUNT       20
+#define WAKE_FRAME_SIZE        8
+#define WAKE_FRAME_INTERVAL_MS 300
+
+#define WAKE_VALUE_TIMEOUTS       0 /**< value[]: 0を返して指定の時間で戻った、タイムアウトした受信の数 */
+#define WAKE_VALUE_TIMEOUT_MS     1 /**< value[]: タイムアウトした受信が戻るまでの時間の最大値 (ミリ秒) */
+#define WAKE_VALUE_FRAMES         2 /**< value[]: 受け取れたフレームの数 */
+#define WAKE_VALUE_LATENCY_SUM_MS 3 /**< value[]: フレームを送ってから受け取るまでの時間の合計 (ミリ秒) */
+#define WAKE_VALUE_LATENCY_MS     4 /**< value[]: フレームを送ってから受け取るまでの時間の最大値 (ミリ秒) */
+#define WAKE_VALUE_RX_IRQ         5 /**< value[]: 受信側のUART受信の割り込みの回数 */
+
+static volatile bool s_is_receiver_ready; // 試行ごとに子プロセスで初期化される
+static volatile bool s_is_sender_done;
+static uint64_t s_sent_us[WAKE_FRAME_COUNT];
+
+typedef struct {
+    bool     use_dtc;
+    uint32_t seed;
+} WakeParams_t;
+
+typedef struct {
+    const WakeParams_t *p_params;
+    SimNode_t *p_node;
+    SimTrialResult_t *p_result;
+} WakeContext_t;
+
+static void wake_sender_task(INT stacd, void *exinf) {
+    (void)stacd;
+    WakeContext_t *p_context = (WakeContext_t *)exinf;
+    LoraConfigItem_t config = sim_default_config(0x0001, LORA_AIR_DATA_RATE_21875_BPS_SF_7_BW_500);
+    sim_node_boot(p_context->p_node, &config);
+    LoraHandle_t *p_handle = sim_node_handle(p_context->p_node);
+    while (!s_is_receiver_ready) {
+        tk_dly_tsk(10);
+    }
+
+    for (int i = 0; i < WAKE_FRAME_COUNT; i++) {
+        uint8_t frame[WAKE_FRAME_SIZE];
+        frame[0] = (uint8_t)i;
+        sim_fill_pattern(&frame[1], WAKE_FRAME_SIZE - 1, p_context->p_params->seed * WAKE_FRAME_COUNT + (uint32_t)i);
+        s_sent_us[i] = sim_now_us();
+        LoRabbit_SendFrame(p_handle, 0x0002, 0, frame, sizeof(frame));
+        tk_dly_tsk(WAKE_FRAME_INTERVAL_MS);
+    }
+    s_is_sender_done = true;
+    tk_ext_tsk();
+}
+
+static void wake_receiver_task(INT stacd, void *exinf) {
+    (void)stacd;
+    WakeContext_t *p_context = (WakeContext_t *)exinf;
+    double *p_value = p_context->p_result->value;
+    if (p_context->p_params->use_dtc) {
+        sim_node_use_uart_dtc(p_context->p_node);
+    }
+    LoraConfigItem_t config = sim_default_config(0x0002, LORA_AIR_DATA_RATE_21875_BPS_SF_7_BW_500);
+    sim_node_boot(p_context->p_node, &config);
+    LoraHandle_t *p_handle = sim_node_handle(p_context->p_node);
+    tk_dly_tsk(SIM_BOOT_SETTLE_MS);
+
+    RecvFrameE220900T22SJP_t frame;
+    for (int i = 0; i < WAKE_TIMEOUT_COUNT; i++) {
+        uint64_t start_us = sim_now_us();
+        int ret = LoRabbit_ReceiveFrame(p_handle, &frame, WAKE_TIMEOUT_MS);
+        double elapsed_ms = (double)(sim_now_us() - start_us) / 1000.0;
+        if (0 == ret && elapsed_ms >= WAKE_TIMEOUT_MS && elapsed_ms <= WAKE_TIMEOUT_MS + WAKE_TIMEOUT_SLACK_MS) {
+            p_value[WAKE_VALUE_TIMEOUTS] += 1.0;
+        }
+        if (elapsed_ms > p_value[WAKE_VALUE_TIMEOUT_MS]) {
+            p_value[WAKE_VALUE_TIMEOUT_MS] = elapsed_ms;
+        }
+    }
+    s_is_receiver_ready = true;
+
+    bool is_received[WAKE_FRAME_COUNT] = {false};
+    while (!s_is_sender_done) {
+        if (WAKE_FRAME_SIZE != LoRabbit_ReceiveFrame(p_handle, &frame, SIM_RECEIVE_POLL_MS)) {
+            continue;
+        }
+        int index = frame.recv_data[0];
+        if (index >= WAKE_FRAME_COUNT || is_received[index] ||
+            !sim_check_pattern(&frame.recv_data[1], WAKE_FRAME_SIZE - 1,
+                               p_context->p_params->seed * WAKE_FRAME_COUNT + (uint32_t)index)) {
+            continue;
+        }
+        is_received[index] = true;
+        p_value[WAKE_VALUE_FRAMES] += 1.0;
+        double latency_ms = (double)(sim_now_us() - s_sent_us[index]) / 1000.0;
+        p_value[WAKE_VALUE_LATENCY_SUM_MS] += latency_ms;
+        if (latency_ms > p_value[WAKE_VALUE_LATENCY_MS]) {
+            p_value[WAKE_VALUE_LATENCY_MS] = latency_ms;
+        }
+    }
+    p_value[WAKE_VALUE_RX_IRQ] = sim_node_stats(p_context->p_node)->uart_rx_irq_count;
+    tk_ext_tsk();
+}
+
+static void wake_trial(const void *p_params, SimTrialResult_t *p_result) {
+    const WakeParams_t *p = (const WakeParams_t *)p_params;
+    SimChannelModel_t model = {0};
+    sim_e220_init(&model);
+    WakeContext_t sender = {p, sim_node_create(false), p_result};
+    WakeContext_t receiver = {p, sim_node_create(false), p_result};
+    sim_start_task(wake_sender_task, &sender, SIM_TASK_PRIORITY);
+    sim_start_task(wake_receiver_task, &receiver, SIM_TASK_PRIORITY);
+    sim_trial_run(p_result);
+
+    const double *p_value = p_result->value;
+    p_result->is_ok = SIM_RUN_DONE == p_result->run_result && WAKE_TIMEOUT_COUNT == p_value[WAKE_VALUE_TIMEOUTS] &&
+                      WAKE_FRAME_COUNT == p_value[WAKE_VALUE_FRAMES];
+}
+
+void scenario_wake(void) {
+    printf("%-4s %-9s %10s %8s %10s %10s %8s\n", "dtc", "ok/trials", "timeout_ms", "frames", "latency_ms",
+           "max_ms", "rx_irq");
+    for (int use_dtc = 0; use_dtc <= 1; use_dtc++) {
+        WakeParams_t params = {(1 == use_dtc), 0};
+        SimSummary_t summary = {0};
+        for (int seed = 1; seed <= g_sim_seeds; seed++) {
+            params.seed = (uint32_t)seed;
+            SimTrialResult_t result;
+            if (!sim_trial(wake_trial, &params, (uint32_t)seed, &result)) {
+                result.is_ok = false;
+            }
+            sim_summary_add(&summary, &result);
+        }
+        char ok_text[16];
+        snprintf(ok_text, sizeof(ok_text), "%d/%d", summary.ok_count, summary.trials);
+        double frames = sim_summary_mean(&summary, summary.sum[WAKE_VALUE_FRAMES]);
+        double latency_sum_ms = sim_summary_mean(&summary, summary.sum[WAKE_VALUE_LATENCY_SUM_MS]);
+        printf("%-4s %-9s %10.1f %8.1f %10.1f %10.1f %8.0f\n", use_dtc ? "on" : "off", ok_text,
+               sim_summary_mean(&summary, summary.sum[WAKE_VALUE_TIMEOUT_MS]), frames,
+               (frames > 0.0) ? latency_sum_ms / frames : 0.0,
+               sim_summary_mean(&summary, summary.sum[WAKE_VALUE_LATENCY_MS]),
+               sim_summary_mean(&summary, summary.sum[WAKE_VALUE_RX_IRQ]));
+    }
+}
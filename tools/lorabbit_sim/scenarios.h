@@ -0,0 +1,26 @@
+/**
+ * @file scenarios.h
+ * @brief シナリオの一覧
+ * @details 各シナリオは、パラメータと乱数シードを変えて試行を繰り返し、集計を標準出力に表示します。
+ */
+#pragma once
+
+void scenario_legacy(void);
+void scenario_wake(void);
+void scenario_length(void);
+void scenario_compact(void);
+void scenario_fragment(void);
+void scenario_multi(void);
+void scenario_loss(void);
+void scenario_fec(void);
+void scenario_multicast(void);
+void scenario_service(void);
+void scenario_dispatcher(void);
+void scenario_preempt(void);
+void scenario_reqresp(void);
+void scenario_aggregation(void);
+void scenario_budget(void);
+void scenario_lbt(void);
+void scenario_survey(void);
+void scenario_dtc(void);
+void scenario_ring(void);
@@ -0,0 +1,120 @@
+/**
+ * @file sim_e220.h
+ * @brief E220-900T22S(JP) モジュールと無線区間の模擬
+ * @details 端末ごとに LoraHandle_t と、それにつながるモジュールを持ちます。モジュールは
+ * UARTのバイト単位の送受信 (ボーレートに応じた時間)、M0/M1ピンによるモード切替、設定コマンド、
+ * RSSIノイズの読み出しコマンド、エアタイム、AUXピンを模擬します。
+ * 無線区間では、同じチャンネルで送信が重なったフレームと、半二重で受信できなかったフレームが失われ、
+ * それ以外のフレームも SimChannelModel_t の確率で失われます。
+ */
+#pragma once
+
+#include "LoRabbit.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SIM_MAX_NODES 10 /**< 端末の最大数 */
+
+/**
+ * @brief フレームが失われる確率のモデル
+ * @details フレームは受信側ごとに独立に失われます。両方の確率を指定した場合は、どちらかで失われます。
+ */
+typedef struct {
+    double frame_loss;      /**< フレームの長さによらず、1フレームが失われる確率 */
+    double byte_error_rate; /**< 1バイトあたりの誤り率 (長いフレームほど失われやすい) */
+} SimChannelModel_t;
+
+/**
+ * @brief 端末ごとの統計
+ */
+typedef struct {
+    uint32_t tx_frame_count;        /**< 送信したフレームの数 */
+    uint64_t tx_airtime_us;         /**< 送信したフレームのエアタイムの合計 (マイクロ秒) */
+    uint32_t rx_frame_count;        /**< UARTに出力したフレームの数 */
+    uint32_t rx_lost_count;         /**< 損失のモデルで失われたフレームの数 */
+    uint32_t rx_collision_count;    /**< 送信の重なりか、自身の送信中で受信できなかったフレームの数 */
+    uint32_t uart_write_busy_count; /**< 前の書き込みの送信中に書き込もうとして失敗した回数 */
+    uint32_t uart_rx_byte_count;    /**< モジュールがMCUへ出力し、MCUが受け取ったバイトの数 */
+    uint32_t uart_rx_irq_count;     /**< MCUが受けたUART受信の割り込み (LoRabbit_UartCallbackHandler() の呼び出し) の回数 */
+} SimNodeStats_t;
+
+/**
+ * @brief 端末 (MCUとモジュール)
+ */
+typedef struct SimNode SimNode_t;
+
+/**
+ * @brief 無線区間とモジュールを初期化する
+ * @details sim_kernel_init() の後に呼びます。
+ */
+void sim_e220_init(const SimChannelModel_t *p_model);
+
+/**
+ * @brief 端末を追加する
+ * @param[in] has_aux AUXピンをMCUにつなぐか (LORABBIT_USE_AUX_IRQ が有効なビルドでのみ意味がある)
+ * @return 端末 (SIM_MAX_NODES 個まで)
+ */
+SimNode_t *sim_node_create(bool has_aux);
+
+/**
+ * @brief 端末のハンドルを返す
+ */
+LoraHandle_t *sim_node_handle(SimNode_t *p_node);
+
+/**
+ * @brief 端末の統計を返す
+ */
+const SimNodeStats_t *sim_node_stats(const SimNode_t *p_node);
+
+/**
+ * @brief 端末が p_sender から受信し、前後のフレームと区切れる間隔でUARTに出力したフレームの数を返す
+ * @details モジュールは受信したフレームを続けてUARTに出力するため、前のフレームの出力中に次のフレームを
+ * 受信すると、ライブラリは2つのフレームを1つとして読み出します。そのようなフレームを除いた数です。
+ * AUXピンを使う受信 (LORABBIT_USE_AUX_IRQ) では、前のフレームの出力を終えた後にAUXがHighに戻っていれば区切れるものとします。
+ */
+uint32_t sim_node_rx_separable_count_from(const SimNode_t *p_node, const SimNode_t *p_sender);
+
+/**
+ * @brief 端末のUARTの設定に、受信のDTC転送を指定する
+ * @details LORABBIT_USE_UART_DTC を有効にしたビルドで、sim_node_boot() の前に呼びます。
+ * DTC転送中に届いたバイトは割り込みなしで転送先に書き込み、転送を終えたバイトで UART_EVENT_RX_COMPLETE を通知します。
+ */
+void sim_node_use_uart_dtc(SimNode_t *p_node);
+
+/**
+ * @brief モジュールの現在のチャンネル (設定レジスタの値) を返す
+ */
+uint8_t sim_node_channel(const SimNode_t *p_node);
+
+/**
+ * @brief 端末が次に受信する count 個のフレームを、損失のモデルによらず失わせる
+ * @details 宛先が端末のアドレス (またはブロードキャスト) のフレームだけを数え、rx_lost_count に含めます。
+ */
+void sim_node_drop_rx(SimNode_t *p_node, uint32_t count);
+
+/**
+ * @brief ライブラリとモジュールを初期化して、通常モードにする (タスクから呼ぶ)
+ * @return LoRabbit_Init() / LoRabbit_InitModule() の戻り値
+ */
+int sim_node_boot(SimNode_t *p_node, const LoraConfigItem_t *p_config);
+
+/**
+ * @brief 全端末の送信フレームのエアタイムの合計 (マイクロ秒) を返す
+ */
+uint64_t sim_total_airtime_us(void);
+
+/**
+ * @brief 全端末の送信フレームの数を返す
+ */
+uint32_t sim_total_tx_frames(void);
+
+/**
+ * @brief モジュールと同じ計算式でエアタイム (マイクロ秒) を求める
+ */
+uint64_t sim_airtime_us(LoraAirDateRate_t air_data_rate, int payload_size);
+
+/**
+ * @brief シナリオで使う、典型的なモジュール設定を返す
+ * @details 115200bps、200バイト、RSSIバイトと周囲のRSSIノイズの出力あり、固定送信モードです。
+ */
+LoraConfigItem_t sim_default_config(uint16_t address, LoraAirDateRate_t air_data_rate);
@@ -0,0 +1,91 @@
+/**
+ * @file sim_heatshrink.c
+ * @brief シミュレータ用の heatshrink (圧縮しないで素通しする実装)
+ */
+#include <heatshrink_decoder.h>
+#include <heatshrink_encoder.h>
+#include <string.h>
+
+// 入力を内部バッファに溜めるヘルパー関数（内部利用）
+static size_t sim_sink(uint8_t *p_buffer, uint16_t *p_count, size_t capacity, const uint8_t *p_in, size_t size) {
+    size_t n = capacity - *p_count;
+    if (n > size) {
+        n = size;
+    }
+    memcpy(&p_buffer[*p_count], p_in, n);
+    *p_count = (uint16_t)(*p_count + n);
+    return n;
+}
+
+// 内部バッファから出力するヘルパー関数（内部利用）
+static size_t sim_poll(uint8_t *p_buffer, uint16_t *p_count, uint8_t *p_out, size_t out_size) {
+    size_t n = (*p_count < out_size) ? *p_count : out_size;
+    memcpy(p_out, p_buffer, n);
+    memmove(p_buffer, &p_buffer[n], *p_count - n);
+    *p_count = (uint16_t)(*p_count - n);
+    return n;
+}
+
+void heatshrink_encoder_reset(heatshrink_encoder *hse) {
+    memset(hse, 0, sizeof(*hse));
+}
+
+HSE_sink_res heatshrink_encoder_sink(heatshrink_encoder *hse, uint8_t *in_buf, size_t size, size_t *input_size) {
+    if (NULL == hse || NULL == in_buf || NULL == input_size) {
+        return HSER_SINK_ERROR_NULL;
+    }
+    if (hse->is_finishing) {
+        return HSER_SINK_ERROR_MISUSE;
+    }
+    *input_size = sim_sink(hse->buffer, &hse->count, sizeof(hse->buffer), in_buf, size);
+    return HSER_SINK_OK;
+}
+
+HSE_poll_res heatshrink_encoder_poll(heatshrink_encoder *hse, uint8_t *out_buf, size_t out_buf_size, size_t *output_size) {
+    if (NULL == hse || NULL == out_buf || NULL == output_size) {
+        return HSER_POLL_ERROR_NULL;
+    }
+    if (0 == out_buf_size) {
+        return HSER_POLL_ERROR_MISUSE;
+    }
+    *output_size = sim_poll(hse->buffer, &hse->count, out_buf, out_buf_size);
+    return (hse->count > 0) ? HSER_POLL_MORE : HSER_POLL_EMPTY;
+}
+
+HSE_finish_res heatshrink_encoder_finish(heatshrink_encoder *hse) {
+    if (NULL == hse) {
+        return HSER_FINISH_ERROR_NULL;
+    }
+    hse->is_finishing = 1;
+    return (hse->count > 0) ? HSER_FINISH_MORE : HSER_FINISH_DONE;
+}
+
+void heatshrink_decoder_reset(heatshrink_decoder *hsd) {
+    memset(hsd, 0, sizeof(*hsd));
+}
+
+HSD_sink_res heatshrink_decoder_sink(heatshrink_decoder *hsd, uint8_t *in_buf, size_t size, size_t *input_size) {
+    if (NULL == hsd || NULL == in_buf || NULL == input_size) {
+        return HSDR_SINK_ERROR_NULL;
+    }
+    if (hsd->count == sizeof(hsd->buffer)) {
+        return HSDR_SINK_FULL;
+    }
+    *input_size = sim_sink(hsd->buffer, &hsd->count, sizeof(hsd->buffer), in_buf, size);
+    return HSDR_SINK_OK;
+}
+
+HSD_poll_res heatshrink_decoder_poll(heatshrink_decoder *hsd, uint8_t *out_buf, size_t out_buf_size, size_t *output_size) {
+    if (NULL == hsd || NULL == out_buf || NULL == output_size) {
+        return HSDR_POLL_ERROR_NULL;
+    }
+    *output_size = sim_poll(hsd->buffer, &hsd->count, out_buf, out_buf_size);
+    return (hsd->count > 0) ? HSDR_POLL_MORE : HSDR_POLL_EMPTY;
+}
+
+HSD_finish_res heatshrink_decoder_finish(heatshrink_decoder *hsd) {
+    if (NULL == hsd) {
+        return HSDR_FINISH_ERROR_NULL;
+    }
+    return (hsd->count > 0) ? HSDR_FINISH_MORE : HSDR_FINISH_DONE;
+}
@@ -0,0 +1,724 @@
+/**
+ * @file sim_kernel.c
+ * @brief 仮想時間で動く μT-Kernel の模擬の実装
+ * @details タスクは ucontext のコルーチンで、実行中のタスクは常に1つです。
+ * 待ちを解除したタスクの優先度が実行中のタスクより高ければ、μT-Kernel と同じく即座に切り替えます
+ * (ディスパッチ禁止中は tk_ena_dsp() まで遅らせます)。
+ */
+#include "sim_kernel.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tm/tmonitor.h>
+#include <ucontext.h>
+
+#define SIM_MAX_TASKS      32
+#define SIM_MAX_SEMAPHORES 256
+#define SIM_MAX_MBFS       16
+#define SIM_MAX_FLAGS      16
+#define SIM_MAX_EVENTS     65536
+#define SIM_STACK_SIZE     (256 * 1024) // ライブラリが指定するスタックサイズに関わらず、十分な大きさを確保する
+#define SIM_MBF_HEADER_SIZE ((INT)sizeof(INT)) // メッセージごとにバッファを消費する管理領域
+
+typedef enum {
+    SIM_TASK_NONEXISTENT = 0,
+    SIM_TASK_DORMANT,
+    SIM_TASK_READY,
+    SIM_TASK_RUNNING,
+    SIM_TASK_WAITING,
+} SimTaskState_t;
+
+typedef struct SimTask {
+    SimTaskState_t state;
+    FP       entry;
+    void    *exinf;
+    INT      stacd;
+    PRI      priority;
+    bool     is_scenario;     // sim_start_task() で起動したタスクか
+    ucontext_t context;
+    void    *p_stack;
+    int64_t  ready_order;     // 同じ優先度の実行可能なタスクの順番 (小さいほど先)
+    struct SimTask *p_next;   // 待ち行列のつながり
+    struct SimTask **pp_queue; // 入っている待ち行列 (NULLなら時間待ち)
+    INT      wait_count;      // セマフォの要求数
+    void    *p_wait_msg;      // メッセージバッファの送受信データ
+    INT      wait_size;       // メッセージバッファの送信サイズ
+    FLGPTN   wait_pattern;    // イベントフラグの待ちパターン
+    UINT     wait_mode;       // イベントフラグの待ちモード
+    FLGPTN  *p_flag_result;   // イベントフラグの待ち解除時のパターン
+    ER       wait_result;     // 待ち解除の理由
+    uint32_t wait_generation; // 待ちに入るたびに増える番号 (解除済みの待ちのタイムアウトを無視する)
+} SimTask;
+
+typedef struct {
+    bool     is_used;
+    INT      count;
+    INT      max;
+    SimTask *p_queue;
+} SimSemaphore;
+
+typedef struct SimMessage {
+    struct SimMessage *p_next;
+    INT     size;
+    uint8_t data[];
+} SimMessage;
+
+typedef struct {
+    bool        is_used;
+    INT         buffer_size;
+    INT         max_message_size;
+    INT         used_size;
+    SimMessage *p_head;
+    SimMessage *p_tail;
+    SimTask    *p_send_queue;
+    SimTask    *p_receive_queue;
+} SimMbf;
+
+typedef struct {
+    bool     is_used;
+    FLGPTN   pattern;
+    SimTask *p_queue;
+} SimFlag;
+
+typedef struct {
+    uint64_t at_us;
+    uint64_t order;
+    SimEventFunc_t func;
+    void    *p_arg;
+    uint32_t tag;
+} SimEvent;
+
+static SimTask      s_tasks[SIM_MAX_TASKS];
+static SimSemaphore s_semaphores[SIM_MAX_SEMAPHORES];
+static SimMbf       s_mbfs[SIM_MAX_MBFS];
+static SimFlag      s_flags[SIM_MAX_FLAGS];
+static SimEvent     s_events[SIM_MAX_EVENTS]; // 時刻順の二分ヒープ
+static int          s_event_count;
+static uint64_t     s_event_order;
+static int64_t      s_ready_order;
+static int64_t      s_preempted_order;
+
+static uint64_t     s_now_us;
+static SimTask     *s_current;
+static ucontext_t   s_scheduler_context;
+static bool         s_is_dispatch_disabled;
+static bool         s_is_dispatch_pending;
+static int          s_scenario_task_count;
+static uint64_t     s_random_state;
+static bool         s_is_verbose;
+
+// =====================================
+// イベント
+
+void sim_schedule(uint64_t at_us, SimEventFunc_t func, void *p_arg, uint32_t tag) {
+    if (s_event_count >= SIM_MAX_EVENTS) {
+        fprintf(stderr, "sim: too many events\n");
+        abort();
+    }
+    if (at_us < s_now_us) {
+        at_us = s_now_us;
+    }
+    int i = s_event_count++;
+    SimEvent event = {at_us, s_event_order++, func, p_arg, tag};
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        SimEvent *p_parent = &s_events[parent];
+        if (p_parent->at_us < at_us || (p_parent->at_us == at_us && p_parent->order < event.order)) {
+            break;
+        }
+        s_events[i] = *p_parent;
+        i = parent;
+    }
+    s_events[i] = event;
+}
+
+static bool sim_event_before(const SimEvent *p_a, const SimEvent *p_b) {
+    return p_a->at_us < p_b->at_us || (p_a->at_us == p_b->at_us && p_a->order < p_b->order);
+}
+
+static SimEvent sim_pop_event(void) {
+    SimEvent top = s_events[0];
+    SimEvent last = s_events[--s_event_count];
+    int i = 0;
+    while (1) {
+        int child = i * 2 + 1;
+        if (child >= s_event_count) {
+            break;
+        }
+        if (child + 1 < s_event_count && sim_event_before(&s_events[child + 1], &s_events[child])) {
+            child++;
+        }
+        if (!sim_event_before(&s_events[child], &last)) {
+            break;
+        }
+        s_events[i] = s_events[child];
+        i = child;
+    }
+    s_events[i] = last;
+    return top;
+}
+
+uint64_t sim_now_us(void) {
+    return s_now_us;
+}
+
+double sim_random(void) {
+    // xorshift64*
+    s_random_state ^= s_random_state >> 12;
+    s_random_state ^= s_random_state << 25;
+    s_random_state ^= s_random_state >> 27;
+    uint64_t value = s_random_state * 2685821657736338717ULL;
+    return (double)(value >> 11) / (double)(1ULL << 53);
+}
+
+void sim_set_verbose(bool is_verbose) {
+    s_is_verbose = is_verbose;
+}
+
+// =====================================
+// タスクの切り替え
+
+static void sim_make_ready(SimTask *p_task) {
+    p_task->state = SIM_TASK_READY;
+    p_task->ready_order = ++s_ready_order;
+    if (NULL != s_current && p_task->priority < s_current->priority) {
+        s_is_dispatch_pending = true; // 実行中のタスクより優先度が高い
+    }
+}
+
+// 優先度の高いタスクが実行可能になっていれば、実行中のタスクを同じ優先度の先頭に戻して切り替える
+static void sim_dispatch_if_pending(void) {
+    if (NULL == s_current || !s_is_dispatch_pending || s_is_dispatch_disabled) {
+        return;
+    }
+    s_is_dispatch_pending = false;
+    SimTask *p_task = s_current;
+    p_task->state = SIM_TASK_READY;
+    p_task->ready_order = --s_preempted_order;
+    swapcontext(&p_task->context, &s_scheduler_context);
+}
+
+static void sim_queue_append(SimTask **pp_queue, SimTask *p_task) {
+    p_task->p_next = NULL;
+    p_task->pp_queue = pp_queue;
+    while (NULL != *pp_queue) {
+        pp_queue = &(*pp_queue)->p_next;
+    }
+    *pp_queue = p_task;
+}
+
+static void sim_queue_remove(SimTask *p_task) {
+    if (NULL == p_task->pp_queue) {
+        return;
+    }
+    for (SimTask **pp = p_task->pp_queue; NULL != *pp; pp = &(*pp)->p_next) {
+        if (*pp == p_task) {
+            *pp = p_task->p_next;
+            break;
+        }
+    }
+    p_task->pp_queue = NULL;
+    p_task->p_next = NULL;
+}
+
+// 待ち状態のタスクを、待ち行列から外して実行可能にする
+static void sim_release_wait(SimTask *p_task, ER result) {
+    sim_queue_remove(p_task);
+    p_task->wait_result = result;
+    p_task->wait_generation++;
+    sim_make_ready(p_task);
+}
+
+static void sim_timeout_event(void *p_arg, uint32_t tag) {
+    SimTask *p_task = (SimTask *)p_arg;
+    if (SIM_TASK_WAITING == p_task->state && p_task->wait_generation == tag) {
+        sim_release_wait(p_task, E_TMOUT);
+    }
+}
+
+// 実行中のタスクを待ち状態にする。pp_queue がNULLなら時間待ち
+static ER sim_wait(SimTask **pp_queue, TMO timeout) {
+    SimTask *p_task = s_current;
+    if (NULL == p_task) {
+        fprintf(stderr, "sim: wait from outside of a task\n");
+        abort();
+    }
+    p_task->state = SIM_TASK_WAITING;
+    p_task->wait_result = E_OK;
+    p_task->pp_queue = NULL;
+    if (NULL != pp_queue) {
+        sim_queue_append(pp_queue, p_task);
+    }
+    if (timeout != TMO_FEVR) {
+        sim_schedule(s_now_us + (uint64_t)timeout * 1000, sim_timeout_event, p_task, p_task->wait_generation);
+    }
+    swapcontext(&p_task->context, &s_scheduler_context);
+    return p_task->wait_result;
+}
+
+static SimTask *sim_pick_ready(void) {
+    SimTask *p_best = NULL;
+    for (int i = 0; i < SIM_MAX_TASKS; i++) {
+        SimTask *p_task = &s_tasks[i];
+        if (SIM_TASK_READY != p_task->state) {
+            continue;
+        }
+        if (NULL == p_best || p_task->priority < p_best->priority ||
+            (p_task->priority == p_best->priority && p_task->ready_order < p_best->ready_order)) {
+            p_best = p_task;
+        }
+    }
+    return p_best;
+}
+
+static void sim_task_entry(int index) {
+    SimTask *p_task = &s_tasks[index];
+    p_task->entry(p_task->stacd, p_task->exinf);
+    tk_ext_tsk();
+}
+
+void sim_kernel_init(uint32_t seed) {
+    memset(s_tasks, 0, sizeof(s_tasks));
+    memset(s_semaphores, 0, sizeof(s_semaphores));
+    memset(s_mbfs, 0, sizeof(s_mbfs));
+    memset(s_flags, 0, sizeof(s_flags));
+    s_event_count = 0;
+    s_event_order = 0;
+    s_ready_order = 0;
+    s_preempted_order = 0;
+    s_now_us = 0;
+    s_current = NULL;
+    s_is_dispatch_disabled = false;
+    s_is_dispatch_pending = false;
+    s_scenario_task_count = 0;
+    s_random_state = 0x9E3779B97F4A7C15ULL ^ ((uint64_t)seed * 0xD1B54A32D192ED03ULL);
+    if (0 == s_random_state) {
+        s_random_state = 1;
+    }
+}
+
+SimRunResult_t sim_run(uint64_t limit_us) {
+    while (1) {
+        if (0 == s_scenario_task_count) {
+            return SIM_RUN_DONE;
+        }
+        SimTask *p_task = sim_pick_ready();
+        if (NULL != p_task) {
+            s_current = p_task;
+            s_is_dispatch_pending = false;
+            p_task->state = SIM_TASK_RUNNING;
+            swapcontext(&s_scheduler_context, &p_task->context);
+            s_current = NULL;
+            continue;
+        }
+        if (0 == s_event_count) {
+            return SIM_RUN_DEADLOCK;
+        }
+        if (s_events[0].at_us > limit_us) {
+            s_now_us = limit_us;
+            return SIM_RUN_TIME_LIMIT;
+        }
+        SimEvent event = sim_pop_event();
+        s_now_us = event.at_us;
+        event.func(event.p_arg, event.tag);
+    }
+}
+
+// =====================================
+// タスク管理機能
+
+static SimTask *sim_get_task(ID tskid) {
+    if (tskid < 1 || tskid > SIM_MAX_TASKS || SIM_TASK_NONEXISTENT == s_tasks[tskid - 1].state) {
+        return NULL;
+    }
+    return &s_tasks[tskid - 1];
+}
+
+ID tk_cre_tsk(const T_CTSK *pk_ctsk) {
+    for (int i = 0; i < SIM_MAX_TASKS; i++) {
+        SimTask *p_task = &s_tasks[i];
+        if (SIM_TASK_NONEXISTENT != p_task->state) {
+            continue;
+        }
+        memset(p_task, 0, sizeof(*p_task));
+        p_task->p_stack = malloc(SIM_STACK_SIZE);
+        if (NULL == p_task->p_stack) {
+            return E_NOMEM;
+        }
+        p_task->state = SIM_TASK_DORMANT;
+        p_task->entry = pk_ctsk->task;
+        p_task->exinf = pk_ctsk->exinf;
+        p_task->priority = pk_ctsk->itskpri;
+        return i + 1;
+    }
+    return E_LIMIT;
+}
+
+ER tk_sta_tsk(ID tskid, INT stacd) {
+    SimTask *p_task = sim_get_task(tskid);
+    if (NULL == p_task) {
+        return E_NOEXS;
+    }
+    if (SIM_TASK_DORMANT != p_task->state) {
+        return E_OBJ;
+    }
+    p_task->stacd = stacd;
+    getcontext(&p_task->context);
+    p_task->context.uc_stack.ss_sp = p_task->p_stack;
+    p_task->context.uc_stack.ss_size = SIM_STACK_SIZE;
+    p_task->context.uc_link = NULL;
+    makecontext(&p_task->context, (void (*)(void))sim_task_entry, 1, tskid - 1);
+    sim_make_ready(p_task);
+    sim_dispatch_if_pending();
+    return E_OK;
+}
+
+ID sim_start_task(FP task, void *exinf, PRI priority) {
+    T_CTSK ctsk;
+    memset(&ctsk, 0, sizeof(ctsk));
+    ctsk.tskatr = TA_HLNG | TA_RNG3;
+    ctsk.task = task;
+    ctsk.exinf = exinf;
+    ctsk.itskpri = priority;
+    ID tskid = tk_cre_tsk(&ctsk);
+    if (tskid < E_OK) {
+        fprintf(stderr, "sim: tk_cre_tsk failed(%d)\n", tskid);
+        abort();
+    }
+    s_tasks[tskid - 1].is_scenario = true;
+    s_scenario_task_count++;
+    tk_sta_tsk(tskid, 0);
+    return tskid;
+}
+
+void tk_ext_tsk(void) {
+    SimTask *p_task = s_current;
+    p_task->state = SIM_TASK_DORMANT;
+    if (p_task->is_scenario) {
+        s_scenario_task_count--;
+    }
+    // スタックは実行中のため解放しない (シナリオはプロセスごとに1回だけ実行する)
+    setcontext(&s_scheduler_context);
+}
+
+ID tk_get_tid(void) {
+    return (NULL != s_current) ? (ID)(s_current - s_tasks) + 1 : 0;
+}
+
+ER tk_dly_tsk(RELTIM dlytim) {
+    if (0 == dlytim) {
+        // 同じ優先度の他のタスクに実行を譲る
+        SimTask *p_task = s_current;
+        p_task->state = SIM_TASK_READY;
+        p_task->ready_order = ++s_ready_order;
+        swapcontext(&p_task->context, &s_scheduler_context);
+        return E_OK;
+    }
+    ER err = sim_wait(NULL, (TMO)dlytim);
+    return (E_TMOUT == err) ? E_OK : err;
+}
+
+ER tk_dis_dsp(void) {
+    s_is_dispatch_disabled = true;
+    return E_OK;
+}
+
+ER tk_ena_dsp(void) {
+    s_is_dispatch_disabled = false;
+    sim_dispatch_if_pending();
+    return E_OK;
+}
+
+ER tk_get_tim(SYSTIM *pk_tim) {
+    uint64_t now_ms = s_now_us / 1000;
+    pk_tim->hi = (W)(now_ms >> 32);
+    pk_tim->lo = (UW)now_ms;
+    return E_OK;
+}
+
+// =====================================
+// セマフォ
+
+static SimSemaphore *sim_get_semaphore(ID semid) {
+    if (semid < 1 || semid > SIM_MAX_SEMAPHORES || !s_semaphores[semid - 1].is_used) {
+        return NULL;
+    }
+    return &s_semaphores[semid - 1];
+}
+
+ID tk_cre_sem(const T_CSEM *pk_csem) {
+    for (int i = 0; i < SIM_MAX_SEMAPHORES; i++) {
+        SimSemaphore *p_sem = &s_semaphores[i];
+        if (!p_sem->is_used) {
+            p_sem->is_used = true;
+            p_sem->count = pk_csem->isemcnt;
+            p_sem->max = pk_csem->maxsem;
+            p_sem->p_queue = NULL;
+            return i + 1;
+        }
+    }
+    return E_LIMIT;
+}
+
+ER tk_del_sem(ID semid) {
+    SimSemaphore *p_sem = sim_get_semaphore(semid);
+    if (NULL == p_sem) {
+        return E_NOEXS;
+    }
+    while (NULL != p_sem->p_queue) {
+        sim_release_wait(p_sem->p_queue, E_RLWAI);
+    }
+    p_sem->is_used = false;
+    sim_dispatch_if_pending();
+    return E_OK;
+}
+
+ER tk_wai_sem(ID semid, INT cnt, TMO tmout) {
+    SimSemaphore *p_sem = sim_get_semaphore(semid);
+    if (NULL == p_sem) {
+        return E_NOEXS;
+    }
+    if (NULL == p_sem->p_queue && p_sem->count >= cnt) {
+        p_sem->count -= cnt;
+        return E_OK;
+    }
+    if (TMO_POL == tmout) {
+        return E_TMOUT;
+    }
+    s_current->wait_count = cnt;
+    return sim_wait(&p_sem->p_queue, tmout);
+}
+
+ER tk_sig_sem(ID semid, INT cnt) {
+    SimSemaphore *p_sem = sim_get_semaphore(semid);
+    if (NULL == p_sem) {
+        return E_NOEXS;
+    }
+    if (p_sem->count + cnt > p_sem->max) {
+        return E_QOVR;
+    }
+    p_sem->count += cnt;
+    // 先頭のタスクから順に、要求数を満たせる間だけ待ちを解除する (TA_FIRST)
+    while (NULL != p_sem->p_queue && p_sem->count >= p_sem->p_queue->wait_count) {
+        p_sem->count -= p_sem->p_queue->wait_count;
+        sim_release_wait(p_sem->p_queue, E_OK);
+    }
+    sim_dispatch_if_pending();
+    return E_OK;
+}
+
+// =====================================
+// メッセージバッファ
+
+static SimMbf *sim_get_mbf(ID mbfid) {
+    if (mbfid < 1 || mbfid > SIM_MAX_MBFS || !s_mbfs[mbfid - 1].is_used) {
+        return NULL;
+    }
+    return &s_mbfs[mbfid - 1];
+}
+
+ID tk_cre_mbf(const T_CMBF *pk_cmbf) {
+    for (int i = 0; i < SIM_MAX_MBFS; i++) {
+        SimMbf *p_mbf = &s_mbfs[i];
+        if (!p_mbf->is_used) {
+            memset(p_mbf, 0, sizeof(*p_mbf));
+            p_mbf->is_used = true;
+            p_mbf->buffer_size = pk_cmbf->bufsz;
+            p_mbf->max_message_size = pk_cmbf->maxmsz;
+            return i + 1;
+        }
+    }
+    return E_LIMIT;
+}
+
+static void sim_mbf_push(SimMbf *p_mbf, const void *msg, INT msgsz) {
+    SimMessage *p_message = malloc(sizeof(SimMessage) + (size_t)msgsz);
+    p_message->p_next = NULL;
+    p_message->size = msgsz;
+    memcpy(p_message->data, msg, (size_t)msgsz);
+    if (NULL == p_mbf->p_tail) {
+        p_mbf->p_head = p_message;
+    } else {
+        p_mbf->p_tail->p_next = p_message;
+    }
+    p_mbf->p_tail = p_message;
+    p_mbf->used_size += msgsz + SIM_MBF_HEADER_SIZE;
+}
+
+ER tk_snd_mbf(ID mbfid, const void *msg, INT msgsz, TMO tmout) {
+    SimMbf *p_mbf = sim_get_mbf(mbfid);
+    if (NULL == p_mbf) {
+        return E_NOEXS;
+    }
+    if (msgsz <= 0 || msgsz > p_mbf->max_message_size) {
+        return E_PAR;
+    }
+    if (NULL != p_mbf->p_receive_queue) {
+        // 受信待ちのタスクに直接渡す
+        SimTask *p_receiver = p_mbf->p_receive_queue;
+        memcpy(p_receiver->p_wait_msg, msg, (size_t)msgsz);
+        p_receiver->wait_size = msgsz;
+        sim_release_wait(p_receiver, E_OK);
+        sim_dispatch_if_pending();
+        return E_OK;
+    }
+    if (NULL == p_mbf->p_send_queue && p_mbf->used_size + msgsz + SIM_MBF_HEADER_SIZE <= p_mbf->buffer_size) {
+        sim_mbf_push(p_mbf, msg, msgsz);
+        return E_OK;
+    }
+    if (TMO_POL == tmout) {
+        return E_TMOUT;
+    }
+    s_current->p_wait_msg = (void *)msg;
+    s_current->wait_size = msgsz;
+    return sim_wait(&p_mbf->p_send_queue, tmout);
+}
+
+INT tk_rcv_mbf(ID mbfid, void *msg, TMO tmout) {
+    SimMbf *p_mbf = sim_get_mbf(mbfid);
+    if (NULL == p_mbf) {
+        return E_NOEXS;
+    }
+    if (NULL != p_mbf->p_head) {
+        SimMessage *p_message = p_mbf->p_head;
+        INT size = p_message->size;
+        memcpy(msg, p_message->data, (size_t)size);
+        p_mbf->p_head = p_message->p_next;
+        if (NULL == p_mbf->p_head) {
+            p_mbf->p_tail = NULL;
+        }
+        p_mbf->used_size -= size + SIM_MBF_HEADER_SIZE;
+        free(p_message);
+        // 空いた領域に、送信待ちのタスクのメッセージを順に入れる
+        while (NULL != p_mbf->p_send_queue &&
+               p_mbf->used_size + p_mbf->p_send_queue->wait_size + SIM_MBF_HEADER_SIZE <= p_mbf->buffer_size) {
+            SimTask *p_sender = p_mbf->p_send_queue;
+            sim_mbf_push(p_mbf, p_sender->p_wait_msg, p_sender->wait_size);
+            sim_release_wait(p_sender, E_OK);
+        }
+        sim_dispatch_if_pending();
+        return size;
+    }
+    if (NULL != p_mbf->p_send_queue) {
+        // バッファサイズが0の場合は、送信待ちのタスクから直接受け取る
+        SimTask *p_sender = p_mbf->p_send_queue;
+        INT size = p_sender->wait_size;
+        memcpy(msg, p_sender->p_wait_msg, (size_t)size);
+        sim_release_wait(p_sender, E_OK);
+        sim_dispatch_if_pending();
+        return size;
+    }
+    if (TMO_POL == tmout) {
+        return E_TMOUT;
+    }
+    s_current->p_wait_msg = msg;
+    ER err = sim_wait(&p_mbf->p_receive_queue, tmout);
+    return (E_OK == err) ? s_current->wait_size : err;
+}
+
+// =====================================
+// イベントフラグ
+
+static SimFlag *sim_get_flag(ID flgid) {
+    if (flgid < 1 || flgid > SIM_MAX_FLAGS || !s_flags[flgid - 1].is_used) {
+        return NULL;
+    }
+    return &s_flags[flgid - 1];
+}
+
+ID tk_cre_flg(const T_CFLG *pk_cflg) {
+    for (int i = 0; i < SIM_MAX_FLAGS; i++) {
+        SimFlag *p_flag = &s_flags[i];
+        if (!p_flag->is_used) {
+            p_flag->is_used = true;
+            p_flag->pattern = pk_cflg->iflgptn;
+            p_flag->p_queue = NULL;
+            return i + 1;
+        }
+    }
+    return E_LIMIT;
+}
+
+static bool sim_flag_matches(FLGPTN pattern, FLGPTN waiptn, UINT wfmode) {
+    return (wfmode & TWF_ORW) ? (pattern & waiptn) != 0 : (pattern & waiptn) == waiptn;
+}
+
+static void sim_flag_consume(SimFlag *p_flag, FLGPTN waiptn, UINT wfmode) {
+    if (wfmode & TWF_CLR) {
+        p_flag->pattern = 0;
+    } else if (wfmode & TWF_BITCLR) {
+        p_flag->pattern &= ~waiptn;
+    }
+}
+
+ER tk_set_flg(ID flgid, FLGPTN setptn) {
+    SimFlag *p_flag = sim_get_flag(flgid);
+    if (NULL == p_flag) {
+        return E_NOEXS;
+    }
+    p_flag->pattern |= setptn;
+    SimTask *p_task = p_flag->p_queue;
+    while (NULL != p_task) {
+        SimTask *p_next = p_task->p_next;
+        if (sim_flag_matches(p_flag->pattern, p_task->wait_pattern, p_task->wait_mode)) {
+            if (NULL != p_task->p_flag_result) {
+                *p_task->p_flag_result = p_flag->pattern;
+            }
+            sim_flag_consume(p_flag, p_task->wait_pattern, p_task->wait_mode);
+            sim_release_wait(p_task, E_OK);
+        }
+        p_task = p_next;
+    }
+    sim_dispatch_if_pending();
+    return E_OK;
+}
+
+ER tk_clr_flg(ID flgid, FLGPTN clrptn) {
+    SimFlag *p_flag = sim_get_flag(flgid);
+    if (NULL == p_flag) {
+        return E_NOEXS;
+    }
+    p_flag->pattern &= clrptn;
+    return E_OK;
+}
+
+ER tk_wai_flg(ID flgid, FLGPTN waiptn, UINT wfmode, FLGPTN *p_flgptn, TMO tmout) {
+    SimFlag *p_flag = sim_get_flag(flgid);
+    if (NULL == p_flag) {
+        return E_NOEXS;
+    }
+    if (sim_flag_matches(p_flag->pattern, waiptn, wfmode)) {
+        if (NULL != p_flgptn) {
+            *p_flgptn = p_flag->pattern;
+        }
+        sim_flag_consume(p_flag, waiptn, wfmode);
+        return E_OK;
+    }
+    if (TMO_POL == tmout) {
+        return E_TMOUT;
+    }
+    s_current->wait_pattern = waiptn;
+    s_current->wait_mode = wfmode;
+    s_current->p_flag_result = p_flgptn;
+    return sim_wait(&p_flag->p_queue, tmout);
+}
+
+// =====================================
+// T-Monitor
+
+INT tm_printf(UB *format, ...) {
+    if (!s_is_verbose) {
+        return 0;
+    }
+    va_list args;
+    va_start(args, format);
+    printf("[%10.3f ms] ", (double)s_now_us / 1000.0);
+    INT len = vprintf((const char *)format, args);
+    va_end(args);
+    return len;
+}
+
+INT tm_putstring(UB *buff) {
+    return tm_printf((UB *)"%s", buff);
+}
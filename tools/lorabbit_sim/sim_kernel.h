@@ -0,0 +1,69 @@
+/**
+ * @file sim_kernel.h
+ * @brief 仮想時間で動く μT-Kernel の模擬
+ * @details タスクはコルーチンとして1つずつ実行し、処理時間は0とみなします。
+ * 全てのタスクが待ち状態になると、次のイベント (タイムアウトやハードウェアの割り込み) の時刻まで
+ * 仮想時間を進めます。同じ入力と乱数シードからは、常に同じ結果になります。
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <tk/tkernel.h>
+
+/**
+ * @brief イベントの時刻に呼ばれる関数の型
+ * @details 割り込みハンドラと同じく、タスクの外から呼ばれます。待ちに入る API は呼べません。
+ * @param[in] p_arg sim_schedule() に渡したポインタ
+ * @param[in] tag sim_schedule() に渡した値
+ */
+typedef void (*SimEventFunc_t)(void *p_arg, uint32_t tag);
+
+/**
+ * @brief sim_run() の結果
+ */
+typedef enum {
+    SIM_RUN_DONE = 0,   /**< sim_start_task() で起動したタスクが全て終了した */
+    SIM_RUN_TIME_LIMIT, /**< 指定の時刻までに終了しなかった */
+    SIM_RUN_DEADLOCK,   /**< 全てのタスクが待ち状態で、次のイベントがない */
+} SimRunResult_t;
+
+/**
+ * @brief カーネルを初期化する
+ * @param[in] seed sim_random() の乱数シード
+ */
+void sim_kernel_init(uint32_t seed);
+
+/**
+ * @brief 現在の仮想時刻 (マイクロ秒) を返す
+ */
+uint64_t sim_now_us(void);
+
+/**
+ * @brief 指定の時刻にイベントを登録する
+ * @details 同じ時刻のイベントは登録した順に呼ばれます。
+ */
+void sim_schedule(uint64_t at_us, SimEventFunc_t func, void *p_arg, uint32_t tag);
+
+/**
+ * @brief シナリオのタスクを生成して起動する
+ * @details このタスクが全て終了すると sim_run() が戻ります (ライブラリが生成するタスクは待ちません)。
+ * @return タスクID
+ */
+ID sim_start_task(FP task, void *exinf, PRI priority);
+
+/**
+ * @brief イベントとタスクを実行する
+ * @param[in] limit_us この時刻を過ぎたら止める
+ */
+SimRunResult_t sim_run(uint64_t limit_us);
+
+/**
+ * @brief 0以上1未満の一様乱数を返す (xorshift)
+ */
+double sim_random(void);
+
+/**
+ * @brief tm_printf() の出力を有効にする (デバッグ用)
+ */
+void sim_set_verbose(bool is_verbose);
@@ -0,0 +1,148 @@
+/**
+ * @file sim_legacy.c
+ * @brief 旧版の大容量データ送受信の再実装
+ */
+#include "sim_legacy.h"
+#include <string.h>
+
+#define SIM_LEGACY_HEADER_SIZE    8
+#define SIM_LEGACY_RETRY_COUNT    3
+#define SIM_LEGACY_ACK_TIMEOUT_MS 2000
+#define SIM_LEGACY_FLAG_ACK_REQUEST (1 << 7)
+#define SIM_LEGACY_FLAG_IS_ACK      (1 << 6)
+#define SIM_LEGACY_FLAG_EOT         (1 << 5)
+
+// 経過時間 (ms) を返すヘルパー関数（内部利用）
+static TMO sim_legacy_elapsed_ms(const SYSTIM *p_start) {
+    SYSTIM now;
+    tk_get_tim(&now);
+    uint64_t start_ms = ((uint64_t)p_start->hi << 32) | p_start->lo;
+    uint64_t now_ms = ((uint64_t)now.hi << 32) | now.lo;
+    return (TMO)(now_ms - start_ms);
+}
+
+int sim_legacy_send_data(LoraHandle_t *p_handle, uint16_t target_address, uint8_t target_channel,
+                         const uint8_t *p_data, uint32_t size, bool request_ack) {
+    static uint8_t s_transaction_id_counter = 0;
+    if (size > 255 * SIM_LEGACY_MAX_PAYLOAD) {
+        return LORABBIT_ERROR_INVALID_ARGUMENT;
+    }
+    const uint8_t transaction_id = s_transaction_id_counter++;
+    const uint8_t total_packets = (uint8_t)((size + SIM_LEGACY_MAX_PAYLOAD - 1) / SIM_LEGACY_MAX_PAYLOAD);
+    uint8_t packet[197];
+    uint32_t sent_size = 0;
+
+    for (uint8_t i = 0; i < total_packets; i++) {
+        uint32_t remaining_size = size - sent_size;
+        uint8_t payload_length = (uint8_t)((remaining_size > SIM_LEGACY_MAX_PAYLOAD) ? SIM_LEGACY_MAX_PAYLOAD : remaining_size);
+        packet[0] = (uint8_t)(p_handle->current_config.own_address >> 8);
+        packet[1] = (uint8_t)(p_handle->current_config.own_address & 0xFF);
+        packet[2] = p_handle->current_config.own_channel;
+        packet[3] = (uint8_t)((request_ack ? SIM_LEGACY_FLAG_ACK_REQUEST : 0) |
+                              ((i == total_packets - 1) ? SIM_LEGACY_FLAG_EOT : 0));
+        packet[4] = transaction_id;
+        packet[5] = total_packets;
+        packet[6] = i;
+        packet[7] = payload_length;
+        memcpy(&packet[SIM_LEGACY_HEADER_SIZE], &p_data[sent_size], payload_length);
+
+        bool is_acked = false;
+        for (int retry = 0; retry < SIM_LEGACY_RETRY_COUNT && !is_acked; retry++) {
+            LoRabbit_SendFrame(p_handle, target_address, target_channel, packet, SIM_LEGACY_HEADER_SIZE + payload_length);
+            if (!request_ack) {
+                is_acked = true;
+                break;
+            }
+            RecvFrameE220900T22SJP_t ack;
+            if (LoRabbit_ReceiveFrame(p_handle, &ack, SIM_LEGACY_ACK_TIMEOUT_MS) > 0 &&
+                (ack.recv_data[3] & SIM_LEGACY_FLAG_IS_ACK) &&
+                ack.recv_data[4] == transaction_id && ack.recv_data[6] == i) {
+                is_acked = true;
+            }
+        }
+        if (!is_acked) {
+            return LORABBIT_ERROR_ACK_FAILED;
+        }
+        sent_size += payload_length;
+    }
+    return LORABBIT_OK;
+}
+
+// 期待するパケットを1つ受信するヘルパー関数（内部利用）
+static int sim_legacy_receive_packet(LoraHandle_t *p_handle, TMO timeout, bool is_first,
+                                     uint8_t transaction_id, uint8_t expected_index,
+                                     RecvFrameE220900T22SJP_t *p_frame) {
+    SYSTIM start;
+    tk_get_tim(&start);
+    while (true) {
+        TMO remaining = timeout;
+        if (TMO_FEVR != timeout) {
+            remaining = timeout - sim_legacy_elapsed_ms(&start);
+            if (remaining <= 0) {
+                return LORABBIT_ERROR_TIMEOUT;
+            }
+        }
+        if (LoRabbit_ReceiveFrame(p_handle, p_frame, remaining) <= 0) {
+            return LORABBIT_ERROR_TIMEOUT;
+        }
+        const uint8_t *p = p_frame->recv_data;
+        if (p_frame->recv_data_len < SIM_LEGACY_HEADER_SIZE || (p[3] & SIM_LEGACY_FLAG_IS_ACK)) {
+            continue;
+        }
+        if (is_first ? (0 == p[6]) : (p[4] == transaction_id && p[6] == expected_index)) {
+            return LORABBIT_OK;
+        }
+    }
+}
+
+// ACKを返すヘルパー関数（内部利用）
+static void sim_legacy_send_ack(LoraHandle_t *p_handle, const uint8_t *p_header) {
+    uint8_t ack[SIM_LEGACY_HEADER_SIZE] = {
+        (uint8_t)(p_handle->current_config.own_address >> 8),
+        (uint8_t)(p_handle->current_config.own_address & 0xFF),
+        p_handle->current_config.own_channel,
+        SIM_LEGACY_FLAG_IS_ACK,
+        p_header[4], p_header[5], p_header[6], 0,
+    };
+    LoRabbit_SendFrame(p_handle, (uint16_t)((p_header[0] << 8) | p_header[1]), p_header[2], ack, sizeof(ack));
+}
+
+int sim_legacy_receive_data(LoraHandle_t *p_handle, uint8_t *p_buffer, uint32_t buffer_size,
+                            uint32_t *p_received_size, TMO timeout) {
+    RecvFrameE220900T22SJP_t frame;
+    uint32_t written_size = 0;
+    *p_received_size = 0;
+
+    int ret = sim_legacy_receive_packet(p_handle, timeout, true, 0, 0, &frame);
+    if (LORABBIT_OK != ret) {
+        return ret;
+    }
+    const uint8_t transaction_id = frame.recv_data[4];
+    const uint8_t total_packets = frame.recv_data[5];
+    if ((uint32_t)total_packets * SIM_LEGACY_MAX_PAYLOAD > buffer_size) {
+        return LORABBIT_ERROR_BUFFER_OVERFLOW;
+    }
+
+    for (uint8_t index = 0; ; index++) {
+        if (index > 0) {
+            ret = sim_legacy_receive_packet(p_handle, SIM_LEGACY_ACK_TIMEOUT_MS, false, transaction_id, index, &frame);
+            if (LORABBIT_OK != ret) {
+                return ret;
+            }
+        }
+        uint8_t payload_length = frame.recv_data[7];
+        memcpy(&p_buffer[written_size], &frame.recv_data[SIM_LEGACY_HEADER_SIZE], payload_length);
+        written_size += payload_length;
+        if (frame.recv_data[3] & SIM_LEGACY_FLAG_ACK_REQUEST) {
+            sim_legacy_send_ack(p_handle, frame.recv_data);
+        }
+        if (index == total_packets - 1) {
+            if (!(frame.recv_data[3] & SIM_LEGACY_FLAG_EOT)) {
+                return LORABBIT_ERROR_INVALID_PACKET;
+            }
+            break;
+        }
+    }
+    *p_received_size = written_size;
+    return LORABBIT_OK;
+}
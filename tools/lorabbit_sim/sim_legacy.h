@@ -0,0 +1,26 @@
+/**
+ * @file sim_legacy.h
+ * @brief 旧版 (拡張前) の LoRabbit_SendData() / LoRabbit_ReceiveData() の再実装
+ * @details 現行版との相互接続を確かめるため、旧版のワイヤフォーマットと手順をそのまま再現します。
+ * - 8バイトのヘッダ [送信元アドレス(2), 送信元チャンネル, コントロールバイト, トランザクションID,
+ *   総パケット数, パケット番号, ペイロード長] に、最大189バイトのペイロードが続く
+ * - ACK要求時は1パケットごとにACK (パケット番号を返す) を待ち、2000ms で最大3回まで送り直す
+ * - 受信側はパケット番号0から順に受け取り、ペイロード長のバイト数だけ詰めて書き込む
+ */
+#pragma once
+
+#include "LoRabbit.h"
+
+#define SIM_LEGACY_MAX_PAYLOAD 189 /**< 旧版の1パケットのペイロード長 */
+
+/**
+ * @brief 旧版の LoRabbit_SendData()
+ */
+int sim_legacy_send_data(LoraHandle_t *p_handle, uint16_t target_address, uint8_t target_channel,
+                         const uint8_t *p_data, uint32_t size, bool request_ack);
+
+/**
+ * @brief 旧版の LoRabbit_ReceiveData()
+ */
+int sim_legacy_receive_data(LoraHandle_t *p_handle, uint8_t *p_buffer, uint32_t buffer_size,
+                            uint32_t *p_received_size, TMO timeout);
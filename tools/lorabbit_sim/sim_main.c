@@ -0,0 +1,95 @@
+/**
+ * @file sim_main.c
+ * @brief LoRabbit シミュレータのコマンドライン
+ * @details 使い方: lorabbit_sim [--seeds N] [--verbose] <シナリオ名>...
+ * シナリオ名を省略すると一覧を表示します。
+ */
+#include "scenarios.h"
+#include "sim_scenario.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    const char *name;
+    const char *description;
+    void (*run)(void);
+    bool requires_aux_irq; // AUXピンをつないだ端末を使う (lorabbit_sim_aux でのみ実行できる)
+} SimScenario_t;
+
+static const SimScenario_t s_scenarios[] = {
+    {"legacy", "旧版の端末との相互接続 (両方向)", scenario_legacy, false},
+    {"wake", "AUXピンを使わない受信の待ちとタイムアウト", scenario_wake, false},
+    {"length", "AUXピンを使わない受信で、フレームの長さから終わりを判定する受信", scenario_length, false},
+    {"compact", "コンパクトヘッダによるフレームごと・転送全体のエアタイムの削減", scenario_compact, true},
+    {"fragment", "payload_size と損失率によるパケット長の選択とエアタイム", scenario_fragment, true},
+    {"multi", "複数の送信元からの同時受信 (LoRabbit_ReceiveData() と LoRabbit_ReceiveDataMulti())", scenario_multi, true},
+    {"loss", "損失率による再送制御方式ごとの転送の成否と時間", scenario_loss, true},
+    {"fec", "FECの冗長度と損失率によるバースト送信のグッドプット", scenario_fec, true},
+    {"multicast", "複数の受信側への同報送信とバースト送信のエアタイム", scenario_multicast, true},
+    {"service", "送信サービスへの送信要求の投入 (LoRabbit_SubmitSend())", scenario_service, true},
+    {"dispatcher", "受信ディスパッチャによる送受信の同時実行 (LoRabbit_StartRxDispatcher())", scenario_dispatcher, true},
+    {"preempt", "トラフィッククラスによる急ぎの転送の割り込み", scenario_preempt, true},
+    {"reqresp", "要求と応答を交互に送り合う転送とピギーバックACK (LORABBIT_TP_DELAYED_ACK_MS)", scenario_reqresp, true},
+    {"aggregation", "短いメッセージの集約送信のエアタイム (LoRabbit_SendMessage())", scenario_aggregation, true},
+    {"budget", "送信時間の制限 (エアタイム予算) による送信の遅延と拒否 [lorabbit_sim_budget]", scenario_budget, true},
+    {"lbt", "送信前のキャリアセンスによる送信の延期 [lorabbit_sim_lbt]", scenario_lbt, true},
+    {"survey", "チャンネルの調査と、通信相手と示し合わせたチャンネル移動", scenario_survey, true},
+    {"dtc", "DTC転送によるUART受信の割り込みの回数", scenario_dtc, true},
+    {"ring", "UART受信用リングバッファの溢れと失われたバイト数", scenario_ring, true},
+};
+
+#define SIM_SCENARIO_COUNT ((int)(sizeof(s_scenarios) / sizeof(s_scenarios[0])))
+
+static void sim_usage(void) {
+    printf("usage: lorabbit_sim [--seeds N] [--verbose] <scenario>...\n\nscenarios:\n");
+    for (int i = 0; i < SIM_SCENARIO_COUNT; i++) {
+        printf("  %-14s %s%s\n", s_scenarios[i].name, s_scenarios[i].description,
+               s_scenarios[i].requires_aux_irq ? " [lorabbit_sim_aux]" : "");
+    }
+}
+
+int main(int argc, char **argv) {
+    int scenario_count = 0;
+    for (int i = 1; i < argc; i++) {
+        if (0 == strcmp(argv[i], "--seeds") && i + 1 < argc) {
+            g_sim_seeds = atoi(argv[++i]);
+        } else if (0 == strcmp(argv[i], "--verbose")) {
+            sim_set_verbose(true);
+        }
+    }
+    for (int i = 1; i < argc; i++) {
+        if (0 == strcmp(argv[i], "--seeds")) {
+            i++;
+            continue;
+        }
+        if (0 == strcmp(argv[i], "--verbose")) {
+            continue;
+        }
+        int found = -1;
+        for (int j = 0; j < SIM_SCENARIO_COUNT; j++) {
+            if (0 == strcmp(argv[i], s_scenarios[j].name)) {
+                found = j;
+            }
+        }
+        if (found < 0) {
+            fprintf(stderr, "unknown scenario: %s\n", argv[i]);
+            sim_usage();
+            return 1;
+        }
+#ifndef LORABBIT_USE_AUX_IRQ
+        if (s_scenarios[found].requires_aux_irq) {
+            fprintf(stderr, "%s: run with lorabbit_sim_aux\n", argv[i]);
+            return 1;
+        }
+#endif
+        printf("== %s: %s (seeds: %d)\n", s_scenarios[found].name, s_scenarios[found].description, g_sim_seeds);
+        s_scenarios[found].run();
+        scenario_count++;
+    }
+    if (0 == scenario_count) {
+        sim_usage();
+    }
+    return 0;
+}
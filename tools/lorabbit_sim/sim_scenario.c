@@ -0,0 +1,117 @@
+/**
+ * @file sim_scenario.c
+ * @brief シナリオの試行を実行する仕組みの実装
+ */
+#include "sim_scenario.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+int g_sim_seeds = 10;
+
+bool sim_trial(SimTrialFunc_t func, const void *p_params, uint32_t seed, SimTrialResult_t *p_result) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        perror("pipe");
+        exit(1);
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+    if (0 == pid) {
+        close(fds[0]);
+        SimTrialResult_t result;
+        memset(&result, 0, sizeof(result));
+        sim_kernel_init(seed);
+        func(p_params, &result);
+        fflush(stdout);
+        ssize_t written = write(fds[1], &result, sizeof(result));
+        _exit(written == (ssize_t)sizeof(result) ? 0 : 1);
+    }
+    close(fds[1]);
+    ssize_t length = read(fds[0], p_result, sizeof(*p_result));
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return length == (ssize_t)sizeof(*p_result) && WIFEXITED(status) && 0 == WEXITSTATUS(status);
+}
+
+void sim_trial_run(SimTrialResult_t *p_result) {
+    p_result->run_result = sim_run(SIM_TRIAL_LIMIT_US);
+    p_result->airtime_us = sim_total_airtime_us();
+    p_result->tx_frames = sim_total_tx_frames();
+}
+
+void sim_fill_pattern(uint8_t *p_data, uint32_t size, uint32_t seed) {
+    uint32_t x = seed * 2654435761u + 1;
+    for (uint32_t i = 0; i < size; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        p_data[i] = (uint8_t)x;
+    }
+}
+
+bool sim_check_pattern(const uint8_t *p_data, uint32_t size, uint32_t seed) {
+    uint8_t *p_expected = malloc(size);
+    sim_fill_pattern(p_expected, size, seed);
+    bool is_same = (0 == memcmp(p_data, p_expected, size));
+    free(p_expected);
+    return is_same;
+}
+
+int sim_receive_data_until_done(LoraHandle_t *p_handle, uint8_t *p_buffer, uint32_t buffer_size,
+                                uint32_t *p_received_size, uint32_t timeout_ms,
+                                const volatile bool *p_is_sender_done, uint64_t *p_done_us)
+{
+    const uint64_t start_us = sim_now_us();
+    uint8_t *p_scratch = malloc(buffer_size);
+    bool is_received = false;
+    int ret = LORABBIT_ERROR_TIMEOUT;
+    while (!*p_is_sender_done) {
+        if (!is_received && sim_now_us() - start_us >= (uint64_t)timeout_ms * 1000) {
+            break;
+        }
+        // 受信できた後は、再送へのACKを返し直すためだけに受信する
+        uint32_t received_size = 0;
+        int result = LoRabbit_ReceiveData(p_handle, is_received ? p_scratch : p_buffer, buffer_size, &received_size,
+                                          SIM_RECEIVE_POLL_MS);
+        if (!is_received) {
+            ret = result;
+            if (LORABBIT_OK == result) {
+                is_received = true;
+                *p_received_size = received_size;
+                *p_done_us = sim_now_us();
+            }
+        }
+    }
+    free(p_scratch);
+    return ret;
+}
+
+double sim_now_ms(void) {
+    return (double)sim_now_us() / 1000.0;
+}
+
+void sim_summary_add(SimSummary_t *p_summary, const SimTrialResult_t *p_result) {
+    p_summary->trials++;
+    if (!p_result->is_ok) {
+        return;
+    }
+    p_summary->ok_count++;
+    for (int i = 0; i < SIM_TRIAL_VALUE_COUNT; i++) {
+        p_summary->sum[i] += p_result->value[i];
+    }
+    p_summary->elapsed_ms_sum += (double)p_result->elapsed_us / 1000.0;
+    p_summary->airtime_ms_sum += (double)p_result->airtime_us / 1000.0;
+    p_summary->tx_frames_sum += (double)p_result->tx_frames;
+}
+
+double sim_summary_mean(const SimSummary_t *p_summary, double sum) {
+    return (p_summary->ok_count > 0) ? sum / p_summary->ok_count : 0.0;
+}
@@ -0,0 +1,105 @@
+/**
+ * @file sim_scenario.h
+ * @brief シナリオの試行を実行する仕組みと、シナリオに共通の処理
+ * @details 1回の試行 (乱数シードとパラメータの組) は子プロセスで実行します。
+ * ライブラリの静的変数も試行ごとに初期状態から始まるため、試行の順序は結果に影響しません。
+ */
+#pragma once
+
+#include "sim_e220.h"
+#include "sim_kernel.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SIM_TRIAL_VALUE_COUNT 8 /**< 試行が返す値の数 */
+#define SIM_TRIAL_LIMIT_US    (3600ULL * 1000000ULL) /**< 1回の試行の仮想時間の上限 (1時間) */
+#define SIM_TASK_PRIORITY     10 /**< シナリオのタスクの優先度 */
+#define SIM_BOOT_SETTLE_MS    500 /**< 全端末の起動を待ってから送信を始めるまでの時間 */
+#define SIM_RECEIVE_POLL_MS   1000 /**< sim_receive_data_until_done() が送信側の終了を確かめる間隔 */
+
+/**
+ * @brief 1回の試行の結果
+ */
+typedef struct {
+    SimRunResult_t run_result;        /**< sim_run() の結果 */
+    int      ret[4];                  /**< シナリオごとの API の戻り値 */
+    bool     is_ok;                   /**< シナリオごとの成功条件を満たしたか */
+    uint64_t start_us;                /**< シナリオごとの計測の開始時刻 (マイクロ秒) */
+    uint64_t elapsed_us;              /**< シナリオごとの所要時間 (マイクロ秒) */
+    uint64_t airtime_us;              /**< 全端末の送信フレームのエアタイムの合計 (マイクロ秒) */
+    uint32_t tx_frames;               /**< 全端末の送信フレームの数 */
+    double   value[SIM_TRIAL_VALUE_COUNT]; /**< シナリオごとの値 */
+} SimTrialResult_t;
+
+/**
+ * @brief 試行の関数の型 (子プロセスで、sim_kernel_init() の後に呼ばれる)
+ */
+typedef void (*SimTrialFunc_t)(const void *p_params, SimTrialResult_t *p_result);
+
+/**
+ * @brief 試行を子プロセスで実行する
+ * @retval true 試行が終了し、p_result に結果を格納した
+ * @retval false 子プロセスが異常終了した
+ */
+bool sim_trial(SimTrialFunc_t func, const void *p_params, uint32_t seed, SimTrialResult_t *p_result);
+
+/**
+ * @brief シナリオのタスクを全て起動した後に呼び、終了を待って統計を p_result に格納する
+ */
+void sim_trial_run(SimTrialResult_t *p_result);
+
+/**
+ * @brief 試行に使うデータ (シードから決まる擬似乱数列) を作る
+ */
+void sim_fill_pattern(uint8_t *p_data, uint32_t size, uint32_t seed);
+
+/**
+ * @brief sim_fill_pattern() で作ったデータと一致するかを返す
+ */
+bool sim_check_pattern(const uint8_t *p_data, uint32_t size, uint32_t seed);
+
+/**
+ * @brief 送信側が終わるまで LoRabbit_ReceiveData() を繰り返す
+ * @details アプリケーションと同じく、受信できた後も送信側が終わるまで受信を続けます。
+ * 最初に受信できたデータを p_buffer に残し、その時刻を *p_done_us に格納します。
+ * 受信できた後の呼び出しは、最後のACKが欠損した送信側の再送にACKを返し直します。
+ * 受信できないまま timeout_ms が過ぎるか、送信側が終わったら戻ります。
+ * @param[in] p_is_sender_done 送信側のタスクが送信を終えたら true にする変数
+ * @return 最初に成功した受信の戻り値 (受信できなければ最後の戻り値)
+ */
+int sim_receive_data_until_done(LoraHandle_t *p_handle, uint8_t *p_buffer, uint32_t buffer_size,
+                                uint32_t *p_received_size, uint32_t timeout_ms,
+                                const volatile bool *p_is_sender_done, uint64_t *p_done_us);
+
+/**
+ * @brief 現在の仮想時刻 (ミリ秒) を返す
+ */
+double sim_now_ms(void);
+
+/**
+ * @brief 試行の平均と成功数を集計する
+ */
+typedef struct {
+    int    trials;
+    int    ok_count;
+    double sum[SIM_TRIAL_VALUE_COUNT];
+    double elapsed_ms_sum;
+    double airtime_ms_sum;
+    double tx_frames_sum;
+} SimSummary_t;
+
+/**
+ * @brief 試行の結果を集計に加える
+ * @details 値と時間は成功した試行だけを加えます。
+ */
+void sim_summary_add(SimSummary_t *p_summary, const SimTrialResult_t *p_result);
+
+/**
+ * @brief 成功した試行の平均を返す (成功した試行がなければ0)
+ */
+double sim_summary_mean(const SimSummary_t *p_summary, double sum);
+
+/**
+ * @brief 集計する試行の数 (コマンドラインの --seeds で変更できる)
+ */
+extern int g_sim_seeds;